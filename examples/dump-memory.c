@@ -30,13 +30,20 @@
 #include <string.h>
 #include <stdio.h>
 #include <limits.h>
+#include <inttypes.h>
 #include <getopt.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <config.h>
 #include <libvmi/libvmi.h>
 
 #define FRAME_SIZE (1UL << 12)
+#define CHUNK_FRAMES 256
+#define CHUNK_SIZE (FRAME_SIZE * CHUNK_FRAMES) // 1 MiB
+#define QUEUE_DEPTH 8
 #define PROGRESS_STRIDE (1024 * 1024 * 32) // 32 MiB
 
 /* Create sparse file */
@@ -48,12 +55,263 @@ static int progress_flag;
 /* Pause VM when dumping memory */
 static int pause_vm_flag = 1;
 
+/* Seconds between delta images, 0 for a single full dump */
+static unsigned int delta_interval;
+
+/* Number of delta images to write, 0 until interrupted */
+static unsigned int delta_count;
+
 volatile int interrupted;
 void sigint_handler()
 {
     interrupted = 1;
 }
 
+/*
+ * The guest is read into chunks by the main thread while a writer thread
+ * stores the previous ones, so reading and writing overlap. Chunks go
+ * round between a queue of free and a queue of filled buffers.
+ */
+struct chunk {
+    addr_t address;
+    size_t size;
+    char present[CHUNK_FRAMES];     /* frame was read and is not all zeros */
+    char data[CHUNK_SIZE];
+};
+
+struct chunk_queue {
+    struct chunk *slots[QUEUE_DEPTH + 1];
+    unsigned int head;
+    unsigned int count;
+};
+
+struct dumper {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct chunk_queue free;
+    struct chunk_queue full;
+    int fd;
+    int failed;
+};
+
+static const char zeros[FRAME_SIZE];
+
+static void queue_push(struct dumper *d, struct chunk_queue *q, struct chunk *c)
+{
+    pthread_mutex_lock(&d->lock);
+    q->slots[(q->head + q->count) % (QUEUE_DEPTH + 1)] = c;
+    q->count++;
+    pthread_cond_broadcast(&d->cond);
+    pthread_mutex_unlock(&d->lock);
+}
+
+static struct chunk *queue_pop(struct dumper *d, struct chunk_queue *q)
+{
+    struct chunk *c;
+
+    pthread_mutex_lock(&d->lock);
+    while (!q->count)
+        pthread_cond_wait(&d->cond, &d->lock);
+    c = q->slots[q->head];
+    q->head = (q->head + 1) % (QUEUE_DEPTH + 1);
+    q->count--;
+    pthread_mutex_unlock(&d->lock);
+
+    return c;
+}
+
+/* Whether the writer gave up, it is set by the writer thread */
+static int dumper_failed(struct dumper *d)
+{
+    int failed;
+
+    pthread_mutex_lock(&d->lock);
+    failed = d->failed;
+    pthread_mutex_unlock(&d->lock);
+
+    return failed;
+}
+
+static void read_chunk(vmi_instance_t vmi, struct chunk *c)
+{
+    size_t frames = (c->size + FRAME_SIZE - 1) / FRAME_SIZE;
+    size_t i;
+
+    /* read the whole chunk at once, frame by frame only if part of it is missing */
+    if (VMI_SUCCESS == vmi_read_pa(vmi, c->address, c->size, c->data, NULL)) {
+        for (i = 0; i < frames; i++)
+            c->present[i] = 1;
+    } else {
+        for (i = 0; i < frames; i++) {
+            addr_t offset = i * FRAME_SIZE;
+            size_t len = c->size - offset < FRAME_SIZE ? c->size - offset : FRAME_SIZE;
+
+            c->present[i] = VMI_SUCCESS == vmi_read_pa(vmi, c->address + offset, len, c->data + offset, NULL);
+            if (!c->present[i])
+                memset(c->data + offset, 0, len);
+        }
+    }
+
+    for (i = 0; i < frames; i++) {
+        addr_t offset = i * FRAME_SIZE;
+        size_t len = c->size - offset < FRAME_SIZE ? c->size - offset : FRAME_SIZE;
+
+        if (c->present[i] && !memcmp(c->data + offset, zeros, len))
+            c->present[i] = 0;
+    }
+}
+
+static int write_range(int fd, const char *buf, size_t len, off_t offset)
+{
+    while (len) {
+        ssize_t written = pwrite(fd, buf, len, offset);
+
+        if (written < 0)
+            return -1;
+
+        buf += written;
+        len -= written;
+        offset += written;
+    }
+
+    return 0;
+}
+
+static int write_chunk(int fd, const struct chunk *c)
+{
+    size_t frames = (c->size + FRAME_SIZE - 1) / FRAME_SIZE;
+    size_t first, last;
+
+    /* unreadable frames have been zeroed, so the chunk goes out as is */
+    if (!sparse_flag)
+        return write_range(fd, c->data, c->size, c->address);
+
+    /* in sparse mode only runs of frames with data are written */
+    for (first = 0; first < frames; first = last) {
+        if (!c->present[first]) {
+            last = first + 1;
+            continue;
+        }
+
+        for (last = first + 1; last < frames && c->present[last]; last++);
+
+        size_t end = last * FRAME_SIZE < c->size ? last * FRAME_SIZE : c->size;
+        if (write_range(fd, c->data + first * FRAME_SIZE, end - first * FRAME_SIZE,
+                        c->address + first * FRAME_SIZE))
+            return -1;
+    }
+
+    return 0;
+}
+
+/* Writer thread, a NULL chunk ends it */
+static void *writer(void *arg)
+{
+    struct dumper *d = arg;
+    struct chunk *c;
+
+    while ((c = queue_pop(d, &d->full))) {
+        if (!dumper_failed(d) && write_chunk(d->fd, c)) {
+            printf("Failed to save chunk at 0x%"PRIx64".\n", c->address);
+            pthread_mutex_lock(&d->lock);
+            d->failed = 1;
+            pthread_mutex_unlock(&d->lock);
+        }
+        queue_push(d, &d->free, c);
+    }
+
+    return NULL;
+}
+
+/*
+ * Write the pages dirtied since the previous image as a delta image
+ * chained to it. The file driver opens the delta as the merged view.
+ */
+static int write_delta(vmi_instance_t vmi, const char *filename, const char *parent, addr_t addr_max)
+{
+    size_t nr_pages = (addr_max + FRAME_SIZE - 1) / FRAME_SIZE;
+    uint64_t *bitmap = calloc((nr_pages + 63) / 64, sizeof(uint64_t));
+    uint64_t *pfns = NULL;
+    vmi_delta_header_t header = { .version = VMI_DELTA_VERSION, .page_shift = 12, .memory_size = addr_max };
+    const char *parent_name = strrchr(parent, '/');
+    char page[FRAME_SIZE];
+    FILE *f = NULL;
+    size_t i;
+    int paused = 0;
+    int ret = -1;
+
+    if (!bitmap)
+        goto done;
+
+    /* keep the guest still so the delta is consistent */
+    if (pause_vm_flag) {
+        if (VMI_FAILURE == vmi_pause_vm(vmi)) {
+            printf("Failed to pause the VM.\n");
+            goto done;
+        }
+        paused = 1;
+    }
+
+    if (VMI_FAILURE == vmi_get_dirty_pages(vmi, bitmap, nr_pages)) {
+        printf("Failed to get the dirty pages.\n");
+        goto done;
+    }
+
+    /* the previous contents of the dirty pages may still be cached */
+    vmi_pagecache_flush(vmi);
+
+    for (i = 0; i < nr_pages; i++)
+        if (bitmap[i / 64] & (1ull << (i % 64)))
+            header.page_count++;
+
+    pfns = malloc(header.page_count * sizeof(uint64_t) + 1);
+    if (!pfns)
+        goto done;
+
+    header.page_count = 0;
+    for (i = 0; i < nr_pages; i++)
+        if (bitmap[i / 64] & (1ull << (i % 64)))
+            pfns[header.page_count++] = i;
+
+    memcpy(header.magic, VMI_DELTA_MAGIC, sizeof(header.magic));
+    snprintf(header.parent, sizeof(header.parent), "%s", parent_name ? parent_name + 1 : parent);
+
+    f = fopen(filename, "w");
+    if (!f) {
+        printf("Failed to open %s for writing.\n", filename);
+        goto done;
+    }
+
+    if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+            fwrite(pfns, sizeof(uint64_t), header.page_count, f) != header.page_count)
+        goto write_failed;
+
+    for (i = 0; i < header.page_count; i++) {
+        if (VMI_FAILURE == vmi_read_pa(vmi, pfns[i] * FRAME_SIZE, FRAME_SIZE, page, NULL))
+            memset(page, 0, FRAME_SIZE);
+
+        if (fwrite(page, FRAME_SIZE, 1, f) != 1)
+            goto write_failed;
+    }
+
+    if (progress_flag)
+        printf("Wrote %"PRIu64" dirty pages to %s\n", header.page_count, filename);
+
+    ret = 0;
+    goto done;
+
+write_failed:
+    printf("Failed to write %s.\n", filename);
+done:
+    if (paused)
+        vmi_resume_vm(vmi);
+    if (f && fclose(f))
+        ret = -1;
+    free(pfns);
+    free(bitmap);
+    return ret;
+}
+
 static int bareflank_setup(vmi_init_data_t **init_data_ptr, memory_map_t **memmap_ptr)
 {
     printf("Using this example on Bareflank is not safe.\n");
@@ -93,6 +351,9 @@ static void usage(const char *argv0)
     printf("  -p, --progress        print progress when dumping\n");
     printf("  -s, --sparse          save dump as sparse file\n");
     printf("      --no-pause        don't pause the VM when dumping memory\n");
+    printf("  -i, --interval SECS   after the dump, write the pages changed every SECS seconds\n");
+    printf("                        to output_file.1, output_file.2, ... (Xen only)\n");
+    printf("  -n, --deltas COUNT    stop after COUNT delta images instead of on ctrl+c\n");
     printf("  -k, --kvmi-socket     use the specified kvmi socket for KVM driver\n");
     printf("  -h, --help            print help and exit\n");
 }
@@ -102,6 +363,8 @@ static const struct option long_opts[] = {
     {"progress", no_argument, &progress_flag, 1},
     {"no-pause", no_argument, &pause_vm_flag, 0},
     {"kvmi-socket", required_argument, NULL, 'k'},
+    {"interval", required_argument, NULL, 'i'},
+    {"deltas",   required_argument, NULL, 'n'},
     {0, 0, 0, 0}
 };
 
@@ -111,7 +374,7 @@ int main(int argc, char **argv)
     int retcode = 1;
     memory_map_t *memmap = NULL;
     vmi_init_data_t *init_data = NULL;
-    while ((c = getopt_long(argc, argv, "psk:h", long_opts, NULL)) != -1) {
+    while ((c = getopt_long(argc, argv, "psk:i:n:h", long_opts, NULL)) != -1) {
         switch (c) {
             case 0:
                 break;
@@ -121,6 +384,12 @@ int main(int argc, char **argv)
             case 'p':
                 progress_flag = 1;
                 break;
+            case 'i':
+                delta_interval = strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                delta_count = strtoul(optarg, NULL, 0);
+                break;
             case 'k':
                 // in case we have multiple '-k' argument, avoid memory leak
                 if (init_data) {
@@ -169,70 +438,128 @@ int main(int argc, char **argv)
     }
 
     /* open the file for writing */
-    FILE *f = fopen(filename, "w+");
-    if (f == NULL) {
+    struct dumper dumper = { .fd = -1 };
+    pthread_t writer_thread;
+    int writer_started = 0;
+    unsigned int i;
+
+    dumper.fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dumper.fd < 0) {
         printf("Failed to open file for writing.\n");
         goto destroy_vmi;
     }
 
+    pthread_mutex_init(&dumper.lock, NULL);
+    pthread_cond_init(&dumper.cond, NULL);
+    for (i = 0; i < QUEUE_DEPTH; i++) {
+        struct chunk *c = malloc(sizeof(struct chunk));
+        if (!c) {
+            printf("Failed to allocate chunk buffers.\n");
+            goto free_chunks;
+        }
+        queue_push(&dumper, &dumper.free, c);
+    }
+
+    /* log the pages written from the start of the full dump on */
+    if (delta_interval && VMI_FAILURE == vmi_set_dirty_logging(vmi, true)) {
+        printf("Failed to enable dirty logging.\n");
+        goto free_chunks;
+    }
+
+    if (pthread_create(&writer_thread, NULL, writer, &dumper)) {
+        printf("Failed to start the writer thread.\n");
+        goto free_chunks;
+    }
+    writer_started = 1;
+
     /* pause the VM */
     if (pause_vm_flag && VMI_FAILURE == vmi_pause_vm(vmi)) {
         printf("Failed to pause the VM.\n");
-        goto close_file;
+        pause_vm_flag = 0;
+        goto stop_writer;
     }
 
     /* handle ctrl+c gracefully */
     signal(SIGINT, sigint_handler);
 
     /* dump physical memory */
-    char memory[FRAME_SIZE];
-    char zeros[FRAME_SIZE];
-    memset(zeros, 0, FRAME_SIZE);
     addr_t addr_max = vmi_get_max_physical_address(vmi);
     addr_t address;
 
-    for (address = 0; address < addr_max && !interrupted; address += FRAME_SIZE) {
+    for (address = 0; address < addr_max && !interrupted && !dumper_failed(&dumper); address += CHUNK_SIZE) {
         if (progress_flag && (address % PROGRESS_STRIDE == 0)) {
             printf("Progress: %lu%%\n", (address * 100) / addr_max);
         }
 
-        int empty_frame = 1;
-        /* try to read current frame*/
-        if (VMI_SUCCESS == vmi_read_pa(vmi, address, FRAME_SIZE, memory, NULL)) {
-            /* check if frame has some non-zero byte */
-            if (memcmp(memory, zeros, FRAME_SIZE) != 0) {
-                empty_frame = 0;
-            }
-        }
+        struct chunk *c = queue_pop(&dumper, &dumper.free);
+        c->address = address;
+        c->size = addr_max - address < CHUNK_SIZE ? addr_max - address : CHUNK_SIZE;
+        read_chunk(vmi, c);
+        queue_push(&dumper, &dumper.full, c);
+    }
 
-        /* skip empty frame in sparse mode*/
-        if (sparse_flag && empty_frame) {
-            int status = fseek(f, FRAME_SIZE, SEEK_CUR);
-            if (status != 0) {
-                printf("Failed to fseek FRAME_SIZE into file.\n");
-                goto resume_vm;
-            }
-            continue;
-        }
+    /* the memory has been read, the VM can run while the last chunks are written */
+    if (pause_vm_flag) {
+        vmi_resume_vm(vmi);
+        pause_vm_flag = 0;
+    }
 
-        /* write frame to output file */
-        char *buffer = empty_frame ? zeros : memory;
-        size_t written = fwrite(buffer, 1, FRAME_SIZE, f);
-        if (written != FRAME_SIZE) {
-            printf("Failed to saved frame.\n");
-            goto resume_vm;
-        }
+    queue_push(&dumper, &dumper.full, NULL);
+    pthread_join(writer_thread, NULL);
+    writer_started = 0;
+
+    /* trailing holes of a sparse dump still count */
+    if (!dumper_failed(&dumper) && !interrupted && ftruncate(dumper.fd, addr_max)) {
+        printf("Failed to set the size of the output file.\n");
+        goto free_chunks;
     }
 
+    if (dumper_failed(&dumper))
+        goto free_chunks;
+
     retcode = 0;
-resume_vm:
+
+    /* then the pages changed since the previous image */
+    char *previous = strdup(filename);
+    unsigned int epoch;
+
+    for (epoch = 1; delta_interval && previous && !interrupted &&
+            (!delta_count || epoch <= delta_count); epoch++) {
+        char *delta_name = NULL;
+
+        sleep(delta_interval);
+        if (interrupted || asprintf(&delta_name, "%s.%u", filename, epoch) < 0)
+            break;
+
+        if (write_delta(vmi, delta_name, previous, addr_max)) {
+            free(delta_name);
+            retcode = 1;
+            break;
+        }
+
+        free(previous);
+        previous = delta_name;
+    }
+    free(previous);
+
+stop_writer:
+    if (writer_started) {
+        queue_push(&dumper, &dumper.full, NULL);
+        pthread_join(writer_thread, NULL);
+    }
+
+free_chunks:
+    while (dumper.free.count)
+        free(queue_pop(&dumper, &dumper.free));
+    close(dumper.fd);
+
+    if (delta_interval)
+        vmi_set_dirty_logging(vmi, false);
+
     if (pause_vm_flag) {
         vmi_resume_vm(vmi);
     }
 
-close_file:
-    fclose(f);
-
 destroy_vmi:
     vmi_destroy(vmi);
 
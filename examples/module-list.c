@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include <stdio.h>
+#include <inttypes.h>
 
 #include <libvmi/libvmi.h>
 
@@ -38,23 +39,28 @@ main(
     char **argv)
 {
     vmi_instance_t vmi = {0};
-    addr_t next_module = 0;
-    addr_t list_head = 0;
+    module_list_t *modules = NULL;
+    vmi_pid_t pid = 0;
+    size_t i;
     // init_data for KVM socket, if needed
     vmi_init_data_t *init_data = NULL;
     int retcode = 1;
 
     if ( argc < 2 ) {
-        fprintf(stderr, "Usage: %s <Name of VM> [socket]", argv[0]);
+        fprintf(stderr, "Usage: %s <Name of VM> [pid] [socket]\n", argv[0]);
         return retcode;
     }
 
     /* this is the VM or file that we are looking at */
     char *name = argv[1];
 
+    /* pid 0 lists the kernel modules */
+    if (argc >= 3)
+        pid = atoi(argv[2]);
+
     /* KVMi socket ? */
-    if (argc == 3) {
-        char *path = argv[2];
+    if (argc == 4) {
+        char *path = argv[3];
 
         init_data = malloc(sizeof(vmi_init_data_t) + sizeof(vmi_init_data_entry_t));
         init_data->count = 1;
@@ -73,80 +79,18 @@ main(
     /* pause the vm for consistent memory access */
     vmi_pause_vm(vmi);
 
-    switch (vmi_get_ostype(vmi)) {
-        case VMI_OS_LINUX:
-            vmi_read_addr_ksym(vmi, "modules", &next_module);
-            break;
-        case VMI_OS_WINDOWS:
-            vmi_read_addr_ksym(vmi, "PsLoadedModuleList", &next_module);
-            break;
-        default:
-            goto error_exit;
+    if (VMI_FAILURE == vmi_get_modules(vmi, pid, NULL, &modules)) {
+        printf("Failed to get the module list.\n");
+        goto error_exit;
     }
 
-    list_head = next_module;
-
-    /* walk the module list */
-    while (1) {
-
-        /* follow the next pointer */
-        addr_t tmp_next = 0;
-
-        vmi_read_addr_va(vmi, next_module, 0, &tmp_next);
-
-        /* if we are back at the list head, we are done */
-        if (list_head == tmp_next) {
-            break;
-        }
-
-        /* print out the module name */
-
-        /* Note: the module struct that we are looking at has a string
-         * directly following the next / prev pointers.  This is why you
-         * can just add the length of 2 address fields to get the name.
-         * See include/linux/module.h for mode details */
-        if (VMI_OS_LINUX == vmi_get_ostype(vmi)) {
-            char *modname = NULL;
-
-            if (VMI_PM_IA32E == vmi_get_page_mode(vmi, 0)) {   // 64-bit paging
-                modname = vmi_read_str_va(vmi, next_module + 16, 0);
-            } else {
-                modname = vmi_read_str_va(vmi, next_module + 8, 0);
-            }
-            printf("%s\n", modname);
-            free(modname);
-        } else if (VMI_OS_WINDOWS == vmi_get_ostype(vmi)) {
-
-            unicode_string_t *us = NULL;
-
-            /*
-             * The offset 0x58 and 0x2c is the offset in the _LDR_DATA_TABLE_ENTRY structure
-             * to the BaseDllName member.
-             * These offset values are stable (at least) between XP and Windows 7.
-             */
-
-            if (VMI_PM_IA32E == vmi_get_page_mode(vmi, 0)) {
-                us = vmi_read_unicode_str_va(vmi, next_module + 0x58, 0);
-            } else {
-                us = vmi_read_unicode_str_va(vmi, next_module + 0x2c, 0);
-            }
-
-            unicode_string_t out = { 0 };
-            //         both of these work
-            if (us &&
-                    VMI_SUCCESS == vmi_convert_str_encoding(us, &out,
-                            "UTF-8")) {
-                printf("%s\n", out.contents);
-                //            if (us &&
-                //                VMI_SUCCESS == vmi_convert_string_encoding (us, &out, "WCHAR_T")) {
-                //                printf ("%ls\n", out.contents);
-                free(out.contents);
-            }   // if
-            if (us)
-                vmi_free_unicode_str(us);
-        }
-        next_module = tmp_next;
-    }
+    for (i = 0; i < modules->count; i++)
+        printf("0x%.16"PRIx64" 0x%.8"PRIx64" %s\n",
+               modules->modules[i].base,
+               modules->modules[i].size,
+               modules->modules[i].name);
+
+    vmi_free_module_list(modules);
 
     retcode = 0;
 error_exit:
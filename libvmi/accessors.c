@@ -435,6 +435,33 @@ vmi_resume_vm(
     return driver_resume_vm(vmi);
 }
 
+status_t
+vmi_set_dirty_logging(
+    vmi_instance_t vmi,
+    bool enable)
+{
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi)
+        return VMI_FAILURE;
+#endif
+
+    return driver_set_dirty_logging(vmi, enable);
+}
+
+status_t
+vmi_get_dirty_pages(
+    vmi_instance_t vmi,
+    uint64_t *bitmap,
+    size_t nr_pages)
+{
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !bitmap || !nr_pages)
+        return VMI_FAILURE;
+#endif
+
+    return driver_get_dirty_pages(vmi, bitmap, nr_pages);
+}
+
 char *
 vmi_get_name(
     vmi_instance_t vmi)
@@ -699,6 +726,14 @@ void* vmi_read_page (vmi_instance_t vmi, addr_t frame_num)
         return NULL;
 #endif
 
+    if (G_UNLIKELY(vmi->event_trace)) {
+        void *page = driver_read_page(vmi, frame_num);
+
+        if (page)
+            event_trace_page(vmi, frame_num, page);
+        return page;
+    }
+
     return driver_read_page(vmi, frame_num);
 }
 
@@ -946,6 +981,8 @@ vmi_translate_uv2p(
         if ( VMI_FAILURE == pid_cache_del(vmi, pid) )
             return VMI_FAILURE;
 
+        vmi->access_generation++;
+
         ret = vmi_pid_to_dtb(vmi, pid, &dtb);
         if (VMI_SUCCESS == ret) {
             page_info_t info = {0};
@@ -1066,6 +1103,7 @@ vmi_pidcache_add(
     if (!vmi)
         return;
 
+    vmi->access_generation++;
     return pid_cache_set(vmi, pid, dtb);
 }
 
@@ -1076,6 +1114,7 @@ vmi_pidcache_flush(
     if (!vmi)
         return;
 
+    vmi->access_generation++;
     return pid_cache_flush(vmi);
 }
 
@@ -1090,6 +1129,7 @@ vmi_symcache_add(
     if (!vmi)
         return;
 
+    vmi->access_generation++;
     return sym_cache_set(vmi, base_addr, pid, sym, va);
 }
 
@@ -1100,6 +1140,7 @@ vmi_symcache_flush(
     if (!vmi)
         return;
 
+    vmi->access_generation++;
     return sym_cache_flush(vmi);
 }
 
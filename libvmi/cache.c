@@ -667,6 +667,8 @@ v2p_cache_del(
     key_128_t key = &local_key;
     key_128_init(key, npt, pt);
 
+    read_lookaside_flush(vmi);
+
     GHashTable *v = g_hash_table_lookup(vmi->v2p_cache, key);
     if ( !v )
         return VMI_SUCCESS;
@@ -696,5 +698,6 @@ v2p_cache_flush(
         key_128_init(key, npt, pt);
         (void) g_hash_table_remove(vmi->v2p_cache, key);
     }
+    read_lookaside_flush(vmi);
     dbprint(VMI_DEBUG_V2PCACHE, "--V2P cache flushed\n");
 }
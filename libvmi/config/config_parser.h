@@ -35,4 +35,7 @@
 int vmi_parse_config(const char *target_name);
 GHashTable* vmi_get_config();
 
+/* Parse every domain, returns a table of domain name -> config entry */
+GHashTable* vmi_parse_config_all();
+
 #endif /* CONFIG_PARSER_H_ */
@@ -47,6 +47,7 @@ extern int yyparse (void);
 
 GHashTable *entry = NULL;
 GHashTable *tmp_entry = NULL;
+GHashTable *all_entries = NULL;
 char *target_domain = NULL;
 char tmp_str[CONFIG_STR_LENGTH];
 char tmp_domain_name[CONFIG_STR_LENGTH];
@@ -217,7 +218,12 @@ int yywrap()
 
 void entry_done ()
 {
-    if (strncmp(tmp_domain_name, target_domain, CONFIG_STR_LENGTH) == 0){
+    if (all_entries) {
+        if (g_hash_table_lookup_extended(all_entries, tmp_domain_name, NULL, NULL)) {
+            fprintf(stderr, "Duplicate config for %s found, using most recent\n", tmp_domain_name);
+        }
+        g_hash_table_replace(all_entries, g_strdup(tmp_domain_name), tmp_entry);
+    } else if (strncmp(tmp_domain_name, target_domain, CONFIG_STR_LENGTH) == 0){
         if (entry != NULL) {
             fprintf(stderr, "Duplicate config for %s found, using most recent\n", target_domain);
             g_hash_table_destroy(entry);
@@ -237,6 +243,7 @@ GHashTable* vmi_get_config()
 int vmi_parse_config (const char *target_name)
 {
     int ret = 0;
+    entry = NULL;
     target_domain = strdup(target_name);
     tmp_entry = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
     ret = yyparse();
@@ -244,6 +251,26 @@ int vmi_parse_config (const char *target_name)
     return ret;
 }
 
+GHashTable* vmi_parse_config_all ()
+{
+    GHashTable *ret = NULL;
+
+    all_entries = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+                                        (GDestroyNotify)g_hash_table_unref);
+    tmp_entry = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    if (yyparse() == 0) {
+        ret = all_entries;
+    } else {
+        g_hash_table_destroy(all_entries);
+    }
+
+    g_hash_table_destroy(tmp_entry);
+    tmp_entry = NULL;
+    all_entries = NULL;
+    return ret;
+}
+
 %}
 
 %union{
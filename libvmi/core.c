@@ -32,6 +32,7 @@
 #include <limits.h>
 #include <fnmatch.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <pwd.h>
 #include <unistd.h>
 
@@ -66,9 +67,21 @@ read_config_file_entry(vmi_instance_t UNUSED(vmi),
 
 extern FILE *yyin;
 
-static FILE *open_config_file()
+/*
+ * The config file is parsed once per process and kept indexed by domain
+ * name. It is parsed again if the file found is a different one or it
+ * was modified since. The lock also serializes use of the parser.
+ */
+G_LOCK_DEFINE_STATIC(config_cache);
+
+static struct {
+    gchar *path;
+    struct stat st;
+    GHashTable *domains;    /* domain name -> config entry */
+} config_cache;
+
+static gchar *find_config_file()
 {
-    FILE *f = NULL;
     gchar *location;
     char *sudo_user = NULL;
     struct passwd *pw_entry = NULL;
@@ -79,11 +92,10 @@ static FILE *open_config_file()
         location = g_strconcat(cwd, "/libvmi.conf", NULL);
         dbprint(VMI_DEBUG_CORE, "--looking for config file at %s\n", location);
 
-        f = fopen(location, "r");
-        g_free(location);
+        if (!access(location, R_OK))
+            return location;
 
-        if (f)
-            return f;
+        g_free(location);
     }
 
     /* next check home directory of sudo user */
@@ -91,33 +103,73 @@ static FILE *open_config_file()
         location = g_strconcat(pw_entry->pw_dir, "/etc/libvmi.conf", NULL);
         dbprint(VMI_DEBUG_CORE, "--looking for config file at %s\n", location);
 
-        f = fopen(location, "r");
-        g_free(location);
+        if (!access(location, R_OK))
+            return location;
 
-        if (f)
-            return f;
+        g_free(location);
     }
 
     /* next check home directory for current user */
     location = g_strconcat(getenv("HOME"), "/etc/libvmi.conf", NULL);
     dbprint(VMI_DEBUG_CORE, "--looking for config file at %s\n", location);
 
-    f = fopen(location, "r");
-    g_free(location);
+    if (!access(location, R_OK))
+        return location;
 
-    if (f)
-        return f;
+    g_free(location);
 
     /* finally check in /etc */
     dbprint(VMI_DEBUG_CORE, "--looking for config file at /etc/libvmi.conf\n");
-    f = fopen("/etc/libvmi.conf", "r");
 
-    if (f)
-        return f;
+    if (!access("/etc/libvmi.conf", R_OK))
+        return g_strdup("/etc/libvmi.conf");
 
     return NULL;
 }
 
+static bool
+config_cache_valid(const gchar *path, const struct stat *st)
+{
+    return config_cache.domains &&
+           !g_strcmp0(config_cache.path, path) &&
+           config_cache.st.st_dev == st->st_dev &&
+           config_cache.st.st_ino == st->st_ino &&
+           config_cache.st.st_size == st->st_size &&
+           config_cache.st.st_mtim.tv_sec == st->st_mtim.tv_sec &&
+           config_cache.st.st_mtim.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static status_t
+config_cache_reload(const gchar *path, const struct stat *st)
+{
+    GHashTable *domains = NULL;
+    FILE *config_file = fopen(path, "r");
+
+    if (!config_file)
+        return VMI_FAILURE;
+
+    yyin = config_file;
+    domains = vmi_parse_config_all();
+    fclose(config_file);
+
+    if (!domains)
+        return VMI_FAILURE;
+
+    dbprint(VMI_DEBUG_CORE, "--parsed %u config entries from %s\n",
+            g_hash_table_size(domains), path);
+
+    /* entries handed out before hold their own reference */
+    if (config_cache.domains)
+        g_hash_table_destroy(config_cache.domains);
+    g_free(config_cache.path);
+
+    config_cache.path = g_strdup(path);
+    config_cache.st = *st;
+    config_cache.domains = domains;
+
+    return VMI_SUCCESS;
+}
+
 static status_t
 read_config_file(vmi_instance_t vmi, FILE* config_file,
                  GHashTable **config, vmi_init_error_t *error)
@@ -172,7 +224,10 @@ status_t read_config_string(vmi_instance_t vmi,
     gchar *config_str = g_strconcat(vmi->image_type, " ", config, NULL);
 
     config_file = fmemopen(config_str, strlen(config_str)+1, "r");
+
+    G_LOCK(config_cache);
     ret = read_config_file(vmi, config_file, _config, error);
+    G_UNLOCK(config_cache);
 
     g_free(config_str);
 
@@ -182,16 +237,46 @@ status_t read_config_string(vmi_instance_t vmi,
 static status_t
 read_config_file_entry(vmi_instance_t vmi, GHashTable **config, vmi_init_error_t *error)
 {
-    FILE* config_file = open_config_file();
-    if (NULL == config_file) {
+    status_t ret = VMI_FAILURE;
+    GHashTable *entry;
+    struct stat st;
+    gchar *path = find_config_file();
+
+    if (NULL == path || stat(path, &st)) {
         if ( error )
             *error = VMI_INIT_ERROR_NO_CONFIG;
 
         fprintf(stderr, "ERROR: config file not found.\n");
+        g_free(path);
         return VMI_FAILURE;
     }
 
-    return read_config_file(vmi, config_file, config, error);
+    G_LOCK(config_cache);
+
+    if (!config_cache_valid(path, &st) && VMI_FAILURE == config_cache_reload(path, &st)) {
+        if ( error )
+            *error = VMI_INIT_ERROR_NO_CONFIG;
+
+        errprint("Failed to read config file.\n");
+        goto done;
+    }
+
+    entry = g_hash_table_lookup(config_cache.domains, vmi->image_type);
+    if (!entry) {
+        if ( error )
+            *error = VMI_INIT_ERROR_NO_CONFIG_ENTRY;
+
+        errprint("No entry in config file for %s.\n", vmi->image_type);
+        goto done;
+    }
+
+    *config = g_hash_table_ref(entry);
+    ret = VMI_SUCCESS;
+
+done:
+    G_UNLOCK(config_cache);
+    g_free(path);
+    return ret;
 }
 
 #endif
@@ -592,6 +677,8 @@ status_t vmi_init(
     sym_cache_init(_vmi);
     rva_cache_init(_vmi);
     v2p_cache_init(_vmi);
+    module_index_init(_vmi);
+    struct_layout_cache_init(_vmi);
 
     status = VMI_SUCCESS;
 
@@ -693,6 +780,9 @@ GHashTable *init_config(vmi_instance_t vmi, vmi_config_t config_mode, void *conf
         if ( error )
             *error = VMI_INIT_ERROR_NO_CONFIG_ENTRY;
 
+        if ( VMI_CONFIG_GLOBAL_FILE_ENTRY == config_mode )
+            g_hash_table_unref(_config);
+
         dbprint(VMI_DEBUG_CORE, "--failed to determine os type from config\n");
         return NULL;
     }
@@ -710,6 +800,9 @@ os_t vmi_init_profile(
     if (!_config)
         return VMI_OS_UNKNOWN;
 
+    if ( VMI_CONFIG_GLOBAL_FILE_ENTRY == config_mode )
+        g_hash_table_unref(_config);
+
     return vmi->os_type;
 }
 
@@ -786,6 +879,9 @@ os_t vmi_init_os(
     };
 
 error_exit:
+    if ( _config && VMI_CONFIG_GLOBAL_FILE_ENTRY == config_mode )
+        g_hash_table_unref(_config);
+
 #ifdef ENABLE_JSON_PROFILES
     if ( VMI_CONFIG_JSON_PATH == config_mode ) {
         g_hash_table_destroy(_config);
@@ -852,9 +948,14 @@ vmi_destroy(
 
     vmi->shutting_down = TRUE;
 
+    window_destroy_all(vmi);
+    vmi_syscall_trace_stop(vmi->syscall_tracer);
     driver_destroy(vmi);
     events_destroy(vmi);
 
+    if (vmi->event_trace)
+        vmi_events_record_stop(vmi);
+
     if (vmi->os_interface) {
         os_destroy(vmi);
     }
@@ -870,6 +971,8 @@ vmi_destroy(
     sym_cache_destroy(vmi);
     rva_cache_destroy(vmi);
     v2p_cache_destroy(vmi);
+    module_index_destroy(vmi);
+    struct_layout_cache_destroy(vmi);
 
     memory_cache_destroy(vmi);
     if (vmi->image_type)
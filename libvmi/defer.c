@@ -0,0 +1,281 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Deferred events. Each vCPU has two single producer, single consumer
+ * queues: the listen thread queues the events whose callback deferred them
+ * for the analysis thread of the vCPU, which queues its responses back and
+ * wakes the listen thread through a pipe.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "private.h"
+
+/* A paused vCPU has a single event outstanding, a few slots are plenty */
+#define DEFER_QUEUE_SIZE 4
+
+struct defer_entry {
+    vmi_deferred_event_t deferred;
+    event_response_t response;
+};
+
+struct defer_queue {
+    gint head;      /* slots written, only moved by the producer */
+    gint tail;      /* slots read, only moved by the consumer */
+    struct defer_entry slots[DEFER_QUEUE_SIZE];
+};
+
+struct event_defer {
+    int wake[2];
+    unsigned int num_vcpus;
+    struct defer_queue *events;     /* per vCPU, to the analysis threads */
+    struct defer_queue *responses;  /* per vCPU, to the listen thread */
+};
+
+static struct defer_entry *
+queue_reserve(
+    struct defer_queue *queue)
+{
+    guint head = g_atomic_int_get(&queue->head);
+
+    if (head - (guint)g_atomic_int_get(&queue->tail) == DEFER_QUEUE_SIZE)
+        return NULL;
+
+    return &queue->slots[head % DEFER_QUEUE_SIZE];
+}
+
+static void
+queue_commit(
+    struct defer_queue *queue)
+{
+    g_atomic_int_set(&queue->head, g_atomic_int_get(&queue->head) + 1);
+}
+
+static bool
+queue_pop(
+    struct defer_queue *queue,
+    struct defer_entry *entry)
+{
+    guint tail = g_atomic_int_get(&queue->tail);
+
+    if ((guint)g_atomic_int_get(&queue->head) == tail)
+        return false;
+
+    *entry = queue->slots[tail % DEFER_QUEUE_SIZE];
+    g_atomic_int_set(&queue->tail, tail + 1);
+    return true;
+}
+
+/* The copy refers to its own registers */
+static void
+deferred_copy(
+    vmi_deferred_event_t *dst,
+    const vmi_deferred_event_t *src)
+{
+    *dst = *src;
+#if defined(ARM32) || defined(ARM64)
+    dst->event.arm_regs = &dst->regs.arm;
+#else
+    dst->event.x86_regs = &dst->regs.x86;
+#endif
+}
+
+static struct event_defer *
+event_defer_init(
+    vmi_instance_t vmi)
+{
+    struct event_defer *defer = g_try_malloc0(sizeof(struct event_defer));
+
+    if (!defer)
+        return NULL;
+
+    defer->num_vcpus = vmi->num_vcpus;
+    defer->events = g_try_malloc0(vmi->num_vcpus * sizeof(struct defer_queue));
+    defer->responses = g_try_malloc0(vmi->num_vcpus * sizeof(struct defer_queue));
+
+    if (!defer->events || !defer->responses || pipe(defer->wake) < 0) {
+        errprint("%s: failed to set up the deferred event queues\n", __FUNCTION__);
+        g_free(defer->events);
+        g_free(defer->responses);
+        g_free(defer);
+        return NULL;
+    }
+
+    /* a full pipe already wakes the listen thread */
+    fcntl(defer->wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(defer->wake[1], F_SETFL, O_NONBLOCK);
+
+    g_atomic_pointer_set(&vmi->event_defer, defer);
+    return defer;
+}
+
+status_t
+event_defer(
+    vmi_instance_t vmi,
+    const vmi_event_t *event)
+{
+    struct event_defer *defer = vmi->event_defer;
+    struct defer_entry *entry;
+
+    if (!defer && !(defer = event_defer_init(vmi)))
+        return VMI_FAILURE;
+
+    if (event->vcpu_id >= defer->num_vcpus)
+        return VMI_FAILURE;
+
+    entry = queue_reserve(&defer->events[event->vcpu_id]);
+    if (!entry) {
+        errprint("%s: deferred events of vCPU %u are not being taken\n", __FUNCTION__, event->vcpu_id);
+        return VMI_FAILURE;
+    }
+
+    entry->deferred.event = *event;
+#if defined(ARM32) || defined(ARM64)
+    if (event->arm_regs)
+        entry->deferred.regs.arm = *event->arm_regs;
+#else
+    if (event->x86_regs)
+        entry->deferred.regs.x86 = *event->x86_regs;
+#endif
+
+    /* buffers set in earlier callbacks belong to those */
+    entry->deferred.event.emul_read = NULL;
+    entry->deferred.event.emul_insn = NULL;
+
+    queue_commit(&defer->events[event->vcpu_id]);
+    return VMI_SUCCESS;
+}
+
+status_t
+event_defer_response(
+    vmi_instance_t vmi,
+    unsigned int vcpu,
+    vmi_deferred_event_t *deferred,
+    event_response_t *response)
+{
+    struct event_defer *defer = vmi->event_defer;
+    struct defer_entry entry;
+
+    if (!defer || vcpu >= defer->num_vcpus)
+        return VMI_FAILURE;
+
+    if (!queue_pop(&defer->responses[vcpu], &entry))
+        return VMI_FAILURE;
+
+    deferred_copy(deferred, &entry.deferred);
+    *response = entry.response;
+    return VMI_SUCCESS;
+}
+
+int
+event_defer_fd(
+    vmi_instance_t vmi)
+{
+    return vmi->event_defer ? vmi->event_defer->wake[0] : -1;
+}
+
+void
+event_defer_clear_wake(
+    vmi_instance_t vmi)
+{
+    char buf[64];
+
+    if (vmi->event_defer)
+        while (read(vmi->event_defer->wake[0], buf, sizeof(buf)) > 0);
+}
+
+void
+event_defer_destroy(
+    vmi_instance_t vmi)
+{
+    struct event_defer *defer = vmi->event_defer;
+
+    if (!defer)
+        return;
+
+    close(defer->wake[0]);
+    close(defer->wake[1]);
+    g_free(defer->events);
+    g_free(defer->responses);
+    g_free(defer);
+    vmi->event_defer = NULL;
+}
+
+status_t
+vmi_event_pop_deferred(
+    vmi_instance_t vmi,
+    unsigned int vcpu,
+    vmi_deferred_event_t *deferred)
+{
+    struct event_defer *defer;
+    struct defer_entry entry;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !deferred)
+        return VMI_FAILURE;
+#endif
+
+    defer = g_atomic_pointer_get(&vmi->event_defer);
+    if (!defer || vcpu >= defer->num_vcpus)
+        return VMI_FAILURE;
+
+    if (!queue_pop(&defer->events[vcpu], &entry))
+        return VMI_FAILURE;
+
+    deferred_copy(deferred, &entry.deferred);
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_event_respond(
+    vmi_instance_t vmi,
+    vmi_deferred_event_t *deferred,
+    event_response_t response)
+{
+    struct event_defer *defer;
+    struct defer_entry *entry;
+    unsigned int vcpu;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !deferred)
+        return VMI_FAILURE;
+#endif
+
+    defer = g_atomic_pointer_get(&vmi->event_defer);
+    vcpu = deferred->event.vcpu_id;
+    if (!defer || vcpu >= defer->num_vcpus)
+        return VMI_FAILURE;
+
+    entry = queue_reserve(&defer->responses[vcpu]);
+    if (!entry)
+        return VMI_FAILURE;
+
+    entry->deferred = *deferred;
+    entry->response = response & ~VMI_EVENT_RESPONSE_DEFER;
+    queue_commit(&defer->responses[vcpu]);
+
+    if (write(defer->wake[1], "", 1) < 0 && errno != EAGAIN)
+        dbprint(VMI_DEBUG_EVENTS, "--%s: failed to wake the listen thread\n", __FUNCTION__);
+
+    return VMI_SUCCESS;
+}
@@ -144,6 +144,12 @@ typedef struct driver_interface {
         addr_t gpfn,
         vmi_mem_access_t,
         uint16_t vmm_pagetable_id);
+    status_t (*set_mem_access_range_ptr)(
+        vmi_instance_t,
+        addr_t gpfn,
+        uint32_t nr,
+        vmi_mem_access_t,
+        uint16_t vmm_pagetable_id);
     status_t (*start_single_step_ptr)(
         vmi_instance_t,
         single_step_event_t*);
@@ -196,6 +202,17 @@ typedef struct driver_interface {
     status_t (*set_access_required_ptr)(
         vmi_instance_t vmi,
         bool required);
+    status_t (*set_dirty_logging_ptr)(
+        vmi_instance_t vmi,
+        bool enable);
+    status_t (*get_dirty_pages_ptr)(
+        vmi_instance_t vmi,
+        uint64_t *bitmap,
+        size_t nr_pages);
+    status_t (*get_page_hash_ptr)(
+        vmi_instance_t vmi,
+        addr_t pfn,
+        uint64_t *hash);
 
     /* Driver-specific data storage. */
     void* driver_data;
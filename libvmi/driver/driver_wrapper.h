@@ -485,6 +485,25 @@ driver_set_mem_access(
     return vmi->driver.set_mem_access_ptr(vmi, gpfn, page_access_flag, vmm_pagetable_id);
 }
 
+/* Drivers without a call for a range of pages get one call per page */
+static inline status_t
+driver_set_mem_access_range(
+    vmi_instance_t vmi,
+    addr_t gpfn,
+    uint32_t nr,
+    vmi_mem_access_t page_access_flag,
+    uint16_t vmm_pagetable_id)
+{
+    if (vmi->driver.set_mem_access_range_ptr)
+        return vmi->driver.set_mem_access_range_ptr(vmi, gpfn, nr, page_access_flag, vmm_pagetable_id);
+
+    for (; nr; nr--, gpfn++)
+        if (VMI_FAILURE == driver_set_mem_access(vmi, gpfn, page_access_flag, vmm_pagetable_id))
+            return VMI_FAILURE;
+
+    return VMI_SUCCESS;
+}
+
 static inline status_t
 driver_start_single_step(
     vmi_instance_t vmi,
@@ -741,5 +760,52 @@ driver_set_access_listener_required(
     return vmi->driver.set_access_required_ptr (vmi, required);
 }
 
+static inline status_t
+driver_set_dirty_logging(
+    vmi_instance_t vmi,
+    bool enable)
+{
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi->driver.initialized || !vmi->driver.set_dirty_logging_ptr) {
+        dbprint(VMI_DEBUG_DRIVER, "WARNING: driver_set_dirty_logging function not implemented.\n");
+        return VMI_FAILURE;
+    }
+#endif
+
+    return vmi->driver.set_dirty_logging_ptr(vmi, enable);
+}
+
+static inline status_t
+driver_get_dirty_pages(
+    vmi_instance_t vmi,
+    uint64_t *bitmap,
+    size_t nr_pages)
+{
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi->driver.initialized || !vmi->driver.get_dirty_pages_ptr) {
+        dbprint(VMI_DEBUG_DRIVER, "WARNING: driver_get_dirty_pages function not implemented.\n");
+        return VMI_FAILURE;
+    }
+#endif
+
+    return vmi->driver.get_dirty_pages_ptr(vmi, bitmap, nr_pages);
+}
+
+static inline status_t
+driver_get_page_hash(
+    vmi_instance_t vmi,
+    addr_t pfn,
+    uint64_t *hash)
+{
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi->driver.initialized || !vmi->driver.get_page_hash_ptr) {
+        dbprint(VMI_DEBUG_DRIVER, "WARNING: driver_get_page_hash function not implemented.\n");
+        return VMI_FAILURE;
+    }
+#endif
+
+    return vmi->driver.get_page_hash_ptr(vmi, pfn, hash);
+}
+
 #endif /* DRIVER_WRAPPER_H */
 
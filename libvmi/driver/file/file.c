@@ -38,6 +38,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <limits.h>
 
 // Use mmap() if this evaluates to true; otherwise, use a file pointer with
@@ -49,6 +50,270 @@
 #define MAP_POPULATE 0
 #endif
 
+//----------------------------------------------------------------------------
+// Delta images
+
+static int
+compare_pfn(
+    const void *a,
+    const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static status_t
+file_load_delta(
+    file_instance_t *fi,
+    file_delta_t *delta,
+    const vmi_delta_header_t *header)
+{
+    size_t size;
+    uint64_t i;
+
+    if (header->version != VMI_DELTA_VERSION ||
+            header->page_shift < 12 || header->page_shift > 30 ||
+            header->page_count > (header->memory_size >> header->page_shift)) {
+        errprint("Unsupported or corrupted delta image header.\n");
+        return VMI_FAILURE;
+    }
+
+    if (fi->ndeltas == 1) {
+        fi->delta_page_shift = header->page_shift;
+        fi->delta_memsize = header->memory_size;
+    } else if (header->page_shift != fi->delta_page_shift) {
+        errprint("Delta images with different page sizes can't be chained.\n");
+        return VMI_FAILURE;
+    }
+
+    size = header->page_count * sizeof(uint64_t);
+    delta->page_count = header->page_count;
+    delta->data = sizeof(*header) + size;
+    if (!size)
+        return VMI_SUCCESS;
+
+    delta->pfns = g_try_malloc(size);
+    if (!delta->pfns)
+        return VMI_FAILURE;
+
+    if (pread(delta->fd, delta->pfns, size, sizeof(*header)) != (ssize_t)size) {
+        errprint("Failed to read the page index of a delta image.\n");
+        return VMI_FAILURE;
+    }
+
+    /* lookups bisect the index */
+    for (i = 1; i < delta->page_count; i++) {
+        if (delta->pfns[i] <= delta->pfns[i - 1]) {
+            errprint("The page index of a delta image is not sorted.\n");
+            return VMI_FAILURE;
+        }
+    }
+
+    return VMI_SUCCESS;
+}
+
+/*
+ * Follow the chain of delta images starting at the opened file down to
+ * the raw image at its root. A raw image is a chain of no deltas.
+ */
+static status_t
+file_open_deltas(
+    file_instance_t *fi)
+{
+    vmi_delta_header_t header;
+    gchar *path = g_strdup(fi->image ? fi->image : fi->filename);
+    int fd = fi->fd;
+    status_t ret = VMI_FAILURE;
+
+    fi->deltas = g_try_new0(file_delta_t, FILE_DELTA_MAX_DEPTH);
+    if (!fi->deltas)
+        goto done;
+
+    while (1) {
+        file_delta_t *delta;
+        gchar *parent;
+
+        if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+                memcmp(header.magic, VMI_DELTA_MAGIC, sizeof(header.magic))) {
+            fi->base_fd = fd;
+            break;
+        }
+
+        if (fi->ndeltas == FILE_DELTA_MAX_DEPTH) {
+            errprint("Chain of delta images is too long.\n");
+            goto close_fd;
+        }
+
+        delta = &fi->deltas[fi->ndeltas++];
+        delta->fd = fd;
+        if (VMI_FAILURE == file_load_delta(fi, delta, &header))
+            goto done;
+
+        /* the parent is relative to the directory of the delta */
+        header.parent[sizeof(header.parent) - 1] = '\0';
+        if (g_path_is_absolute(header.parent)) {
+            parent = g_strdup(header.parent);
+        } else {
+            gchar *dir = g_path_get_dirname(path);
+            parent = g_build_filename(dir, header.parent, NULL);
+            g_free(dir);
+        }
+        g_free(path);
+        path = parent;
+
+        fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            errprint("Failed to open parent image '%s' for reading.\n", path);
+            goto done;
+        }
+    }
+
+    if (fi->ndeltas)
+        dbprint(VMI_DEBUG_FILE, "--Opened a chain of %u delta images over %s\n", fi->ndeltas, path);
+
+    ret = VMI_SUCCESS;
+    goto done;
+
+close_fd:
+    if (fd != fi->fd)
+        close(fd);
+done:
+    g_free(path);
+    return ret;
+}
+
+static status_t
+file_read_deltas(
+    file_instance_t *fi,
+    addr_t paddr,
+    uint32_t length,
+    uint8_t *buf)
+{
+    uint64_t page_size = 1ull << fi->delta_page_shift;
+
+    while (length) {
+        uint64_t pfn = paddr >> fi->delta_page_shift;
+        uint64_t offset = paddr & (page_size - 1);
+        uint32_t len = MIN(length, page_size - offset);
+        int fd = fi->base_fd;
+        off_t pos = paddr;
+        unsigned int i;
+
+        /* the newest delta holding the page wins */
+        for (i = 0; i < fi->ndeltas; i++) {
+            file_delta_t *delta = &fi->deltas[i];
+            uint64_t *found = bsearch(&pfn, delta->pfns, delta->page_count, sizeof(uint64_t), compare_pfn);
+
+            if (found) {
+                fd = delta->fd;
+                pos = delta->data + ((found - delta->pfns) << fi->delta_page_shift) + offset;
+                break;
+            }
+        }
+
+        if (pread(fd, buf, len, pos) != (ssize_t)len)
+            return VMI_FAILURE;
+
+        paddr += len;
+        buf += len;
+        length -= len;
+    }
+
+    return VMI_SUCCESS;
+}
+
+/* Read from the image, or from the chain of deltas over it */
+static status_t
+file_read(
+    file_instance_t *fi,
+    addr_t paddr,
+    uint32_t length,
+    void *buf)
+{
+    if (fi->trace_pages && VMI_SUCCESS == file_replay_read(fi, paddr, length, buf))
+        return VMI_SUCCESS;
+
+    if (fi->ndeltas)
+        return file_read_deltas(fi, paddr, length, buf);
+
+#if USE_MMAP
+    (void) memcpy(buf, ((uint8_t *) fi->map) + paddr, length);
+#else
+    ssize_t rc = pread(fi->fd, buf, length, paddr);
+    if ( rc < 0 || (size_t)rc != length )
+        return VMI_FAILURE;
+#endif // USE_MMAP
+
+    return VMI_SUCCESS;
+}
+
+//----------------------------------------------------------------------------
+// Page hashes
+
+static void
+file_set_page_hash(
+    file_instance_t *fi,
+    addr_t paddr,
+    uint32_t length,
+    uint64_t hash)
+{
+    uint64_t pfn = paddr >> 12;
+
+    if (!fi->page_hashes || length != VMI_PS_4KB || (paddr & (VMI_PS_4KB - 1)) || pfn >= fi->nr_hashes)
+        return;
+
+    fi->page_hashes[pfn] = hash;
+    fi->hashed[pfn / 64] |= 1ull << (pfn % 64);
+}
+
+status_t
+file_get_page_hash(
+    vmi_instance_t vmi,
+    addr_t pfn,
+    uint64_t *hash)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+    addr_t paddr = pfn << 12;
+    uint8_t *buf;
+
+    if (paddr + VMI_PS_4KB > vmi->max_physical_address)
+        return VMI_FAILURE;
+
+    if (!fi->page_hashes) {
+        fi->nr_hashes = vmi->max_physical_address >> 12;
+        fi->page_hashes = g_try_new(uint64_t, fi->nr_hashes);
+        fi->hashed = g_try_new0(uint64_t, (fi->nr_hashes + 63) / 64);
+        if (!fi->page_hashes || !fi->hashed) {
+            g_free(fi->page_hashes);
+            g_free(fi->hashed);
+            fi->page_hashes = fi->hashed = NULL;
+            return VMI_FAILURE;
+        }
+    }
+
+    if (fi->hashed[pfn / 64] & (1ull << (pfn % 64))) {
+        *hash = fi->page_hashes[pfn];
+        return VMI_SUCCESS;
+    }
+
+    buf = g_try_malloc(VMI_PS_4KB);
+    if (!buf)
+        return VMI_FAILURE;
+
+    if (VMI_FAILURE == file_read(fi, paddr, VMI_PS_4KB, buf)) {
+        g_free(buf);
+        return VMI_FAILURE;
+    }
+
+    *hash = xxh64(buf, VMI_PS_4KB, 0);
+    file_set_page_hash(fi, paddr, VMI_PS_4KB, *hash);
+    g_free(buf);
+
+    return VMI_SUCCESS;
+}
+
 //----------------------------------------------------------------------------
 // File-Specific Interface Functions
 
@@ -58,7 +323,9 @@ file_get_memory(
     addr_t paddr,
     uint32_t length)
 {
+    file_instance_t *fi = file_get_instance(vmi);
     void *memory = 0;
+    uint64_t hash;
 
     if (paddr + length >= vmi->max_physical_address) {
         dbprint
@@ -67,25 +334,18 @@ file_get_memory(
         goto error_noprint;
     }   // if
 
-    memory = g_try_malloc0(length);
+    memory = fi->page_store ? page_store_alloc(length) : g_try_malloc0(length);
 
     if ( !memory )
         return NULL;
 
-#if USE_MMAP
-    (void) memcpy(memory,
-                  ((uint8_t *) file_get_instance(vmi)->map) + paddr,
-                  length);
-#else
-    off_t rc = lseek(file_get_instance(vmi)->fd, paddr, SEEK_SET);
-    if ( rc < 0 || (addr_t)rc != paddr ) {
-        goto error_print;
-    }
-    ssize_t rc2 = read(file_get_instance(vmi)->fd, memory, length);
-    if ( rc2 < 0 || (size_t)rc2 != length ) {
+    if (VMI_FAILURE == file_read(fi, paddr, length, memory))
         goto error_print;
+
+    if (fi->page_store) {
+        memory = page_store_share(memory, &hash);
+        file_set_page_hash(fi, paddr, length, hash);
     }
-#endif // USE_MMAP
 
     return memory;
 
@@ -94,8 +354,12 @@ error_print:
             "PA (offset) 0x%.16"PRIx64" [VM size 0x%.16"PRIx64"]\n", __FUNCTION__,
             length, paddr, vmi->allocated_ram_size);
 error_noprint:
-    if (memory)
-        free(memory);
+    if (memory) {
+        if (fi->page_store)
+            page_store_discard(memory);
+        else
+            free(memory);
+    }
     return NULL;
 }
 
@@ -109,6 +373,15 @@ file_release_memory(
         free(memory);
 }
 
+static void
+file_release_shared_memory(
+    vmi_instance_t UNUSED(vmi),
+    void *memory,
+    size_t UNUSED(length))
+{
+    page_store_release(memory);
+}
+
 //----------------------------------------------------------------------------
 // General Interface Functions (1-1 mapping to driver_* function)
 
@@ -116,9 +389,22 @@ status_t
 file_init(
     vmi_instance_t vmi,
     uint32_t UNUSED(init_flags),
-    vmi_init_data_t *UNUSED(init_data))
+    vmi_init_data_t *init_data)
 {
-    vmi->driver.driver_data = g_try_malloc0(sizeof(file_instance_t));
+    file_instance_t *fi = g_try_malloc0(sizeof(file_instance_t));
+
+    if (!fi)
+        return VMI_FAILURE;
+
+    if ( init_data && init_data->count ) {
+        uint64_t i;
+        for (i=0; i < init_data->count; i++) {
+            if ( init_data->entry[i].type == VMI_INIT_DATA_FILE_PAGE_STORE )
+                fi->page_store = true;
+        }
+    }
+
+    vmi->driver.driver_data = fi;
     return VMI_SUCCESS;
 }
 
@@ -140,7 +426,15 @@ file_init_vmi(
 
     fi->fhandle = fhandle;
     fi->fd = fd;
-    memory_cache_init(vmi, file_get_memory, file_release_memory,
+
+    if (VMI_FAILURE == file_replay_open(vmi, fi))
+        goto fail;
+
+    if (VMI_FAILURE == file_open_deltas(fi))
+        goto fail;
+    /* the cache outlives the driver data, it can't check fi->page_store */
+    memory_cache_init(vmi, file_get_memory,
+                      fi->page_store ? file_release_shared_memory : file_release_memory,
                       ULONG_MAX);
     //    memory_cache_init(vmi, file_get_memory, file_release_memory, 0);
 
@@ -196,6 +490,23 @@ file_destroy(
         fi->map = 0;
     }
 #endif // USE_MMAP
+    if (fi->deltas) {
+        unsigned int i;
+
+        for (i = 0; i < fi->ndeltas; i++) {
+            if (fi->deltas[i].fd != fi->fd)
+                close(fi->deltas[i].fd);
+            g_free(fi->deltas[i].pfns);
+        }
+        if (fi->ndeltas && fi->base_fd > 0 && fi->base_fd != fi->fd)
+            close(fi->base_fd);
+        g_free(fi->deltas);
+        fi->deltas = NULL;
+    }
+    g_free(fi->page_hashes);
+    g_free(fi->hashed);
+    file_replay_close(fi);
+
     // fi->fhandle refers to fi->fd; closing both would be an error
     if (fi->fhandle) {
         fclose(fi->fhandle);
@@ -229,9 +540,22 @@ file_get_memsize(
     addr_t *max_physical_address)
 {
     status_t ret = VMI_FAILURE;
+    file_instance_t *fi = file_get_instance(vmi);
     struct stat s;
 
-    if (fstat(file_get_instance(vmi)->fd, &s) == -1) {
+    if (fi->trace) {
+        *allocated_ram_size = fi->trace_memsize;
+        *max_physical_address = fi->trace_memsize;
+        return VMI_SUCCESS;
+    }
+
+    if (fi->ndeltas) {
+        *allocated_ram_size = fi->delta_memsize;
+        *max_physical_address = fi->delta_memsize;
+        return VMI_SUCCESS;
+    }
+
+    if (fstat(fi->fd, &s) == -1) {
         errprint("Failed to stat file.\n");
         goto error_exit;
     }
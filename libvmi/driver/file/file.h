@@ -67,6 +67,38 @@ status_t file_pause_vm(
     vmi_instance_t vmi);
 status_t file_resume_vm(
     vmi_instance_t vmi);
+status_t file_get_page_hash(
+    vmi_instance_t vmi,
+    addr_t pfn,
+    uint64_t *hash);
+status_t file_events_listen(
+    vmi_instance_t vmi,
+    uint32_t timeout);
+int file_are_events_pending(
+    vmi_instance_t vmi);
+status_t file_set_reg_access(
+    vmi_instance_t vmi,
+    reg_event_t *event);
+status_t file_set_intr_access(
+    vmi_instance_t vmi,
+    interrupt_event_t *event,
+    bool enabled);
+status_t file_set_mem_access(
+    vmi_instance_t vmi,
+    addr_t gpfn,
+    vmi_mem_access_t page_access_flag,
+    uint16_t vmm_pagetable_id);
+status_t file_start_single_step(
+    vmi_instance_t vmi,
+    single_step_event_t *event);
+status_t file_stop_single_step(
+    vmi_instance_t vmi,
+    uint32_t vcpu);
+status_t file_shutdown_single_step(
+    vmi_instance_t vmi);
+status_t file_set_event(
+    vmi_instance_t vmi,
+    bool enabled);
 
 static inline status_t
 driver_file_setup(vmi_instance_t vmi)
@@ -85,6 +117,21 @@ driver_file_setup(vmi_instance_t vmi)
     driver.is_pv_ptr = &file_is_pv;
     driver.pause_vm_ptr = &file_pause_vm;
     driver.resume_vm_ptr = &file_resume_vm;
+    driver.get_page_hash_ptr = &file_get_page_hash;
+    driver.events_listen_ptr = &file_events_listen;
+    driver.are_events_pending_ptr = &file_are_events_pending;
+    driver.set_reg_access_ptr = &file_set_reg_access;
+    driver.set_intr_access_ptr = &file_set_intr_access;
+    driver.set_mem_access_ptr = &file_set_mem_access;
+    driver.start_single_step_ptr = &file_start_single_step;
+    driver.stop_single_step_ptr = &file_stop_single_step;
+    driver.shutdown_single_step_ptr = &file_shutdown_single_step;
+    driver.set_guest_requested_ptr = &file_set_event;
+    driver.set_cpuid_event_ptr = &file_set_event;
+    driver.set_debug_event_ptr = &file_set_event;
+    driver.set_privcall_event_ptr = &file_set_event;
+    driver.set_desc_access_event_ptr = &file_set_event;
+    driver.set_failed_emulation_event_ptr = &file_set_event;
     vmi->driver = driver;
     return VMI_SUCCESS;
 }
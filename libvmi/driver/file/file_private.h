@@ -31,6 +31,17 @@
 #include "private.h"
 #include "driver/file/file.h"
 
+/* Longest chain of delta images we follow */
+#define FILE_DELTA_MAX_DEPTH 256
+
+/* A delta image, see vmi_delta_header_t */
+typedef struct file_delta {
+    int fd;
+    uint64_t page_count;
+    uint64_t *pfns;     /**< sorted page frame numbers of the pages in the delta */
+    off_t data;         /**< file offset of the first page */
+} file_delta_t;
+
 typedef struct file_instance {
 
     FILE *fhandle;       /**< handle to the memory image file */
@@ -40,6 +51,27 @@ typedef struct file_instance {
     char *filename;      /**< name of the file being accessed */
 
     void *map;           /**< memory mapped file */
+
+    /* set when the file is a delta image */
+    file_delta_t *deltas;   /**< the chain of deltas, newest first */
+    unsigned int ndeltas;
+    int base_fd;            /**< raw image at the root of the chain */
+    uint32_t delta_page_shift;
+    uint64_t delta_memsize;
+
+    bool page_store;        /**< cached pages live in the shared page store */
+    uint64_t *page_hashes;  /**< hash of each 4KB page, see vmi_diff_pages */
+    uint64_t *hashed;       /**< bitmap of the valid page_hashes */
+    uint64_t nr_hashes;
+
+    /* set when the file is an event trace, see vmi_events_record */
+    FILE *trace;
+    gchar *image;               /**< image under the trace, if any */
+    GHashTable *trace_pages;    /**< latest recorded content of each page */
+    uint32_t trace_page_shift;
+    uint64_t trace_memsize;
+    registers_t trace_regs;     /**< registers of the event being replayed */
+    uint64_t replayed;
 } file_instance_t;
 
 static inline file_instance_t*
@@ -48,4 +80,27 @@ file_get_instance(vmi_instance_t vmi)
     return ((file_instance_t *) vmi->driver.driver_data);
 }
 
+/* page_store.c */
+void *page_store_alloc(
+    uint32_t length);
+void *page_store_share(
+    void *data,
+    uint64_t *hash);
+void page_store_release(
+    void *data);
+void page_store_discard(
+    void *data);
+
+/* replay.c */
+status_t file_replay_open(
+    vmi_instance_t vmi,
+    file_instance_t *fi);
+void file_replay_close(
+    file_instance_t *fi);
+status_t file_replay_read(
+    file_instance_t *fi,
+    addr_t paddr,
+    uint32_t length,
+    void *buf);
+
 #endif /* FILE_PRIVATE_H */
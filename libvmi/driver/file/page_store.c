@@ -0,0 +1,149 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Process-wide store of the pages cached by file instances. Pages with the
+ * same content are kept once, whichever image or offset they came from.
+ * The pages handed out are read-only and owned by the store.
+ */
+
+#include <string.h>
+#include <stddef.h>
+
+#include "private.h"
+#include "driver/file/file_private.h"
+
+struct stored_page {
+    uint64_t hash;
+    uint32_t length;
+    guint refs;
+    uint8_t data[];
+};
+
+G_LOCK_DEFINE_STATIC(page_store);
+static GHashTable *page_store;
+
+static inline struct stored_page *
+stored_page(
+    void *data)
+{
+    return (struct stored_page *)((uint8_t *)data - offsetof(struct stored_page, data));
+}
+
+static guint
+stored_page_hash(
+    gconstpointer key)
+{
+    return (guint)((const struct stored_page *)key)->hash;
+}
+
+static gboolean
+stored_page_equal(
+    gconstpointer a,
+    gconstpointer b)
+{
+    const struct stored_page *x = a;
+    const struct stored_page *y = b;
+
+    return x->hash == y->hash &&
+           x->length == y->length &&
+           !memcmp(x->data, y->data, x->length);
+}
+
+void *
+page_store_alloc(
+    uint32_t length)
+{
+    struct stored_page *page = g_try_malloc(sizeof(struct stored_page) + length);
+
+    if (!page)
+        return NULL;
+
+    page->length = length;
+    page->refs = 1;
+    return page->data;
+}
+
+void *
+page_store_share(
+    void *data,
+    uint64_t *hash)
+{
+    struct stored_page *page = stored_page(data);
+    struct stored_page *found;
+
+    page->hash = xxh64(page->data, page->length, 0);
+    if (hash)
+        *hash = page->hash;
+
+    G_LOCK(page_store);
+
+    if (!page_store)
+        page_store = g_hash_table_new(stored_page_hash, stored_page_equal);
+
+    found = g_hash_table_lookup(page_store, page);
+    if (found) {
+        found->refs++;
+        G_UNLOCK(page_store);
+        g_free(page);
+        return found->data;
+    }
+
+    g_hash_table_insert(page_store, page, page);
+    G_UNLOCK(page_store);
+
+    return page->data;
+}
+
+void
+page_store_release(
+    void *data)
+{
+    struct stored_page *page;
+
+    if (!data)
+        return;
+
+    page = stored_page(data);
+
+    G_LOCK(page_store);
+
+    if (--page->refs) {
+        G_UNLOCK(page_store);
+        return;
+    }
+
+    g_hash_table_remove(page_store, page);
+    if (!g_hash_table_size(page_store)) {
+        g_hash_table_destroy(page_store);
+        page_store = NULL;
+    }
+
+    G_UNLOCK(page_store);
+    g_free(page);
+}
+
+void
+page_store_discard(
+    void *data)
+{
+    if (data)
+        g_free(stored_page(data));
+}
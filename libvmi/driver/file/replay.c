@@ -0,0 +1,498 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Replay of event traces written by vmi_events_record. Each call to
+ * vmi_events_listen loads the pages recorded with the next event and
+ * issues it to the handler registered for it, the same way the Xen driver
+ * looks handlers up. Pages not in the trace are read from its image.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "private.h"
+#include "driver/file/file_private.h"
+#include "driver/memory_cache.h"
+
+struct replay_page {
+    uint64_t pfn;       /* key */
+    uint8_t data[];
+};
+
+status_t
+file_replay_open(
+    vmi_instance_t vmi,
+    file_instance_t *fi)
+{
+    vmi_trace_header_t *header = g_try_malloc(sizeof(vmi_trace_header_t));
+    status_t ret = VMI_FAILURE;
+
+    if (!header)
+        return VMI_FAILURE;
+
+    if (pread(fi->fd, header, sizeof(*header), 0) != sizeof(*header) ||
+            memcmp(header->magic, VMI_TRACE_MAGIC, sizeof(header->magic))) {
+        /* not a trace */
+        ret = VMI_SUCCESS;
+        goto done;
+    }
+
+    if (header->version != VMI_TRACE_VERSION ||
+            header->events_version != VMI_EVENTS_VERSION ||
+            header->page_shift < 12 || header->page_shift > 30) {
+        errprint("Unsupported or corrupted event trace header.\n");
+        goto done;
+    }
+
+    fi->trace = fi->fhandle;
+    fi->fhandle = NULL;
+    fi->fd = -1;
+    fi->trace_page_shift = header->page_shift;
+    fi->trace_memsize = header->memory_size;
+    fi->trace_pages = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+    vmi->num_vcpus = header->num_vcpus;
+
+    if (fseek(fi->trace, sizeof(*header), SEEK_SET))
+        goto done;
+
+    /* without an image only the recorded pages can be read */
+    header->image[sizeof(header->image) - 1] = '\0';
+    if (header->image[0]) {
+        if (g_path_is_absolute(header->image)) {
+            fi->image = g_strdup(header->image);
+        } else {
+            gchar *dir = g_path_get_dirname(fi->filename);
+            fi->image = g_build_filename(dir, header->image, NULL);
+            g_free(dir);
+        }
+
+        fi->fhandle = fopen(fi->image, "rb");
+        if (!fi->fhandle) {
+            errprint("Failed to open image '%s' for reading.\n", fi->image);
+            goto done;
+        }
+        fi->fd = fileno(fi->fhandle);
+    }
+
+    dbprint(VMI_DEBUG_FILE, "--Replaying the event trace %s\n", fi->filename);
+    ret = VMI_SUCCESS;
+
+done:
+    g_free(header);
+    return ret;
+}
+
+void
+file_replay_close(
+    file_instance_t *fi)
+{
+    if (fi->trace_pages) {
+        g_hash_table_destroy(fi->trace_pages);
+        fi->trace_pages = NULL;
+    }
+    if (fi->trace) {
+        fclose(fi->trace);
+        fi->trace = NULL;
+    }
+    g_free(fi->image);
+    fi->image = NULL;
+}
+
+/* Reads within a recorded page, which is how the page cache reads */
+status_t
+file_replay_read(
+    file_instance_t *fi,
+    addr_t paddr,
+    uint32_t length,
+    void *buf)
+{
+    uint64_t pfn = paddr >> fi->trace_page_shift;
+    uint64_t offset = paddr & ((1ull << fi->trace_page_shift) - 1);
+    struct replay_page *page;
+
+    if (offset + length > (1ull << fi->trace_page_shift))
+        return VMI_FAILURE;
+
+    page = g_hash_table_lookup(fi->trace_pages, &pfn);
+    if (!page)
+        return VMI_FAILURE;
+
+    memcpy(buf, page->data + offset, length);
+    return VMI_SUCCESS;
+}
+
+static status_t
+replay_load_page(
+    file_instance_t *fi,
+    uint32_t size)
+{
+    size_t page_size = 1ull << fi->trace_page_shift;
+    struct replay_page *page;
+
+    if (size != sizeof(uint64_t) + page_size)
+        return VMI_FAILURE;
+
+    page = g_try_malloc(sizeof(struct replay_page) + page_size);
+    if (!page)
+        return VMI_FAILURE;
+
+    if (fread(page, size, 1, fi->trace) != 1) {
+        g_free(page);
+        return VMI_FAILURE;
+    }
+
+    g_hash_table_replace(fi->trace_pages, page, page);
+    return VMI_SUCCESS;
+}
+
+static vmi_event_t *
+replay_lookup(
+    vmi_instance_t vmi,
+    const vmi_trace_event_t *record)
+{
+    switch (record->type) {
+        case VMI_EVENT_MEMORY: {
+            /*
+             * The record holds the registration of the handler it was issued
+             * to, every generic handler an access matched has its own record.
+             * They are looked up among the handlers of the access like the
+             * drivers do.
+             */
+            const mem_access_event_t *mem = (const mem_access_event_t *)record->data;
+            vmi_event_t *event, **events;
+
+            if (mem->generic) {
+                for (events = mem_events_for_access(vmi, mem->out_access); events && *events; events++)
+                    if ((*events)->mem_event.in_access == mem->in_access)
+                        return *events;
+                return NULL;
+            }
+
+            event = mem_event_on_gfn(vmi, mem->gfn);
+            return event && (event->mem_event.in_access & mem->out_access) ? event : NULL;
+        }
+        case VMI_EVENT_REGISTER: {
+            const reg_event_t *reg = (const reg_event_t *)record->data;
+            gint key = reg->reg;
+            vmi_event_t *event = g_hash_table_lookup(vmi->reg_events, &key);
+
+            if (!event && reg->msr) {
+                key = reg->msr;
+                event = g_hash_table_lookup(vmi->msr_events, &key);
+            }
+
+            return event;
+        }
+        case VMI_EVENT_INTERRUPT: {
+            const interrupt_event_t *intr = (const interrupt_event_t *)record->data;
+            gint key = intr->intr;
+
+            return g_hash_table_lookup(vmi->interrupt_events, &key);
+        }
+        case VMI_EVENT_SINGLESTEP: {
+            gint key = record->vcpu_id;
+
+            return g_hash_table_lookup(vmi->ss_events, &key);
+        }
+        case VMI_EVENT_GUEST_REQUEST:
+            return vmi->guest_requested_event;
+        case VMI_EVENT_CPUID:
+            return vmi->cpuid_event;
+        case VMI_EVENT_DEBUG_EXCEPTION:
+            return vmi->debug_event;
+        case VMI_EVENT_PRIVILEGED_CALL:
+            return vmi->privcall_event;
+        case VMI_EVENT_DESCRIPTOR_ACCESS:
+            return vmi->descriptor_access_event;
+        case VMI_EVENT_FAILED_EMULATION:
+            return vmi->failed_emulation_event;
+        default:
+            return NULL;
+    }
+}
+
+/* The record is the request, there are no registers to convert */
+static bool
+replay_filtered(
+    vmi_instance_t vmi,
+    vmi_event_t *event)
+{
+    event_fields_t fields = {
+        .vcpu = event->vcpu_id,
+        .value = event->reg_event.value,
+        .gfn = event->mem_event.gfn,
+        .gla = event->mem_event.gla,
+        .gla_valid = event->mem_event.gla_valid,
+    };
+
+#if !defined(ARM32) && !defined(ARM64)
+    fields.reg = event_filter_x86_regs;
+    fields.regs = event->x86_regs;
+#endif
+
+    return event_filtered(vmi, event, &fields);
+}
+
+static void
+replay_event(
+    vmi_instance_t vmi,
+    file_instance_t *fi,
+    vmi_event_t *event,
+    const vmi_trace_event_t *record,
+    event_response_t recorded)
+{
+    vmi_mem_access_t in_access = event->mem_event.in_access;
+    uint8_t generic = event->mem_event.generic;
+    reg_event_t reg_event = event->reg_event;
+    event_response_t response;
+
+    memcpy(&event->reg_event, record->data, VMI_TRACE_EVENT_DATA_SIZE);
+
+    /* the handler may not be the one the event was recorded with */
+    if (VMI_EVENT_MEMORY == event->type) {
+        event->mem_event.in_access = in_access;
+        event->mem_event.generic = generic;
+    } else if (VMI_EVENT_REGISTER == event->type) {
+        event->reg_event.reg = reg_event.reg;
+        event->reg_event.equal = reg_event.equal;
+        event->reg_event.async = reg_event.async;
+        event->reg_event.onchange = reg_event.onchange;
+        event->reg_event.in_access = reg_event.in_access;
+        event->reg_event.onswitch = reg_event.onswitch;
+    }
+
+    event->vcpu_id = record->vcpu_id;
+    event->slat_id = record->slat_id;
+    event->page_mode = record->page_mode;
+
+    fi->trace_regs = record->regs;
+#if defined(ARM32) || defined(ARM64)
+    event->arm_regs = record->has_regs ? &fi->trace_regs.arm : NULL;
+#else
+    event->x86_regs = record->has_regs ? &fi->trace_regs.x86 : NULL;
+#endif
+
+    if (G_UNLIKELY(vmi->event_filters) && replay_filtered(vmi, event)) {
+        response = event_filter_response(event);
+        goto done;
+    }
+
+    /* writes the handler does not want are answered as the drivers do */
+    if (VMI_EVENT_REGISTER == event->type &&
+            ((event->reg_event.equal && event->reg_event.equal != event->reg_event.value) ||
+             (event->reg_event.onswitch && reg_event_unswitched(vmi, event)))) {
+        response = VMI_EVENT_RESPONSE_NONE;
+        goto done;
+    }
+
+    vmi->event_callback = 1;
+    response = event_dispatch(vmi, event);
+    vmi->event_callback = 0;
+
+    /* deferred events go to the analysis threads as they would live */
+    if ((response & VMI_EVENT_RESPONSE_DEFER) && VMI_FAILURE == event_defer(vmi, event))
+        dbprint(VMI_DEBUG_FILE, "--Event %"PRIu64" could not be deferred\n", fi->replayed);
+
+done:
+    if (response != recorded)
+        dbprint(VMI_DEBUG_FILE, "--Event %"PRIu64" was answered with 0x%x, recorded 0x%x\n",
+                fi->replayed, response, recorded);
+}
+
+/* There is no vCPU to release, the responses are only taken off the queues */
+static void
+replay_deferred_responses(
+    vmi_instance_t vmi)
+{
+    vmi_deferred_event_t deferred;
+    event_response_t response;
+    unsigned int vcpu;
+
+    if (event_defer_fd(vmi) < 0)
+        return;
+
+    event_defer_clear_wake(vmi);
+
+    for (vcpu = 0; vcpu < vmi->num_vcpus; vcpu++)
+        while (VMI_SUCCESS == event_defer_response(vmi, vcpu, &deferred, &response))
+            dbprint(VMI_DEBUG_FILE, "--Deferred event of vCPU %u answered with 0x%x\n", vcpu, response);
+}
+
+status_t
+file_events_listen(
+    vmi_instance_t vmi,
+    uint32_t UNUSED(timeout))
+{
+    file_instance_t *fi = file_get_instance(vmi);
+    vmi_trace_record_t header;
+    vmi_trace_event_t record;
+    event_response_t recorded;
+    vmi_event_t *event;
+    bool loaded = false;
+
+    if (!fi->trace)
+        return VMI_FAILURE;
+
+    replay_deferred_responses(vmi);
+
+    /* the end of the trace is a timeout without events */
+    if (fread(&header, sizeof(header), 1, fi->trace) != 1)
+        return VMI_SUCCESS;
+
+    if (header.type != VMI_TRACE_RECORD_EVENT || header.size != sizeof(record) ||
+            fread(&record, sizeof(record), 1, fi->trace) != 1)
+        goto corrupted;
+
+    while (1) {
+        if (fread(&header, sizeof(header), 1, fi->trace) != 1)
+            goto corrupted;
+
+        if (header.type == VMI_TRACE_RECORD_RESPONSE) {
+            if (header.size != sizeof(recorded) ||
+                    fread(&recorded, sizeof(recorded), 1, fi->trace) != 1)
+                goto corrupted;
+            break;
+        }
+
+        if (header.type != VMI_TRACE_RECORD_PAGE || VMI_FAILURE == replay_load_page(fi, header.size))
+            goto corrupted;
+        loaded = true;
+    }
+
+    if (loaded)
+        memory_cache_flush(vmi);
+
+    fi->replayed++;
+
+    event = replay_lookup(vmi, &record);
+    if (!event) {
+        dbprint(VMI_DEBUG_FILE, "--Event %"PRIu64" of type %u has no handler registered\n",
+                fi->replayed, record.type);
+        return VMI_SUCCESS;
+    }
+
+    replay_event(vmi, fi, event, &record, recorded);
+
+    /* requests issued in the callback, like the Xen driver handles them */
+    if (vmi->swap_events) {
+        GSList *loop = vmi->swap_events;
+
+        while (loop) {
+            swap_wrapper_t *swap_wrapper = loop->data;
+            swap_events(vmi, swap_wrapper->swap_from, swap_wrapper->swap_to,
+                        swap_wrapper->free_routine);
+            g_slice_free(swap_wrapper_t, swap_wrapper);
+            loop = loop->next;
+        }
+
+        g_slist_free(vmi->swap_events);
+        vmi->swap_events = NULL;
+    }
+
+    if (vmi->clear_events && g_hash_table_size(vmi->clear_events))
+        g_hash_table_foreach_remove(vmi->clear_events, clear_events_full, vmi);
+
+    return VMI_SUCCESS;
+
+corrupted:
+    errprint("The event trace is truncated or corrupted.\n");
+    return VMI_FAILURE;
+}
+
+int
+file_are_events_pending(
+    vmi_instance_t vmi)
+{
+    file_instance_t *fi = file_get_instance(vmi);
+    int c;
+
+    if (!fi->trace)
+        return -1;
+
+    c = fgetc(fi->trace);
+    if (EOF == c)
+        return 0;
+
+    ungetc(c, fi->trace);
+    return 1;
+}
+
+/*
+ * Registering an event has nothing to set up, the trace holds whatever was
+ * registered when it was recorded.
+ */
+status_t
+file_set_reg_access(
+    vmi_instance_t vmi,
+    reg_event_t *UNUSED(event))
+{
+    return file_get_instance(vmi)->trace ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+status_t
+file_set_intr_access(
+    vmi_instance_t vmi,
+    interrupt_event_t *UNUSED(event),
+    bool UNUSED(enabled))
+{
+    return file_get_instance(vmi)->trace ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+status_t
+file_set_mem_access(
+    vmi_instance_t vmi,
+    addr_t UNUSED(gpfn),
+    vmi_mem_access_t UNUSED(page_access_flag),
+    uint16_t UNUSED(vmm_pagetable_id))
+{
+    return file_get_instance(vmi)->trace ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+status_t
+file_start_single_step(
+    vmi_instance_t vmi,
+    single_step_event_t *UNUSED(event))
+{
+    return file_get_instance(vmi)->trace ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+status_t
+file_stop_single_step(
+    vmi_instance_t vmi,
+    uint32_t UNUSED(vcpu))
+{
+    return file_get_instance(vmi)->trace ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+status_t
+file_shutdown_single_step(
+    vmi_instance_t vmi)
+{
+    return file_get_instance(vmi)->trace ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+status_t
+file_set_event(
+    vmi_instance_t vmi,
+    bool UNUSED(enabled))
+{
+    return file_get_instance(vmi)->trace ? VMI_SUCCESS : VMI_FAILURE;
+}
@@ -479,6 +479,11 @@ kvm_close_vmi(vmi_instance_t vmi, kvm_instance_t *kvm)
         kvm->pause_events_list = NULL;
     }
 
+    g_free(kvm->dispatch_events);
+    kvm->dispatch_events = NULL;
+    g_free(kvm->event_regs);
+    kvm->event_regs = NULL;
+
     if (kvm->kvmi_dom) {
         kvm->libkvmi.kvmi_domain_close(kvm->kvmi_dom, true);
         kvm->kvmi_dom = NULL;
@@ -574,6 +579,12 @@ kvm_init_vmi(
     if (!kvm->sstep_enabled)
         goto err_exit;
 
+    // init per VCPU event dispatch state
+    kvm->dispatch_events = g_try_new0(struct kvmi_dom_event*, vmi->num_vcpus);
+    kvm->event_regs = g_try_new0(x86_registers_t, vmi->num_vcpus);
+    if (!kvm->dispatch_events || !kvm->event_regs)
+        goto err_exit;
+
     // events ?
     if (init_flags & VMI_INIT_EVENTS) {
         if (VMI_FAILURE == kvm_events_init(vmi, init_flags, init_data))
@@ -690,6 +701,111 @@ status_t kvm_get_tsc_info(
     return VMI_SUCCESS;
 }
 
+/*
+ * Read a register from the state sent along with a KVMi event. Only the
+ * registers carried by the event are handled.
+ */
+static status_t
+event_vcpureg(
+    struct kvmi_dom_event *event,
+    reg_t reg,
+    uint64_t *value)
+{
+    struct kvm_regs *regs = &event->event.common.arch.regs;
+    struct kvm_sregs *sregs = &event->event.common.arch.sregs;
+
+    switch (reg) {
+        case RAX:
+            *value = regs->rax;
+            break;
+        case RBX:
+            *value = regs->rbx;
+            break;
+        case RCX:
+            *value = regs->rcx;
+            break;
+        case RDX:
+            *value = regs->rdx;
+            break;
+        case RBP:
+            *value = regs->rbp;
+            break;
+        case RSI:
+            *value = regs->rsi;
+            break;
+        case RDI:
+            *value = regs->rdi;
+            break;
+        case RSP:
+            *value = regs->rsp;
+            break;
+        case R8:
+            *value = regs->r8;
+            break;
+        case R9:
+            *value = regs->r9;
+            break;
+        case R10:
+            *value = regs->r10;
+            break;
+        case R11:
+            *value = regs->r11;
+            break;
+        case R12:
+            *value = regs->r12;
+            break;
+        case R13:
+            *value = regs->r13;
+            break;
+        case R14:
+            *value = regs->r14;
+            break;
+        case R15:
+            *value = regs->r15;
+            break;
+        case RIP:
+            *value = regs->rip;
+            break;
+        case RFLAGS:
+            *value = regs->rflags;
+            break;
+        case CR0:
+            *value = sregs->cr0;
+            break;
+        case CR2:
+            *value = sregs->cr2;
+            break;
+        case CR3:
+            *value = sregs->cr3;
+            break;
+        case CR4:
+            *value = sregs->cr4;
+            break;
+        case FS_BASE:
+            *value = sregs->fs.base;
+            break;
+        case GS_BASE:
+            *value = sregs->gs.base;
+            break;
+        case GDTR_BASE:
+            *value = sregs->gdt.base;
+            break;
+        case GDTR_LIMIT:
+            *value = sregs->gdt.limit;
+            break;
+        case IDTR_BASE:
+            *value = sregs->idt.base;
+            break;
+        case IDTR_LIMIT:
+            *value = sregs->idt.limit;
+            break;
+        default:
+            return VMI_FAILURE;
+    }
+
+    return VMI_SUCCESS;
+}
+
 status_t
 kvm_get_vcpureg(
     vmi_instance_t vmi,
@@ -702,8 +818,12 @@ kvm_get_vcpureg(
         return VMI_FAILURE;
     }
 
-    // TODO: add some sort of caching to avoir fetching
-    // all registers everytime ?
+    // while an event of this VCPU is dispatched, its registers are
+    // those carried by the event
+    struct kvmi_dom_event *event = kvm_dispatch_event(kvm_get_instance(vmi), vcpu, vmi->num_vcpus);
+    if (event && VMI_SUCCESS == event_vcpureg(event, reg, value))
+        return VMI_SUCCESS;
+
     registers_t regs = {0};
     if (VMI_FAILURE == kvm_get_vcpuregs(vmi, &regs, (unsigned short)vcpu))
         return VMI_FAILURE;
@@ -886,8 +1006,11 @@ kvm_set_vcpureg(vmi_instance_t vmi,
         struct kvm_msr_entry entries[0];
     } msrs = {0};
     msrs.msrs.nmsrs = 0;
+    struct kvmi_dom_event *event = kvm_dispatch_event(kvm, vcpu, vmi->num_vcpus);
 
-    if (kvm->libkvmi.kvmi_get_registers(kvm->kvmi_dom, vcpu, &regs, &sregs, &msrs.msrs, &mode) < 0) {
+    if (event)
+        regs = event->event.common.arch.regs;
+    else if (kvm->libkvmi.kvmi_get_registers(kvm->kvmi_dom, vcpu, &regs, &sregs, &msrs.msrs, &mode) < 0) {
         return VMI_FAILURE;
     }
 
@@ -955,6 +1078,13 @@ kvm_set_vcpureg(vmi_instance_t vmi,
         return VMI_FAILURE;
     }
 
+    if (event) {
+        event->event.common.arch.regs = regs;
+        kvmi_regs_to_libvmi(&event->event.common.arch.regs,
+                            &event->event.common.arch.sregs,
+                            &kvm->event_regs[vcpu]);
+    }
+
     return VMI_SUCCESS;
 }
 
@@ -990,6 +1120,14 @@ kvm_set_vcpuregs(vmi_instance_t vmi,
     if (kvm->libkvmi.kvmi_set_registers(kvm->kvmi_dom, vcpu, &regs) < 0) {
         return VMI_FAILURE;
     }
+
+    struct kvmi_dom_event *event = kvm_dispatch_event(kvm, vcpu, vmi->num_vcpus);
+    if (event) {
+        event->event.common.arch.regs = regs;
+        kvmi_regs_to_libvmi(&event->event.common.arch.regs,
+                            &event->event.common.arch.sregs,
+                            &kvm->event_regs[vcpu]);
+    }
     return VMI_SUCCESS;
 }
 
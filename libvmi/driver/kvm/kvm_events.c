@@ -232,59 +232,270 @@ call_event_callback(
     vmi_event_t *libvmi_event)
 {
     event_response_t response;
+
+    if (kvm_get_instance(vmi)->event_dropped)
+        return VMI_EVENT_RESPONSE_NONE;
+
     vmi->event_callback = 1;
-    response = libvmi_event->callback(vmi, libvmi_event);
+    response = event_dispatch(vmi, libvmi_event);
     vmi->event_callback = 0;
     return response;
 }
 
 /*
- * VM event handlers (process_xxx)
- * called from kvm_events_listen
+ * Registers of the event being dispatched. They are converted once when
+ * the event is taken off the queue and shared by every callback of the
+ * event, like the Xen driver shares the registers of the ring request.
  */
-static status_t
-process_register(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
+static x86_registers_t *
+event_regs(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
 {
-#ifdef ENABLE_SAFETY_CHECKS
-    if (!vmi || !kvmi_event) {
-        errprint("%s: Invalid vmi or kvmi event handles\n", __func__);
-        return VMI_FAILURE;
+    kvm_instance_t *kvm = kvm_get_instance(vmi);
+
+    return &kvm->event_regs[kvmi_event->event.common.vcpu];
+}
+
+/* Registers filters test, read from the event as kvmi delivered it */
+static bool
+kvmi_filter_regs(const void *data, reg_t reg, uint64_t *value)
+{
+    const struct kvmi_dom_event *kvmi_event = data;
+    const struct kvm_regs *regs = &kvmi_event->event.common.arch.regs;
+    const struct kvm_sregs *sregs = &kvmi_event->event.common.arch.sregs;
+
+    switch (reg) {
+        case RAX:
+            *value = regs->rax;
+            break;
+        case RBX:
+            *value = regs->rbx;
+            break;
+        case RCX:
+            *value = regs->rcx;
+            break;
+        case RDX:
+            *value = regs->rdx;
+            break;
+        case RSI:
+            *value = regs->rsi;
+            break;
+        case RDI:
+            *value = regs->rdi;
+            break;
+        case RBP:
+            *value = regs->rbp;
+            break;
+        case RSP:
+            *value = regs->rsp;
+            break;
+        case R8:
+            *value = regs->r8;
+            break;
+        case R9:
+            *value = regs->r9;
+            break;
+        case R10:
+            *value = regs->r10;
+            break;
+        case R11:
+            *value = regs->r11;
+            break;
+        case R12:
+            *value = regs->r12;
+            break;
+        case R13:
+            *value = regs->r13;
+            break;
+        case R14:
+            *value = regs->r14;
+            break;
+        case R15:
+            *value = regs->r15;
+            break;
+        case RIP:
+            *value = regs->rip;
+            break;
+        case RFLAGS:
+            *value = regs->rflags;
+            break;
+        case CR0:
+            *value = sregs->cr0;
+            break;
+        case CR2:
+            *value = sregs->cr2;
+            break;
+        case CR3:
+            *value = sregs->cr3;
+            break;
+        case CR4:
+            *value = sregs->cr4;
+            break;
+        case FS_BASE:
+            *value = sregs->fs.base;
+            break;
+        case GS_BASE:
+            *value = sregs->gs.base;
+            break;
+        default:
+            return false;
     }
-#endif
-    dbprint(VMI_DEBUG_KVM, "--Received CR event\n");
+
+    return true;
+}
+
+static vmi_event_t *
+cr_event_lookup(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
+{
+    gint key;
 
     // associate kvmi reg -> libvmi reg
-    reg_t libvmi_reg;
     switch (kvmi_event->event.cr.cr) {
         case 0:
-            libvmi_reg = CR0;
+            key = CR0;
             break;
         case 3:
-            libvmi_reg = CR3;
+            key = CR3;
             break;
         case 4:
-            libvmi_reg = CR4;
+            key = CR4;
             break;
         default:
             errprint("Unexpected CR value %" PRIu16 "\n", kvmi_event->event.cr.cr);
-            return VMI_FAILURE;
+            return NULL;
+    }
+
+    return g_hash_table_lookup(vmi->reg_events, &key);
+}
+
+static vmi_event_t *
+msr_event_lookup(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
+{
+    vmi_event_t *libvmi_event = NULL;
+    gint key = kvmi_event->event.msr.msr;
+
+    // test for MSR_ANY in msr_events
+    if (g_hash_table_size(vmi->msr_events))
+        libvmi_event = g_hash_table_lookup(vmi->msr_events, &key);
+
+    // test for MSR_xxx in reg_events
+    if (!libvmi_event && g_hash_table_size(vmi->reg_events))
+        libvmi_event = g_hash_table_lookup(vmi->reg_events, &key);
+
+    if (!libvmi_event) {
+        // test for MSR_ALL in reg_events
+        key = MSR_ALL;
+        libvmi_event = g_hash_table_lookup(vmi->reg_events, &key);
+        if (libvmi_event) // fill msr field
+            libvmi_event->reg_event.msr = kvmi_event->event.msr.msr;
     }
 
+    return libvmi_event;
+}
+
+static vmi_mem_access_t
+pf_out_access(struct kvmi_dom_event *kvmi_event)
+{
+    vmi_mem_access_t out_access = VMI_MEMACCESS_INVALID;
+
+    if (kvmi_event->event.page_fault.access & KVMI_PAGE_ACCESS_R) out_access |= VMI_MEMACCESS_R;
+    if (kvmi_event->event.page_fault.access & KVMI_PAGE_ACCESS_W) out_access |= VMI_MEMACCESS_W;
+    if (kvmi_event->event.page_fault.access & KVMI_PAGE_ACCESS_X) out_access |= VMI_MEMACCESS_X;
+
+    return out_access;
+}
+
+static void
+kvmi_filter_fields(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event, event_fields_t *fields)
+{
+    fields->reg = kvmi_filter_regs;
+    fields->regs = kvmi_event;
+    fields->vcpu = kvmi_event->event.common.vcpu;
+
+    switch (kvmi_event->event.common.event) {
+        case KVMI_EVENT_CR:
+            fields->value = kvmi_event->event.cr.new_value;
+            break;
+        case KVMI_EVENT_MSR:
+            fields->value = kvmi_event->event.msr.new_value;
+            break;
+        case KVMI_EVENT_PF:
+            fields->gfn = kvmi_event->event.page_fault.gpa >> vmi->page_shift;
+            fields->gla = kvmi_event->event.page_fault.gva;
+            fields->gla_valid = true;
+            break;
+    }
+}
+
+/*
+ * Test the filters on the event as kvmi delivered it, before its registers
+ * are converted. The handler of a dropped event answers it without
+ * calling back. An access matching several generic memory events is only
+ * dropped if all of them drop it.
+ */
+static bool
+kvm_event_filtered(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
+{
+    event_fields_t fields = {0};
+    vmi_event_t *libvmi_event = NULL, **libvmi_events;
+    gint key = INT3;
+
+    kvmi_filter_fields(vmi, kvmi_event, &fields);
+
+    switch (kvmi_event->event.common.event) {
+        case KVMI_EVENT_CR:
+            libvmi_event = cr_event_lookup(vmi, kvmi_event);
+            break;
+        case KVMI_EVENT_MSR:
+            libvmi_event = msr_event_lookup(vmi, kvmi_event);
+            break;
+        case KVMI_EVENT_BREAKPOINT:
+            libvmi_event = g_hash_table_lookup(vmi->interrupt_events, &key);
+            break;
+        case KVMI_EVENT_PF:
+            libvmi_event = mem_event_on_gfn(vmi, fields.gfn);
+            if (libvmi_event && (libvmi_event->mem_event.in_access & pf_out_access(kvmi_event)))
+                break;
+
+            libvmi_events = mem_events_for_access(vmi, pf_out_access(kvmi_event));
+            if (!libvmi_events || !*libvmi_events)
+                return false;
+
+            for (; *libvmi_events; libvmi_events++)
+                if (!event_filtered(vmi, *libvmi_events, &fields))
+                    return false;
+
+            return true;
+        default:
+            return false;
+    }
+
+    return libvmi_event && event_filtered(vmi, libvmi_event, &fields);
+}
+
+/*
+ * VM event handlers (process_xxx)
+ * called from kvm_events_listen
+ */
+static status_t
+process_register(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
+{
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !kvmi_event) {
+        errprint("%s: Invalid vmi or kvmi event handles\n", __func__);
+        return VMI_FAILURE;
+    }
+#endif
+    dbprint(VMI_DEBUG_KVM, "--Received CR event\n");
+
     // lookup vmi event
-    gint key = (gint)libvmi_reg;
-    vmi_event_t *libvmi_event = g_hash_table_lookup(vmi->reg_events, &key);
+    vmi_event_t *libvmi_event = cr_event_lookup(vmi, kvmi_event);
     if (!libvmi_event) {
         errprint("%s: No control register event handler is registered in LibVMI\n", __func__);
         return VMI_FAILURE;
     }
 
     // fill libvmi_event struct
-    x86_registers_t regs = {0};
-    libvmi_event->x86_regs = &regs;
-
-    struct kvm_regs *kvmi_regs = &kvmi_event->event.common.arch.regs;
-    struct kvm_sregs *kvmi_sregs = &kvmi_event->event.common.arch.sregs;
-    kvmi_regs_to_libvmi(kvmi_regs, kvmi_sregs, libvmi_event->x86_regs);
+    libvmi_event->x86_regs = event_regs(vmi, kvmi_event);
     libvmi_event->vcpu_id = kvmi_event->event.common.vcpu;
 
     // fill specific CR fields
@@ -293,8 +504,10 @@ process_register(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
     libvmi_event->reg_event.value = kvmi_event->event.cr.new_value;
     libvmi_event->reg_event.previous = kvmi_event->event.cr.old_value;
 
-    // call user callback
-    event_response_t response = call_event_callback(vmi, libvmi_event);
+    // call user callback, unless the value is the one last delivered
+    event_response_t response = VMI_EVENT_RESPONSE_NONE;
+    if (!libvmi_event->reg_event.onswitch || !reg_event_unswitched(vmi, libvmi_event))
+        response = call_event_callback(vmi, libvmi_event);
 
     // reply struct
     struct {
@@ -326,26 +539,7 @@ process_msr(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
     dbprint(VMI_DEBUG_KVM, "--Received MSR event on index 0x%"PRIx32"\n", kvmi_event->event.msr.msr);
 
     // lookup vmi event
-    vmi_event_t *libvmi_event = NULL;
-    if (g_hash_table_size(vmi->msr_events)) {
-        // test for MSR_ANY in msr_events
-        gint key = kvmi_event->event.msr.msr;
-        libvmi_event = g_hash_table_lookup(vmi->msr_events, &key);
-    }
-
-    if (!libvmi_event && g_hash_table_size(vmi->reg_events)) {
-        // test for MSR_xxx in reg_events
-        gint key = kvmi_event->event.msr.msr;
-        libvmi_event = g_hash_table_lookup(vmi->reg_events, &key);
-    }
-
-    if (!libvmi_event) {
-        // test for MSR_ALL in reg_events
-        gint key = MSR_ALL;
-        libvmi_event = g_hash_table_lookup(vmi->reg_events, &key);
-        if (libvmi_event) // fill msr field
-            libvmi_event->reg_event.msr = kvmi_event->event.msr.msr;
-    }
+    vmi_event_t *libvmi_event = msr_event_lookup(vmi, kvmi_event);
 
 #ifdef ENABLE_SAFETY_CHECKS
     if (!libvmi_event) {
@@ -355,11 +549,7 @@ process_msr(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
 #endif
 
     // fill libvmi_event struct
-    x86_registers_t regs = {0};
-    libvmi_event->x86_regs = &regs;
-    struct kvm_regs *kvmi_regs = &kvmi_event->event.common.arch.regs;
-    struct kvm_sregs *kvmi_sregs = &kvmi_event->event.common.arch.sregs;
-    kvmi_regs_to_libvmi(kvmi_regs, kvmi_sregs, libvmi_event->x86_regs);
+    libvmi_event->x86_regs = event_regs(vmi, kvmi_event);
     libvmi_event->vcpu_id = kvmi_event->event.common.vcpu;
 
     //      msr_event
@@ -409,11 +599,7 @@ process_interrupt(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
 #endif
 
     // fill libvmi_event struct
-    x86_registers_t regs = {0};
-    libvmi_event->x86_regs = &regs;
-    struct kvm_regs *kvmi_regs = &kvmi_event->event.common.arch.regs;
-    struct kvm_sregs *kvmi_sregs = &kvmi_event->event.common.arch.sregs;
-    kvmi_regs_to_libvmi(kvmi_regs, kvmi_sregs, libvmi_event->x86_regs);
+    libvmi_event->x86_regs = event_regs(vmi, kvmi_event);
     libvmi_event->vcpu_id = kvmi_event->event.common.vcpu;
 
     //      interrupt_event
@@ -460,28 +646,58 @@ process_pagefault(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
     dbprint(VMI_DEBUG_KVM, "--Received pagefault event\n");
 
     // build out_access
-    vmi_mem_access_t out_access = VMI_MEMACCESS_INVALID;
-    if (kvmi_event->event.page_fault.access & KVMI_PAGE_ACCESS_R) out_access |= VMI_MEMACCESS_R;
-    if (kvmi_event->event.page_fault.access & KVMI_PAGE_ACCESS_W) out_access |= VMI_MEMACCESS_W;
-    if (kvmi_event->event.page_fault.access & KVMI_PAGE_ACCESS_X) out_access |= VMI_MEMACCESS_X;
+    vmi_mem_access_t out_access = pf_out_access(kvmi_event);
 
     // reply struct
     struct kvm_event_pf_reply_packet rpl = {0};
 
-    vmi_event_t *libvmi_event;
+    vmi_event_t *libvmi_event, **libvmi_events;
     addr_t gfn = kvmi_event->event.page_fault.gpa >> vmi->page_shift;
     // lookup vmi_event
     //      standard ?
-    if ( g_hash_table_size(vmi->mem_events_on_gfn) ) {
-        libvmi_event = g_hash_table_lookup(vmi->mem_events_on_gfn, &gfn);
-        if (libvmi_event && (libvmi_event->mem_event.in_access & out_access)) {
+    libvmi_event = mem_event_on_gfn(vmi, gfn);
+    if (libvmi_event && (libvmi_event->mem_event.in_access & out_access)) {
+        // fill libvmi_event struct
+        libvmi_event->x86_regs = event_regs(vmi, kvmi_event);
+        libvmi_event->vcpu_id = kvmi_event->event.common.vcpu;
+        //      mem_event
+        libvmi_event->mem_event.gfn = gfn;
+        libvmi_event->mem_event.out_access = out_access;
+        libvmi_event->mem_event.gla = kvmi_event->event.page_fault.gva;
+        libvmi_event->mem_event.offset = kvmi_event->event.page_fault.gpa & VMI_BIT_MASK(0, 11);
+        // TODO
+        // libvmi_event->mem_event.valid
+        // libvmi_event->mem_event.gptw
+
+        // call user callback
+        event_response_t response = call_event_callback(vmi, libvmi_event);
+
+        // handle emulation reply requests
+        if (VMI_FAILURE == process_cb_response_emulate(vmi, response, libvmi_event, &rpl))
+            return VMI_FAILURE;
+
+        // set reply action
+        rpl.hdr.vcpu = kvmi_event->event.common.vcpu;
+        rpl.common.event = kvmi_event->event.common.event;
+        rpl.common.action = KVMI_EVENT_ACTION_CONTINUE;
+
+        return process_cb_response(vmi, response, libvmi_event, kvmi_event, &rpl, sizeof(rpl));
+    }
+    //  generic ?
+    libvmi_events = mem_events_for_access(vmi, out_access);
+    if ( libvmi_events ) {
+        event_fields_t fields = {0};
+
+        kvmi_filter_fields(vmi, kvmi_event, &fields);
+
+        for ( ; (libvmi_event = *libvmi_events); libvmi_events++ ) {
+            // the access got through the filters of another handler
+            if (G_UNLIKELY(vmi->event_filters) && !kvm_get_instance(vmi)->event_dropped &&
+                    event_filtered(vmi, libvmi_event, &fields))
+                continue;
+
             // fill libvmi_event struct
-            x86_registers_t regs = {0};
-            libvmi_event->x86_regs = &regs;
-            struct kvm_regs *kvmi_regs = &kvmi_event->event.common.arch.regs;
-            struct kvm_sregs *kvmi_sregs = &kvmi_event->event.common.arch.sregs;
-            kvmi_regs_to_libvmi(kvmi_regs, kvmi_sregs, libvmi_event->x86_regs);
-            libvmi_event->vcpu_id = kvmi_event->event.common.vcpu;
+            libvmi_event->x86_regs = event_regs(vmi, kvmi_event);
             //      mem_event
             libvmi_event->mem_event.gfn = gfn;
             libvmi_event->mem_event.out_access = out_access;
@@ -503,53 +719,12 @@ process_pagefault(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
             rpl.common.event = kvmi_event->event.common.event;
             rpl.common.action = KVMI_EVENT_ACTION_CONTINUE;
 
-            return process_cb_response(vmi, response, libvmi_event, kvmi_event, &rpl, sizeof(rpl));
-        }
-    }
-    //  generic ?
-    if ( g_hash_table_size(vmi->mem_events_generic) ) {
-        GHashTableIter i;
-        vmi_mem_access_t *key = NULL;
-        bool cb_issued = 0;
-
-        ghashtable_foreach(vmi->mem_events_generic, i, &key, &libvmi_event) {
-            if ( (*key) & out_access ) {
-                // fill libvmi_event struct
-                x86_registers_t regs = {0};
-                libvmi_event->x86_regs = &regs;
-                struct kvm_regs *kvmi_regs = &kvmi_event->event.common.arch.regs;
-                struct kvm_sregs *kvmi_sregs = &kvmi_event->event.common.arch.sregs;
-                kvmi_regs_to_libvmi(kvmi_regs, kvmi_sregs, libvmi_event->x86_regs);
-                //      mem_event
-                libvmi_event->mem_event.gfn = gfn;
-                libvmi_event->mem_event.out_access = out_access;
-                libvmi_event->mem_event.gla = kvmi_event->event.page_fault.gva;
-                libvmi_event->mem_event.offset = kvmi_event->event.page_fault.gpa & VMI_BIT_MASK(0, 11);
-                // TODO
-                // libvmi_event->mem_event.valid
-                // libvmi_event->mem_event.gptw
-
-                // call user callback
-                event_response_t response = call_event_callback(vmi, libvmi_event);
-
-                // handle emulation reply requests
-                if (VMI_FAILURE == process_cb_response_emulate(vmi, response, libvmi_event, &rpl))
-                    return VMI_FAILURE;
-
-                // set reply action
-                rpl.hdr.vcpu = kvmi_event->event.common.vcpu;
-                rpl.common.event = kvmi_event->event.common.event;
-                rpl.common.action = KVMI_EVENT_ACTION_CONTINUE;
-
-                if (VMI_FAILURE ==
-                        process_cb_response(vmi, response, libvmi_event, kvmi_event, &rpl, sizeof(rpl)))
-                    return VMI_FAILURE;
-
-                cb_issued = 1;
-            }
+            if (VMI_FAILURE ==
+                    process_cb_response(vmi, response, libvmi_event, kvmi_event, &rpl, sizeof(rpl)))
+                return VMI_FAILURE;
         }
-        if ( cb_issued )
-            return VMI_SUCCESS;
+
+        return VMI_SUCCESS;
     }
 
     errprint("%s: Caught a memory event that had no handler registered in LibVMI @ GFN 0x%" PRIx64 " (0x%" PRIx64 "), access: %u\n",
@@ -573,11 +748,7 @@ process_descriptor(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
     // assign VCPU id
     libvmi_event->vcpu_id = kvmi_event->event.common.vcpu;
     // assign regs
-    x86_registers_t libvmi_regs = {0};
-    libvmi_event->x86_regs = &libvmi_regs;
-    struct kvm_regs *regs = &kvmi_event->event.common.arch.regs;
-    struct kvm_sregs *sregs = &kvmi_event->event.common.arch.sregs;
-    kvmi_regs_to_libvmi(regs, sregs, libvmi_event->x86_regs);
+    libvmi_event->x86_regs = event_regs(vmi, kvmi_event);
     // event specific fields
     switch (kvmi_event->event.desc.descriptor) {
         case KVMI_DESC_IDTR:
@@ -657,11 +828,7 @@ process_singlestep(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
         // assign VCPU id
         libvmi_event->vcpu_id = kvmi_event->event.common.vcpu;
         // assign regs
-        x86_registers_t libvmi_regs = {0};
-        libvmi_event->x86_regs = &libvmi_regs;
-        struct kvm_regs *regs = &kvmi_event->event.common.arch.regs;
-        struct kvm_sregs *sregs = &kvmi_event->event.common.arch.sregs;
-        kvmi_regs_to_libvmi(regs, sregs, libvmi_event->x86_regs);
+        libvmi_event->x86_regs = event_regs(vmi, kvmi_event);
 
         // TODO ss_event
         // gfn
@@ -707,11 +874,7 @@ process_cpuid(vmi_instance_t vmi, struct kvmi_dom_event *kvmi_event)
 #endif
 
     // fill libvmi_event struct
-    x86_registers_t regs = {0};
-    libvmi_event->x86_regs = &regs;
-    struct kvm_regs *kvmi_regs = &kvmi_event->event.common.arch.regs;
-    struct kvm_sregs *kvmi_sregs = &kvmi_event->event.common.arch.sregs;
-    kvmi_regs_to_libvmi(kvmi_regs, kvmi_sregs, libvmi_event->x86_regs);
+    libvmi_event->x86_regs = event_regs(vmi, kvmi_event);
 
     libvmi_event->vcpu_id = kvmi_event->event.common.vcpu;
     libvmi_event->cpuid_event.leaf = kvmi_event->event.cpuid.function;
@@ -911,6 +1074,9 @@ kvm_events_listen(
     unsigned int ev_reason = 0;
     // if timeout is 0, we have to process all leftover events on the ring
     bool process_all_events = (timeout == 0) ? true : false;
+    // unless a budget caps them, leaving the rest for the next call
+    uint32_t budget = vmi->shutting_down ? 0 : vmi->events_budget;
+    uint32_t handled = 0;
 
     kvm_instance_t *kvm = kvm_get_instance(vmi);
 #ifdef ENABLE_SAFETY_CHECKS
@@ -955,13 +1121,33 @@ kvm_events_listen(
         }
 #endif
         if (!vmi->shutting_down) {
+            uint16_t vcpu = event->event.common.vcpu;
+            status_t status;
+
+            assert(vcpu < vmi->num_vcpus);
+            kvm->dispatch_events[vcpu] = event;
+
+            // events the filters drop are answered without converting their registers
+            kvm->event_dropped = G_UNLIKELY(vmi->event_filters) && kvm_event_filtered(vmi, event);
+            if (!kvm->event_dropped)
+                kvmi_regs_to_libvmi(&event->event.common.arch.regs,
+                                    &event->event.common.arch.sregs,
+                                    &kvm->event_regs[vcpu]);
+
             // call handler
-            if (VMI_FAILURE == kvm->process_event[ev_reason](vmi, event))
+            status = kvm->process_event[ev_reason](vmi, event);
+            kvm->dispatch_events[vcpu] = NULL;
+            kvm->event_dropped = false;
+
+            if (VMI_FAILURE == status)
                 goto error_exit;
         }
         // free event
         if (event)
             free(event);
+
+        if (budget && ++handled >= budget)
+            break;
     } while (process_all_events);
 
     return VMI_SUCCESS;
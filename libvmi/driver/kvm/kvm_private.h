@@ -71,6 +71,16 @@ typedef struct kvm_instance {
     // array of [VCPU] -> [boolean]
     // whether singlstep is enabled on a given VCPU
     bool *sstep_enabled;
+    // array of [VCPU] -> event being dispatched, NULL outside of dispatch.
+    // lets the register accessors answer from the event instead of
+    // asking KVM again
+    struct kvmi_dom_event **dispatch_events;
+    // array of [VCPU] -> registers of the event being dispatched,
+    // converted once per event and kept in sync by the setters
+    x86_registers_t *event_regs;
+    // whether the filters dropped the event being dispatched, its
+    // registers are not converted and no callback is called
+    bool event_dropped;
 #endif
 } kvm_instance_t;
 
@@ -96,6 +106,18 @@ kvmi_regs_to_libvmi(
     struct kvm_regs *kvmi_regs,
     struct kvm_sregs *kvmi_sregs,
     x86_registers_t *libvmi_regs);
+
+static inline struct kvmi_dom_event *
+kvm_dispatch_event(
+    kvm_instance_t *kvm,
+    unsigned long vcpu,
+    unsigned int num_vcpus)
+{
+    if (!kvm->dispatch_events || vcpu >= num_vcpus)
+        return NULL;
+
+    return kvm->dispatch_events[vcpu];
+}
 # endif
 
 #endif
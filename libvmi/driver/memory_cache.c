@@ -61,6 +61,7 @@ memory_cache_entry_free(
     memory_cache_entry_t entry = (memory_cache_entry_t) data;
 
     if (entry) {
+        read_lookaside_flush(entry->vmi);
         entry->vmi->release_data_callback(entry->vmi, entry->data, entry->length);
         g_slice_free(struct memory_cache_entry, entry);
     }
@@ -91,6 +92,7 @@ validate_and_return_data(
     if (vmi->memory_cache_age &&
             (now - entry->last_updated > vmi->memory_cache_age)) {
         dbprint(VMI_DEBUG_MEMCACHE, "--MEMORY cache refresh 0x%"PRIx64"\n", entry->paddr);
+        read_lookaside_flush(vmi);
         vmi->release_data_callback(vmi, entry->data, entry->length);
         entry->data = get_memory_data(vmi, entry->paddr, entry->length);
         entry->last_updated = now;
@@ -240,6 +242,23 @@ void memory_cache_remove(
     g_hash_table_remove(vmi->memory_cache, key);
 }
 
+time_t
+memory_cache_expires(
+    vmi_instance_t vmi,
+    addr_t paddr)
+{
+    memory_cache_entry_t entry;
+
+    if (!vmi->memory_cache_age)
+        return 0;
+
+    entry = g_hash_table_lookup(vmi->memory_cache, &paddr);
+    if (!entry)
+        return 0;
+
+    return entry->last_updated + vmi->memory_cache_age;
+}
+
 void free_lru_entry(void *p1, void *UNUSED(p2))
 {
     free_gint64(p1);
@@ -307,6 +326,7 @@ memory_cache_insert(
         return vmi->last_used_page;
     } else {
         if (vmi->last_used_page) {
+            read_lookaside_flush(vmi);
             vmi->release_data_callback(vmi, vmi->last_used_page, vmi->page_size);
         }
         vmi->last_used_page = get_memory_data(vmi, paddr, vmi->page_size);
@@ -320,15 +340,26 @@ void memory_cache_remove(
     addr_t paddr)
 {
     if (paddr == vmi->last_used_page_key && vmi->last_used_page) {
+        read_lookaside_flush(vmi);
         vmi->release_data_callback(vmi, vmi->last_used_page, vmi->page_size);
+        vmi->last_used_page = NULL;
     }
 }
 
+time_t
+memory_cache_expires(
+    vmi_instance_t UNUSED(vmi),
+    addr_t UNUSED(paddr))
+{
+    return 0;
+}
+
 void
 memory_cache_destroy(
     vmi_instance_t vmi)
 {
     if (vmi->last_used_page) {
+        read_lookaside_flush(vmi);
         vmi->release_data_callback(vmi, vmi->last_used_page, vmi->page_size);
     }
     vmi->last_used_page_key = 0;
@@ -341,8 +372,10 @@ void
 memory_cache_flush(
     vmi_instance_t vmi)
 {
-    if (vmi->last_used_page)
+    if (vmi->last_used_page) {
+        read_lookaside_flush(vmi);
         vmi->release_data_callback(vmi, vmi->last_used_page, vmi->page_size);
+    }
 
     vmi->last_used_page_key = 0;
     vmi->last_used_page = NULL;
@@ -47,6 +47,11 @@ void memory_cache_remove(
     vmi_instance_t vmi,
     addr_t paddr);
 
+/* Time after which the cached page has to be fetched again, 0 if never */
+time_t memory_cache_expires(
+    vmi_instance_t vmi,
+    addr_t paddr);
+
 void memory_cache_destroy(
     vmi_instance_t vmi);
 
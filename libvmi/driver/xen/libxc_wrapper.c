@@ -224,6 +224,12 @@ status_t create_libxc_wrapper(xen_instance_t *xen)
     wrapper->xc_get_hvm_param = dlsym(wrapper->handle, "xc_get_hvm_param");
     wrapper->xc_set_hvm_param = dlsym(wrapper->handle, "xc_set_hvm_param");
 
+    /* Dirty logging */
+    wrapper->xc__hypercall_buffer_alloc_pages = dlsym(wrapper->handle, "xc__hypercall_buffer_alloc_pages");
+    wrapper->xc__hypercall_buffer_free_pages = dlsym(wrapper->handle, "xc__hypercall_buffer_free_pages");
+    wrapper->xc_shadow_control = dlsym(wrapper->handle, "xc_shadow_control");
+    wrapper->xc_logdirty_control = dlsym(wrapper->handle, "xc_logdirty_control");
+
     if (VMI_FAILURE == sanity_check(xen)) {
         // close libxenctrl handle
         if (dlclose(wrapper->handle))
@@ -260,6 +260,23 @@ typedef struct {
     int (*xc_vm_event_get_version)
     (xc_interface *xch);
 
+    /* Dirty logging, optional */
+    void* (*xc__hypercall_buffer_alloc_pages)
+    (xc_interface *xch, xc_hypercall_buffer_t *b, int nr_pages);
+
+    void (*xc__hypercall_buffer_free_pages)
+    (xc_interface *xch, xc_hypercall_buffer_t *b, int nr_pages);
+
+    /* Xen 4.1 - Xen 4.15 */
+    int (*xc_shadow_control)
+    (xc_interface *xch, uint32_t domid, unsigned int sop, xc_hypercall_buffer_t *dirty_bitmap,
+     unsigned long pages, unsigned long *mb, uint32_t mode, xc_shadow_op_stats_t *stats);
+
+    /* Xen 4.16+ */
+    int (*xc_logdirty_control)
+    (xc_interface *xch, uint32_t domid, unsigned int sop, xc_hypercall_buffer_t *dirty_bitmap,
+     unsigned long pages, unsigned int mode, xc_shadow_op_stats_t *stats);
+
 } libxc_wrapper_t;
 
 status_t create_libxc_wrapper(struct xen_instance *xen);
@@ -2756,3 +2756,79 @@ xen_set_access_required(
 
     return VMI_SUCCESS;
 }
+
+/*
+ * Log-dirty operations. xc_shadow_control() lost its bitmap arguments to
+ * xc_logdirty_control() in Xen 4.16.
+ */
+static int
+xen_logdirty_op(
+    xen_instance_t *xen,
+    unsigned int sop,
+    xc_hypercall_buffer_t *bitmap,
+    unsigned long pages)
+{
+    libxc_wrapper_t *w = &xen->libxcw;
+
+    if ( xen->major_version > 4 || xen->minor_version >= 16 ) {
+        if ( !w->xc_logdirty_control )
+            return -1;
+
+        return w->xc_logdirty_control(xen->xchandle, xen->domainid, sop, bitmap, pages, 0, NULL);
+    }
+
+    if ( !w->xc_shadow_control )
+        return -1;
+
+    return w->xc_shadow_control(xen->xchandle, xen->domainid, sop, bitmap, pages, NULL, 0, NULL);
+}
+
+status_t
+xen_set_dirty_logging(
+    vmi_instance_t vmi,
+    bool enable)
+{
+    xen_instance_t *xen = xen_get_instance(vmi);
+    unsigned int sop = enable ? XEN_DOMCTL_SHADOW_OP_ENABLE_LOGDIRTY : XEN_DOMCTL_SHADOW_OP_OFF;
+
+    if ( xen_logdirty_op(xen, sop, NULL, 0) < 0 ) {
+        errprint("Failed to %s dirty logging: %s\n", enable ? "enable" : "disable", strerror(errno));
+        return VMI_FAILURE;
+    }
+
+    return VMI_SUCCESS;
+}
+
+status_t
+xen_get_dirty_pages(
+    vmi_instance_t vmi,
+    uint64_t *bitmap,
+    size_t nr_pages)
+{
+    xen_instance_t *xen = xen_get_instance(vmi);
+    libxc_wrapper_t *w = &xen->libxcw;
+    size_t size = ((nr_pages + 63) / 64) * sizeof(uint64_t);
+    int buffer_pages = (size + XC_PAGE_SIZE - 1) >> XC_PAGE_SHIFT;
+    status_t ret = VMI_FAILURE;
+    DECLARE_HYPERCALL_BUFFER(uint8_t, dirty);
+
+    if ( !w->xc__hypercall_buffer_alloc_pages || !w->xc__hypercall_buffer_free_pages )
+        return VMI_FAILURE;
+
+    /* the bitmap has to live in hypercall safe memory */
+    dirty = w->xc__hypercall_buffer_alloc_pages(xen->xchandle, HYPERCALL_BUFFER(dirty), buffer_pages);
+    if ( !dirty )
+        return VMI_FAILURE;
+
+    if ( xen_logdirty_op(xen, XEN_DOMCTL_SHADOW_OP_CLEAN, HYPERCALL_BUFFER(dirty), nr_pages) < 0 ) {
+        errprint("Failed to retrieve the dirty pages: %s\n", strerror(errno));
+        goto done;
+    }
+
+    memcpy(bitmap, dirty, size);
+    ret = VMI_SUCCESS;
+
+done:
+    w->xc__hypercall_buffer_free_pages(xen->xchandle, HYPERCALL_BUFFER(dirty), buffer_pages);
+    return ret;
+}
@@ -174,6 +174,13 @@ status_t xen_set_domain_debug_control(
 status_t xen_set_access_required(
     vmi_instance_t vmi,
     bool required);
+status_t xen_set_dirty_logging(
+    vmi_instance_t vmi,
+    bool enable);
+status_t xen_get_dirty_pages(
+    vmi_instance_t vmi,
+    uint64_t *bitmap,
+    size_t nr_pages);
 
 static inline status_t
 driver_xen_setup(vmi_instance_t vmi)
@@ -208,6 +215,8 @@ driver_xen_setup(vmi_instance_t vmi)
     driver.pause_vm_ptr = &xen_pause_vm;
     driver.resume_vm_ptr = &xen_resume_vm;
     driver.set_access_required_ptr = &xen_set_access_required;
+    driver.set_dirty_logging_ptr = &xen_set_dirty_logging;
+    driver.get_dirty_pages_ptr = &xen_get_dirty_pages;
     vmi->driver = driver;
     return VMI_SUCCESS;
 }
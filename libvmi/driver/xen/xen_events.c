@@ -69,6 +69,47 @@ status_t xen_set_mem_access(vmi_instance_t vmi, addr_t gpfn,
     return VMI_SUCCESS;
 }
 
+status_t xen_set_mem_access_range(vmi_instance_t vmi, addr_t gpfn, uint32_t nr,
+                                  vmi_mem_access_t page_access_flag, uint16_t altp2m_idx)
+{
+    int rc;
+    xenmem_access_t access;
+    xen_instance_t *xen = xen_get_instance(vmi);
+    xc_interface * xch = xen_get_xchandle(vmi);
+    domid_t dom = xen_get_domainid(vmi);
+
+    /* altp2m views are set a page at a time */
+    if ( altp2m_idx ) {
+        for ( ; nr; nr--, gpfn++ )
+            if ( VMI_FAILURE == xen_set_mem_access(vmi, gpfn, page_access_flag, altp2m_idx) )
+                return VMI_FAILURE;
+
+        return VMI_SUCCESS;
+    }
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if ( !xch ) {
+        errprint("%s error: invalid xc_interface handle\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+    if ( dom == (domid_t)VMI_INVALID_DOMID ) {
+        errprint("%s error: invalid domid\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+#endif
+
+    if ( VMI_FAILURE == convert_vmi_flags_to_xenmem(page_access_flag, &access) )
+        return VMI_FAILURE;
+
+    rc = xen->libxcw.xc_set_mem_access(xch, dom, access, gpfn, nr);
+    if (rc) {
+        errprint("xc_hvm_set_mem_access failed with code: %d\n", rc);
+        return VMI_FAILURE;
+    }
+    dbprint(VMI_DEBUG_XEN, "--Done Setting memaccess on %"PRIu32" GPFNs from %"PRIu64"\n", nr, gpfn);
+    return VMI_SUCCESS;
+}
+
 status_t xen_set_reg_access(vmi_instance_t vmi, reg_event_t *event)
 {
     bool enable;
@@ -606,17 +647,73 @@ status_t xen_set_domain_watch_event(vmi_instance_t vmi, bool enabled)
  */
 
 /*
- * Here we check for response flags placed on the event in the callback
- * that allows triggering Xen vm_event response flags.
+ * Rings older than VM_EVENT_INTERFACE_VERSION 6 have no fast singlestep.
+ * The vCPU is singlestepped instead and process_singlestep switches it to
+ * the next view, without the event reaching the user.
  */
 static
-void process_response ( event_response_t response, vmi_event_t *event, vm_event_compat_t *rsp )
+void emulate_fast_singlestep ( vmi_instance_t vmi, uint16_t next_slat_id, vm_event_compat_t *rsp )
 {
-    /*
-     * The only flag we keep from the request
-     */
-    rsp->flags = (rsp->flags & VM_EVENT_FLAG_VCPU_PAUSED);
+    xen_events_t *xe = xen_get_events(vmi);
+    xen_instance_t *xen = xen_get_instance(vmi);
+
+    if ( rsp->vcpu_id >= MAX_SINGLESTEP_VCPUS ) {
+        errprint("%s error: can't singlestep vCPU %u\n", __FUNCTION__, rsp->vcpu_id);
+        return;
+    }
+
+    if ( !xe->monitor_singlestep_on ) {
+        if ( xen->libxcw.xc_monitor_singlestep(xen_get_xchandle(vmi), xen_get_domainid(vmi), true) < 0 ) {
+            errprint("%s error: failed to enable singlestep events\n", __FUNCTION__);
+            return;
+        }
+
+        xe->monitor_singlestep_on = 1;
+    }
+
+    xe->next_slat[rsp->vcpu_id] = next_slat_id;
+    xe->next_slat_pending |= 1u << rsp->vcpu_id;
+    rsp->flags |= VM_EVENT_FLAG_TOGGLE_SINGLESTEP;
+}
+
+/*
+ * Hold on to a request whose callback returned VMI_EVENT_RESPONSE_DEFER,
+ * the vCPU stays paused until respond_deferred writes the response.
+ */
+static
+bool defer_request ( vmi_instance_t vmi, vmi_event_t *event, vm_event_compat_t *rsp )
+{
+    xen_events_t *xe = xen_get_events(vmi);
+
+    if ( !(rsp->flags & VM_EVENT_FLAG_VCPU_PAUSED) || rsp->vcpu_id >= vmi->num_vcpus )
+        return false;
+
+    if ( !xe->deferred ) {
+        xe->deferred = g_try_new0(vm_event_compat_t, vmi->num_vcpus);
+        if ( !xe->deferred )
+            return false;
+    }
+
+    /* a second callback of the same request can't defer it again */
+    if ( xe->deferred[rsp->vcpu_id].version )
+        return false;
+
+    if ( VMI_FAILURE == event_defer(vmi, event) )
+        return false;
+
+    xe->deferred[rsp->vcpu_id] = *rsp;
+    xe->deferring = 1;
+    return true;
+}
 
+/*
+ * Here we check for response flags placed on the event in the callback
+ * that allows triggering Xen vm_event response flags. They are added to
+ * the flags rsp already has.
+ */
+static
+void convert_response ( vmi_instance_t vmi, event_response_t response, vmi_event_t *event, vm_event_compat_t *rsp )
+{
     if ( response && event ) {
         uint32_t i = VMI_EVENT_RESPONSE_NONE+1;
 
@@ -662,6 +759,10 @@ void process_response ( event_response_t response, vmi_event_t *event, vm_event_
                         }
                         break;
                     case VMI_EVENT_RESPONSE_NEXT_SLAT_ID:
+                        if ( !xen_get_events(vmi)->fast_singlestep ) {
+                            emulate_fast_singlestep(vmi, event->next_slat_id, rsp);
+                            continue;
+                        }
                         rsp->fast_singlestep.p2midx = event->next_slat_id;
                         break;
                 };
@@ -673,41 +774,44 @@ void process_response ( event_response_t response, vmi_event_t *event, vm_event_
 }
 
 static
-status_t process_software_breakpoint(vmi_instance_t vmi, vm_event_compat_t *vmec)
+void process_response ( vmi_instance_t vmi, event_response_t response, vmi_event_t *event, vm_event_compat_t *rsp )
 {
-    gint lookup = INT3;
-    xen_instance_t *xen = xen_get_instance(vmi);
-    vmi_event_t *event = g_hash_table_lookup(vmi->interrupt_events, &lookup);
+    xen_events_t *xe = xen_get_events(vmi);
 
-    if ( !event )
-        return VMI_FAILURE;
+    /*
+     * A generic handler called after the one that deferred the request
+     * adds its flags to the deferred response.
+     */
+    if ( xe->deferring ) {
+        vm_event_compat_t *deferred = &xe->deferred[rsp->vcpu_id];
 
-    event->interrupt_event.gfn = vmec->software_breakpoint.gfn;
-    event->interrupt_event.reinject = -1;
-    event->interrupt_event.insn_length = vmec->software_breakpoint.insn_length;
-    event->interrupt_event.offset = vmec->data.regs.x86.rip & VMI_BIT_MASK(0,11);
-    event->interrupt_event.gla = vmec->data.regs.x86.rip;
+        if ( response & VMI_EVENT_RESPONSE_SET_REGISTERS ) {
+#if defined(ARM32) || defined(ARM64)
+            deferred->data.regs.arm = rsp->data.regs.arm;
+#elif defined(I386) || defined(X86_64)
+            deferred->data.regs.x86 = rsp->data.regs.x86;
+#endif
+        }
 
-    event->x86_regs = &vmec->data.regs.x86;
-    event->slat_id = vmec->altp2m_idx;
-    event->vcpu_id = vmec->vcpu_id;
-    event->page_mode = vmec->pm;
+        convert_response(vmi, response, event, deferred);
+        return;
+    }
 
-    vmi->event_callback = 1;
-    process_response( event->callback(vmi, event), event, vmec );
-    vmi->event_callback = 0;
+    /*
+     * The only flag we keep from the request
+     */
+    rsp->flags = (rsp->flags & VM_EVENT_FLAG_VCPU_PAUSED);
 
-    /* Reinject (callback may decide) */
-    if ( !event->interrupt_event.reinject )
-        return VMI_SUCCESS;
+    if ( (response & VMI_EVENT_RESPONSE_DEFER) && event && defer_request(vmi, event, rsp) )
+        return;
 
-    if ( -1 == event->interrupt_event.reinject ) {
-        errprint("%s Need to specify reinjection behaviour!\n", __FUNCTION__);
-        return VMI_FAILURE;
-    }
+    convert_response(vmi, response, event, rsp);
+}
 
-    dbprint(VMI_DEBUG_XEN, "rip %"PRIx64" gfn %"PRIx64"\n",
-            event->interrupt_event.gla, event->interrupt_event.gfn);
+static
+status_t inject_software_breakpoint(vmi_instance_t vmi, uint32_t vcpu, uint32_t insn_length)
+{
+    xen_instance_t *xen = xen_get_instance(vmi);
 
     /*
      *  Undocumented enough to be worth describing at length:
@@ -730,11 +834,11 @@ status_t process_software_breakpoint(vmi_instance_t vmi, vm_event_compat_t *vmec
      */
     int rc = xen->libxcw.xc_hvm_inject_trap(xen_get_xchandle(vmi),
                                             xen_get_domainid(vmi),
-                                            vmec->vcpu_id,
+                                            vcpu,
                                             X86_TRAP_INT3,     /* Vector 3 for INT3 */
                                             X86_TRAP_sw_exc,   /* Trap type, here a software intr */
                                             ~0u, /* error code. ~0u means 'ignore' */
-                                            event->interrupt_event.insn_length,
+                                            insn_length,
                                             0    /* cr2 need not be preserved */
                                            );
 
@@ -746,6 +850,45 @@ status_t process_software_breakpoint(vmi_instance_t vmi, vm_event_compat_t *vmec
     return VMI_SUCCESS;
 }
 
+static
+status_t process_software_breakpoint(vmi_instance_t vmi, vm_event_compat_t *vmec)
+{
+    gint lookup = INT3;
+    vmi_event_t *event = g_hash_table_lookup(vmi->interrupt_events, &lookup);
+
+    if ( !event )
+        return VMI_FAILURE;
+
+    event->interrupt_event.gfn = vmec->software_breakpoint.gfn;
+    event->interrupt_event.reinject = -1;
+    event->interrupt_event.insn_length = vmec->software_breakpoint.insn_length;
+    event->interrupt_event.offset = vmec->data.regs.x86.rip & VMI_BIT_MASK(0,11);
+    event->interrupt_event.gla = vmec->data.regs.x86.rip;
+
+    event->x86_regs = &vmec->data.regs.x86;
+    event->slat_id = vmec->altp2m_idx;
+    event->vcpu_id = vmec->vcpu_id;
+    event->page_mode = vmec->pm;
+
+    vmi->event_callback = 1;
+    process_response( vmi, event_dispatch(vmi, event), event, vmec );
+    vmi->event_callback = 0;
+
+    /* Reinject (callback may decide) */
+    if ( !event->interrupt_event.reinject )
+        return VMI_SUCCESS;
+
+    if ( -1 == event->interrupt_event.reinject ) {
+        errprint("%s Need to specify reinjection behaviour!\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    dbprint(VMI_DEBUG_XEN, "rip %"PRIx64" gfn %"PRIx64"\n",
+            event->interrupt_event.gla, event->interrupt_event.gfn);
+
+    return inject_software_breakpoint(vmi, vmec->vcpu_id, event->interrupt_event.insn_length);
+}
+
 static
 status_t process_interrupt(vmi_instance_t vmi, vm_event_compat_t *vmec)
 {
@@ -770,23 +913,23 @@ status_t process_interrupt(vmi_instance_t vmi, vm_event_compat_t *vmec)
     event->page_mode = vmec->pm;
 
     vmi->event_callback = 1;
-    process_response( event->callback(vmi, event), event, vmec );
+    process_response( vmi, event_dispatch(vmi, event), event, vmec );
     vmi->event_callback = 0;
 
     return VMI_SUCCESS;
 }
 
+static const reg_t ctrlreg_convert[] = {
+    [VM_EVENT_X86_CR0] = CR0,
+    [VM_EVENT_X86_CR3] = CR3,
+    [VM_EVENT_X86_CR4] = CR4,
+    [VM_EVENT_X86_XCR0] = XCR0
+};
+
 static
 status_t process_register(vmi_instance_t vmi, vm_event_compat_t *vmec)
 {
-    reg_t convert[] = {
-        [VM_EVENT_X86_CR0] = CR0,
-        [VM_EVENT_X86_CR3] = CR3,
-        [VM_EVENT_X86_CR4] = CR4,
-        [VM_EVENT_X86_XCR0] = XCR0
-    };
-
-    gint lookup = convert[vmec->write_ctrlreg.index];
+    gint lookup = ctrlreg_convert[vmec->write_ctrlreg.index];
     vmi_event_t * event = g_hash_table_lookup(vmi->reg_events, &lookup);
 
 #ifdef ENABLE_SAFETY_CHECKS
@@ -815,29 +958,42 @@ status_t process_register(vmi_instance_t vmi, vm_event_compat_t *vmec)
             break;
     }
 
+    event->vcpu_id = vmec->vcpu_id;
+
+    /* the vCPU stays in the address space it was last reported in */
+    if ( event->reg_event.onswitch && reg_event_unswitched(vmi, event) )
+        return VMI_SUCCESS;
+
     event->x86_regs = &vmec->data.regs.x86;
     event->slat_id = vmec->altp2m_idx;
-    event->vcpu_id = vmec->vcpu_id;
     event->page_mode = vmec->pm;
 
     vmi->event_callback = 1;
-    process_response ( event->callback(vmi, event), event, vmec );
+    process_response( vmi, event_dispatch(vmi, event), event, vmec );
     vmi->event_callback = 0;
 
     return VMI_SUCCESS;
 }
 
 static
-status_t process_msr(vmi_instance_t vmi, vm_event_compat_t *vmec)
+vmi_event_t *msr_event_lookup(vmi_instance_t vmi, uint64_t msr)
 {
     gint lookup = MSR_ALL;
-    vmi_event_t * event = g_hash_table_lookup(vmi->reg_events, &lookup);
+    vmi_event_t *event = g_hash_table_lookup(vmi->reg_events, &lookup);
 
     if ( !event ) {
-        lookup = vmec->mov_to_msr.msr;
+        lookup = msr;
         event = g_hash_table_lookup(vmi->msr_events, &lookup);
     }
 
+    return event;
+}
+
+static
+status_t process_msr(vmi_instance_t vmi, vm_event_compat_t *vmec)
+{
+    vmi_event_t * event = msr_event_lookup(vmi, vmec->mov_to_msr.msr);
+
 #ifdef ENABLE_SAFETY_CHECKS
     if ( !event ) {
         errprint("Unhandled MSR event caught: 0x%lx\n", vmec->mov_to_msr.msr);
@@ -855,7 +1011,7 @@ status_t process_msr(vmi_instance_t vmi, vm_event_compat_t *vmec)
     event->page_mode = vmec->pm;
 
     vmi->event_callback = 1;
-    process_response ( event->callback(vmi, event), event, vmec );
+    process_response( vmi, event_dispatch(vmi, event), event, vmec );
     vmi->event_callback = 0;
 
     return VMI_SUCCESS;
@@ -864,8 +1020,20 @@ status_t process_msr(vmi_instance_t vmi, vm_event_compat_t *vmec)
 static
 status_t process_singlestep(vmi_instance_t vmi, vm_event_compat_t *vmec)
 {
+    xen_events_t *xe = xen_get_events(vmi);
     gint lookup = vmec->vcpu_id;
-    vmi_event_t * event = g_hash_table_lookup(vmi->ss_events, &lookup);
+    vmi_event_t * event;
+
+    /* the step of an emulated fast singlestep is done */
+    if ( vmec->vcpu_id < MAX_SINGLESTEP_VCPUS && (xe->next_slat_pending & (1u << vmec->vcpu_id)) ) {
+        xe->next_slat_pending &= ~(1u << vmec->vcpu_id);
+        vmec->flags = (vmec->flags & VM_EVENT_FLAG_VCPU_PAUSED) |
+                      VM_EVENT_FLAG_ALTERNATE_P2M | VM_EVENT_FLAG_TOGGLE_SINGLESTEP;
+        vmec->altp2m_idx = xe->next_slat[vmec->vcpu_id];
+        return VMI_SUCCESS;
+    }
+
+    event = g_hash_table_lookup(vmi->ss_events, &lookup);
 
 #ifdef ENABLE_SAFETY_CHECKS
     if ( !event ) {
@@ -884,12 +1052,55 @@ status_t process_singlestep(vmi_instance_t vmi, vm_event_compat_t *vmec)
     event->page_mode = vmec->pm;
 
     vmi->event_callback = 1;
-    process_response ( event->callback(vmi, event), event, vmec );
+    process_response( vmi, event_dispatch(vmi, event), event, vmec );
     vmi->event_callback = 0;
 
     return VMI_SUCCESS;
 }
 
+static inline
+vmi_mem_access_t mem_out_access(vm_event_compat_t *vmec)
+{
+    vmi_mem_access_t out_access = VMI_MEMACCESS_INVALID;
+
+    if (vmec->mem_access.flags & MEM_ACCESS_R) out_access |= VMI_MEMACCESS_R;
+    if (vmec->mem_access.flags & MEM_ACCESS_W) out_access |= VMI_MEMACCESS_W;
+    if (vmec->mem_access.flags & MEM_ACCESS_X) out_access |= VMI_MEMACCESS_X;
+
+    return out_access;
+}
+
+/*
+ * The request fields event filters test. The registers are read by reg
+ * from regs, which is either the ring request or the copy in vmec.
+ */
+static
+void ring_filter_fields(vm_event_compat_t *vmec,
+                        bool (*reg)(const void *regs, reg_t reg, uint64_t *value),
+                        const void *regs,
+                        event_fields_t *fields)
+{
+    fields->reg = reg;
+    fields->regs = regs;
+    fields->vcpu = vmec->vcpu_id;
+
+    switch ( vmec->reason ) {
+        case VM_EVENT_REASON_MEM_ACCESS:
+            fields->gfn = vmec->mem_access.gfn;
+            fields->gla_valid = !!(vmec->mem_access.flags & MEM_ACCESS_GLA_VALID);
+            fields->gla = fields->gla_valid ? vmec->mem_access.gla : 0;
+            break;
+        case VM_EVENT_REASON_WRITE_CTRLREG:
+            fields->value = vmec->write_ctrlreg.new_value;
+            break;
+        case VM_EVENT_REASON_MOV_TO_MSR:
+            fields->value = vmec->mov_to_msr.new_value;
+            break;
+        default:
+            break;
+    }
+}
+
 static inline
 event_response_t issue_mem_cb(vmi_instance_t vmi,
                               vmi_event_t *event,
@@ -908,58 +1119,53 @@ event_response_t issue_mem_cb(vmi_instance_t vmi,
     event->mem_event.out_access = out_access;
     event->vcpu_id = vmec->vcpu_id;
 
-    return event->callback(vmi, event);
+    return event_dispatch(vmi, event);
 }
 
 static
 status_t process_mem(vmi_instance_t vmi, vm_event_compat_t *vmec)
 {
-    vmi_event_t *event;
-    vmi_mem_access_t out_access = VMI_MEMACCESS_INVALID;
+    vmi_event_t *event, **events;
+    vmi_mem_access_t out_access = mem_out_access(vmec);
+    event_fields_t fields = { 0 };
 
-    if (vmec->mem_access.flags & MEM_ACCESS_R) out_access |= VMI_MEMACCESS_R;
-    if (vmec->mem_access.flags & MEM_ACCESS_W) out_access |= VMI_MEMACCESS_W;
-    if (vmec->mem_access.flags & MEM_ACCESS_X) out_access |= VMI_MEMACCESS_X;
+    event = mem_event_on_gfn(vmi, vmec->mem_access.gfn);
+
+    if (event && (event->mem_event.in_access & out_access) ) {
+        event->x86_regs = &vmec->data.regs.x86;
+        event->slat_id = vmec->altp2m_idx;
+        event->vcpu_id = vmec->vcpu_id;
+        event->page_mode = vmec->pm;
+
+        vmi->event_callback = 1;
+        process_response( vmi, issue_mem_cb(vmi, event, vmec, out_access), event, vmec );
+        vmi->event_callback = 0;
 
-    if ( g_hash_table_size(vmi->mem_events_on_gfn) ) {
-        event = g_hash_table_lookup(vmi->mem_events_on_gfn, &vmec->mem_access.gfn);
+        return VMI_SUCCESS;
+    }
+
+    events = mem_events_for_access(vmi, out_access);
+
+    if ( events ) {
+        if ( G_UNLIKELY(vmi->event_filters) )
+            ring_filter_fields(vmec, event_filter_x86_regs, &vmec->data.regs.x86, &fields);
+
+        for ( ; (event = *events); events++ ) {
+            /* the access only reached us because another handler keeps it */
+            if ( G_UNLIKELY(vmi->event_filters) && event_filtered(vmi, event, &fields) )
+                continue;
 
-        if (event && (event->mem_event.in_access & out_access) ) {
             event->x86_regs = &vmec->data.regs.x86;
             event->slat_id = vmec->altp2m_idx;
             event->vcpu_id = vmec->vcpu_id;
             event->page_mode = vmec->pm;
 
             vmi->event_callback = 1;
-            process_response( issue_mem_cb(vmi, event, vmec, out_access), event, vmec );
+            process_response( vmi, issue_mem_cb(vmi, event, vmec, out_access), event, vmec );
             vmi->event_callback = 0;
-
-            return VMI_SUCCESS;
         }
-    }
-
-    if ( g_hash_table_size(vmi->mem_events_generic) ) {
-        GHashTableIter i;
-        vmi_mem_access_t *key = NULL;
-        bool cb_issued = 0;
-
-        ghashtable_foreach(vmi->mem_events_generic, i, &key, &event) {
-            if ( (*key) & out_access ) {
-                event->x86_regs = &vmec->data.regs.x86;
-                event->slat_id = vmec->altp2m_idx;
-                event->vcpu_id = vmec->vcpu_id;
-                event->page_mode = vmec->pm;
-
-                vmi->event_callback = 1;
-                process_response( issue_mem_cb(vmi, event, vmec, out_access), event, vmec );
-                vmi->event_callback = 0;
 
-                cb_issued = 1;
-            }
-        }
-
-        if ( cb_issued )
-            return VMI_SUCCESS;
+        return VMI_SUCCESS;
     }
 
     /*
@@ -998,7 +1204,7 @@ status_t process_debug_exception(vmi_instance_t vmi, vm_event_compat_t *vmec)
     event->page_mode = vmec->pm;
 
     vmi->event_callback = 1;
-    process_response ( event->callback(vmi, event),
+    process_response( vmi, event_dispatch(vmi, event),
                        event, vmec );
     vmi->event_callback = 0;
 
@@ -1048,7 +1254,7 @@ status_t process_cpuid(vmi_instance_t vmi, vm_event_compat_t *vmec)
     event->page_mode = vmec->pm;
 
     vmi->event_callback = 1;
-    process_response ( event->callback(vmi, event),
+    process_response( vmi, event_dispatch(vmi, event),
                        event, vmec );
     vmi->event_callback = 0;
 
@@ -1087,7 +1293,7 @@ status_t process_privcall(vmi_instance_t vmi, vm_event_compat_t *vmec)
     event->page_mode = vmec->pm;
 
     vmi->event_callback = 1;
-    process_response ( event->callback(vmi, event),
+    process_response( vmi, event_dispatch(vmi, event),
                        event, vmec );
     vmi->event_callback = 0;
 
@@ -1121,7 +1327,7 @@ status_t process_guest_request(vmi_instance_t vmi, vm_event_compat_t *vmec)
     event->page_mode = vmec->pm;
 
     vmi->event_callback = 1;
-    process_response ( event->callback(vmi, event),
+    process_response( vmi, event_dispatch(vmi, event),
                        event, vmec );
     vmi->event_callback = 0;
 
@@ -1146,7 +1352,7 @@ status_t process_unimplemented_emul(vmi_instance_t vmi, vm_event_compat_t *vmec)
     event->page_mode = vmec->pm;
 
     vmi->event_callback = 1;
-    process_response ( event->callback(vmi, event),
+    process_response( vmi, event_dispatch(vmi, event),
                        event, vmec );
     vmi->event_callback = 0;
 
@@ -1176,7 +1382,7 @@ status_t process_desc_access(vmi_instance_t vmi, vm_event_compat_t *vmec)
     event->page_mode = vmec->pm;
 
     vmi->event_callback = 1;
-    process_response ( event->callback(vmi, event),
+    process_response( vmi, event_dispatch(vmi, event),
                        event, vmec );
     vmi->event_callback = 0;
 
@@ -1277,6 +1483,9 @@ status_t process_request(vmi_instance_t vmi, vm_event_compat_t *vmec)
 {
     xen_events_t *xe = xen_get_events(vmi);
 
+    /* handlers of this request only merge into a request it deferred */
+    xe->deferring = 0;
+
 #ifdef ENABLE_SAFETY_CHECKS
     if ( !xe->process_event[vmec->reason] )
         return VMI_FAILURE;
@@ -1292,44 +1501,180 @@ status_t process_request(vmi_instance_t vmi, vm_event_compat_t *vmec)
     return xe->process_event[vmec->reason](vmi, vmec);
 }
 
+/*
+ * The filters test the registers of the ring request, before they are
+ * copied to vmec.
+ */
+#if defined(I386) || defined(X86_64)
+static EVENT_FILTER_X86_REGS(ring_filter_regs_1, struct regs_x86_1)
+static EVENT_FILTER_X86_REGS(ring_filter_regs_4, struct regs_x86_4)
+static EVENT_FILTER_X86_REGS(ring_filter_regs_5, struct regs_x86_5)
+static EVENT_FILTER_X86_REGS(ring_filter_regs_7, struct regs_x86_7)
+#define ring_filter_regs_2 ring_filter_regs_1
+#define ring_filter_regs_3 ring_filter_regs_1
+#define ring_filter_regs_6 ring_filter_regs_5
+#define RING_FILTER_REGS(req, version) ring_filter_regs_##version, &(req)->data.regs.x86
+#else
+/* the rules only name x86 registers */
+#define RING_FILTER_REGS(req, version) NULL, NULL
+#endif
+
+/*
+ * Test the filters on a request whose reason specific fields are in vmec.
+ * A dropped request is answered here without its registers being copied:
+ * memory accesses are emulated, breakpoints reinjected and register writes
+ * let through. An access matching several generic memory events is only
+ * dropped if all of them drop it.
+ */
+static
+bool ring_event_dropped(vmi_instance_t vmi,
+                        vm_event_compat_t *vmec,
+                        bool (*reg)(const void *regs, reg_t reg, uint64_t *value),
+                        const void *regs)
+{
+    event_fields_t fields = { 0 };
+    vmi_event_t *event = NULL, **events;
+    vmi_mem_access_t out_access;
+    gint lookup;
+
+    ring_filter_fields(vmec, reg, regs, &fields);
+
+    switch ( vmec->reason ) {
+        case VM_EVENT_REASON_MEM_ACCESS:
+            out_access = mem_out_access(vmec);
+            event = mem_event_on_gfn(vmi, vmec->mem_access.gfn);
+            if ( event && (event->mem_event.in_access & out_access) )
+                break;
+
+            events = mem_events_for_access(vmi, out_access);
+            if ( !events || !(event = *events) )
+                return false;
+
+            for ( ; *events; events++ )
+                if ( !event_filtered(vmi, *events, &fields) )
+                    return false;
+
+            process_response(vmi, event_filter_response(event), event, vmec);
+            return true;
+        case VM_EVENT_REASON_WRITE_CTRLREG:
+            lookup = ctrlreg_convert[vmec->write_ctrlreg.index];
+            event = g_hash_table_lookup(vmi->reg_events, &lookup);
+            break;
+        case VM_EVENT_REASON_MOV_TO_MSR:
+            event = msr_event_lookup(vmi, vmec->mov_to_msr.msr);
+            break;
+        case VM_EVENT_REASON_SOFTWARE_BREAKPOINT:
+            lookup = INT3;
+            event = g_hash_table_lookup(vmi->interrupt_events, &lookup);
+            break;
+        default:
+            return false;
+    }
+
+    if ( !event || !event_filtered(vmi, event, &fields) )
+        return false;
+
+    process_response(vmi, event_filter_response(event), event, vmec);
+
+    if ( vmec->reason == VM_EVENT_REASON_SOFTWARE_BREAKPOINT )
+        inject_software_breakpoint(vmi, vmec->vcpu_id, vmec->software_breakpoint.insn_length);
+
+    return true;
+}
+
 /*
  * VM_EVENT_VERSION 1 ring functions
  */
 
 static inline
-void ring_get_request_and_response_1(xen_events_t *xe,
-                                     vm_event_1_request_t **req,
-                                     vm_event_1_request_t **rsp)
+void ring_get_request_1(xen_events_t *xe,
+                        vm_event_1_request_t **req)
 {
     vm_event_1_back_ring_t *back_ring = &xe->back_ring_1;
     RING_IDX req_cons = back_ring->req_cons;
-    RING_IDX rsp_prod = back_ring->rsp_prod_pvt;
 
     *req = RING_GET_REQUEST(back_ring, req_cons);
-    *rsp = RING_GET_RESPONSE(back_ring, rsp_prod);
 
     // Update ring positions
     req_cons++;
     back_ring->req_cons = req_cons;
     back_ring->sring->req_event = req_cons + 1;
+}
+
+static
+void ring_put_response_1(xen_events_t *xe, vm_event_compat_t *vmec)
+{
+    vm_event_1_back_ring_t *back_ring = &xe->back_ring_1;
+    vm_event_1_response_t *rsp = RING_GET_RESPONSE(back_ring, back_ring->rsp_prod_pvt);
+
+    rsp->version = vmec->version;
+    rsp->vcpu_id = vmec->vcpu_id;
+    rsp->flags = vmec->flags;
+    rsp->reason = vmec->reason;
+    rsp->altp2m_idx = vmec->altp2m_idx;
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
+        rsp->data.emul_read_data.size = vmec->data.emul.read.size;
+        memcpy(&rsp->data.emul_read_data.data, &vmec->data.emul.read.data, vmec->data.emul.read.size);
+    }
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
+#if defined(I386) || defined(X86_64)
+        rsp->data.regs.x86.rax = vmec->data.regs.x86.rax;
+        rsp->data.regs.x86.rcx = vmec->data.regs.x86.rcx;
+        rsp->data.regs.x86.rdx = vmec->data.regs.x86.rdx;
+        rsp->data.regs.x86.rbx = vmec->data.regs.x86.rbx;
+        rsp->data.regs.x86.rsp = vmec->data.regs.x86.rsp;
+        rsp->data.regs.x86.rbp = vmec->data.regs.x86.rbp;
+        rsp->data.regs.x86.rsi = vmec->data.regs.x86.rsi;
+        rsp->data.regs.x86.rdi = vmec->data.regs.x86.rdi;
+        rsp->data.regs.x86.r8 = vmec->data.regs.x86.r8;
+        rsp->data.regs.x86.r9 = vmec->data.regs.x86.r9;
+        rsp->data.regs.x86.r10 = vmec->data.regs.x86.r10;
+        rsp->data.regs.x86.r11 = vmec->data.regs.x86.r11;
+        rsp->data.regs.x86.r12 = vmec->data.regs.x86.r12;
+        rsp->data.regs.x86.r13 = vmec->data.regs.x86.r13;
+        rsp->data.regs.x86.r14 = vmec->data.regs.x86.r14;
+        rsp->data.regs.x86.r15 = vmec->data.regs.x86.r15;
+        rsp->data.regs.x86.rflags = vmec->data.regs.x86.rflags;
+        rsp->data.regs.x86.dr7 = vmec->data.regs.x86.dr7;
+        rsp->data.regs.x86.rip = vmec->data.regs.x86.rip;
+        rsp->data.regs.x86.cr0 = vmec->data.regs.x86.cr0;
+        rsp->data.regs.x86.cr2 = vmec->data.regs.x86.cr2;
+        rsp->data.regs.x86.cr3 = vmec->data.regs.x86.cr3;
+        rsp->data.regs.x86.cr4 = vmec->data.regs.x86.cr4;
+        rsp->data.regs.x86.sysenter_cs = vmec->data.regs.x86.sysenter_cs;
+        rsp->data.regs.x86.sysenter_esp = vmec->data.regs.x86.sysenter_esp;
+        rsp->data.regs.x86.sysenter_eip = vmec->data.regs.x86.sysenter_eip;
+        rsp->data.regs.x86.msr_efer = vmec->data.regs.x86.msr_efer;
+        rsp->data.regs.x86.msr_star = vmec->data.regs.x86.msr_star;
+        rsp->data.regs.x86.msr_lstar = vmec->data.regs.x86.msr_lstar;
+        rsp->data.regs.x86.fs_base = vmec->data.regs.x86.fs_base;
+        rsp->data.regs.x86.gs_base = vmec->data.regs.x86.gs_base;
+        rsp->data.regs.x86.cs_arbytes = vmec->data.regs.x86.cs_arbytes;
+        rsp->data.regs.x86._pad = 0;
+#endif
+    }
+
     back_ring->rsp_prod_pvt++;
+    RING_PUSH_RESPONSES(back_ring);
 }
 
 static
-status_t process_requests_1(vmi_instance_t vmi, uint32_t *requests_processed)
+status_t process_requests_1(vmi_instance_t vmi, uint32_t budget, uint32_t *requests_processed)
 {
     vm_event_1_request_t *req;
-    vm_event_1_response_t *rsp;
     vm_event_compat_t vmec =  { 0 };
     xen_events_t *xe = xen_get_events(vmi);
     xen_instance_t *xen = xen_get_instance(vmi);
     int rc;
     status_t vrc = VMI_SUCCESS;
-    uint32_t processed = 0;
+    uint32_t processed = 0, taken = 0;
 
-    while ( RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_1) ) {
+    while ( (!budget || taken < budget) && RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_1) ) {
 
-        ring_get_request_and_response_1(xe, &req, &rsp);
+        ring_get_request_1(xe, &req);
+        taken++;
 
         if ( req->version != 0x00000001 ) {
             errprint("Error, Xen reports a VM_EVENT_INTERFACE_VERSION that doesn't match what we expected (0x00000001)!\n");
@@ -1342,7 +1687,38 @@ status_t process_requests_1(vmi_instance_t vmi, uint32_t *requests_processed)
         vmec.vcpu_id = req->vcpu_id;
         vmec.altp2m_idx = req->altp2m_idx;
 
-#if defined(I386) || defined(X86_64)
+        switch ( vmec.reason ) {
+            case VM_EVENT_REASON_MEM_ACCESS:
+                memcpy(&vmec.mem_access, &req->u.mem_access, sizeof(vmec.mem_access));
+                break;
+
+            case VM_EVENT_REASON_WRITE_CTRLREG:
+                memcpy(&vmec.write_ctrlreg, &req->u.write_ctrlreg, sizeof(vmec.write_ctrlreg));
+                break;
+
+            case VM_EVENT_REASON_MOV_TO_MSR:
+                vmec.mov_to_msr.msr = req->u.mov_to_msr.msr;
+                vmec.mov_to_msr.new_value = req->u.mov_to_msr.value;
+                break;
+
+            case VM_EVENT_REASON_SINGLESTEP:
+                vmec.singlestep.gfn = req->u.singlestep.gfn;
+                break;
+
+            case VM_EVENT_REASON_SOFTWARE_BREAKPOINT:
+                vmec.software_breakpoint.gfn = req->u.software_breakpoint.gfn;
+                break;
+        };
+
+        /* a request the filters drop is answered before its registers are copied */
+        if ( G_UNLIKELY(vmi->event_filters) &&
+                ring_event_dropped(vmi, &vmec, RING_FILTER_REGS(req, 1)) ) {
+            ring_put_response_1(xe, &vmec);
+            processed++;
+            continue;
+        }
+
+#if defined(I386) || defined(X86_64)
         vmec.data.regs.x86.rax = req->data.regs.x86.rax;
         vmec.data.regs.x86.rcx = req->data.regs.x86.rcx;
         vmec.data.regs.x86.rdx = req->data.regs.x86.rdx;
@@ -1377,86 +1753,20 @@ status_t process_requests_1(vmi_instance_t vmi, uint32_t *requests_processed)
         vmec.data.regs.x86.cs_arbytes = req->data.regs.x86.cs_arbytes;
 #endif
 
-        switch ( vmec.reason ) {
-            case VM_EVENT_REASON_MEM_ACCESS:
-                memcpy(&vmec.mem_access, &req->u.mem_access, sizeof(vmec.mem_access));
-                break;
-
-            case VM_EVENT_REASON_WRITE_CTRLREG:
-                memcpy(&vmec.write_ctrlreg, &req->u.write_ctrlreg, sizeof(vmec.write_ctrlreg));
-                break;
-
-            case VM_EVENT_REASON_MOV_TO_MSR:
-                vmec.mov_to_msr.msr = req->u.mov_to_msr.msr;
-                vmec.mov_to_msr.new_value = req->u.mov_to_msr.value;
-                break;
-
-            case VM_EVENT_REASON_SINGLESTEP:
-                vmec.singlestep.gfn = req->u.singlestep.gfn;
-                break;
-
-            case VM_EVENT_REASON_SOFTWARE_BREAKPOINT:
-                vmec.software_breakpoint.gfn = req->u.software_breakpoint.gfn;
-                break;
-        };
-
         vrc = process_request(vmi, &vmec);
 #ifdef ENABLE_SAFETY_CHECKS
         if ( VMI_FAILURE == vrc )
             break;
 #endif
 
-        rsp->version = vmec.version;
-        rsp->vcpu_id = vmec.vcpu_id;
-        rsp->flags = vmec.flags;
-        rsp->reason = vmec.reason;
-        rsp->altp2m_idx = vmec.altp2m_idx;
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
-            rsp->data.emul_read_data.size = vmec.data.emul.read.size;
-            memcpy(&rsp->data.emul_read_data.data, &vmec.data.emul.read.data, vmec.data.emul.read.size);
+        if ( xe->deferring ) {
+            xe->deferring = 0;
+            continue;
         }
 
-        if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
-#if defined(I386) || defined(X86_64)
-            rsp->data.regs.x86.rax = vmec.data.regs.x86.rax;
-            rsp->data.regs.x86.rcx = vmec.data.regs.x86.rcx;
-            rsp->data.regs.x86.rdx = vmec.data.regs.x86.rdx;
-            rsp->data.regs.x86.rbx = vmec.data.regs.x86.rbx;
-            rsp->data.regs.x86.rsp = vmec.data.regs.x86.rsp;
-            rsp->data.regs.x86.rbp = vmec.data.regs.x86.rbp;
-            rsp->data.regs.x86.rsi = vmec.data.regs.x86.rsi;
-            rsp->data.regs.x86.rdi = vmec.data.regs.x86.rdi;
-            rsp->data.regs.x86.r8 = vmec.data.regs.x86.r8;
-            rsp->data.regs.x86.r9 = vmec.data.regs.x86.r9;
-            rsp->data.regs.x86.r10 = vmec.data.regs.x86.r10;
-            rsp->data.regs.x86.r11 = vmec.data.regs.x86.r11;
-            rsp->data.regs.x86.r12 = vmec.data.regs.x86.r12;
-            rsp->data.regs.x86.r13 = vmec.data.regs.x86.r13;
-            rsp->data.regs.x86.r14 = vmec.data.regs.x86.r14;
-            rsp->data.regs.x86.r15 = vmec.data.regs.x86.r15;
-            rsp->data.regs.x86.rflags = vmec.data.regs.x86.rflags;
-            rsp->data.regs.x86.dr7 = vmec.data.regs.x86.dr7;
-            rsp->data.regs.x86.rip = vmec.data.regs.x86.rip;
-            rsp->data.regs.x86.cr0 = vmec.data.regs.x86.cr0;
-            rsp->data.regs.x86.cr2 = vmec.data.regs.x86.cr2;
-            rsp->data.regs.x86.cr3 = vmec.data.regs.x86.cr3;
-            rsp->data.regs.x86.cr4 = vmec.data.regs.x86.cr4;
-            rsp->data.regs.x86.sysenter_cs = vmec.data.regs.x86.sysenter_cs;
-            rsp->data.regs.x86.sysenter_esp = vmec.data.regs.x86.sysenter_esp;
-            rsp->data.regs.x86.sysenter_eip = vmec.data.regs.x86.sysenter_eip;
-            rsp->data.regs.x86.msr_efer = vmec.data.regs.x86.msr_efer;
-            rsp->data.regs.x86.msr_star = vmec.data.regs.x86.msr_star;
-            rsp->data.regs.x86.msr_lstar = vmec.data.regs.x86.msr_lstar;
-            rsp->data.regs.x86.fs_base = vmec.data.regs.x86.fs_base;
-            rsp->data.regs.x86.gs_base = vmec.data.regs.x86.gs_base;
-            rsp->data.regs.x86.cs_arbytes = vmec.data.regs.x86.cs_arbytes;
-            rsp->data.regs.x86._pad = 0;
-#endif
-        }
+        ring_put_response_1(xe, &vmec);
 
         processed++;
-        RING_PUSH_RESPONSES(&xe->back_ring_1);
 
         /*
          * Send notification to Xen that response(s) were placed on the ring
@@ -1502,6 +1812,7 @@ status_t init_events_1(vmi_instance_t vmi)
 
     vmi->driver.are_events_pending_ptr = &xen_are_events_pending_1;
     xe->process_requests = &process_requests_1;
+    xe->put_response = &ring_put_response_1;
 
     SHARED_RING_INIT((vm_event_1_sring_t *)xe->ring_page);
     BACK_RING_INIT(&xe->back_ring_1,
@@ -1516,38 +1827,98 @@ status_t init_events_1(vmi_instance_t vmi)
  */
 
 static inline
-void ring_get_request_and_response_2(xen_events_t *xe,
-                                     vm_event_2_request_t **req,
-                                     vm_event_2_request_t **rsp)
+void ring_get_request_2(xen_events_t *xe,
+                        vm_event_2_request_t **req)
 {
     vm_event_2_back_ring_t *back_ring = &xe->back_ring_2;
     RING_IDX req_cons = back_ring->req_cons;
-    RING_IDX rsp_prod = back_ring->rsp_prod_pvt;
 
     *req = RING_GET_REQUEST(back_ring, req_cons);
-    *rsp = RING_GET_RESPONSE(back_ring, rsp_prod);
 
     // Update ring positions
     req_cons++;
     back_ring->req_cons = req_cons;
     back_ring->sring->req_event = req_cons + 1;
+}
+
+static
+void ring_put_response_2(xen_events_t *xe, vm_event_compat_t *vmec)
+{
+    vm_event_2_back_ring_t *back_ring = &xe->back_ring_2;
+    vm_event_2_response_t *rsp = RING_GET_RESPONSE(back_ring, back_ring->rsp_prod_pvt);
+
+    rsp->version = vmec->version;
+    rsp->vcpu_id = vmec->vcpu_id;
+    rsp->flags = vmec->flags;
+    rsp->reason = vmec->reason;
+    rsp->altp2m_idx = vmec->altp2m_idx;
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
+        rsp->data.emul.read.size = vmec->data.emul.read.size;
+        memcpy(&rsp->data.emul.read.data, &vmec->data.emul.read.data, vmec->data.emul.read.size);
+    }
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_INSN_DATA )
+        memcpy(&rsp->data.emul.insn, &vmec->data.emul.insn, sizeof(rsp->data.emul.insn));
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
+#if defined(ARM32) || defined(ARM64)
+        memcpy(&rsp->data.regs.arm, &vmec->data.regs.arm, sizeof(rsp->data.regs.arm));
+#elif defined(I386) || defined(X86_64)
+        rsp->data.regs.x86.rax = vmec->data.regs.x86.rax;
+        rsp->data.regs.x86.rcx = vmec->data.regs.x86.rcx;
+        rsp->data.regs.x86.rdx = vmec->data.regs.x86.rdx;
+        rsp->data.regs.x86.rbx = vmec->data.regs.x86.rbx;
+        rsp->data.regs.x86.rsp = vmec->data.regs.x86.rsp;
+        rsp->data.regs.x86.rbp = vmec->data.regs.x86.rbp;
+        rsp->data.regs.x86.rsi = vmec->data.regs.x86.rsi;
+        rsp->data.regs.x86.rdi = vmec->data.regs.x86.rdi;
+        rsp->data.regs.x86.r8 = vmec->data.regs.x86.r8;
+        rsp->data.regs.x86.r9 = vmec->data.regs.x86.r9;
+        rsp->data.regs.x86.r10 = vmec->data.regs.x86.r10;
+        rsp->data.regs.x86.r11 = vmec->data.regs.x86.r11;
+        rsp->data.regs.x86.r12 = vmec->data.regs.x86.r12;
+        rsp->data.regs.x86.r13 = vmec->data.regs.x86.r13;
+        rsp->data.regs.x86.r14 = vmec->data.regs.x86.r14;
+        rsp->data.regs.x86.r15 = vmec->data.regs.x86.r15;
+        rsp->data.regs.x86.rflags = vmec->data.regs.x86.rflags;
+        rsp->data.regs.x86.dr7 = vmec->data.regs.x86.dr7;
+        rsp->data.regs.x86.rip = vmec->data.regs.x86.rip;
+        rsp->data.regs.x86.cr0 = vmec->data.regs.x86.cr0;
+        rsp->data.regs.x86.cr2 = vmec->data.regs.x86.cr2;
+        rsp->data.regs.x86.cr3 = vmec->data.regs.x86.cr3;
+        rsp->data.regs.x86.cr4 = vmec->data.regs.x86.cr4;
+        rsp->data.regs.x86.sysenter_cs = vmec->data.regs.x86.sysenter_cs;
+        rsp->data.regs.x86.sysenter_esp = vmec->data.regs.x86.sysenter_esp;
+        rsp->data.regs.x86.sysenter_eip = vmec->data.regs.x86.sysenter_eip;
+        rsp->data.regs.x86.msr_efer = vmec->data.regs.x86.msr_efer;
+        rsp->data.regs.x86.msr_star = vmec->data.regs.x86.msr_star;
+        rsp->data.regs.x86.msr_lstar = vmec->data.regs.x86.msr_lstar;
+        rsp->data.regs.x86.fs_base = vmec->data.regs.x86.fs_base;
+        rsp->data.regs.x86.gs_base = vmec->data.regs.x86.gs_base;
+        rsp->data.regs.x86.cs_arbytes = vmec->data.regs.x86.cs_arbytes;
+        rsp->data.regs.x86._pad = 0;
+#endif
+    }
+
     back_ring->rsp_prod_pvt++;
+    RING_PUSH_RESPONSES(back_ring);
 }
 
-status_t process_requests_2(vmi_instance_t vmi, uint32_t *requests_processed)
+status_t process_requests_2(vmi_instance_t vmi, uint32_t budget, uint32_t *requests_processed)
 {
     vm_event_2_request_t *req;
-    vm_event_2_response_t *rsp;
     vm_event_compat_t vmec = { 0 };
     xen_events_t *xe = xen_get_events(vmi);
     xen_instance_t *xen = xen_get_instance(vmi);
     int rc;
     status_t vrc = VMI_SUCCESS;
-    uint32_t processed = 0;
+    uint32_t processed = 0, taken = 0;
 
-    while ( RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_2) ) {
+    while ( (!budget || taken < budget) && RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_2) ) {
 
-        ring_get_request_and_response_2(xe, &req, &rsp);
+        ring_get_request_2(xe, &req);
+        taken++;
 
         if ( req->version != 0x00000002 ) {
             errprint("Error, Xen reports a VM_EVENT_INTERFACE_VERSION that is different then what we expect (0x%x != 0x%x)!\n",
@@ -1561,43 +1932,6 @@ status_t process_requests_2(vmi_instance_t vmi, uint32_t *requests_processed)
         vmec.vcpu_id = req->vcpu_id;
         vmec.altp2m_idx = req->altp2m_idx;
 
-#if defined(ARM32) || defined(ARM64)
-        memcpy(&vmec.data.regs.arm, &req->data.regs.arm, sizeof(vmec.data.regs.arm));
-#elif defined(I386) || defined(X86_64)
-        vmec.data.regs.x86.rax = req->data.regs.x86.rax;
-        vmec.data.regs.x86.rcx = req->data.regs.x86.rcx;
-        vmec.data.regs.x86.rdx = req->data.regs.x86.rdx;
-        vmec.data.regs.x86.rbx = req->data.regs.x86.rbx;
-        vmec.data.regs.x86.rsp = req->data.regs.x86.rsp;
-        vmec.data.regs.x86.rbp = req->data.regs.x86.rbp;
-        vmec.data.regs.x86.rsi = req->data.regs.x86.rsi;
-        vmec.data.regs.x86.rdi = req->data.regs.x86.rdi;
-        vmec.data.regs.x86.r8 = req->data.regs.x86.r8;
-        vmec.data.regs.x86.r9 = req->data.regs.x86.r9;
-        vmec.data.regs.x86.r10 = req->data.regs.x86.r10;
-        vmec.data.regs.x86.r11 = req->data.regs.x86.r11;
-        vmec.data.regs.x86.r12 = req->data.regs.x86.r12;
-        vmec.data.regs.x86.r13 = req->data.regs.x86.r13;
-        vmec.data.regs.x86.r14 = req->data.regs.x86.r14;
-        vmec.data.regs.x86.r15 = req->data.regs.x86.r15;
-        vmec.data.regs.x86.rflags = req->data.regs.x86.rflags;
-        vmec.data.regs.x86.dr7 = req->data.regs.x86.dr7;
-        vmec.data.regs.x86.rip = req->data.regs.x86.rip;
-        vmec.data.regs.x86.cr0 = req->data.regs.x86.cr0;
-        vmec.data.regs.x86.cr2 = req->data.regs.x86.cr2;
-        vmec.data.regs.x86.cr3 = req->data.regs.x86.cr3;
-        vmec.data.regs.x86.cr4 = req->data.regs.x86.cr4;
-        vmec.data.regs.x86.sysenter_cs = req->data.regs.x86.sysenter_cs;
-        vmec.data.regs.x86.sysenter_esp = req->data.regs.x86.sysenter_esp;
-        vmec.data.regs.x86.sysenter_eip = req->data.regs.x86.sysenter_eip;
-        vmec.data.regs.x86.msr_efer = req->data.regs.x86.msr_efer;
-        vmec.data.regs.x86.msr_star = req->data.regs.x86.msr_star;
-        vmec.data.regs.x86.msr_lstar = req->data.regs.x86.msr_lstar;
-        vmec.data.regs.x86.fs_base = req->data.regs.x86.fs_base;
-        vmec.data.regs.x86.gs_base = req->data.regs.x86.gs_base;
-        vmec.data.regs.x86.cs_arbytes = req->data.regs.x86.cs_arbytes;
-#endif
-
         switch ( vmec.reason ) {
             case VM_EVENT_REASON_MEM_ACCESS:
                 memcpy(&vmec.mem_access, &req->u.mem_access, sizeof(vmec.mem_access));
@@ -1636,68 +1970,65 @@ status_t process_requests_2(vmi_instance_t vmi, uint32_t *requests_processed)
                 break;
         }
 
+        /* a request the filters drop is answered before its registers are copied */
+        if ( G_UNLIKELY(vmi->event_filters) &&
+                ring_event_dropped(vmi, &vmec, RING_FILTER_REGS(req, 2)) ) {
+            ring_put_response_2(xe, &vmec);
+            processed++;
+            continue;
+        }
+
+#if defined(ARM32) || defined(ARM64)
+        memcpy(&vmec.data.regs.arm, &req->data.regs.arm, sizeof(vmec.data.regs.arm));
+#elif defined(I386) || defined(X86_64)
+        vmec.data.regs.x86.rax = req->data.regs.x86.rax;
+        vmec.data.regs.x86.rcx = req->data.regs.x86.rcx;
+        vmec.data.regs.x86.rdx = req->data.regs.x86.rdx;
+        vmec.data.regs.x86.rbx = req->data.regs.x86.rbx;
+        vmec.data.regs.x86.rsp = req->data.regs.x86.rsp;
+        vmec.data.regs.x86.rbp = req->data.regs.x86.rbp;
+        vmec.data.regs.x86.rsi = req->data.regs.x86.rsi;
+        vmec.data.regs.x86.rdi = req->data.regs.x86.rdi;
+        vmec.data.regs.x86.r8 = req->data.regs.x86.r8;
+        vmec.data.regs.x86.r9 = req->data.regs.x86.r9;
+        vmec.data.regs.x86.r10 = req->data.regs.x86.r10;
+        vmec.data.regs.x86.r11 = req->data.regs.x86.r11;
+        vmec.data.regs.x86.r12 = req->data.regs.x86.r12;
+        vmec.data.regs.x86.r13 = req->data.regs.x86.r13;
+        vmec.data.regs.x86.r14 = req->data.regs.x86.r14;
+        vmec.data.regs.x86.r15 = req->data.regs.x86.r15;
+        vmec.data.regs.x86.rflags = req->data.regs.x86.rflags;
+        vmec.data.regs.x86.dr7 = req->data.regs.x86.dr7;
+        vmec.data.regs.x86.rip = req->data.regs.x86.rip;
+        vmec.data.regs.x86.cr0 = req->data.regs.x86.cr0;
+        vmec.data.regs.x86.cr2 = req->data.regs.x86.cr2;
+        vmec.data.regs.x86.cr3 = req->data.regs.x86.cr3;
+        vmec.data.regs.x86.cr4 = req->data.regs.x86.cr4;
+        vmec.data.regs.x86.sysenter_cs = req->data.regs.x86.sysenter_cs;
+        vmec.data.regs.x86.sysenter_esp = req->data.regs.x86.sysenter_esp;
+        vmec.data.regs.x86.sysenter_eip = req->data.regs.x86.sysenter_eip;
+        vmec.data.regs.x86.msr_efer = req->data.regs.x86.msr_efer;
+        vmec.data.regs.x86.msr_star = req->data.regs.x86.msr_star;
+        vmec.data.regs.x86.msr_lstar = req->data.regs.x86.msr_lstar;
+        vmec.data.regs.x86.fs_base = req->data.regs.x86.fs_base;
+        vmec.data.regs.x86.gs_base = req->data.regs.x86.gs_base;
+        vmec.data.regs.x86.cs_arbytes = req->data.regs.x86.cs_arbytes;
+#endif
+
         vrc = process_request(vmi, &vmec);
 #ifdef ENABLE_SAFETY_CHECKS
         if ( VMI_FAILURE == vrc )
             break;
 #endif
 
-        rsp->version = vmec.version;
-        rsp->vcpu_id = vmec.vcpu_id;
-        rsp->flags = vmec.flags;
-        rsp->reason = vmec.reason;
-        rsp->altp2m_idx = vmec.altp2m_idx;
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
-            rsp->data.emul.read.size = vmec.data.emul.read.size;
-            memcpy(&rsp->data.emul.read.data, &vmec.data.emul.read.data, vmec.data.emul.read.size);
+        if ( xe->deferring ) {
+            xe->deferring = 0;
+            continue;
         }
 
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_INSN_DATA )
-            memcpy(&rsp->data.emul.insn, &vmec.data.emul.insn, sizeof(rsp->data.emul.insn));
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
-#if defined(ARM32) || defined(ARM64)
-            memcpy(&rsp->data.regs.arm, &vmec.data.regs.arm, sizeof(rsp->data.regs.arm));
-#elif defined(I386) || defined(X86_64)
-            rsp->data.regs.x86.rax = vmec.data.regs.x86.rax;
-            rsp->data.regs.x86.rcx = vmec.data.regs.x86.rcx;
-            rsp->data.regs.x86.rdx = vmec.data.regs.x86.rdx;
-            rsp->data.regs.x86.rbx = vmec.data.regs.x86.rbx;
-            rsp->data.regs.x86.rsp = vmec.data.regs.x86.rsp;
-            rsp->data.regs.x86.rbp = vmec.data.regs.x86.rbp;
-            rsp->data.regs.x86.rsi = vmec.data.regs.x86.rsi;
-            rsp->data.regs.x86.rdi = vmec.data.regs.x86.rdi;
-            rsp->data.regs.x86.r8 = vmec.data.regs.x86.r8;
-            rsp->data.regs.x86.r9 = vmec.data.regs.x86.r9;
-            rsp->data.regs.x86.r10 = vmec.data.regs.x86.r10;
-            rsp->data.regs.x86.r11 = vmec.data.regs.x86.r11;
-            rsp->data.regs.x86.r12 = vmec.data.regs.x86.r12;
-            rsp->data.regs.x86.r13 = vmec.data.regs.x86.r13;
-            rsp->data.regs.x86.r14 = vmec.data.regs.x86.r14;
-            rsp->data.regs.x86.r15 = vmec.data.regs.x86.r15;
-            rsp->data.regs.x86.rflags = vmec.data.regs.x86.rflags;
-            rsp->data.regs.x86.dr7 = vmec.data.regs.x86.dr7;
-            rsp->data.regs.x86.rip = vmec.data.regs.x86.rip;
-            rsp->data.regs.x86.cr0 = vmec.data.regs.x86.cr0;
-            rsp->data.regs.x86.cr2 = vmec.data.regs.x86.cr2;
-            rsp->data.regs.x86.cr3 = vmec.data.regs.x86.cr3;
-            rsp->data.regs.x86.cr4 = vmec.data.regs.x86.cr4;
-            rsp->data.regs.x86.sysenter_cs = vmec.data.regs.x86.sysenter_cs;
-            rsp->data.regs.x86.sysenter_esp = vmec.data.regs.x86.sysenter_esp;
-            rsp->data.regs.x86.sysenter_eip = vmec.data.regs.x86.sysenter_eip;
-            rsp->data.regs.x86.msr_efer = vmec.data.regs.x86.msr_efer;
-            rsp->data.regs.x86.msr_star = vmec.data.regs.x86.msr_star;
-            rsp->data.regs.x86.msr_lstar = vmec.data.regs.x86.msr_lstar;
-            rsp->data.regs.x86.fs_base = vmec.data.regs.x86.fs_base;
-            rsp->data.regs.x86.gs_base = vmec.data.regs.x86.gs_base;
-            rsp->data.regs.x86.cs_arbytes = vmec.data.regs.x86.cs_arbytes;
-            rsp->data.regs.x86._pad = 0;
-#endif
-        }
+        ring_put_response_2(xe, &vmec);
 
         processed++;
-        RING_PUSH_RESPONSES(&xe->back_ring_2);
 
         /*
          * Send notification to Xen that response(s) were placed on the ring
@@ -1740,6 +2071,7 @@ status_t init_events_2(vmi_instance_t vmi)
     xen_events_t *xe = xen_get_events(vmi);
 
     xe->process_requests = &process_requests_2;
+    xe->put_response = &ring_put_response_2;
     vmi->driver.are_events_pending_ptr = &xen_are_events_pending_2;
 
     SHARED_RING_INIT((vm_event_2_sring_t *)xe->ring_page);
@@ -1755,38 +2087,98 @@ status_t init_events_2(vmi_instance_t vmi)
  */
 
 static inline
-void ring_get_request_and_response_3(xen_events_t *xe,
-                                     vm_event_3_request_t **req,
-                                     vm_event_3_request_t **rsp)
+void ring_get_request_3(xen_events_t *xe,
+                        vm_event_3_request_t **req)
 {
     vm_event_3_back_ring_t *back_ring = &xe->back_ring_3;
     RING_IDX req_cons = back_ring->req_cons;
-    RING_IDX rsp_prod = back_ring->rsp_prod_pvt;
 
     *req = RING_GET_REQUEST(back_ring, req_cons);
-    *rsp = RING_GET_RESPONSE(back_ring, rsp_prod);
 
     // Update ring positions
     req_cons++;
     back_ring->req_cons = req_cons;
     back_ring->sring->req_event = req_cons + 1;
+}
+
+static
+void ring_put_response_3(xen_events_t *xe, vm_event_compat_t *vmec)
+{
+    vm_event_3_back_ring_t *back_ring = &xe->back_ring_3;
+    vm_event_3_response_t *rsp = RING_GET_RESPONSE(back_ring, back_ring->rsp_prod_pvt);
+
+    rsp->version = vmec->version;
+    rsp->vcpu_id = vmec->vcpu_id;
+    rsp->flags = vmec->flags;
+    rsp->reason = vmec->reason;
+    rsp->altp2m_idx = vmec->altp2m_idx;
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
+        rsp->data.emul.read.size = vmec->data.emul.read.size;
+        memcpy(&rsp->data.emul.read.data, &vmec->data.emul.read.data, vmec->data.emul.read.size);
+    }
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_INSN_DATA )
+        memcpy(&rsp->data.emul.insn, &vmec->data.emul.insn, sizeof(rsp->data.emul.insn));
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
+#if defined(ARM32) || defined(ARM64)
+        memcpy(&rsp->data.regs.arm, &vmec->data.regs.arm, sizeof(rsp->data.regs.arm));
+#elif defined(I386) || defined(X86_64)
+        rsp->data.regs.x86.rax = vmec->data.regs.x86.rax;
+        rsp->data.regs.x86.rcx = vmec->data.regs.x86.rcx;
+        rsp->data.regs.x86.rdx = vmec->data.regs.x86.rdx;
+        rsp->data.regs.x86.rbx = vmec->data.regs.x86.rbx;
+        rsp->data.regs.x86.rsp = vmec->data.regs.x86.rsp;
+        rsp->data.regs.x86.rbp = vmec->data.regs.x86.rbp;
+        rsp->data.regs.x86.rsi = vmec->data.regs.x86.rsi;
+        rsp->data.regs.x86.rdi = vmec->data.regs.x86.rdi;
+        rsp->data.regs.x86.r8 = vmec->data.regs.x86.r8;
+        rsp->data.regs.x86.r9 = vmec->data.regs.x86.r9;
+        rsp->data.regs.x86.r10 = vmec->data.regs.x86.r10;
+        rsp->data.regs.x86.r11 = vmec->data.regs.x86.r11;
+        rsp->data.regs.x86.r12 = vmec->data.regs.x86.r12;
+        rsp->data.regs.x86.r13 = vmec->data.regs.x86.r13;
+        rsp->data.regs.x86.r14 = vmec->data.regs.x86.r14;
+        rsp->data.regs.x86.r15 = vmec->data.regs.x86.r15;
+        rsp->data.regs.x86.rflags = vmec->data.regs.x86.rflags;
+        rsp->data.regs.x86.dr7 = vmec->data.regs.x86.dr7;
+        rsp->data.regs.x86.rip = vmec->data.regs.x86.rip;
+        rsp->data.regs.x86.cr0 = vmec->data.regs.x86.cr0;
+        rsp->data.regs.x86.cr2 = vmec->data.regs.x86.cr2;
+        rsp->data.regs.x86.cr3 = vmec->data.regs.x86.cr3;
+        rsp->data.regs.x86.cr4 = vmec->data.regs.x86.cr4;
+        rsp->data.regs.x86.sysenter_cs = vmec->data.regs.x86.sysenter_cs;
+        rsp->data.regs.x86.sysenter_esp = vmec->data.regs.x86.sysenter_esp;
+        rsp->data.regs.x86.sysenter_eip = vmec->data.regs.x86.sysenter_eip;
+        rsp->data.regs.x86.msr_efer = vmec->data.regs.x86.msr_efer;
+        rsp->data.regs.x86.msr_star = vmec->data.regs.x86.msr_star;
+        rsp->data.regs.x86.msr_lstar = vmec->data.regs.x86.msr_lstar;
+        rsp->data.regs.x86.fs_base = vmec->data.regs.x86.fs_base;
+        rsp->data.regs.x86.gs_base = vmec->data.regs.x86.gs_base;
+        rsp->data.regs.x86.cs_arbytes = vmec->data.regs.x86.cs_arbytes;
+        rsp->data.regs.x86._pad = 0;
+#endif
+    }
+
     back_ring->rsp_prod_pvt++;
+    RING_PUSH_RESPONSES(back_ring);
 }
 
-status_t process_requests_3(vmi_instance_t vmi, uint32_t *requests_processed)
+status_t process_requests_3(vmi_instance_t vmi, uint32_t budget, uint32_t *requests_processed)
 {
     vm_event_3_request_t *req;
-    vm_event_3_response_t *rsp;
     vm_event_compat_t vmec = { 0 };
     xen_events_t *xe = xen_get_events(vmi);
     xen_instance_t *xen = xen_get_instance(vmi);
     int rc;
     status_t vrc = VMI_SUCCESS;
-    uint32_t processed = 0;
+    uint32_t processed = 0, taken = 0;
 
-    while ( RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_3) ) {
+    while ( (!budget || taken < budget) && RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_3) ) {
 
-        ring_get_request_and_response_3(xe, &req, &rsp);
+        ring_get_request_3(xe, &req);
+        taken++;
 
         if ( req->version != 0x00000003 ) {
             errprint("Error, Xen reports a VM_EVENT_INTERFACE_VERSION that is different then what we expect (0x%x != 0x%x)!\n",
@@ -1800,43 +2192,6 @@ status_t process_requests_3(vmi_instance_t vmi, uint32_t *requests_processed)
         vmec.vcpu_id = req->vcpu_id;
         vmec.altp2m_idx = req->altp2m_idx;
 
-#if defined(ARM32) || defined(ARM64)
-        memcpy(&vmec.data.regs.arm, &req->data.regs.arm, sizeof(vmec.data.regs.arm));
-#elif defined(I386) || defined(X86_64)
-        vmec.data.regs.x86.rax = req->data.regs.x86.rax;
-        vmec.data.regs.x86.rcx = req->data.regs.x86.rcx;
-        vmec.data.regs.x86.rdx = req->data.regs.x86.rdx;
-        vmec.data.regs.x86.rbx = req->data.regs.x86.rbx;
-        vmec.data.regs.x86.rsp = req->data.regs.x86.rsp;
-        vmec.data.regs.x86.rbp = req->data.regs.x86.rbp;
-        vmec.data.regs.x86.rsi = req->data.regs.x86.rsi;
-        vmec.data.regs.x86.rdi = req->data.regs.x86.rdi;
-        vmec.data.regs.x86.r8 = req->data.regs.x86.r8;
-        vmec.data.regs.x86.r9 = req->data.regs.x86.r9;
-        vmec.data.regs.x86.r10 = req->data.regs.x86.r10;
-        vmec.data.regs.x86.r11 = req->data.regs.x86.r11;
-        vmec.data.regs.x86.r12 = req->data.regs.x86.r12;
-        vmec.data.regs.x86.r13 = req->data.regs.x86.r13;
-        vmec.data.regs.x86.r14 = req->data.regs.x86.r14;
-        vmec.data.regs.x86.r15 = req->data.regs.x86.r15;
-        vmec.data.regs.x86.rflags = req->data.regs.x86.rflags;
-        vmec.data.regs.x86.dr7 = req->data.regs.x86.dr7;
-        vmec.data.regs.x86.rip = req->data.regs.x86.rip;
-        vmec.data.regs.x86.cr0 = req->data.regs.x86.cr0;
-        vmec.data.regs.x86.cr2 = req->data.regs.x86.cr2;
-        vmec.data.regs.x86.cr3 = req->data.regs.x86.cr3;
-        vmec.data.regs.x86.cr4 = req->data.regs.x86.cr4;
-        vmec.data.regs.x86.sysenter_cs = req->data.regs.x86.sysenter_cs;
-        vmec.data.regs.x86.sysenter_esp = req->data.regs.x86.sysenter_esp;
-        vmec.data.regs.x86.sysenter_eip = req->data.regs.x86.sysenter_eip;
-        vmec.data.regs.x86.msr_efer = req->data.regs.x86.msr_efer;
-        vmec.data.regs.x86.msr_star = req->data.regs.x86.msr_star;
-        vmec.data.regs.x86.msr_lstar = req->data.regs.x86.msr_lstar;
-        vmec.data.regs.x86.fs_base = req->data.regs.x86.fs_base;
-        vmec.data.regs.x86.gs_base = req->data.regs.x86.gs_base;
-        vmec.data.regs.x86.cs_arbytes = req->data.regs.x86.cs_arbytes;
-#endif
-
         switch ( vmec.reason ) {
             case VM_EVENT_REASON_MEM_ACCESS:
                 memcpy(&vmec.mem_access, &req->u.mem_access, sizeof(vmec.mem_access));
@@ -1878,68 +2233,65 @@ status_t process_requests_3(vmi_instance_t vmi, uint32_t *requests_processed)
                 break;
         }
 
+        /* a request the filters drop is answered before its registers are copied */
+        if ( G_UNLIKELY(vmi->event_filters) &&
+                ring_event_dropped(vmi, &vmec, RING_FILTER_REGS(req, 3)) ) {
+            ring_put_response_3(xe, &vmec);
+            processed++;
+            continue;
+        }
+
+#if defined(ARM32) || defined(ARM64)
+        memcpy(&vmec.data.regs.arm, &req->data.regs.arm, sizeof(vmec.data.regs.arm));
+#elif defined(I386) || defined(X86_64)
+        vmec.data.regs.x86.rax = req->data.regs.x86.rax;
+        vmec.data.regs.x86.rcx = req->data.regs.x86.rcx;
+        vmec.data.regs.x86.rdx = req->data.regs.x86.rdx;
+        vmec.data.regs.x86.rbx = req->data.regs.x86.rbx;
+        vmec.data.regs.x86.rsp = req->data.regs.x86.rsp;
+        vmec.data.regs.x86.rbp = req->data.regs.x86.rbp;
+        vmec.data.regs.x86.rsi = req->data.regs.x86.rsi;
+        vmec.data.regs.x86.rdi = req->data.regs.x86.rdi;
+        vmec.data.regs.x86.r8 = req->data.regs.x86.r8;
+        vmec.data.regs.x86.r9 = req->data.regs.x86.r9;
+        vmec.data.regs.x86.r10 = req->data.regs.x86.r10;
+        vmec.data.regs.x86.r11 = req->data.regs.x86.r11;
+        vmec.data.regs.x86.r12 = req->data.regs.x86.r12;
+        vmec.data.regs.x86.r13 = req->data.regs.x86.r13;
+        vmec.data.regs.x86.r14 = req->data.regs.x86.r14;
+        vmec.data.regs.x86.r15 = req->data.regs.x86.r15;
+        vmec.data.regs.x86.rflags = req->data.regs.x86.rflags;
+        vmec.data.regs.x86.dr7 = req->data.regs.x86.dr7;
+        vmec.data.regs.x86.rip = req->data.regs.x86.rip;
+        vmec.data.regs.x86.cr0 = req->data.regs.x86.cr0;
+        vmec.data.regs.x86.cr2 = req->data.regs.x86.cr2;
+        vmec.data.regs.x86.cr3 = req->data.regs.x86.cr3;
+        vmec.data.regs.x86.cr4 = req->data.regs.x86.cr4;
+        vmec.data.regs.x86.sysenter_cs = req->data.regs.x86.sysenter_cs;
+        vmec.data.regs.x86.sysenter_esp = req->data.regs.x86.sysenter_esp;
+        vmec.data.regs.x86.sysenter_eip = req->data.regs.x86.sysenter_eip;
+        vmec.data.regs.x86.msr_efer = req->data.regs.x86.msr_efer;
+        vmec.data.regs.x86.msr_star = req->data.regs.x86.msr_star;
+        vmec.data.regs.x86.msr_lstar = req->data.regs.x86.msr_lstar;
+        vmec.data.regs.x86.fs_base = req->data.regs.x86.fs_base;
+        vmec.data.regs.x86.gs_base = req->data.regs.x86.gs_base;
+        vmec.data.regs.x86.cs_arbytes = req->data.regs.x86.cs_arbytes;
+#endif
+
         vrc = process_request(vmi, &vmec);
 #ifdef ENABLE_SAFETY_CHECKS
         if ( VMI_FAILURE == vrc )
             break;
 #endif
 
-        rsp->version = vmec.version;
-        rsp->vcpu_id = vmec.vcpu_id;
-        rsp->flags = vmec.flags;
-        rsp->reason = vmec.reason;
-        rsp->altp2m_idx = vmec.altp2m_idx;
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
-            rsp->data.emul.read.size = vmec.data.emul.read.size;
-            memcpy(&rsp->data.emul.read.data, &vmec.data.emul.read.data, vmec.data.emul.read.size);
+        if ( xe->deferring ) {
+            xe->deferring = 0;
+            continue;
         }
 
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_INSN_DATA )
-            memcpy(&rsp->data.emul.insn, &vmec.data.emul.insn, sizeof(rsp->data.emul.insn));
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
-#if defined(ARM32) || defined(ARM64)
-            memcpy(&rsp->data.regs.arm, &vmec.data.regs.arm, sizeof(rsp->data.regs.arm));
-#elif defined(I386) || defined(X86_64)
-            rsp->data.regs.x86.rax = vmec.data.regs.x86.rax;
-            rsp->data.regs.x86.rcx = vmec.data.regs.x86.rcx;
-            rsp->data.regs.x86.rdx = vmec.data.regs.x86.rdx;
-            rsp->data.regs.x86.rbx = vmec.data.regs.x86.rbx;
-            rsp->data.regs.x86.rsp = vmec.data.regs.x86.rsp;
-            rsp->data.regs.x86.rbp = vmec.data.regs.x86.rbp;
-            rsp->data.regs.x86.rsi = vmec.data.regs.x86.rsi;
-            rsp->data.regs.x86.rdi = vmec.data.regs.x86.rdi;
-            rsp->data.regs.x86.r8 = vmec.data.regs.x86.r8;
-            rsp->data.regs.x86.r9 = vmec.data.regs.x86.r9;
-            rsp->data.regs.x86.r10 = vmec.data.regs.x86.r10;
-            rsp->data.regs.x86.r11 = vmec.data.regs.x86.r11;
-            rsp->data.regs.x86.r12 = vmec.data.regs.x86.r12;
-            rsp->data.regs.x86.r13 = vmec.data.regs.x86.r13;
-            rsp->data.regs.x86.r14 = vmec.data.regs.x86.r14;
-            rsp->data.regs.x86.r15 = vmec.data.regs.x86.r15;
-            rsp->data.regs.x86.rflags = vmec.data.regs.x86.rflags;
-            rsp->data.regs.x86.dr7 = vmec.data.regs.x86.dr7;
-            rsp->data.regs.x86.rip = vmec.data.regs.x86.rip;
-            rsp->data.regs.x86.cr0 = vmec.data.regs.x86.cr0;
-            rsp->data.regs.x86.cr2 = vmec.data.regs.x86.cr2;
-            rsp->data.regs.x86.cr3 = vmec.data.regs.x86.cr3;
-            rsp->data.regs.x86.cr4 = vmec.data.regs.x86.cr4;
-            rsp->data.regs.x86.sysenter_cs = vmec.data.regs.x86.sysenter_cs;
-            rsp->data.regs.x86.sysenter_esp = vmec.data.regs.x86.sysenter_esp;
-            rsp->data.regs.x86.sysenter_eip = vmec.data.regs.x86.sysenter_eip;
-            rsp->data.regs.x86.msr_efer = vmec.data.regs.x86.msr_efer;
-            rsp->data.regs.x86.msr_star = vmec.data.regs.x86.msr_star;
-            rsp->data.regs.x86.msr_lstar = vmec.data.regs.x86.msr_lstar;
-            rsp->data.regs.x86.fs_base = vmec.data.regs.x86.fs_base;
-            rsp->data.regs.x86.gs_base = vmec.data.regs.x86.gs_base;
-            rsp->data.regs.x86.cs_arbytes = vmec.data.regs.x86.cs_arbytes;
-            rsp->data.regs.x86._pad = 0;
-#endif
-        }
+        ring_put_response_3(xe, &vmec);
 
         processed++;
-        RING_PUSH_RESPONSES(&xe->back_ring_3);
 
         /*
          * Send notification to Xen that response(s) were placed on the ring
@@ -1982,6 +2334,7 @@ status_t init_events_3(vmi_instance_t vmi)
     xen_events_t *xe = xen_get_events(vmi);
 
     xe->process_requests = &process_requests_3;
+    xe->put_response = &ring_put_response_3;
     vmi->driver.are_events_pending_ptr = &xen_are_events_pending_3;
 
     SHARED_RING_INIT((vm_event_3_sring_t *)xe->ring_page);
@@ -1997,38 +2350,121 @@ status_t init_events_3(vmi_instance_t vmi)
  */
 
 static inline
-void ring_get_request_and_response_4(xen_events_t *xe,
-                                     vm_event_4_request_t **req,
-                                     vm_event_4_request_t **rsp)
+void ring_get_request_4(xen_events_t *xe,
+                        vm_event_4_request_t **req)
 {
     vm_event_4_back_ring_t *back_ring = &xe->back_ring_4;
     RING_IDX req_cons = back_ring->req_cons;
-    RING_IDX rsp_prod = back_ring->rsp_prod_pvt;
 
     *req = RING_GET_REQUEST(back_ring, req_cons);
-    *rsp = RING_GET_RESPONSE(back_ring, rsp_prod);
 
     // Update ring positions
     req_cons++;
     back_ring->req_cons = req_cons;
     back_ring->sring->req_event = req_cons + 1;
+}
+
+static
+void ring_put_response_4(xen_events_t *xe, vm_event_compat_t *vmec)
+{
+    vm_event_4_back_ring_t *back_ring = &xe->back_ring_4;
+    vm_event_4_response_t *rsp = RING_GET_RESPONSE(back_ring, back_ring->rsp_prod_pvt);
+
+    rsp->version = vmec->version;
+    rsp->vcpu_id = vmec->vcpu_id;
+    rsp->flags = vmec->flags;
+    rsp->reason = vmec->reason;
+    rsp->altp2m_idx = vmec->altp2m_idx;
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
+        rsp->data.emul.read.size = vmec->data.emul.read.size;
+        memcpy(&rsp->data.emul.read.data, &vmec->data.emul.read.data, vmec->data.emul.read.size);
+    }
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_INSN_DATA )
+        memcpy(&rsp->data.emul.insn, &vmec->data.emul.insn, sizeof(rsp->data.emul.insn));
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
+#if defined(ARM32) || defined(ARM64)
+        memcpy(&rsp->data.regs.arm, &vmec->data.regs.arm, sizeof(rsp->data.regs.arm));
+#elif defined(I386) || defined(X86_64)
+        rsp->data.regs.x86.rax = vmec->data.regs.x86.rax;
+        rsp->data.regs.x86.rcx = vmec->data.regs.x86.rcx;
+        rsp->data.regs.x86.rdx = vmec->data.regs.x86.rdx;
+        rsp->data.regs.x86.rbx = vmec->data.regs.x86.rbx;
+        rsp->data.regs.x86.rsp = vmec->data.regs.x86.rsp;
+        rsp->data.regs.x86.rbp = vmec->data.regs.x86.rbp;
+        rsp->data.regs.x86.rsi = vmec->data.regs.x86.rsi;
+        rsp->data.regs.x86.rdi = vmec->data.regs.x86.rdi;
+        rsp->data.regs.x86.r8 = vmec->data.regs.x86.r8;
+        rsp->data.regs.x86.r9 = vmec->data.regs.x86.r9;
+        rsp->data.regs.x86.r10 = vmec->data.regs.x86.r10;
+        rsp->data.regs.x86.r11 = vmec->data.regs.x86.r11;
+        rsp->data.regs.x86.r12 = vmec->data.regs.x86.r12;
+        rsp->data.regs.x86.r13 = vmec->data.regs.x86.r13;
+        rsp->data.regs.x86.r14 = vmec->data.regs.x86.r14;
+        rsp->data.regs.x86.r15 = vmec->data.regs.x86.r15;
+        rsp->data.regs.x86.rflags = vmec->data.regs.x86.rflags;
+        rsp->data.regs.x86.dr6 = vmec->data.regs.x86.dr6;
+        rsp->data.regs.x86.dr7 = vmec->data.regs.x86.dr7;
+        rsp->data.regs.x86.rip = vmec->data.regs.x86.rip;
+        rsp->data.regs.x86.cr0 = vmec->data.regs.x86.cr0;
+        rsp->data.regs.x86.cr2 = vmec->data.regs.x86.cr2;
+        rsp->data.regs.x86.cr3 = vmec->data.regs.x86.cr3;
+        rsp->data.regs.x86.cr4 = vmec->data.regs.x86.cr4;
+        rsp->data.regs.x86.sysenter_cs = vmec->data.regs.x86.sysenter_cs;
+        rsp->data.regs.x86.sysenter_esp = vmec->data.regs.x86.sysenter_esp;
+        rsp->data.regs.x86.sysenter_eip = vmec->data.regs.x86.sysenter_eip;
+        rsp->data.regs.x86.msr_efer = vmec->data.regs.x86.msr_efer;
+        rsp->data.regs.x86.msr_star = vmec->data.regs.x86.msr_star;
+        rsp->data.regs.x86.msr_lstar = vmec->data.regs.x86.msr_lstar;
+        rsp->data.regs.x86.shadow_gs = vmec->data.regs.x86.shadow_gs;
+        rsp->data.regs.x86.fs_base = vmec->data.regs.x86.fs_base;
+        rsp->data.regs.x86.fs_sel = vmec->data.regs.x86.fs_sel;
+        rsp->data.regs.x86.fs.ar = vmec->data.regs.x86.fs_arbytes;
+        rsp->data.regs.x86.fs.limit = vmec->data.regs.x86.fs_limit;
+        rsp->data.regs.x86.gs_base = vmec->data.regs.x86.gs_base;
+        rsp->data.regs.x86.gs_sel = vmec->data.regs.x86.gs_sel;
+        rsp->data.regs.x86.gs.ar = vmec->data.regs.x86.gs_arbytes;
+        rsp->data.regs.x86.gs.limit = vmec->data.regs.x86.gs_limit;
+        rsp->data.regs.x86.cs_base = vmec->data.regs.x86.cs_base;
+        rsp->data.regs.x86.cs_sel = vmec->data.regs.x86.cs_sel;
+        rsp->data.regs.x86.cs.ar = vmec->data.regs.x86.cs_arbytes;
+        rsp->data.regs.x86.cs.limit = vmec->data.regs.x86.cs_limit;
+        rsp->data.regs.x86.ds_base = vmec->data.regs.x86.ds_base;
+        rsp->data.regs.x86.ds_sel = vmec->data.regs.x86.ds_sel;
+        rsp->data.regs.x86.ds.ar = vmec->data.regs.x86.ds_arbytes;
+        rsp->data.regs.x86.ds.limit = vmec->data.regs.x86.ds_limit;
+        rsp->data.regs.x86.es_base = vmec->data.regs.x86.es_base;
+        rsp->data.regs.x86.es_sel = vmec->data.regs.x86.es_sel;
+        rsp->data.regs.x86.es.ar = vmec->data.regs.x86.es_arbytes;
+        rsp->data.regs.x86.es.limit = vmec->data.regs.x86.es_limit;
+        rsp->data.regs.x86.ss_base = vmec->data.regs.x86.ss_base;
+        rsp->data.regs.x86.ss_sel = vmec->data.regs.x86.ss_sel;
+        rsp->data.regs.x86.ss.ar = vmec->data.regs.x86.ss_arbytes;
+        rsp->data.regs.x86.ss.limit = vmec->data.regs.x86.ss_limit;
+        rsp->data.regs.x86._pad = 0;
+#endif
+    }
+
     back_ring->rsp_prod_pvt++;
+    RING_PUSH_RESPONSES(back_ring);
 }
 
-status_t process_requests_4(vmi_instance_t vmi, uint32_t *requests_processed)
+status_t process_requests_4(vmi_instance_t vmi, uint32_t budget, uint32_t *requests_processed)
 {
     vm_event_4_request_t *req;
-    vm_event_4_response_t *rsp;
     vm_event_compat_t vmec = { 0 };
     xen_events_t *xe = xen_get_events(vmi);
     xen_instance_t *xen = xen_get_instance(vmi);
     int rc;
     status_t vrc = VMI_SUCCESS;
-    uint32_t processed = 0;
+    uint32_t processed = 0, taken = 0;
 
-    while ( RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_4) ) {
+    while ( (!budget || taken < budget) && RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_4) ) {
 
-        ring_get_request_and_response_4(xe, &req, &rsp);
+        ring_get_request_4(xe, &req);
+        taken++;
 
         if ( req->version != 0x00000004 ) {
             errprint("Error, Xen reports a VM_EVENT_INTERFACE_VERSION that is different then what we expect (0x%x != 0x%x)!\n",
@@ -2042,6 +2478,55 @@ status_t process_requests_4(vmi_instance_t vmi, uint32_t *requests_processed)
         vmec.vcpu_id = req->vcpu_id;
         vmec.altp2m_idx = req->altp2m_idx;
 
+        switch ( vmec.reason ) {
+            case VM_EVENT_REASON_MEM_ACCESS:
+                memcpy(&vmec.mem_access, &req->u.mem_access, sizeof(vmec.mem_access));
+                break;
+
+            case VM_EVENT_REASON_WRITE_CTRLREG:
+                memcpy(&vmec.write_ctrlreg, &req->u.write_ctrlreg, sizeof(vmec.write_ctrlreg));
+                break;
+
+            case VM_EVENT_REASON_MOV_TO_MSR:
+                memcpy(&vmec.mov_to_msr, &req->u.mov_to_msr, sizeof(vmec.mov_to_msr));
+                break;
+
+            case VM_EVENT_REASON_SINGLESTEP:
+                memcpy(&vmec.singlestep, &req->u.singlestep, sizeof(vmec.singlestep));
+                break;
+
+            case VM_EVENT_REASON_SOFTWARE_BREAKPOINT:
+                vmec.software_breakpoint.gfn = req->u.software_breakpoint.gfn;
+                vmec.software_breakpoint.insn_length = req->u.software_breakpoint.insn_length;
+                break;
+
+            case VM_EVENT_REASON_INTERRUPT:
+                memcpy(&vmec.x86_interrupt, &req->u.interrupt.x86, sizeof(vmec.x86_interrupt));
+                break;
+
+            case VM_EVENT_REASON_DEBUG_EXCEPTION:
+                vmec.debug_exception.gfn = req->u.debug_exception.gfn;
+                vmec.debug_exception.insn_length = req->u.debug_exception.insn_length;
+                vmec.debug_exception.type = req->u.debug_exception.type;
+                break;
+
+            case VM_EVENT_REASON_CPUID:
+                memcpy(&vmec.cpuid, &req->u.cpuid, sizeof(vmec.cpuid));
+                break;
+
+            case VM_EVENT_REASON_DESCRIPTOR_ACCESS:
+                memcpy(&vmec.desc_access, &req->u.desc_access, sizeof(vmec.desc_access));
+                break;
+        }
+
+        /* a request the filters drop is answered before its registers are copied */
+        if ( G_UNLIKELY(vmi->event_filters) &&
+                ring_event_dropped(vmi, &vmec, RING_FILTER_REGS(req, 4)) ) {
+            ring_put_response_4(xe, &vmec);
+            processed++;
+            continue;
+        }
+
 #if defined(ARM32) || defined(ARM64)
         memcpy(&vmec.data.regs.arm, &req->data.regs.arm, sizeof(vmec.data.regs.arm));
 #elif defined(I386) || defined(X86_64)
@@ -2102,132 +2587,20 @@ status_t process_requests_4(vmi_instance_t vmi, uint32_t *requests_processed)
         vmec.data.regs.x86.ss_arbytes = req->data.regs.x86.ss.ar;
 #endif
 
-        switch ( vmec.reason ) {
-            case VM_EVENT_REASON_MEM_ACCESS:
-                memcpy(&vmec.mem_access, &req->u.mem_access, sizeof(vmec.mem_access));
-                break;
-
-            case VM_EVENT_REASON_WRITE_CTRLREG:
-                memcpy(&vmec.write_ctrlreg, &req->u.write_ctrlreg, sizeof(vmec.write_ctrlreg));
-                break;
-
-            case VM_EVENT_REASON_MOV_TO_MSR:
-                memcpy(&vmec.mov_to_msr, &req->u.mov_to_msr, sizeof(vmec.mov_to_msr));
-                break;
-
-            case VM_EVENT_REASON_SINGLESTEP:
-                memcpy(&vmec.singlestep, &req->u.singlestep, sizeof(vmec.singlestep));
-                break;
-
-            case VM_EVENT_REASON_SOFTWARE_BREAKPOINT:
-                vmec.software_breakpoint.gfn = req->u.software_breakpoint.gfn;
-                vmec.software_breakpoint.insn_length = req->u.software_breakpoint.insn_length;
-                break;
-
-            case VM_EVENT_REASON_INTERRUPT:
-                memcpy(&vmec.x86_interrupt, &req->u.interrupt.x86, sizeof(vmec.x86_interrupt));
-                break;
-
-            case VM_EVENT_REASON_DEBUG_EXCEPTION:
-                vmec.debug_exception.gfn = req->u.debug_exception.gfn;
-                vmec.debug_exception.insn_length = req->u.debug_exception.insn_length;
-                vmec.debug_exception.type = req->u.debug_exception.type;
-                break;
-
-            case VM_EVENT_REASON_CPUID:
-                memcpy(&vmec.cpuid, &req->u.cpuid, sizeof(vmec.cpuid));
-                break;
-
-            case VM_EVENT_REASON_DESCRIPTOR_ACCESS:
-                memcpy(&vmec.desc_access, &req->u.desc_access, sizeof(vmec.desc_access));
-                break;
-        }
-
         vrc = process_request(vmi, &vmec);
 #ifdef ENABLE_SAFETY_CHECKS
         if ( VMI_FAILURE == vrc )
             break;
 #endif
 
-        rsp->version = vmec.version;
-        rsp->vcpu_id = vmec.vcpu_id;
-        rsp->flags = vmec.flags;
-        rsp->reason = vmec.reason;
-        rsp->altp2m_idx = vmec.altp2m_idx;
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
-            rsp->data.emul.read.size = vmec.data.emul.read.size;
-            memcpy(&rsp->data.emul.read.data, &vmec.data.emul.read.data, vmec.data.emul.read.size);
+        if ( xe->deferring ) {
+            xe->deferring = 0;
+            continue;
         }
 
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_INSN_DATA )
-            memcpy(&rsp->data.emul.insn, &vmec.data.emul.insn, sizeof(rsp->data.emul.insn));
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
-#if defined(ARM32) || defined(ARM64)
-            memcpy(&rsp->data.regs.arm, &vmec.data.regs.arm, sizeof(rsp->data.regs.arm));
-#elif defined(I386) || defined(X86_64)
-            rsp->data.regs.x86.rax = vmec.data.regs.x86.rax;
-            rsp->data.regs.x86.rcx = vmec.data.regs.x86.rcx;
-            rsp->data.regs.x86.rdx = vmec.data.regs.x86.rdx;
-            rsp->data.regs.x86.rbx = vmec.data.regs.x86.rbx;
-            rsp->data.regs.x86.rsp = vmec.data.regs.x86.rsp;
-            rsp->data.regs.x86.rbp = vmec.data.regs.x86.rbp;
-            rsp->data.regs.x86.rsi = vmec.data.regs.x86.rsi;
-            rsp->data.regs.x86.rdi = vmec.data.regs.x86.rdi;
-            rsp->data.regs.x86.r8 = vmec.data.regs.x86.r8;
-            rsp->data.regs.x86.r9 = vmec.data.regs.x86.r9;
-            rsp->data.regs.x86.r10 = vmec.data.regs.x86.r10;
-            rsp->data.regs.x86.r11 = vmec.data.regs.x86.r11;
-            rsp->data.regs.x86.r12 = vmec.data.regs.x86.r12;
-            rsp->data.regs.x86.r13 = vmec.data.regs.x86.r13;
-            rsp->data.regs.x86.r14 = vmec.data.regs.x86.r14;
-            rsp->data.regs.x86.r15 = vmec.data.regs.x86.r15;
-            rsp->data.regs.x86.rflags = vmec.data.regs.x86.rflags;
-            rsp->data.regs.x86.dr6 = vmec.data.regs.x86.dr6;
-            rsp->data.regs.x86.dr7 = vmec.data.regs.x86.dr7;
-            rsp->data.regs.x86.rip = vmec.data.regs.x86.rip;
-            rsp->data.regs.x86.cr0 = vmec.data.regs.x86.cr0;
-            rsp->data.regs.x86.cr2 = vmec.data.regs.x86.cr2;
-            rsp->data.regs.x86.cr3 = vmec.data.regs.x86.cr3;
-            rsp->data.regs.x86.cr4 = vmec.data.regs.x86.cr4;
-            rsp->data.regs.x86.sysenter_cs = vmec.data.regs.x86.sysenter_cs;
-            rsp->data.regs.x86.sysenter_esp = vmec.data.regs.x86.sysenter_esp;
-            rsp->data.regs.x86.sysenter_eip = vmec.data.regs.x86.sysenter_eip;
-            rsp->data.regs.x86.msr_efer = vmec.data.regs.x86.msr_efer;
-            rsp->data.regs.x86.msr_star = vmec.data.regs.x86.msr_star;
-            rsp->data.regs.x86.msr_lstar = vmec.data.regs.x86.msr_lstar;
-            rsp->data.regs.x86.shadow_gs = vmec.data.regs.x86.shadow_gs;
-            rsp->data.regs.x86.fs_base = vmec.data.regs.x86.fs_base;
-            rsp->data.regs.x86.fs_sel = vmec.data.regs.x86.fs_sel;
-            rsp->data.regs.x86.fs.ar = vmec.data.regs.x86.fs_arbytes;
-            rsp->data.regs.x86.fs.limit = vmec.data.regs.x86.fs_limit;
-            rsp->data.regs.x86.gs_base = vmec.data.regs.x86.gs_base;
-            rsp->data.regs.x86.gs_sel = vmec.data.regs.x86.gs_sel;
-            rsp->data.regs.x86.gs.ar = vmec.data.regs.x86.gs_arbytes;
-            rsp->data.regs.x86.gs.limit = vmec.data.regs.x86.gs_limit;
-            rsp->data.regs.x86.cs_base = vmec.data.regs.x86.cs_base;
-            rsp->data.regs.x86.cs_sel = vmec.data.regs.x86.cs_sel;
-            rsp->data.regs.x86.cs.ar = vmec.data.regs.x86.cs_arbytes;
-            rsp->data.regs.x86.cs.limit = vmec.data.regs.x86.cs_limit;
-            rsp->data.regs.x86.ds_base = vmec.data.regs.x86.ds_base;
-            rsp->data.regs.x86.ds_sel = vmec.data.regs.x86.ds_sel;
-            rsp->data.regs.x86.ds.ar = vmec.data.regs.x86.ds_arbytes;
-            rsp->data.regs.x86.ds.limit = vmec.data.regs.x86.ds_limit;
-            rsp->data.regs.x86.es_base = vmec.data.regs.x86.es_base;
-            rsp->data.regs.x86.es_sel = vmec.data.regs.x86.es_sel;
-            rsp->data.regs.x86.es.ar = vmec.data.regs.x86.es_arbytes;
-            rsp->data.regs.x86.es.limit = vmec.data.regs.x86.es_limit;
-            rsp->data.regs.x86.ss_base = vmec.data.regs.x86.ss_base;
-            rsp->data.regs.x86.ss_sel = vmec.data.regs.x86.ss_sel;
-            rsp->data.regs.x86.ss.ar = vmec.data.regs.x86.ss_arbytes;
-            rsp->data.regs.x86.ss.limit = vmec.data.regs.x86.ss_limit;
-            rsp->data.regs.x86._pad = 0;
-#endif
-        }
+        ring_put_response_4(xe, &vmec);
 
         processed++;
-        RING_PUSH_RESPONSES(&xe->back_ring_4);
 
         /*
          * Send notification to Xen that response(s) were placed on the ring
@@ -2270,6 +2643,7 @@ status_t init_events_4(vmi_instance_t vmi)
     xen_events_t *xe = xen_get_events(vmi);
 
     xe->process_requests = &process_requests_4;
+    xe->put_response = &ring_put_response_4;
     vmi->driver.are_events_pending_ptr = &xen_are_events_pending_4;
 
     SHARED_RING_INIT((vm_event_4_sring_t *)xe->ring_page);
@@ -2285,38 +2659,123 @@ status_t init_events_4(vmi_instance_t vmi)
  */
 
 static inline
-void ring_get_request_and_response_5(xen_events_t *xe,
-                                     vm_event_5_request_t **req,
-                                     vm_event_5_request_t **rsp)
+void ring_get_request_5(xen_events_t *xe,
+                        vm_event_5_request_t **req)
 {
     vm_event_5_back_ring_t *back_ring = &xe->back_ring_5;
     RING_IDX req_cons = back_ring->req_cons;
-    RING_IDX rsp_prod = back_ring->rsp_prod_pvt;
 
     *req = RING_GET_REQUEST(back_ring, req_cons);
-    *rsp = RING_GET_RESPONSE(back_ring, rsp_prod);
 
     // Update ring positions
     req_cons++;
     back_ring->req_cons = req_cons;
     back_ring->sring->req_event = req_cons + 1;
+}
+
+static
+void ring_put_response_5(xen_events_t *xe, vm_event_compat_t *vmec)
+{
+    vm_event_5_back_ring_t *back_ring = &xe->back_ring_5;
+    vm_event_5_response_t *rsp = RING_GET_RESPONSE(back_ring, back_ring->rsp_prod_pvt);
+
+    rsp->version = vmec->version;
+    rsp->vcpu_id = vmec->vcpu_id;
+    rsp->flags = vmec->flags;
+    rsp->reason = vmec->reason;
+    rsp->altp2m_idx = vmec->altp2m_idx;
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
+        rsp->data.emul.read.size = vmec->data.emul.read.size;
+        memcpy(&rsp->data.emul.read.data, &vmec->data.emul.read.data, vmec->data.emul.read.size);
+    }
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_INSN_DATA )
+        memcpy(&rsp->data.emul.insn, &vmec->data.emul.insn, sizeof(rsp->data.emul.insn));
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
+#if defined(ARM32) || defined(ARM64)
+        memcpy(&rsp->data.regs.arm, &vmec->data.regs.arm, sizeof(rsp->data.regs.arm));
+#elif defined(I386) || defined(X86_64)
+        rsp->data.regs.x86.rax = vmec->data.regs.x86.rax;
+        rsp->data.regs.x86.rcx = vmec->data.regs.x86.rcx;
+        rsp->data.regs.x86.rdx = vmec->data.regs.x86.rdx;
+        rsp->data.regs.x86.rbx = vmec->data.regs.x86.rbx;
+        rsp->data.regs.x86.rsp = vmec->data.regs.x86.rsp;
+        rsp->data.regs.x86.rbp = vmec->data.regs.x86.rbp;
+        rsp->data.regs.x86.rsi = vmec->data.regs.x86.rsi;
+        rsp->data.regs.x86.rdi = vmec->data.regs.x86.rdi;
+        rsp->data.regs.x86.r8 = vmec->data.regs.x86.r8;
+        rsp->data.regs.x86.r9 = vmec->data.regs.x86.r9;
+        rsp->data.regs.x86.r10 = vmec->data.regs.x86.r10;
+        rsp->data.regs.x86.r11 = vmec->data.regs.x86.r11;
+        rsp->data.regs.x86.r12 = vmec->data.regs.x86.r12;
+        rsp->data.regs.x86.r13 = vmec->data.regs.x86.r13;
+        rsp->data.regs.x86.r14 = vmec->data.regs.x86.r14;
+        rsp->data.regs.x86.r15 = vmec->data.regs.x86.r15;
+        rsp->data.regs.x86.rflags = vmec->data.regs.x86.rflags;
+        rsp->data.regs.x86.dr6 = vmec->data.regs.x86.dr6;
+        rsp->data.regs.x86.dr7 = vmec->data.regs.x86.dr7;
+        rsp->data.regs.x86.rip = vmec->data.regs.x86.rip;
+        rsp->data.regs.x86.cr0 = vmec->data.regs.x86.cr0;
+        rsp->data.regs.x86.cr2 = vmec->data.regs.x86.cr2;
+        rsp->data.regs.x86.cr3 = vmec->data.regs.x86.cr3;
+        rsp->data.regs.x86.cr4 = vmec->data.regs.x86.cr4;
+        rsp->data.regs.x86.sysenter_cs = vmec->data.regs.x86.sysenter_cs;
+        rsp->data.regs.x86.sysenter_esp = vmec->data.regs.x86.sysenter_esp;
+        rsp->data.regs.x86.sysenter_eip = vmec->data.regs.x86.sysenter_eip;
+        rsp->data.regs.x86.msr_efer = vmec->data.regs.x86.msr_efer;
+        rsp->data.regs.x86.msr_star = vmec->data.regs.x86.msr_star;
+        rsp->data.regs.x86.msr_lstar = vmec->data.regs.x86.msr_lstar;
+        rsp->data.regs.x86.gdtr_base = vmec->data.regs.x86.gdtr_base;
+        rsp->data.regs.x86.gdtr_limit = vmec->data.regs.x86.gdtr_limit;
+        rsp->data.regs.x86.shadow_gs = vmec->data.regs.x86.shadow_gs;
+        rsp->data.regs.x86.fs_base = vmec->data.regs.x86.fs_base;
+        rsp->data.regs.x86.fs_sel = vmec->data.regs.x86.fs_sel;
+        rsp->data.regs.x86.fs.ar = vmec->data.regs.x86.fs_arbytes;
+        rsp->data.regs.x86.fs.limit = vmec->data.regs.x86.fs_limit;
+        rsp->data.regs.x86.gs_base = vmec->data.regs.x86.gs_base;
+        rsp->data.regs.x86.gs_sel = vmec->data.regs.x86.gs_sel;
+        rsp->data.regs.x86.gs.ar = vmec->data.regs.x86.gs_arbytes;
+        rsp->data.regs.x86.gs.limit = vmec->data.regs.x86.gs_limit;
+        rsp->data.regs.x86.cs_base = vmec->data.regs.x86.cs_base;
+        rsp->data.regs.x86.cs_sel = vmec->data.regs.x86.cs_sel;
+        rsp->data.regs.x86.cs.ar = vmec->data.regs.x86.cs_arbytes;
+        rsp->data.regs.x86.cs.limit = vmec->data.regs.x86.cs_limit;
+        rsp->data.regs.x86.ds_base = vmec->data.regs.x86.ds_base;
+        rsp->data.regs.x86.ds_sel = vmec->data.regs.x86.ds_sel;
+        rsp->data.regs.x86.ds.ar = vmec->data.regs.x86.ds_arbytes;
+        rsp->data.regs.x86.ds.limit = vmec->data.regs.x86.ds_limit;
+        rsp->data.regs.x86.es_base = vmec->data.regs.x86.es_base;
+        rsp->data.regs.x86.es_sel = vmec->data.regs.x86.es_sel;
+        rsp->data.regs.x86.es.ar = vmec->data.regs.x86.es_arbytes;
+        rsp->data.regs.x86.es.limit = vmec->data.regs.x86.es_limit;
+        rsp->data.regs.x86.ss_base = vmec->data.regs.x86.ss_base;
+        rsp->data.regs.x86.ss_sel = vmec->data.regs.x86.ss_sel;
+        rsp->data.regs.x86.ss.ar = vmec->data.regs.x86.ss_arbytes;
+        rsp->data.regs.x86.ss.limit = vmec->data.regs.x86.ss_limit;
+        rsp->data.regs.x86._pad = 0;
+#endif
+    }
+
     back_ring->rsp_prod_pvt++;
+    RING_PUSH_RESPONSES(back_ring);
 }
 
-status_t process_requests_5(vmi_instance_t vmi, uint32_t *requests_processed)
+status_t process_requests_5(vmi_instance_t vmi, uint32_t budget, uint32_t *requests_processed)
 {
     vm_event_5_request_t *req;
-    vm_event_5_response_t *rsp;
     vm_event_compat_t vmec = { 0 };
     xen_events_t *xe = xen_get_events(vmi);
     xen_instance_t *xen = xen_get_instance(vmi);
     int rc;
     status_t vrc = VMI_SUCCESS;
-    uint32_t processed = 0;
+    uint32_t processed = 0, taken = 0;
 
-    while ( RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_5) ) {
+    while ( (!budget || taken < budget) && RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_5) ) {
 
-        ring_get_request_and_response_5(xe, &req, &rsp);
+        ring_get_request_5(xe, &req);
+        taken++;
 
         if ( req->version != 0x00000005 ) {
             errprint("Error, Xen reports a VM_EVENT_INTERFACE_VERSION that is different then what we expect (0x%x > 0x%x)!\n",
@@ -2330,6 +2789,55 @@ status_t process_requests_5(vmi_instance_t vmi, uint32_t *requests_processed)
         vmec.vcpu_id = req->vcpu_id;
         vmec.altp2m_idx = req->altp2m_idx;
 
+        switch ( vmec.reason ) {
+            case VM_EVENT_REASON_MEM_ACCESS:
+                memcpy(&vmec.mem_access, &req->u.mem_access, sizeof(vmec.mem_access));
+                break;
+
+            case VM_EVENT_REASON_WRITE_CTRLREG:
+                memcpy(&vmec.write_ctrlreg, &req->u.write_ctrlreg, sizeof(vmec.write_ctrlreg));
+                break;
+
+            case VM_EVENT_REASON_MOV_TO_MSR:
+                memcpy(&vmec.mov_to_msr, &req->u.mov_to_msr, sizeof(vmec.mov_to_msr));
+                break;
+
+            case VM_EVENT_REASON_SINGLESTEP:
+                memcpy(&vmec.singlestep, &req->u.singlestep, sizeof(vmec.singlestep));
+                break;
+
+            case VM_EVENT_REASON_SOFTWARE_BREAKPOINT:
+                vmec.software_breakpoint.gfn = req->u.software_breakpoint.gfn;
+                vmec.software_breakpoint.insn_length = req->u.software_breakpoint.insn_length;
+                break;
+
+            case VM_EVENT_REASON_INTERRUPT:
+                memcpy(&vmec.x86_interrupt, &req->u.interrupt.x86, sizeof(vmec.x86_interrupt));
+                break;
+
+            case VM_EVENT_REASON_DEBUG_EXCEPTION:
+                vmec.debug_exception.gfn = req->u.debug_exception.gfn;
+                vmec.debug_exception.insn_length = req->u.debug_exception.insn_length;
+                vmec.debug_exception.type = req->u.debug_exception.type;
+                break;
+
+            case VM_EVENT_REASON_CPUID:
+                memcpy(&vmec.cpuid, &req->u.cpuid, sizeof(vmec.cpuid));
+                break;
+
+            case VM_EVENT_REASON_DESCRIPTOR_ACCESS:
+                memcpy(&vmec.desc_access, &req->u.desc_access, sizeof(vmec.desc_access));
+                break;
+        }
+
+        /* a request the filters drop is answered before its registers are copied */
+        if ( G_UNLIKELY(vmi->event_filters) &&
+                ring_event_dropped(vmi, &vmec, RING_FILTER_REGS(req, 5)) ) {
+            ring_put_response_5(xe, &vmec);
+            processed++;
+            continue;
+        }
+
 #if defined(ARM32) || defined(ARM64)
         memcpy(&vmec.data.regs.arm, &req->data.regs.arm, sizeof(vmec.data.regs.arm));
 #elif defined(I386) || defined(X86_64)
@@ -2392,134 +2900,20 @@ status_t process_requests_5(vmi_instance_t vmi, uint32_t *requests_processed)
         vmec.data.regs.x86.ss_arbytes = req->data.regs.x86.ss.ar;
 #endif
 
-        switch ( vmec.reason ) {
-            case VM_EVENT_REASON_MEM_ACCESS:
-                memcpy(&vmec.mem_access, &req->u.mem_access, sizeof(vmec.mem_access));
-                break;
-
-            case VM_EVENT_REASON_WRITE_CTRLREG:
-                memcpy(&vmec.write_ctrlreg, &req->u.write_ctrlreg, sizeof(vmec.write_ctrlreg));
-                break;
-
-            case VM_EVENT_REASON_MOV_TO_MSR:
-                memcpy(&vmec.mov_to_msr, &req->u.mov_to_msr, sizeof(vmec.mov_to_msr));
-                break;
-
-            case VM_EVENT_REASON_SINGLESTEP:
-                memcpy(&vmec.singlestep, &req->u.singlestep, sizeof(vmec.singlestep));
-                break;
-
-            case VM_EVENT_REASON_SOFTWARE_BREAKPOINT:
-                vmec.software_breakpoint.gfn = req->u.software_breakpoint.gfn;
-                vmec.software_breakpoint.insn_length = req->u.software_breakpoint.insn_length;
-                break;
-
-            case VM_EVENT_REASON_INTERRUPT:
-                memcpy(&vmec.x86_interrupt, &req->u.interrupt.x86, sizeof(vmec.x86_interrupt));
-                break;
-
-            case VM_EVENT_REASON_DEBUG_EXCEPTION:
-                vmec.debug_exception.gfn = req->u.debug_exception.gfn;
-                vmec.debug_exception.insn_length = req->u.debug_exception.insn_length;
-                vmec.debug_exception.type = req->u.debug_exception.type;
-                break;
-
-            case VM_EVENT_REASON_CPUID:
-                memcpy(&vmec.cpuid, &req->u.cpuid, sizeof(vmec.cpuid));
-                break;
-
-            case VM_EVENT_REASON_DESCRIPTOR_ACCESS:
-                memcpy(&vmec.desc_access, &req->u.desc_access, sizeof(vmec.desc_access));
-                break;
-        }
-
         vrc = process_request(vmi, &vmec);
 #ifdef ENABLE_SAFETY_CHECKS
-        if ( VMI_FAILURE == vrc )
-            break;
-#endif
-
-        rsp->version = vmec.version;
-        rsp->vcpu_id = vmec.vcpu_id;
-        rsp->flags = vmec.flags;
-        rsp->reason = vmec.reason;
-        rsp->altp2m_idx = vmec.altp2m_idx;
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
-            rsp->data.emul.read.size = vmec.data.emul.read.size;
-            memcpy(&rsp->data.emul.read.data, &vmec.data.emul.read.data, vmec.data.emul.read.size);
-        }
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_INSN_DATA )
-            memcpy(&rsp->data.emul.insn, &vmec.data.emul.insn, sizeof(rsp->data.emul.insn));
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
-#if defined(ARM32) || defined(ARM64)
-            memcpy(&rsp->data.regs.arm, &vmec.data.regs.arm, sizeof(rsp->data.regs.arm));
-#elif defined(I386) || defined(X86_64)
-            rsp->data.regs.x86.rax = vmec.data.regs.x86.rax;
-            rsp->data.regs.x86.rcx = vmec.data.regs.x86.rcx;
-            rsp->data.regs.x86.rdx = vmec.data.regs.x86.rdx;
-            rsp->data.regs.x86.rbx = vmec.data.regs.x86.rbx;
-            rsp->data.regs.x86.rsp = vmec.data.regs.x86.rsp;
-            rsp->data.regs.x86.rbp = vmec.data.regs.x86.rbp;
-            rsp->data.regs.x86.rsi = vmec.data.regs.x86.rsi;
-            rsp->data.regs.x86.rdi = vmec.data.regs.x86.rdi;
-            rsp->data.regs.x86.r8 = vmec.data.regs.x86.r8;
-            rsp->data.regs.x86.r9 = vmec.data.regs.x86.r9;
-            rsp->data.regs.x86.r10 = vmec.data.regs.x86.r10;
-            rsp->data.regs.x86.r11 = vmec.data.regs.x86.r11;
-            rsp->data.regs.x86.r12 = vmec.data.regs.x86.r12;
-            rsp->data.regs.x86.r13 = vmec.data.regs.x86.r13;
-            rsp->data.regs.x86.r14 = vmec.data.regs.x86.r14;
-            rsp->data.regs.x86.r15 = vmec.data.regs.x86.r15;
-            rsp->data.regs.x86.rflags = vmec.data.regs.x86.rflags;
-            rsp->data.regs.x86.dr6 = vmec.data.regs.x86.dr6;
-            rsp->data.regs.x86.dr7 = vmec.data.regs.x86.dr7;
-            rsp->data.regs.x86.rip = vmec.data.regs.x86.rip;
-            rsp->data.regs.x86.cr0 = vmec.data.regs.x86.cr0;
-            rsp->data.regs.x86.cr2 = vmec.data.regs.x86.cr2;
-            rsp->data.regs.x86.cr3 = vmec.data.regs.x86.cr3;
-            rsp->data.regs.x86.cr4 = vmec.data.regs.x86.cr4;
-            rsp->data.regs.x86.sysenter_cs = vmec.data.regs.x86.sysenter_cs;
-            rsp->data.regs.x86.sysenter_esp = vmec.data.regs.x86.sysenter_esp;
-            rsp->data.regs.x86.sysenter_eip = vmec.data.regs.x86.sysenter_eip;
-            rsp->data.regs.x86.msr_efer = vmec.data.regs.x86.msr_efer;
-            rsp->data.regs.x86.msr_star = vmec.data.regs.x86.msr_star;
-            rsp->data.regs.x86.msr_lstar = vmec.data.regs.x86.msr_lstar;
-            rsp->data.regs.x86.gdtr_base = vmec.data.regs.x86.gdtr_base;
-            rsp->data.regs.x86.gdtr_limit = vmec.data.regs.x86.gdtr_limit;
-            rsp->data.regs.x86.shadow_gs = vmec.data.regs.x86.shadow_gs;
-            rsp->data.regs.x86.fs_base = vmec.data.regs.x86.fs_base;
-            rsp->data.regs.x86.fs_sel = vmec.data.regs.x86.fs_sel;
-            rsp->data.regs.x86.fs.ar = vmec.data.regs.x86.fs_arbytes;
-            rsp->data.regs.x86.fs.limit = vmec.data.regs.x86.fs_limit;
-            rsp->data.regs.x86.gs_base = vmec.data.regs.x86.gs_base;
-            rsp->data.regs.x86.gs_sel = vmec.data.regs.x86.gs_sel;
-            rsp->data.regs.x86.gs.ar = vmec.data.regs.x86.gs_arbytes;
-            rsp->data.regs.x86.gs.limit = vmec.data.regs.x86.gs_limit;
-            rsp->data.regs.x86.cs_base = vmec.data.regs.x86.cs_base;
-            rsp->data.regs.x86.cs_sel = vmec.data.regs.x86.cs_sel;
-            rsp->data.regs.x86.cs.ar = vmec.data.regs.x86.cs_arbytes;
-            rsp->data.regs.x86.cs.limit = vmec.data.regs.x86.cs_limit;
-            rsp->data.regs.x86.ds_base = vmec.data.regs.x86.ds_base;
-            rsp->data.regs.x86.ds_sel = vmec.data.regs.x86.ds_sel;
-            rsp->data.regs.x86.ds.ar = vmec.data.regs.x86.ds_arbytes;
-            rsp->data.regs.x86.ds.limit = vmec.data.regs.x86.ds_limit;
-            rsp->data.regs.x86.es_base = vmec.data.regs.x86.es_base;
-            rsp->data.regs.x86.es_sel = vmec.data.regs.x86.es_sel;
-            rsp->data.regs.x86.es.ar = vmec.data.regs.x86.es_arbytes;
-            rsp->data.regs.x86.es.limit = vmec.data.regs.x86.es_limit;
-            rsp->data.regs.x86.ss_base = vmec.data.regs.x86.ss_base;
-            rsp->data.regs.x86.ss_sel = vmec.data.regs.x86.ss_sel;
-            rsp->data.regs.x86.ss.ar = vmec.data.regs.x86.ss_arbytes;
-            rsp->data.regs.x86.ss.limit = vmec.data.regs.x86.ss_limit;
-            rsp->data.regs.x86._pad = 0;
+        if ( VMI_FAILURE == vrc )
+            break;
 #endif
+
+        if ( xe->deferring ) {
+            xe->deferring = 0;
+            continue;
         }
 
+        ring_put_response_5(xe, &vmec);
+
         processed++;
-        RING_PUSH_RESPONSES(&xe->back_ring_5);
 
         /*
          * Send notification to Xen that response(s) were placed on the ring
@@ -2563,6 +2957,7 @@ status_t init_events_5(vmi_instance_t vmi)
     xen_events_t *xe = xen_get_events(vmi);
 
     xe->process_requests = &process_requests_5;
+    xe->put_response = &ring_put_response_5;
     vmi->driver.are_events_pending_ptr = &xen_are_events_pending_5;
 
     SHARED_RING_INIT((vm_event_5_sring_t *)xe->ring_page);
@@ -2578,38 +2973,126 @@ status_t init_events_5(vmi_instance_t vmi)
  */
 
 static inline
-void ring_get_request_and_response_6(xen_events_t *xe,
-                                     vm_event_6_request_t **req,
-                                     vm_event_6_request_t **rsp)
+void ring_get_request_6(xen_events_t *xe,
+                        vm_event_6_request_t **req)
 {
     vm_event_6_back_ring_t *back_ring = &xe->back_ring_6;
     RING_IDX req_cons = back_ring->req_cons;
-    RING_IDX rsp_prod = back_ring->rsp_prod_pvt;
 
     *req = RING_GET_REQUEST(back_ring, req_cons);
-    *rsp = RING_GET_RESPONSE(back_ring, rsp_prod);
 
     // Update ring positions
     req_cons++;
     back_ring->req_cons = req_cons;
     back_ring->sring->req_event = req_cons + 1;
+}
+
+static
+void ring_put_response_6(xen_events_t *xe, vm_event_compat_t *vmec)
+{
+    vm_event_6_back_ring_t *back_ring = &xe->back_ring_6;
+    vm_event_6_response_t *rsp = RING_GET_RESPONSE(back_ring, back_ring->rsp_prod_pvt);
+
+    rsp->version = vmec->version;
+    rsp->vcpu_id = vmec->vcpu_id;
+    rsp->flags = vmec->flags;
+    rsp->reason = vmec->reason;
+    rsp->altp2m_idx = vmec->altp2m_idx;
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
+        rsp->data.emul.read.size = vmec->data.emul.read.size;
+        memcpy(&rsp->data.emul.read.data, &vmec->data.emul.read.data, vmec->data.emul.read.size);
+    }
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_INSN_DATA )
+        memcpy(&rsp->data.emul.insn, &vmec->data.emul.insn, sizeof(rsp->data.emul.insn));
+
+    if ( rsp->flags & VM_EVENT_FLAG_FAST_SINGLESTEP )
+        rsp->u.fast_singlestep.p2midx = vmec->fast_singlestep.p2midx;
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
+#if defined(ARM32) || defined(ARM64)
+        memcpy(&rsp->data.regs.arm, &vmec->data.regs.arm, sizeof(rsp->data.regs.arm));
+#elif defined(I386) || defined(X86_64)
+        rsp->data.regs.x86.rax = vmec->data.regs.x86.rax;
+        rsp->data.regs.x86.rcx = vmec->data.regs.x86.rcx;
+        rsp->data.regs.x86.rdx = vmec->data.regs.x86.rdx;
+        rsp->data.regs.x86.rbx = vmec->data.regs.x86.rbx;
+        rsp->data.regs.x86.rsp = vmec->data.regs.x86.rsp;
+        rsp->data.regs.x86.rbp = vmec->data.regs.x86.rbp;
+        rsp->data.regs.x86.rsi = vmec->data.regs.x86.rsi;
+        rsp->data.regs.x86.rdi = vmec->data.regs.x86.rdi;
+        rsp->data.regs.x86.r8 = vmec->data.regs.x86.r8;
+        rsp->data.regs.x86.r9 = vmec->data.regs.x86.r9;
+        rsp->data.regs.x86.r10 = vmec->data.regs.x86.r10;
+        rsp->data.regs.x86.r11 = vmec->data.regs.x86.r11;
+        rsp->data.regs.x86.r12 = vmec->data.regs.x86.r12;
+        rsp->data.regs.x86.r13 = vmec->data.regs.x86.r13;
+        rsp->data.regs.x86.r14 = vmec->data.regs.x86.r14;
+        rsp->data.regs.x86.r15 = vmec->data.regs.x86.r15;
+        rsp->data.regs.x86.rflags = vmec->data.regs.x86.rflags;
+        rsp->data.regs.x86.dr6 = vmec->data.regs.x86.dr6;
+        rsp->data.regs.x86.dr7 = vmec->data.regs.x86.dr7;
+        rsp->data.regs.x86.rip = vmec->data.regs.x86.rip;
+        rsp->data.regs.x86.cr0 = vmec->data.regs.x86.cr0;
+        rsp->data.regs.x86.cr2 = vmec->data.regs.x86.cr2;
+        rsp->data.regs.x86.cr3 = vmec->data.regs.x86.cr3;
+        rsp->data.regs.x86.cr4 = vmec->data.regs.x86.cr4;
+        rsp->data.regs.x86.sysenter_cs = vmec->data.regs.x86.sysenter_cs;
+        rsp->data.regs.x86.sysenter_esp = vmec->data.regs.x86.sysenter_esp;
+        rsp->data.regs.x86.sysenter_eip = vmec->data.regs.x86.sysenter_eip;
+        rsp->data.regs.x86.msr_efer = vmec->data.regs.x86.msr_efer;
+        rsp->data.regs.x86.msr_star = vmec->data.regs.x86.msr_star;
+        rsp->data.regs.x86.msr_lstar = vmec->data.regs.x86.msr_lstar;
+        rsp->data.regs.x86.gdtr_base = vmec->data.regs.x86.gdtr_base;
+        rsp->data.regs.x86.gdtr_limit = vmec->data.regs.x86.gdtr_limit;
+        rsp->data.regs.x86.shadow_gs = vmec->data.regs.x86.shadow_gs;
+        rsp->data.regs.x86.fs_base = vmec->data.regs.x86.fs_base;
+        rsp->data.regs.x86.fs_sel = vmec->data.regs.x86.fs_sel;
+        rsp->data.regs.x86.fs.ar = vmec->data.regs.x86.fs_arbytes;
+        rsp->data.regs.x86.fs.limit = vmec->data.regs.x86.fs_limit;
+        rsp->data.regs.x86.gs_base = vmec->data.regs.x86.gs_base;
+        rsp->data.regs.x86.gs_sel = vmec->data.regs.x86.gs_sel;
+        rsp->data.regs.x86.gs.ar = vmec->data.regs.x86.gs_arbytes;
+        rsp->data.regs.x86.gs.limit = vmec->data.regs.x86.gs_limit;
+        rsp->data.regs.x86.cs_base = vmec->data.regs.x86.cs_base;
+        rsp->data.regs.x86.cs_sel = vmec->data.regs.x86.cs_sel;
+        rsp->data.regs.x86.cs.ar = vmec->data.regs.x86.cs_arbytes;
+        rsp->data.regs.x86.cs.limit = vmec->data.regs.x86.cs_limit;
+        rsp->data.regs.x86.ds_base = vmec->data.regs.x86.ds_base;
+        rsp->data.regs.x86.ds_sel = vmec->data.regs.x86.ds_sel;
+        rsp->data.regs.x86.ds.ar = vmec->data.regs.x86.ds_arbytes;
+        rsp->data.regs.x86.ds.limit = vmec->data.regs.x86.ds_limit;
+        rsp->data.regs.x86.es_base = vmec->data.regs.x86.es_base;
+        rsp->data.regs.x86.es_sel = vmec->data.regs.x86.es_sel;
+        rsp->data.regs.x86.es.ar = vmec->data.regs.x86.es_arbytes;
+        rsp->data.regs.x86.es.limit = vmec->data.regs.x86.es_limit;
+        rsp->data.regs.x86.ss_base = vmec->data.regs.x86.ss_base;
+        rsp->data.regs.x86.ss_sel = vmec->data.regs.x86.ss_sel;
+        rsp->data.regs.x86.ss.ar = vmec->data.regs.x86.ss_arbytes;
+        rsp->data.regs.x86.ss.limit = vmec->data.regs.x86.ss_limit;
+        rsp->data.regs.x86._pad = 0;
+#endif
+    }
+
     back_ring->rsp_prod_pvt++;
+    RING_PUSH_RESPONSES(back_ring);
 }
 
-status_t process_requests_6(vmi_instance_t vmi, uint32_t *requests_processed)
+status_t process_requests_6(vmi_instance_t vmi, uint32_t budget, uint32_t *requests_processed)
 {
     vm_event_6_request_t *req;
-    vm_event_6_response_t *rsp;
     vm_event_compat_t vmec = { 0 };
     xen_events_t *xe = xen_get_events(vmi);
     xen_instance_t *xen = xen_get_instance(vmi);
     int rc;
     status_t vrc = VMI_SUCCESS;
-    uint32_t processed = 0;
+    uint32_t processed = 0, taken = 0;
 
-    while ( RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_6) ) {
+    while ( (!budget || taken < budget) && RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_6) ) {
 
-        ring_get_request_and_response_6(xe, &req, &rsp);
+        ring_get_request_6(xe, &req);
+        taken++;
 
         if ( req->version != 0x00000006 ) {
             errprint("Error, Xen reports a VM_EVENT_INTERFACE_VERSION that is different then what we expect (0x%x != 0x%x)!\n",
@@ -2623,6 +3106,55 @@ status_t process_requests_6(vmi_instance_t vmi, uint32_t *requests_processed)
         vmec.vcpu_id = req->vcpu_id;
         vmec.altp2m_idx = req->altp2m_idx;
 
+        switch ( vmec.reason ) {
+            case VM_EVENT_REASON_MEM_ACCESS:
+                memcpy(&vmec.mem_access, &req->u.mem_access, sizeof(vmec.mem_access));
+                break;
+
+            case VM_EVENT_REASON_WRITE_CTRLREG:
+                memcpy(&vmec.write_ctrlreg, &req->u.write_ctrlreg, sizeof(vmec.write_ctrlreg));
+                break;
+
+            case VM_EVENT_REASON_MOV_TO_MSR:
+                memcpy(&vmec.mov_to_msr, &req->u.mov_to_msr, sizeof(vmec.mov_to_msr));
+                break;
+
+            case VM_EVENT_REASON_SINGLESTEP:
+                memcpy(&vmec.singlestep, &req->u.singlestep, sizeof(vmec.singlestep));
+                break;
+
+            case VM_EVENT_REASON_SOFTWARE_BREAKPOINT:
+                vmec.software_breakpoint.gfn = req->u.software_breakpoint.gfn;
+                vmec.software_breakpoint.insn_length = req->u.software_breakpoint.insn_length;
+                break;
+
+            case VM_EVENT_REASON_INTERRUPT:
+                memcpy(&vmec.x86_interrupt, &req->u.interrupt.x86, sizeof(vmec.x86_interrupt));
+                break;
+
+            case VM_EVENT_REASON_DEBUG_EXCEPTION:
+                vmec.debug_exception.gfn = req->u.debug_exception.gfn;
+                vmec.debug_exception.insn_length = req->u.debug_exception.insn_length;
+                vmec.debug_exception.type = req->u.debug_exception.type;
+                break;
+
+            case VM_EVENT_REASON_CPUID:
+                memcpy(&vmec.cpuid, &req->u.cpuid, sizeof(vmec.cpuid));
+                break;
+
+            case VM_EVENT_REASON_DESCRIPTOR_ACCESS:
+                memcpy(&vmec.desc_access, &req->u.desc_access, sizeof(vmec.desc_access));
+                break;
+        }
+
+        /* a request the filters drop is answered before its registers are copied */
+        if ( G_UNLIKELY(vmi->event_filters) &&
+                ring_event_dropped(vmi, &vmec, RING_FILTER_REGS(req, 6)) ) {
+            ring_put_response_6(xe, &vmec);
+            processed++;
+            continue;
+        }
+
 #if defined(ARM32) || defined(ARM64)
         memcpy(&vmec.data.regs.arm, &req->data.regs.arm, sizeof(vmec.data.regs.arm));
 #elif defined(I386) || defined(X86_64)
@@ -2685,137 +3217,20 @@ status_t process_requests_6(vmi_instance_t vmi, uint32_t *requests_processed)
         vmec.data.regs.x86.ss_arbytes = req->data.regs.x86.ss.ar;
 #endif
 
-        switch ( vmec.reason ) {
-            case VM_EVENT_REASON_MEM_ACCESS:
-                memcpy(&vmec.mem_access, &req->u.mem_access, sizeof(vmec.mem_access));
-                break;
-
-            case VM_EVENT_REASON_WRITE_CTRLREG:
-                memcpy(&vmec.write_ctrlreg, &req->u.write_ctrlreg, sizeof(vmec.write_ctrlreg));
-                break;
-
-            case VM_EVENT_REASON_MOV_TO_MSR:
-                memcpy(&vmec.mov_to_msr, &req->u.mov_to_msr, sizeof(vmec.mov_to_msr));
-                break;
-
-            case VM_EVENT_REASON_SINGLESTEP:
-                memcpy(&vmec.singlestep, &req->u.singlestep, sizeof(vmec.singlestep));
-                break;
-
-            case VM_EVENT_REASON_SOFTWARE_BREAKPOINT:
-                vmec.software_breakpoint.gfn = req->u.software_breakpoint.gfn;
-                vmec.software_breakpoint.insn_length = req->u.software_breakpoint.insn_length;
-                break;
-
-            case VM_EVENT_REASON_INTERRUPT:
-                memcpy(&vmec.x86_interrupt, &req->u.interrupt.x86, sizeof(vmec.x86_interrupt));
-                break;
-
-            case VM_EVENT_REASON_DEBUG_EXCEPTION:
-                vmec.debug_exception.gfn = req->u.debug_exception.gfn;
-                vmec.debug_exception.insn_length = req->u.debug_exception.insn_length;
-                vmec.debug_exception.type = req->u.debug_exception.type;
-                break;
-
-            case VM_EVENT_REASON_CPUID:
-                memcpy(&vmec.cpuid, &req->u.cpuid, sizeof(vmec.cpuid));
-                break;
-
-            case VM_EVENT_REASON_DESCRIPTOR_ACCESS:
-                memcpy(&vmec.desc_access, &req->u.desc_access, sizeof(vmec.desc_access));
-                break;
-        }
-
         vrc = process_request(vmi, &vmec);
 #ifdef ENABLE_SAFETY_CHECKS
         if ( VMI_FAILURE == vrc )
             break;
 #endif
 
-        rsp->version = vmec.version;
-        rsp->vcpu_id = vmec.vcpu_id;
-        rsp->flags = vmec.flags;
-        rsp->reason = vmec.reason;
-        rsp->altp2m_idx = vmec.altp2m_idx;
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
-            rsp->data.emul.read.size = vmec.data.emul.read.size;
-            memcpy(&rsp->data.emul.read.data, &vmec.data.emul.read.data, vmec.data.emul.read.size);
+        if ( xe->deferring ) {
+            xe->deferring = 0;
+            continue;
         }
 
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_INSN_DATA )
-            memcpy(&rsp->data.emul.insn, &vmec.data.emul.insn, sizeof(rsp->data.emul.insn));
-
-        if ( rsp->flags & VM_EVENT_FLAG_FAST_SINGLESTEP )
-            rsp->u.fast_singlestep.p2midx = vmec.fast_singlestep.p2midx;
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
-#if defined(ARM32) || defined(ARM64)
-            memcpy(&rsp->data.regs.arm, &vmec.data.regs.arm, sizeof(rsp->data.regs.arm));
-#elif defined(I386) || defined(X86_64)
-            rsp->data.regs.x86.rax = vmec.data.regs.x86.rax;
-            rsp->data.regs.x86.rcx = vmec.data.regs.x86.rcx;
-            rsp->data.regs.x86.rdx = vmec.data.regs.x86.rdx;
-            rsp->data.regs.x86.rbx = vmec.data.regs.x86.rbx;
-            rsp->data.regs.x86.rsp = vmec.data.regs.x86.rsp;
-            rsp->data.regs.x86.rbp = vmec.data.regs.x86.rbp;
-            rsp->data.regs.x86.rsi = vmec.data.regs.x86.rsi;
-            rsp->data.regs.x86.rdi = vmec.data.regs.x86.rdi;
-            rsp->data.regs.x86.r8 = vmec.data.regs.x86.r8;
-            rsp->data.regs.x86.r9 = vmec.data.regs.x86.r9;
-            rsp->data.regs.x86.r10 = vmec.data.regs.x86.r10;
-            rsp->data.regs.x86.r11 = vmec.data.regs.x86.r11;
-            rsp->data.regs.x86.r12 = vmec.data.regs.x86.r12;
-            rsp->data.regs.x86.r13 = vmec.data.regs.x86.r13;
-            rsp->data.regs.x86.r14 = vmec.data.regs.x86.r14;
-            rsp->data.regs.x86.r15 = vmec.data.regs.x86.r15;
-            rsp->data.regs.x86.rflags = vmec.data.regs.x86.rflags;
-            rsp->data.regs.x86.dr6 = vmec.data.regs.x86.dr6;
-            rsp->data.regs.x86.dr7 = vmec.data.regs.x86.dr7;
-            rsp->data.regs.x86.rip = vmec.data.regs.x86.rip;
-            rsp->data.regs.x86.cr0 = vmec.data.regs.x86.cr0;
-            rsp->data.regs.x86.cr2 = vmec.data.regs.x86.cr2;
-            rsp->data.regs.x86.cr3 = vmec.data.regs.x86.cr3;
-            rsp->data.regs.x86.cr4 = vmec.data.regs.x86.cr4;
-            rsp->data.regs.x86.sysenter_cs = vmec.data.regs.x86.sysenter_cs;
-            rsp->data.regs.x86.sysenter_esp = vmec.data.regs.x86.sysenter_esp;
-            rsp->data.regs.x86.sysenter_eip = vmec.data.regs.x86.sysenter_eip;
-            rsp->data.regs.x86.msr_efer = vmec.data.regs.x86.msr_efer;
-            rsp->data.regs.x86.msr_star = vmec.data.regs.x86.msr_star;
-            rsp->data.regs.x86.msr_lstar = vmec.data.regs.x86.msr_lstar;
-            rsp->data.regs.x86.gdtr_base = vmec.data.regs.x86.gdtr_base;
-            rsp->data.regs.x86.gdtr_limit = vmec.data.regs.x86.gdtr_limit;
-            rsp->data.regs.x86.shadow_gs = vmec.data.regs.x86.shadow_gs;
-            rsp->data.regs.x86.fs_base = vmec.data.regs.x86.fs_base;
-            rsp->data.regs.x86.fs_sel = vmec.data.regs.x86.fs_sel;
-            rsp->data.regs.x86.fs.ar = vmec.data.regs.x86.fs_arbytes;
-            rsp->data.regs.x86.fs.limit = vmec.data.regs.x86.fs_limit;
-            rsp->data.regs.x86.gs_base = vmec.data.regs.x86.gs_base;
-            rsp->data.regs.x86.gs_sel = vmec.data.regs.x86.gs_sel;
-            rsp->data.regs.x86.gs.ar = vmec.data.regs.x86.gs_arbytes;
-            rsp->data.regs.x86.gs.limit = vmec.data.regs.x86.gs_limit;
-            rsp->data.regs.x86.cs_base = vmec.data.regs.x86.cs_base;
-            rsp->data.regs.x86.cs_sel = vmec.data.regs.x86.cs_sel;
-            rsp->data.regs.x86.cs.ar = vmec.data.regs.x86.cs_arbytes;
-            rsp->data.regs.x86.cs.limit = vmec.data.regs.x86.cs_limit;
-            rsp->data.regs.x86.ds_base = vmec.data.regs.x86.ds_base;
-            rsp->data.regs.x86.ds_sel = vmec.data.regs.x86.ds_sel;
-            rsp->data.regs.x86.ds.ar = vmec.data.regs.x86.ds_arbytes;
-            rsp->data.regs.x86.ds.limit = vmec.data.regs.x86.ds_limit;
-            rsp->data.regs.x86.es_base = vmec.data.regs.x86.es_base;
-            rsp->data.regs.x86.es_sel = vmec.data.regs.x86.es_sel;
-            rsp->data.regs.x86.es.ar = vmec.data.regs.x86.es_arbytes;
-            rsp->data.regs.x86.es.limit = vmec.data.regs.x86.es_limit;
-            rsp->data.regs.x86.ss_base = vmec.data.regs.x86.ss_base;
-            rsp->data.regs.x86.ss_sel = vmec.data.regs.x86.ss_sel;
-            rsp->data.regs.x86.ss.ar = vmec.data.regs.x86.ss_arbytes;
-            rsp->data.regs.x86.ss.limit = vmec.data.regs.x86.ss_limit;
-            rsp->data.regs.x86._pad = 0;
-#endif
-        }
+        ring_put_response_6(xe, &vmec);
 
         processed++;
-        RING_PUSH_RESPONSES(&xe->back_ring_6);
 
         /*
          * Send notification to Xen that response(s) were placed on the ring
@@ -2859,6 +3274,8 @@ status_t init_events_6(vmi_instance_t vmi)
     xen_events_t *xe = xen_get_events(vmi);
 
     xe->process_requests = &process_requests_6;
+    xe->put_response = &ring_put_response_6;
+    xe->fast_singlestep = 1;
     vmi->driver.are_events_pending_ptr = &xen_are_events_pending_6;
 
     SHARED_RING_INIT((vm_event_6_sring_t *)xe->ring_page);
@@ -2874,38 +3291,126 @@ status_t init_events_6(vmi_instance_t vmi)
  */
 
 static inline
-void ring_get_request_and_response_7(xen_events_t *xe,
-                                     vm_event_7_request_t **req,
-                                     vm_event_7_request_t **rsp)
+void ring_get_request_7(xen_events_t *xe,
+                        vm_event_7_request_t **req)
 {
     vm_event_7_back_ring_t *back_ring = &xe->back_ring_7;
     RING_IDX req_cons = back_ring->req_cons;
-    RING_IDX rsp_prod = back_ring->rsp_prod_pvt;
 
     *req = RING_GET_REQUEST(back_ring, req_cons);
-    *rsp = RING_GET_RESPONSE(back_ring, rsp_prod);
 
     // Update ring positions
     req_cons++;
     back_ring->req_cons = req_cons;
     back_ring->sring->req_event = req_cons + 1;
+}
+
+static
+void ring_put_response_7(xen_events_t *xe, vm_event_compat_t *vmec)
+{
+    vm_event_7_back_ring_t *back_ring = &xe->back_ring_7;
+    vm_event_7_response_t *rsp = RING_GET_RESPONSE(back_ring, back_ring->rsp_prod_pvt);
+
+    rsp->version = vmec->version;
+    rsp->vcpu_id = vmec->vcpu_id;
+    rsp->flags = vmec->flags;
+    rsp->reason = vmec->reason;
+    rsp->altp2m_idx = vmec->altp2m_idx;
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
+        rsp->data.emul.read.size = vmec->data.emul.read.size;
+        memcpy(&rsp->data.emul.read.data, &vmec->data.emul.read.data, vmec->data.emul.read.size);
+    }
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_INSN_DATA )
+        memcpy(&rsp->data.emul.insn, &vmec->data.emul.insn, sizeof(rsp->data.emul.insn));
+
+    if ( rsp->flags & VM_EVENT_FLAG_FAST_SINGLESTEP )
+        rsp->u.fast_singlestep.p2midx = vmec->fast_singlestep.p2midx;
+
+    if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
+#if defined(ARM32) || defined(ARM64)
+        memcpy(&rsp->data.regs.arm, &vmec->data.regs.arm, sizeof(rsp->data.regs.arm));
+#elif defined(I386) || defined(X86_64)
+        rsp->data.regs.x86.rax = vmec->data.regs.x86.rax;
+        rsp->data.regs.x86.rcx = vmec->data.regs.x86.rcx;
+        rsp->data.regs.x86.rdx = vmec->data.regs.x86.rdx;
+        rsp->data.regs.x86.rbx = vmec->data.regs.x86.rbx;
+        rsp->data.regs.x86.rsp = vmec->data.regs.x86.rsp;
+        rsp->data.regs.x86.rbp = vmec->data.regs.x86.rbp;
+        rsp->data.regs.x86.rsi = vmec->data.regs.x86.rsi;
+        rsp->data.regs.x86.rdi = vmec->data.regs.x86.rdi;
+        rsp->data.regs.x86.r8 = vmec->data.regs.x86.r8;
+        rsp->data.regs.x86.r9 = vmec->data.regs.x86.r9;
+        rsp->data.regs.x86.r10 = vmec->data.regs.x86.r10;
+        rsp->data.regs.x86.r11 = vmec->data.regs.x86.r11;
+        rsp->data.regs.x86.r12 = vmec->data.regs.x86.r12;
+        rsp->data.regs.x86.r13 = vmec->data.regs.x86.r13;
+        rsp->data.regs.x86.r14 = vmec->data.regs.x86.r14;
+        rsp->data.regs.x86.r15 = vmec->data.regs.x86.r15;
+        rsp->data.regs.x86.rflags = vmec->data.regs.x86.rflags;
+        rsp->data.regs.x86.dr6 = vmec->data.regs.x86.dr6;
+        rsp->data.regs.x86.dr7 = vmec->data.regs.x86.dr7;
+        rsp->data.regs.x86.rip = vmec->data.regs.x86.rip;
+        rsp->data.regs.x86.cr0 = vmec->data.regs.x86.cr0;
+        rsp->data.regs.x86.cr2 = vmec->data.regs.x86.cr2;
+        rsp->data.regs.x86.cr3 = vmec->data.regs.x86.cr3;
+        rsp->data.regs.x86.cr4 = vmec->data.regs.x86.cr4;
+        rsp->data.regs.x86.sysenter_cs = vmec->data.regs.x86.sysenter_cs;
+        rsp->data.regs.x86.sysenter_esp = vmec->data.regs.x86.sysenter_esp;
+        rsp->data.regs.x86.sysenter_eip = vmec->data.regs.x86.sysenter_eip;
+        rsp->data.regs.x86.msr_efer = vmec->data.regs.x86.msr_efer;
+        rsp->data.regs.x86.msr_star = vmec->data.regs.x86.msr_star;
+        rsp->data.regs.x86.msr_lstar = vmec->data.regs.x86.msr_lstar;
+        rsp->data.regs.x86.gdtr_base = vmec->data.regs.x86.gdtr_base;
+        rsp->data.regs.x86.gdtr_limit = vmec->data.regs.x86.gdtr_limit;
+        rsp->data.regs.x86.shadow_gs = vmec->data.regs.x86.shadow_gs;
+        rsp->data.regs.x86.fs_base = vmec->data.regs.x86.fs_base;
+        rsp->data.regs.x86.fs_sel = vmec->data.regs.x86.fs_sel;
+        rsp->data.regs.x86.fs.ar = vmec->data.regs.x86.fs_arbytes;
+        rsp->data.regs.x86.fs.limit = vmec->data.regs.x86.fs_limit;
+        rsp->data.regs.x86.gs_base = vmec->data.regs.x86.gs_base;
+        rsp->data.regs.x86.gs_sel = vmec->data.regs.x86.gs_sel;
+        rsp->data.regs.x86.gs.ar = vmec->data.regs.x86.gs_arbytes;
+        rsp->data.regs.x86.gs.limit = vmec->data.regs.x86.gs_limit;
+        rsp->data.regs.x86.cs_base = vmec->data.regs.x86.cs_base;
+        rsp->data.regs.x86.cs_sel = vmec->data.regs.x86.cs_sel;
+        rsp->data.regs.x86.cs.ar = vmec->data.regs.x86.cs_arbytes;
+        rsp->data.regs.x86.cs.limit = vmec->data.regs.x86.cs_limit;
+        rsp->data.regs.x86.ds_base = vmec->data.regs.x86.ds_base;
+        rsp->data.regs.x86.ds_sel = vmec->data.regs.x86.ds_sel;
+        rsp->data.regs.x86.ds.ar = vmec->data.regs.x86.ds_arbytes;
+        rsp->data.regs.x86.ds.limit = vmec->data.regs.x86.ds_limit;
+        rsp->data.regs.x86.es_base = vmec->data.regs.x86.es_base;
+        rsp->data.regs.x86.es_sel = vmec->data.regs.x86.es_sel;
+        rsp->data.regs.x86.es.ar = vmec->data.regs.x86.es_arbytes;
+        rsp->data.regs.x86.es.limit = vmec->data.regs.x86.es_limit;
+        rsp->data.regs.x86.ss_base = vmec->data.regs.x86.ss_base;
+        rsp->data.regs.x86.ss_sel = vmec->data.regs.x86.ss_sel;
+        rsp->data.regs.x86.ss.ar = vmec->data.regs.x86.ss_arbytes;
+        rsp->data.regs.x86.ss.limit = vmec->data.regs.x86.ss_limit;
+        rsp->data.regs.x86._pad = 0;
+#endif
+    }
+
     back_ring->rsp_prod_pvt++;
+    RING_PUSH_RESPONSES(back_ring);
 }
 
-status_t process_requests_7(vmi_instance_t vmi, uint32_t *requests_processed)
+status_t process_requests_7(vmi_instance_t vmi, uint32_t budget, uint32_t *requests_processed)
 {
     vm_event_7_request_t *req;
-    vm_event_7_response_t *rsp;
     vm_event_compat_t vmec = { 0 };
     xen_events_t *xe = xen_get_events(vmi);
     xen_instance_t *xen = xen_get_instance(vmi);
     int rc;
     status_t vrc = VMI_SUCCESS;
-    uint32_t processed = 0;
+    uint32_t processed = 0, taken = 0;
 
-    while ( RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_7) ) {
+    while ( (!budget || taken < budget) && RING_HAS_UNCONSUMED_REQUESTS(&xe->back_ring_7) ) {
 
-        ring_get_request_and_response_7(xe, &req, &rsp);
+        ring_get_request_7(xe, &req);
+        taken++;
 
         if ( req->version != 0x00000007 ) {
             errprint("Error, Xen reports a VM_EVENT_INTERFACE_VERSION that is different then what we expect (0x%x != 0x%x)!\n",
@@ -2919,6 +3424,55 @@ status_t process_requests_7(vmi_instance_t vmi, uint32_t *requests_processed)
         vmec.vcpu_id = req->vcpu_id;
         vmec.altp2m_idx = req->altp2m_idx;
 
+        switch ( vmec.reason ) {
+            case VM_EVENT_REASON_MEM_ACCESS:
+                memcpy(&vmec.mem_access, &req->u.mem_access, sizeof(vmec.mem_access));
+                break;
+
+            case VM_EVENT_REASON_WRITE_CTRLREG:
+                memcpy(&vmec.write_ctrlreg, &req->u.write_ctrlreg, sizeof(vmec.write_ctrlreg));
+                break;
+
+            case VM_EVENT_REASON_MOV_TO_MSR:
+                memcpy(&vmec.mov_to_msr, &req->u.mov_to_msr, sizeof(vmec.mov_to_msr));
+                break;
+
+            case VM_EVENT_REASON_SINGLESTEP:
+                memcpy(&vmec.singlestep, &req->u.singlestep, sizeof(vmec.singlestep));
+                break;
+
+            case VM_EVENT_REASON_SOFTWARE_BREAKPOINT:
+                vmec.software_breakpoint.gfn = req->u.software_breakpoint.gfn;
+                vmec.software_breakpoint.insn_length = req->u.software_breakpoint.insn_length;
+                break;
+
+            case VM_EVENT_REASON_INTERRUPT:
+                memcpy(&vmec.x86_interrupt, &req->u.interrupt.x86, sizeof(vmec.x86_interrupt));
+                break;
+
+            case VM_EVENT_REASON_DEBUG_EXCEPTION:
+                vmec.debug_exception.gfn = req->u.debug_exception.gfn;
+                vmec.debug_exception.insn_length = req->u.debug_exception.insn_length;
+                vmec.debug_exception.type = req->u.debug_exception.type;
+                break;
+
+            case VM_EVENT_REASON_CPUID:
+                memcpy(&vmec.cpuid, &req->u.cpuid, sizeof(vmec.cpuid));
+                break;
+
+            case VM_EVENT_REASON_DESCRIPTOR_ACCESS:
+                memcpy(&vmec.desc_access, &req->u.desc_access, sizeof(vmec.desc_access));
+                break;
+        }
+
+        /* a request the filters drop is answered before its registers are copied */
+        if ( G_UNLIKELY(vmi->event_filters) &&
+                ring_event_dropped(vmi, &vmec, RING_FILTER_REGS(req, 7)) ) {
+            ring_put_response_7(xe, &vmec);
+            processed++;
+            continue;
+        }
+
 #if defined(ARM32) || defined(ARM64)
         memcpy(&vmec.data.regs.arm, &req->data.regs.arm, sizeof(vmec.data.regs.arm));
 #elif defined(I386) || defined(X86_64)
@@ -2987,137 +3541,20 @@ status_t process_requests_7(vmi_instance_t vmi, uint32_t *requests_processed)
             vmec.data.regs.x86.npt_base = req->data.regs.x86.npt_base;
 #endif
 
-        switch ( vmec.reason ) {
-            case VM_EVENT_REASON_MEM_ACCESS:
-                memcpy(&vmec.mem_access, &req->u.mem_access, sizeof(vmec.mem_access));
-                break;
-
-            case VM_EVENT_REASON_WRITE_CTRLREG:
-                memcpy(&vmec.write_ctrlreg, &req->u.write_ctrlreg, sizeof(vmec.write_ctrlreg));
-                break;
-
-            case VM_EVENT_REASON_MOV_TO_MSR:
-                memcpy(&vmec.mov_to_msr, &req->u.mov_to_msr, sizeof(vmec.mov_to_msr));
-                break;
-
-            case VM_EVENT_REASON_SINGLESTEP:
-                memcpy(&vmec.singlestep, &req->u.singlestep, sizeof(vmec.singlestep));
-                break;
-
-            case VM_EVENT_REASON_SOFTWARE_BREAKPOINT:
-                vmec.software_breakpoint.gfn = req->u.software_breakpoint.gfn;
-                vmec.software_breakpoint.insn_length = req->u.software_breakpoint.insn_length;
-                break;
-
-            case VM_EVENT_REASON_INTERRUPT:
-                memcpy(&vmec.x86_interrupt, &req->u.interrupt.x86, sizeof(vmec.x86_interrupt));
-                break;
-
-            case VM_EVENT_REASON_DEBUG_EXCEPTION:
-                vmec.debug_exception.gfn = req->u.debug_exception.gfn;
-                vmec.debug_exception.insn_length = req->u.debug_exception.insn_length;
-                vmec.debug_exception.type = req->u.debug_exception.type;
-                break;
-
-            case VM_EVENT_REASON_CPUID:
-                memcpy(&vmec.cpuid, &req->u.cpuid, sizeof(vmec.cpuid));
-                break;
-
-            case VM_EVENT_REASON_DESCRIPTOR_ACCESS:
-                memcpy(&vmec.desc_access, &req->u.desc_access, sizeof(vmec.desc_access));
-                break;
-        }
-
         vrc = process_request(vmi, &vmec);
 #ifdef ENABLE_SAFETY_CHECKS
         if ( VMI_FAILURE == vrc )
             break;
 #endif
 
-        rsp->version = vmec.version;
-        rsp->vcpu_id = vmec.vcpu_id;
-        rsp->flags = vmec.flags;
-        rsp->reason = vmec.reason;
-        rsp->altp2m_idx = vmec.altp2m_idx;
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_READ_DATA ) {
-            rsp->data.emul.read.size = vmec.data.emul.read.size;
-            memcpy(&rsp->data.emul.read.data, &vmec.data.emul.read.data, vmec.data.emul.read.size);
+        if ( xe->deferring ) {
+            xe->deferring = 0;
+            continue;
         }
 
-        if ( rsp->flags & VM_EVENT_FLAG_SET_EMUL_INSN_DATA )
-            memcpy(&rsp->data.emul.insn, &vmec.data.emul.insn, sizeof(rsp->data.emul.insn));
-
-        if ( rsp->flags & VM_EVENT_FLAG_FAST_SINGLESTEP )
-            rsp->u.fast_singlestep.p2midx = vmec.fast_singlestep.p2midx;
-
-        if ( rsp->flags & VM_EVENT_FLAG_SET_REGISTERS ) {
-#if defined(ARM32) || defined(ARM64)
-            memcpy(&rsp->data.regs.arm, &vmec.data.regs.arm, sizeof(rsp->data.regs.arm));
-#elif defined(I386) || defined(X86_64)
-            rsp->data.regs.x86.rax = vmec.data.regs.x86.rax;
-            rsp->data.regs.x86.rcx = vmec.data.regs.x86.rcx;
-            rsp->data.regs.x86.rdx = vmec.data.regs.x86.rdx;
-            rsp->data.regs.x86.rbx = vmec.data.regs.x86.rbx;
-            rsp->data.regs.x86.rsp = vmec.data.regs.x86.rsp;
-            rsp->data.regs.x86.rbp = vmec.data.regs.x86.rbp;
-            rsp->data.regs.x86.rsi = vmec.data.regs.x86.rsi;
-            rsp->data.regs.x86.rdi = vmec.data.regs.x86.rdi;
-            rsp->data.regs.x86.r8 = vmec.data.regs.x86.r8;
-            rsp->data.regs.x86.r9 = vmec.data.regs.x86.r9;
-            rsp->data.regs.x86.r10 = vmec.data.regs.x86.r10;
-            rsp->data.regs.x86.r11 = vmec.data.regs.x86.r11;
-            rsp->data.regs.x86.r12 = vmec.data.regs.x86.r12;
-            rsp->data.regs.x86.r13 = vmec.data.regs.x86.r13;
-            rsp->data.regs.x86.r14 = vmec.data.regs.x86.r14;
-            rsp->data.regs.x86.r15 = vmec.data.regs.x86.r15;
-            rsp->data.regs.x86.rflags = vmec.data.regs.x86.rflags;
-            rsp->data.regs.x86.dr6 = vmec.data.regs.x86.dr6;
-            rsp->data.regs.x86.dr7 = vmec.data.regs.x86.dr7;
-            rsp->data.regs.x86.rip = vmec.data.regs.x86.rip;
-            rsp->data.regs.x86.cr0 = vmec.data.regs.x86.cr0;
-            rsp->data.regs.x86.cr2 = vmec.data.regs.x86.cr2;
-            rsp->data.regs.x86.cr3 = vmec.data.regs.x86.cr3;
-            rsp->data.regs.x86.cr4 = vmec.data.regs.x86.cr4;
-            rsp->data.regs.x86.sysenter_cs = vmec.data.regs.x86.sysenter_cs;
-            rsp->data.regs.x86.sysenter_esp = vmec.data.regs.x86.sysenter_esp;
-            rsp->data.regs.x86.sysenter_eip = vmec.data.regs.x86.sysenter_eip;
-            rsp->data.regs.x86.msr_efer = vmec.data.regs.x86.msr_efer;
-            rsp->data.regs.x86.msr_star = vmec.data.regs.x86.msr_star;
-            rsp->data.regs.x86.msr_lstar = vmec.data.regs.x86.msr_lstar;
-            rsp->data.regs.x86.gdtr_base = vmec.data.regs.x86.gdtr_base;
-            rsp->data.regs.x86.gdtr_limit = vmec.data.regs.x86.gdtr_limit;
-            rsp->data.regs.x86.shadow_gs = vmec.data.regs.x86.shadow_gs;
-            rsp->data.regs.x86.fs_base = vmec.data.regs.x86.fs_base;
-            rsp->data.regs.x86.fs_sel = vmec.data.regs.x86.fs_sel;
-            rsp->data.regs.x86.fs.ar = vmec.data.regs.x86.fs_arbytes;
-            rsp->data.regs.x86.fs.limit = vmec.data.regs.x86.fs_limit;
-            rsp->data.regs.x86.gs_base = vmec.data.regs.x86.gs_base;
-            rsp->data.regs.x86.gs_sel = vmec.data.regs.x86.gs_sel;
-            rsp->data.regs.x86.gs.ar = vmec.data.regs.x86.gs_arbytes;
-            rsp->data.regs.x86.gs.limit = vmec.data.regs.x86.gs_limit;
-            rsp->data.regs.x86.cs_base = vmec.data.regs.x86.cs_base;
-            rsp->data.regs.x86.cs_sel = vmec.data.regs.x86.cs_sel;
-            rsp->data.regs.x86.cs.ar = vmec.data.regs.x86.cs_arbytes;
-            rsp->data.regs.x86.cs.limit = vmec.data.regs.x86.cs_limit;
-            rsp->data.regs.x86.ds_base = vmec.data.regs.x86.ds_base;
-            rsp->data.regs.x86.ds_sel = vmec.data.regs.x86.ds_sel;
-            rsp->data.regs.x86.ds.ar = vmec.data.regs.x86.ds_arbytes;
-            rsp->data.regs.x86.ds.limit = vmec.data.regs.x86.ds_limit;
-            rsp->data.regs.x86.es_base = vmec.data.regs.x86.es_base;
-            rsp->data.regs.x86.es_sel = vmec.data.regs.x86.es_sel;
-            rsp->data.regs.x86.es.ar = vmec.data.regs.x86.es_arbytes;
-            rsp->data.regs.x86.es.limit = vmec.data.regs.x86.es_limit;
-            rsp->data.regs.x86.ss_base = vmec.data.regs.x86.ss_base;
-            rsp->data.regs.x86.ss_sel = vmec.data.regs.x86.ss_sel;
-            rsp->data.regs.x86.ss.ar = vmec.data.regs.x86.ss_arbytes;
-            rsp->data.regs.x86.ss.limit = vmec.data.regs.x86.ss_limit;
-            rsp->data.regs.x86._pad = 0;
-#endif
-        }
+        ring_put_response_7(xe, &vmec);
 
         processed++;
-        RING_PUSH_RESPONSES(&xe->back_ring_7);
 
         /*
          * Send notification to Xen that response(s) were placed on the ring
@@ -3161,6 +3598,8 @@ status_t init_events_7(vmi_instance_t vmi)
     xen_events_t *xe = xen_get_events(vmi);
 
     xe->process_requests = &process_requests_7;
+    xe->put_response = &ring_put_response_7;
+    xe->fast_singlestep = 1;
     vmi->driver.are_events_pending_ptr = &xen_are_events_pending_7;
 
     SHARED_RING_INIT((vm_event_7_sring_t *)xe->ring_page);
@@ -3175,6 +3614,50 @@ status_t init_events_7(vmi_instance_t vmi)
  * Main event functions
  */
 
+/*
+ * Write the responses the analysis threads queued for deferred requests.
+ */
+static
+uint32_t respond_deferred(vmi_instance_t vmi)
+{
+    xen_events_t *xe = xen_get_events(vmi);
+    vmi_deferred_event_t deferred;
+    event_response_t response;
+    uint32_t vcpu, responded = 0;
+
+    if ( !xe->deferred )
+        return 0;
+
+    event_defer_clear_wake(vmi);
+
+    for ( vcpu = 0; vcpu < vmi->num_vcpus; vcpu++ ) {
+        vm_event_compat_t *vmec = &xe->deferred[vcpu];
+
+        while ( VMI_SUCCESS == event_defer_response(vmi, vcpu, &deferred, &response) ) {
+            if ( !vmec->version ) {
+                dbprint(VMI_DEBUG_XEN, "--vCPU %u has no deferred request, response dropped\n", vcpu);
+                continue;
+            }
+
+            if ( response & VMI_EVENT_RESPONSE_SET_REGISTERS ) {
+#if defined(ARM32) || defined(ARM64)
+                vmec->data.regs.arm = deferred.regs.arm;
+#elif defined(I386) || defined(X86_64)
+                vmec->data.regs.x86 = deferred.regs.x86;
+#endif
+            }
+
+            /* keeps the flags of the handlers called after the deferring one */
+            convert_response( vmi, response, &deferred.event, vmec );
+            xe->put_response(xe, vmec);
+            vmec->version = 0;
+            responded++;
+        }
+    }
+
+    return responded;
+}
+
 static
 status_t unmask_event(xen_instance_t *xen, xen_events_t *xe)
 {
@@ -3209,8 +3692,24 @@ static
 status_t wait_for_event_or_timeout(vmi_instance_t vmi, unsigned long ms, bool *needs_unmasking)
 {
     xen_events_t *xe = xen_get_events(vmi);
+    struct pollfd fd[G_N_ELEMENTS(xe->fd) + 1];
+    nfds_t i, nfds = xe->fd_size;
+    int rc;
+
+    /* responses to deferred requests wake us up too */
+    memcpy(fd, xe->fd, sizeof(xe->fd));
+    if ( xe->deferred ) {
+        fd[nfds].fd = event_defer_fd(vmi);
+        fd[nfds].events = POLLIN;
+        nfds++;
+    }
+
+    rc = poll(fd, nfds, ms);
 
-    switch ( poll(xe->fd, xe->fd_size, ms) ) {
+    for ( i = 0; i < xe->fd_size; i++ )
+        xe->fd[i].revents = fd[i].revents;
+
+    switch ( rc ) {
         case -1:
             if (errno == EINTR)
                 return VMI_SUCCESS;
@@ -3220,6 +3719,9 @@ status_t wait_for_event_or_timeout(vmi_instance_t vmi, unsigned long ms, bool *n
         case 0:
             return VMI_SUCCESS;
         default:
+            if ( 1 == rc && nfds > xe->fd_size && fd[xe->fd_size].revents )
+                return VMI_SUCCESS;
+
             // Don't unmask port until finished with processing events found on the ring
             *needs_unmasking = 1;
             return VMI_SUCCESS;
@@ -3235,7 +3737,7 @@ status_t xen_events_listen(vmi_instance_t vmi, uint32_t timeout)
 
     int rc;
     status_t vrc = VMI_SUCCESS;
-    uint32_t requests_processed = 0;
+    uint32_t requests_processed = 0, responded;
     bool needs_unmasking = 0;
 
 #ifdef ENABLE_SAFETY_CHECKS
@@ -3251,6 +3753,10 @@ status_t xen_events_listen(vmi_instance_t vmi, uint32_t timeout)
 
     if (!vmi->shutting_down) {
         if ( !xe->external_poll ) {
+            /* requests a budget left on the ring won't be notified again */
+            if ( (vmi->init_flags & VMI_INIT_EVENTS) && driver_are_events_pending(vmi) > 0 )
+                timeout = 0;
+
             dbprint(VMI_DEBUG_XEN, "--Waiting for xen events...(%"PRIu32" ms)\n", timeout);
             if ( VMI_FAILURE == wait_for_event_or_timeout(vmi, timeout, &needs_unmasking) ) {
                 errprint("Error while waiting for event.\n");
@@ -3270,12 +3776,14 @@ status_t xen_events_listen(vmi_instance_t vmi, uint32_t timeout)
     if ( !(vmi->init_flags & VMI_INIT_EVENTS) )
         return vrc;
 
-    vrc = xe->process_requests(vmi, &requests_processed);
+    vrc = xe->process_requests(vmi, vmi->shutting_down ? 0 : vmi->events_budget, &requests_processed);
 #ifdef ENABLE_SAFETY_CHECKS
     if ( VMI_FAILURE == vrc )
         return VMI_FAILURE;
 #endif
 
+    responded = respond_deferred(vmi);
+
     /*
      * The only way to gracefully handle vmi_swap_events and vmi_clear_event requests
      * that were issued in a callback is to ensure no more requests
@@ -3287,7 +3795,7 @@ status_t xen_events_listen(vmi_instance_t vmi, uint32_t timeout)
         uint32_t requests_processed_extra = 0;
         vmi_pause_vm(vmi);
 
-        vrc = xe->process_requests(vmi, &requests_processed_extra);
+        vrc = xe->process_requests(vmi, 0, &requests_processed_extra);
 #ifdef ENABLE_SAFETY_CHECKS
         if ( VMI_FAILURE == vrc )
             return VMI_FAILURE;
@@ -3330,7 +3838,7 @@ status_t xen_events_listen(vmi_instance_t vmi, uint32_t timeout)
      * Note: it is more performant to send notification after each event if
      * there are a lot of vCPUs assigned to the VM.
      */
-    if (vmi->num_vcpus < 7 && requests_processed) {
+    if ((vmi->num_vcpus < 7 && requests_processed) || responded) {
         rc = xen->libxcw.xc_evtchn_notify(xe->xce_handle, xe->port);
 
 #ifdef ENABLE_SAFETY_CHECKS
@@ -3503,6 +4011,7 @@ status_t xen_init_events(
     vmi->driver.set_reg_access_ptr = &xen_set_reg_access;
     vmi->driver.set_intr_access_ptr = &xen_set_intr_access;
     vmi->driver.set_mem_access_ptr = &xen_set_mem_access;
+    vmi->driver.set_mem_access_range_ptr = &xen_set_mem_access_range;
     vmi->driver.start_single_step_ptr = &xen_start_single_step;
     vmi->driver.stop_single_step_ptr = &xen_stop_single_step;
     vmi->driver.shutdown_single_step_ptr = &xen_shutdown_single_step;
@@ -3602,9 +4111,25 @@ void xen_events_destroy(vmi_instance_t vmi)
         resume = 1;
     }
 
-    if ( driver_are_events_pending(vmi) )
+    if ( driver_are_events_pending(vmi) || xe->deferred )
         xen_events_listen(vmi, 0);
 
+    /* deferred requests nobody answered are let go */
+    if ( xe->deferred ) {
+        uint32_t vcpu;
+
+        for ( vcpu = 0; vcpu < vmi->num_vcpus; vcpu++ ) {
+            if ( !xe->deferred[vcpu].version )
+                continue;
+
+            xe->deferred[vcpu].flags &= VM_EVENT_FLAG_VCPU_PAUSED;
+            xe->put_response(xe, &xe->deferred[vcpu]);
+        }
+
+        (void)xen->libxcw.xc_evtchn_notify(xe->xce_handle, xe->port);
+        g_free(xe->deferred);
+    }
+
     // Shutdown all events to make sure VM is in a stable state
     if ( g_hash_table_size(vmi->mem_events_on_gfn) || g_hash_table_size(vmi->mem_events_generic) )
         (void)xen->libxcw.xc_set_mem_access(xch, dom, XENMEM_access_rwx, 0, xen->max_gpfn);
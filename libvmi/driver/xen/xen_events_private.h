@@ -104,7 +104,7 @@ typedef struct vm_event_compat {
     } data;
 } vm_event_compat_t;
 
-typedef struct {
+typedef struct xen_events {
     xc_evtchn* xce_handle;
     int port;
 #ifdef HAVE_LIBXENSTORE
@@ -137,7 +137,17 @@ typedef struct {
     bool monitor_xcr0_on;
     bool monitor_msr_on;
 
-    status_t (*process_requests)(vmi_instance_t vmi, uint32_t *requests_processed);
+    /* VM_EVENT_FLAG_FAST_SINGLESTEP, emulated on older rings */
+    bool fast_singlestep;
+    uint32_t next_slat_pending;     /**< vCPUs stepping before a view switch */
+    uint16_t next_slat[MAX_SINGLESTEP_VCPUS];
+
+    /* VMI_EVENT_RESPONSE_DEFER */
+    bool deferring;                 /**< the request being processed was deferred */
+    vm_event_compat_t *deferred;    /**< per vCPU, version 0 if none is deferred */
+
+    status_t (*process_requests)(vmi_instance_t vmi, uint32_t budget, uint32_t *requests_processed);
+    void (*put_response)(struct xen_events *xe, vm_event_compat_t *vmec);
     status_t (*process_event[__VM_EVENT_REASON_MAX])(vmi_instance_t vmi, vm_event_compat_t *vmec);
 
 } xen_events_t;
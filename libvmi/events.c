@@ -92,6 +92,93 @@ void step_event_free(vmi_event_t *event, status_t rc)
         g_slice_free(vmi_event_t, event);
 }
 
+/* Point the radix table at an event of mem_events_on_gfn, NULL to remove it */
+static void mem_event_index(vmi_instance_t vmi, addr_t gfn, vmi_event_t *event)
+{
+    unsigned int shift = 3 * MEM_EVENT_NODE_BITS;
+    void ***slot = (void ***)&vmi->mem_events_table;
+    size_t entries = 1u << MEM_EVENT_TOP_BITS;
+
+    if ( gfn >= MEM_EVENT_TABLE_GFNS )
+        return;
+
+    for (;;) {
+        if ( !*slot ) {
+            /* empty nodes are kept until the events are destroyed */
+            if ( !event )
+                return;
+            *slot = g_new0(void *, entries);
+        }
+
+        if ( !shift )
+            break;
+
+        slot = (void ***)&(*slot)[(gfn >> shift) & (entries - 1)];
+        shift -= MEM_EVENT_NODE_BITS;
+        entries = 1u << MEM_EVENT_NODE_BITS;
+    }
+
+    (*slot)[gfn & (entries - 1)] = event;
+}
+
+static void mem_event_table_free(void **node, unsigned int level)
+{
+    size_t i, entries = level ? 1u << MEM_EVENT_NODE_BITS : 1u << MEM_EVENT_TOP_BITS;
+
+    if ( !node )
+        return;
+
+    if ( level < 3 )
+        for ( i = 0; i < entries; i++ )
+            mem_event_table_free(node[i], level + 1);
+
+    g_free(node);
+}
+
+/*
+ * Sort the generic mem events by the R/W/X accesses they match. A callback
+ * registering one is called from a driver walking the current arrays, so
+ * those are only freed by a later update outside of callbacks.
+ */
+static void mem_events_access_update(vmi_instance_t vmi)
+{
+    guint access, size = g_hash_table_size(vmi->mem_events_generic);
+
+    if ( !vmi->event_callback ) {
+        g_slist_free_full(vmi->mem_events_retired, g_free);
+        vmi->mem_events_retired = NULL;
+    }
+
+    for ( access = 0; access < G_N_ELEMENTS(vmi->mem_events_access); access++ ) {
+        vmi_event_t **events = NULL;
+        vmi_mem_access_t *key = NULL;
+        vmi_event_t *event = NULL;
+        GHashTableIter i;
+        guint n = 0;
+
+        if ( vmi->event_callback && vmi->mem_events_access[access] )
+            vmi->mem_events_retired = g_slist_prepend(vmi->mem_events_retired,
+                                      vmi->mem_events_access[access]);
+        else
+            g_free(vmi->mem_events_access[access]);
+        vmi->mem_events_access[access] = NULL;
+
+        if ( !size )
+            continue;
+
+        events = g_new0(vmi_event_t *, size + 1);
+        ghashtable_foreach(vmi->mem_events_generic, i, &key, &event) {
+            if ( (*key) & (access << 1) )
+                events[n++] = event;
+        }
+
+        if ( n )
+            vmi->mem_events_access[access] = events;
+        else
+            g_free(events);
+    }
+}
+
 status_t events_init(vmi_instance_t vmi)
 {
     switch (vmi->mode) {
@@ -99,6 +186,9 @@ status_t events_init(vmi_instance_t vmi)
             break;
         case VMI_XEN:
             break;
+        case VMI_FILE:
+            /* replaying a trace */
+            break;
         default:
             errprint("The selected hypervisor has no events support!\n");
             return VMI_FAILURE;
@@ -117,24 +207,49 @@ status_t events_init(vmi_instance_t vmi)
 
 void events_destroy(vmi_instance_t vmi)
 {
+    unsigned int i;
+
+    event_defer_destroy(vmi);
+
+    if (vmi->event_filters) {
+        g_hash_table_destroy(vmi->event_filters);
+        vmi->event_filters = NULL;
+    }
+
     if (vmi->mem_events_on_gfn) {
         dbprint(VMI_DEBUG_EVENTS, "Destroying memaccess on gfn events\n");
         g_hash_table_destroy(vmi->mem_events_on_gfn);
         vmi->mem_events_on_gfn = NULL;
     }
 
+    mem_event_table_free(vmi->mem_events_table, 0);
+    vmi->mem_events_table = NULL;
+
     if (vmi->mem_events_generic) {
         dbprint(VMI_DEBUG_EVENTS, "Destroying memaccess generic events\n");
         g_hash_table_destroy(vmi->mem_events_generic);
         vmi->mem_events_generic = NULL;
     }
 
+    for (i = 0; i < G_N_ELEMENTS(vmi->mem_events_access); i++) {
+        g_free(vmi->mem_events_access[i]);
+        vmi->mem_events_access[i] = NULL;
+    }
+
+    g_slist_free_full(vmi->mem_events_retired, g_free);
+    vmi->mem_events_retired = NULL;
+
     if (vmi->reg_events) {
         dbprint(VMI_DEBUG_EVENTS, "Destroying register events\n");
         g_hash_table_destroy(vmi->reg_events);
         vmi->reg_events = NULL;
     }
 
+    if (vmi->reg_last_values) {
+        g_hash_table_destroy(vmi->reg_last_values);
+        vmi->reg_last_values = NULL;
+    }
+
     if (vmi->msr_events) {
         dbprint(VMI_DEBUG_EVENTS, "Destroying MSR events\n");
         g_hash_table_destroy(vmi->msr_events);
@@ -318,6 +433,7 @@ static status_t register_mem_event_generic(vmi_instance_t vmi, vmi_event_t *even
     *access = event->mem_event.in_access;
 
     g_hash_table_insert_compat(vmi->mem_events_generic, access, event);
+    mem_events_access_update(vmi);
     return VMI_SUCCESS;
 }
 
@@ -346,6 +462,7 @@ static status_t register_mem_event_on_gfn(vmi_instance_t vmi, vmi_event_t *event
             event->mem_event.in_access,
             event->slat_id)) {
         g_hash_table_insert_compat(vmi->mem_events_on_gfn, g_slice_dup(addr_t, &event->mem_event.gfn), event);
+        mem_event_index(vmi, event->mem_event.gfn, event);
 
         if ( event->mem_event.gfn > (vmi->max_physical_address >> vmi->page_shift) )
             vmi->max_physical_address = event->mem_event.gfn << vmi->page_shift;
@@ -364,6 +481,73 @@ status_t register_mem_event(vmi_instance_t vmi, vmi_event_t *event)
         return register_mem_event_on_gfn(vmi, event);
 }
 
+/* Length of the run of contiguous pages with the same access from events[i] */
+static size_t mem_events_run(vmi_event_t *events, size_t count, size_t i)
+{
+    size_t run = i + 1;
+
+    while ( run < count &&
+            events[run].mem_event.gfn == events[run - 1].mem_event.gfn + 1 &&
+            events[run].mem_event.in_access == events[i].mem_event.in_access &&
+            events[run].slat_id == events[i].slat_id &&
+            run - i < UINT32_MAX )
+        run++;
+
+    return run - i;
+}
+
+/*
+ * Register page specific events sorted by gfn, setting the access of each
+ * run of contiguous pages with a single driver call where it has one.
+ * If it fails and the events registered so far can't be cleared, held is
+ * set and the events must be kept.
+ */
+status_t register_mem_events_sorted(vmi_instance_t vmi, vmi_event_t *events, size_t count, bool *held)
+{
+    size_t i, j, run;
+
+    *held = false;
+
+    if ( g_hash_table_size(vmi->mem_events_generic) ) {
+        dbprint(VMI_DEBUG_EVENTS, "You already have generic mem event handlers registered.\n");
+        return VMI_FAILURE;
+    }
+
+    for ( i = 0; i < count; i++ ) {
+        if ( VMI_MEMACCESS_INVALID == events[i].mem_event.in_access ||
+                (i && events[i].mem_event.gfn <= events[i - 1].mem_event.gfn) ||
+                g_hash_table_lookup(vmi->mem_events_on_gfn, &events[i].mem_event.gfn) ) {
+            dbprint(VMI_DEBUG_EVENTS, "Can't register a mem event on page: %"PRIu64"\n",
+                    events[i].mem_event.gfn);
+            return VMI_FAILURE;
+        }
+    }
+
+    for ( i = 0; i < count; i += run ) {
+        run = mem_events_run(events, count, i);
+
+        if ( VMI_FAILURE == driver_set_mem_access_range(vmi, events[i].mem_event.gfn, run,
+                events[i].mem_event.in_access,
+                events[i].slat_id) ) {
+            /* a range may have been set part of the way before failing */
+            driver_set_mem_access_range(vmi, events[i].mem_event.gfn, run, VMI_MEMACCESS_N,
+                                        events[i].slat_id);
+            *held = VMI_FAILURE == clear_mem_events_sorted(vmi, events, i);
+            return VMI_FAILURE;
+        }
+
+        for ( j = i; j < i + run; j++ ) {
+            g_hash_table_insert_compat(vmi->mem_events_on_gfn, g_slice_dup(addr_t, &events[j].mem_event.gfn), &events[j]);
+            mem_event_index(vmi, events[j].mem_event.gfn, &events[j]);
+        }
+    }
+
+    if ( count && events[count - 1].mem_event.gfn > (vmi->max_physical_address >> vmi->page_shift) )
+        vmi->max_physical_address = events[count - 1].mem_event.gfn << vmi->page_shift;
+
+    return VMI_SUCCESS;
+}
+
 status_t register_singlestep_event(vmi_instance_t vmi, vmi_event_t *event)
 {
     status_t rc = VMI_FAILURE;
@@ -506,8 +690,40 @@ status_t clear_interrupt_event(vmi_instance_t vmi, vmi_event_t *event)
     return rc;
 }
 
+bool reg_event_unswitched(vmi_instance_t vmi, vmi_event_t *event)
+{
+    reg_t value = event->reg_event.value;
+    reg_t *last;
+
+    if ( event->vcpu_id >= vmi->num_vcpus )
+        return false;
+
+    if ( CR3 == event->reg_event.reg )
+        value = cr3_page_table(vmi, value);
+
+    if ( !vmi->reg_last_values )
+        vmi->reg_last_values = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+    last = g_hash_table_lookup(vmi->reg_last_values, event);
+    if ( !last ) {
+        /* ~0 is no value a register is written with */
+        last = g_new(reg_t, vmi->num_vcpus);
+        memset(last, 0xff, vmi->num_vcpus * sizeof(reg_t));
+        g_hash_table_insert(vmi->reg_last_values, event, last);
+    }
+
+    if ( last[event->vcpu_id] == value )
+        return true;
+
+    last[event->vcpu_id] = value;
+    return false;
+}
+
 status_t clear_reg_event(vmi_instance_t vmi, vmi_event_t *event)
 {
+    if ( vmi->reg_last_values )
+        g_hash_table_remove(vmi->reg_last_values, event);
+
     if (NULL != g_hash_table_lookup(vmi->reg_events, &(event->reg_event.reg))) {
         dbprint(VMI_DEBUG_EVENTS, "Disabling register event on reg: %"PRIu64"\n", event->reg_event.reg);
         vmi_reg_access_t original_in_access = event->reg_event.in_access;
@@ -545,8 +761,10 @@ status_t clear_mem_event(vmi_instance_t vmi, vmi_event_t *event)
     /* For generic events we just have to remove the handler */
     if ( event->mem_event.generic ) {
         /* No point if we are shutting down because we will just destroy the table anyway */
-        if ( !vmi->shutting_down )
+        if ( !vmi->shutting_down ) {
             g_hash_table_remove(vmi->mem_events_generic, &event->mem_event.in_access);
+            mem_events_access_update(vmi);
+        }
 
         return VMI_SUCCESS;
     }
@@ -558,13 +776,39 @@ status_t clear_mem_event(vmi_instance_t vmi, vmi_event_t *event)
             event->mem_event.gfn, event->slat_id,
             (rc == VMI_FAILURE) ? "failed" : "success");
 
-    if ( !vmi->shutting_down && rc == VMI_SUCCESS )
+    if ( !vmi->shutting_down && rc == VMI_SUCCESS ) {
         g_hash_table_remove(vmi->mem_events_on_gfn, &event->mem_event.gfn);
+        mem_event_index(vmi, event->mem_event.gfn, NULL);
+    }
 
     return rc;
 
 }
 
+/* Clear events registered with register_mem_events_sorted */
+status_t clear_mem_events_sorted(vmi_instance_t vmi, vmi_event_t *events, size_t count)
+{
+    status_t ret = VMI_SUCCESS;
+    size_t i, j, run;
+
+    for ( i = 0; i < count; i += run ) {
+        run = mem_events_run(events, count, i);
+
+        if ( VMI_FAILURE == driver_set_mem_access_range(vmi, events[i].mem_event.gfn, run,
+                VMI_MEMACCESS_N, events[i].slat_id) ) {
+            ret = VMI_FAILURE;
+            continue;
+        }
+
+        for ( j = i; j < i + run; j++ ) {
+            g_hash_table_remove(vmi->mem_events_on_gfn, &events[j].mem_event.gfn);
+            mem_event_index(vmi, events[j].mem_event.gfn, NULL);
+        }
+    }
+
+    return ret;
+}
+
 status_t clear_singlestep_event(vmi_instance_t vmi, vmi_event_t *event)
 {
 
@@ -646,6 +890,7 @@ status_t swap_events(vmi_instance_t vmi, vmi_event_t *swap_from, vmi_event_t *sw
         return rc;
 
     g_hash_table_replace(vmi->mem_events_on_gfn, g_slice_dup(addr_t, &swap_to->mem_event.gfn), swap_to);
+    mem_event_index(vmi, swap_to->mem_event.gfn, swap_to);
 
     if ( free_routine )
         free_routine(swap_from, rc);
@@ -931,6 +1176,9 @@ status_t vmi_clear_event(
             rc = VMI_FAILURE;
     }
 
+    if ( VMI_SUCCESS == rc )
+        event_filter_remove(vmi, event);
+
     if ( free_routine )
         free_routine(event, rc);
 
@@ -1027,6 +1275,20 @@ status_t vmi_events_listen(vmi_instance_t vmi, uint32_t timeout)
     return driver_events_listen(vmi, timeout);
 }
 
+status_t vmi_events_set_budget(vmi_instance_t vmi, uint32_t max_events)
+{
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi)
+        return VMI_FAILURE;
+
+    if (!(vmi->init_flags & VMI_INIT_EVENTS))
+        return VMI_FAILURE;
+#endif
+
+    vmi->events_budget = max_events;
+    return VMI_SUCCESS;
+}
+
 status_t vmi_event_listener_required(vmi_instance_t vmi, bool required)
 {
 #ifdef ENABLE_SAFETY_CHECKS
@@ -198,7 +198,20 @@ typedef struct {
      */
     vmi_reg_access_t out_access;
 
-    uint32_t _pad;
+    /**
+     * CONST IN
+     *
+     * IFF set to 1, control register events are only delivered if the
+     *  written value differs from the last one delivered for the vCPU, the
+     *  others are answered right away. CR3 values are compared without the PCID bits and, on
+     *  Linux kernels using KPTI, the user page table bit, so only address
+     *  space switches are seen. To only see some address spaces, filter the values with
+     *  vmi_event_set_filter.
+     * Default : 0. (i.e., All write events are delivered).
+     */
+    uint8_t onswitch;
+
+    uint8_t _pad[3];
 
     /**
      * OUT
@@ -439,6 +452,16 @@ typedef uint32_t event_response_flags_t;
 #define VMI_EVENT_RESPONSE_RESET_VMTRACE        (1u << 11)
 #define __VMI_EVENT_RESPONSE_MAX                11
 
+/**
+ * Keep the vCPU paused and answer the event later from another thread,
+ * see vmi_event_pop_deferred. Handled by LibVMI, other flags returned
+ * with it are ignored. The flags returned by the generic memory event
+ * handlers called after it for the same access are sent along with the
+ * deferred response. Only supported on Xen, elsewhere and for events
+ * that don't pause the vCPU the flag is ignored.
+ */
+#define VMI_EVENT_RESPONSE_DEFER                (1u << 31)
+
 /**
  * Bitmap holding event_reponse_flags_t values returned by callback
  * (ie. 1u << VMI_EVENT_RESPONSE_*).
@@ -484,7 +507,9 @@ struct vmi_event {
      *
      * Note: on Xen this corresponds to the altp2m_idx and it also enables MTF singlestepping.
      *  The altp2m switch automatically happens in the singlestep handler in Xen after a single
-     *  instruction is executed.
+     *  instruction is executed. Xen versions without fast singlestep (VM_EVENT_INTERFACE_VERSION
+     *  older than 6) get a singlestep instead and LibVMI does the switch, the singlestep event
+     *  is not delivered.
      */
     uint16_t next_slat_id;
 
@@ -788,6 +813,24 @@ status_t vmi_events_listen(
     vmi_instance_t vmi,
     uint32_t timeout) NOEXCEPT;
 
+/**
+ * Limit how many events a single vmi_events_listen call handles.
+ * By default every event on the ring is handled before returning, which
+ * can keep the caller away from other work (or other VMs) for long under
+ * event storms. With a budget set, the events left over stay queued and are
+ * handled by the next call, which then doesn't wait for new ones.
+ * vmi_are_events_pending tells how many are left. Events are queued in
+ * the order vCPUs hit them and a paused vCPU queues one at a time, so no
+ * vCPU is starved by the others.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] max_events Number of events per call, 0 for no limit.
+ * @return VMI_FAILURE or VMI_SUCCESS
+ */
+status_t vmi_events_set_budget(
+    vmi_instance_t vmi,
+    uint32_t max_events) NOEXCEPT;
+
 /**
  * Set whether to crash the domain if the event listener is no longer present.
  * By default Xen assumes the listener is not required.
@@ -809,6 +852,243 @@ status_t vmi_event_listener_required(
 int vmi_are_events_pending(
     vmi_instance_t vmi) NOEXCEPT;
 
+/**
+ * Header of an event trace, as written by vmi_events_record and replayed by
+ * the file driver. It is followed by records, each a vmi_trace_record_t and
+ * its payload. Each event callback is an EVENT record, the PAGE records of
+ * the frames the callback read that changed since they were last recorded
+ * and a RESPONSE record.
+ */
+#define VMI_TRACE_MAGIC "VMITRACE"
+#define VMI_TRACE_VERSION 1
+
+typedef struct vmi_trace_header {
+    char magic[8];          /**< VMI_TRACE_MAGIC, not NUL terminated */
+    uint32_t version;       /**< VMI_TRACE_VERSION */
+    uint32_t events_version; /**< VMI_EVENTS_VERSION of the recording */
+    uint32_t page_shift;    /**< size of the pages in the trace */
+    uint32_t num_vcpus;
+    uint64_t memory_size;   /**< size of the guest physical memory */
+    char image[4096];       /**< image the pages missing from the trace are
+                                 read from, relative to the trace unless
+                                 absolute */
+} vmi_trace_header_t;
+
+typedef enum {
+    VMI_TRACE_RECORD_EVENT = 1, /**< vmi_trace_event_t */
+    VMI_TRACE_RECORD_PAGE,      /**< frame number (uint64_t) followed by the page */
+    VMI_TRACE_RECORD_RESPONSE   /**< event_response_t */
+} vmi_trace_record_type_t;
+
+typedef struct vmi_trace_record {
+    uint32_t type;          /**< vmi_trace_record_type_t */
+    uint32_t size;          /**< of the payload that follows */
+} vmi_trace_record_t;
+
+/* The type specific part of vmi_event_t, from reg_event up to x86_regs */
+#define VMI_TRACE_EVENT_DATA_SIZE \
+    (offsetof(vmi_event_t, x86_regs) - offsetof(vmi_event_t, reg_event))
+
+typedef struct vmi_trace_event {
+    uint32_t type;          /**< vmi_event_type_t */
+    uint32_t vcpu_id;
+    uint32_t page_mode;
+    uint16_t slat_id;
+    uint16_t has_regs;      /**< regs holds the registers of the vCPU */
+    uint8_t data[VMI_TRACE_EVENT_DATA_SIZE];
+    registers_t regs;
+} vmi_trace_event_t;
+
+/**
+ * Start recording the events delivered to the callbacks into a trace.
+ * For each event the trace holds its type, vCPU, registers and the type
+ * specific fields, the guest pages read during the callback and the
+ * response. Pages are only recorded again once their content changed.
+ *
+ * A trace is opened with the file driver like a memory image, events
+ * registered on that instance are then replayed by vmi_events_listen,
+ * one per call, with the guest memory as it was read when recording.
+ * Only pages read with vmi_read_* are captured, not the ones accessed
+ * through vmi_mmap_guest or a window.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] path The trace file to create
+ * @param[in] image Optional: memory image the replay falls back to for
+ *                  pages not in the trace, relative to the trace unless
+ *                  absolute
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_events_record(
+    vmi_instance_t vmi,
+    const char *path,
+    const char *image) NOEXCEPT;
+
+/**
+ * Stop recording events and close the trace.
+ *
+ * @param[in] vmi LibVMI instance
+ * @return VMI_FAILURE if the trace could not be written completely
+ */
+status_t vmi_events_record_stop(
+    vmi_instance_t vmi) NOEXCEPT;
+
+/**
+ * Fields an event filter can test.
+ */
+typedef enum {
+    VMI_FILTER_REGISTER,    /**< a register of the vCPU, see vmi_filter_rule_t.reg */
+    VMI_FILTER_REG_VALUE,   /**< reg_event.value of register events */
+    VMI_FILTER_GLA,         /**< mem_event.gla of memory events, when valid */
+    VMI_FILTER_GFN          /**< mem_event.gfn of memory events */
+} vmi_filter_field_t;
+
+/**
+ * A range of values of a field that lets events through. A set of values
+ * is a rule per value with lo == hi.
+ */
+typedef struct {
+    vmi_filter_field_t field;
+    reg_t reg;              /**< for VMI_FILTER_REGISTER: RAX-R15, RIP, RFLAGS,
+                                 CR0, CR2-CR4, FS_BASE or GS_BASE */
+    uint64_t lo;            /**< first value let through */
+    uint64_t hi;            /**< last value let through */
+} vmi_filter_rule_t;
+
+/**
+ * Filter the events delivered to the callback of a memory, register or INT3
+ * event. The event is let through if, for every field the rules test, the
+ * value is in one of the ranges given for the field. Values an event does
+ * not carry, like a GLA that is not valid, are not tested.
+ *
+ * The drivers test the rules on the request as the hypervisor delivered it,
+ * before its registers are converted. Events that are not let through are
+ * answered without the callback being called: memory accesses are emulated,
+ * breakpoints reinjected and register writes let through. An access that
+ * matches several generic memory events is only dropped if the filters of
+ * all of them drop it.
+ *
+ * The filter is dropped when the event is cleared.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] event The registered event
+ * @param[in] rules The rules, copied
+ * @param[in] nrules Number of rules, 0 removes the filter
+ * @return VMI_FAILURE if the type of the event can't be filtered or a rule
+ *  does not apply to it
+ */
+status_t vmi_event_set_filter(
+    vmi_instance_t vmi,
+    vmi_event_t *event,
+    const vmi_filter_rule_t *rules,
+    size_t nrules) NOEXCEPT;
+
+/**
+ * An event whose callback returned VMI_EVENT_RESPONSE_DEFER. The event is
+ * a copy of the registered one as the callback saw it, its register
+ * pointer refers to regs. Set the fields the response needs on it, like
+ * in a callback, before handing it to vmi_event_respond.
+ *
+ * The instance is not thread-safe: while a thread is in vmi_events_listen
+ * the analysis threads may only call vmi_event_pop_deferred and
+ * vmi_event_respond on it, no other vmi_* function.
+ */
+typedef struct {
+    vmi_event_t event;
+    registers_t regs;
+} vmi_deferred_event_t;
+
+/**
+ * Take the oldest deferred event of a vCPU. The events of each vCPU are
+ * queued without locks for a single consumer, so only one thread may take
+ * the events of a vCPU. Events are queued once their callback returned.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] vcpu The vCPU
+ * @param[out] deferred Receives the event
+ * @return VMI_FAILURE if there is none
+ */
+status_t vmi_event_pop_deferred(
+    vmi_instance_t vmi,
+    unsigned int vcpu,
+    vmi_deferred_event_t *deferred) NOEXCEPT;
+
+/**
+ * Answer a deferred event, from the thread that took it. The response is
+ * written to the ring and the vCPU released by the thread in
+ * vmi_events_listen, which is woken up for it.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] deferred The event taken with vmi_event_pop_deferred
+ * @param[in] response The response, as a callback would return it
+ * @return VMI_FAILURE if the response can't be queued
+ */
+status_t vmi_event_respond(
+    vmi_instance_t vmi,
+    vmi_deferred_event_t *deferred,
+    event_response_t response) NOEXCEPT;
+
+#define VMI_SYSCALL_LINUX_ARGS 6
+#define VMI_SYSCALL_MAX_ARGS 19
+
+/**
+ * A syscall as it enters the kernel.
+ */
+typedef struct {
+    uint32_t vcpu;
+    uint32_t number;
+    const char *name;       /**< from the syscall table, NULL if unknown */
+    vmi_pid_t pid;          /**< calling process, -1 if unknown */
+    addr_t dtb;             /**< CR3 of the caller */
+    addr_t ret;             /**< user address the syscall returns to */
+    unsigned int nargs;     /**< 6 on Linux, from the table on Windows */
+    uint64_t args[VMI_SYSCALL_MAX_ARGS];
+} vmi_syscall_t;
+
+typedef void (*vmi_syscall_cb_t)(vmi_instance_t vmi, const vmi_syscall_t *syscall, void *data);
+
+typedef struct vmi_syscall_tracer *vmi_syscall_tracer_t;
+
+/**
+ * Trace the syscalls of a Linux or Windows x86-64 guest. The page holding
+ * the syscall entry is replaced in a new SLAT view by a copy with a
+ * breakpoint, the guest runs in that view. A hit steps over the entry in
+ * the original view and the VMM switches back without another event.
+ *
+ * The syscall table is resolved from the profile once, the callback gets
+ * each syscall decoded from the registers of the event. On Windows the
+ * stack arguments take a single read and the names are looked up in the
+ * symbols of the JSON profile, without one they are NULL. With KVA
+ * shadowing Windows enters syscalls on the user CR3, which vmi_dtb_to_pid
+ * does not know, so pid is -1.
+ *
+ * The tracer owns the INT3 event of the instance, breakpoints elsewhere
+ * are reinjected. It needs VMI_INIT_EVENTS and SLAT support, SLAT is
+ * turned off again when the tracer stops if it was off before.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] shadow_gfn A guest frame that is not used by the guest, it
+ *                       holds the copy of the entry page
+ * @param[in] callback Called for each syscall from vmi_events_listen
+ * @param[in] data Passed to the callback
+ * @param[out] tracer The tracer
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_syscall_trace_start(
+    vmi_instance_t vmi,
+    addr_t shadow_gfn,
+    vmi_syscall_cb_t callback,
+    void *data,
+    vmi_syscall_tracer_t *tracer) NOEXCEPT;
+
+/**
+ * Stop tracing syscalls. Not to be called from an event callback. Tracers
+ * still running are stopped by vmi_destroy.
+ *
+ * @param[in] tracer The tracer
+ */
+void vmi_syscall_trace_stop(
+    vmi_syscall_tracer_t tracer) NOEXCEPT;
+
 /**
  * Return the pointer to the vmi_event_t if one is set on the given vcpu.
  *
@@ -870,6 +1150,258 @@ status_t vmi_toggle_single_step_vcpu(
 status_t vmi_shutdown_single_step(
     vmi_instance_t) NOEXCEPT;
 
+/**
+ * An event scheduler shares a fixed pool of worker threads between the
+ * event loops of many instances. Instances with events pending, deferred
+ * responses to send or periodic tasks due are queued by priority, and a
+ * worker takes one at a time for a slice: a vmi_events_listen with no
+ * timeout followed by the tasks that are due. Use vmi_events_set_budget
+ * to bound how long a slice listens.
+ *
+ * The CPU time a worker spends in a slice, callbacks included, is charged
+ * to the instance. Once an instance has used its quota in a period it is
+ * not queued again before the next period; its paused vCPUs wait. A slice
+ * that runs past the quota is paid for from the following periods, so the
+ * instance's share of a CPU over time stays within the quota.
+ *
+ * An instance only ever runs on one worker at a time, but while it is
+ * added to a scheduler no other thread may use it.
+ */
+typedef struct vmi_scheduler *vmi_scheduler_t;
+
+typedef struct {
+    int priority;           /**< Instances with a higher priority are taken first */
+    uint32_t cpu_quota;     /**< CPU time per period in permille of one CPU, 0 for no limit */
+} vmi_sched_params_t;
+
+typedef struct {
+    uint64_t slices;        /**< Times a worker took the instance */
+    uint64_t cpu_ns;        /**< CPU time used by its slices */
+    uint64_t delay_ns;      /**< Total time it waited for a worker once queued */
+    uint64_t max_delay_ns;  /**< Longest wait for a worker */
+    uint64_t throttled;     /**< Periods in which its quota ran out */
+} vmi_sched_stats_t;
+
+/**
+ * Periodic task of an instance, run on the worker that holds the instance.
+ */
+typedef void (*vmi_sched_task_t)(vmi_instance_t vmi, void *data);
+
+/**
+ * Create an event scheduler.
+ *
+ * @param[in] workers Number of worker threads.
+ * @param[in] period_ms Length of the period CPU quotas apply to.
+ * @return The scheduler or NULL on error
+ */
+vmi_scheduler_t vmi_scheduler_create(
+    unsigned int workers,
+    uint32_t period_ms) NOEXCEPT;
+
+/**
+ * Add an instance initialized with VMI_INIT_EVENTS to a scheduler.
+ *
+ * @param[in] sched Scheduler
+ * @param[in] vmi LibVMI instance
+ * @param[in] params Priority and quota of the instance, NULL for defaults.
+ * @return VMI_FAILURE or VMI_SUCCESS
+ */
+status_t vmi_scheduler_add(
+    vmi_scheduler_t sched,
+    vmi_instance_t vmi,
+    const vmi_sched_params_t *params) NOEXCEPT;
+
+/**
+ * Run a task of an instance every interval. Its CPU time counts towards
+ * the quota of the instance.
+ *
+ * @param[in] sched Scheduler
+ * @param[in] vmi LibVMI instance added to the scheduler
+ * @param[in] interval_ms Time between runs.
+ * @param[in] task Task to run
+ * @param[in] data Passed to the task
+ * @return VMI_FAILURE or VMI_SUCCESS
+ */
+status_t vmi_scheduler_add_task(
+    vmi_scheduler_t sched,
+    vmi_instance_t vmi,
+    uint32_t interval_ms,
+    vmi_sched_task_t task,
+    void *data) NOEXCEPT;
+
+/**
+ * Remove an instance and its tasks from a scheduler, waiting for a slice
+ * in progress to finish. Must not be called from a callback or task of
+ * the instance.
+ *
+ * @param[in] sched Scheduler
+ * @param[in] vmi LibVMI instance
+ * @return VMI_FAILURE or VMI_SUCCESS
+ */
+status_t vmi_scheduler_remove(
+    vmi_scheduler_t sched,
+    vmi_instance_t vmi) NOEXCEPT;
+
+/**
+ * Get the scheduling statistics of an instance.
+ *
+ * @param[in] sched Scheduler
+ * @param[in] vmi LibVMI instance
+ * @param[out] stats Statistics since the instance was added
+ * @return VMI_FAILURE or VMI_SUCCESS
+ */
+status_t vmi_scheduler_get_stats(
+    vmi_scheduler_t sched,
+    vmi_instance_t vmi,
+    vmi_sched_stats_t *stats) NOEXCEPT;
+
+/**
+ * Stop the workers once their slices finish and free the scheduler. The
+ * instances are left as they are.
+ *
+ * @param[in] sched Scheduler
+ */
+void vmi_scheduler_destroy(
+    vmi_scheduler_t sched) NOEXCEPT;
+
+/**
+ * An event template is a plan of memory watches and breakpoints that is
+ * worked out once on a reference instance and then armed in any number of
+ * its clones. Symbols are resolved and translated on the reference only;
+ * the plan refers to guest frames, so it holds for clones whose kernel
+ * sits at the same physical addresses, such as clones of one snapshot.
+ * Applying a plan checks the bytes under its breakpoints before arming
+ * anything, and sets the access of contiguous frames with one call where
+ * the driver supports it.
+ *
+ * A template isn't changed by applying it, so it can be applied to
+ * instances from different threads once it's built.
+ */
+typedef struct vmi_event_template *vmi_event_template_t;
+
+/**
+ * Create an empty event template.
+ *
+ * @return The template or NULL on error
+ */
+vmi_event_template_t vmi_event_template_create(void) NOEXCEPT;
+
+/**
+ * Add a watched frame to a template. A frame watched more than once traps
+ * on any of the accesses. VMI_MEMACCESS_N, VMI_MEMACCESS_W2X and
+ * VMI_MEMACCESS_RWX2N can't be combined with other accesses.
+ *
+ * @param[in] tmpl Event template
+ * @param[in] gfn Guest frame
+ * @param[in] access VMI_MEMACCESS_* flags to trap on
+ * @return VMI_FAILURE if the access, or its combination with the frame's
+ *  earlier watches, can't be set
+ */
+status_t vmi_event_template_watch(
+    vmi_event_template_t tmpl,
+    addr_t gfn,
+    vmi_mem_access_t access) NOEXCEPT;
+
+/**
+ * Watch the frames backing a kernel symbol's range in a template.
+ *
+ * @param[in] tmpl Event template
+ * @param[in] reference LibVMI instance the symbol is resolved on
+ * @param[in] symbol Kernel symbol
+ * @param[in] size Size of the range from the symbol, in bytes
+ * @param[in] access VMI_MEMACCESS_* flags to trap on
+ * @return VMI_FAILURE or VMI_SUCCESS
+ */
+status_t vmi_event_template_watch_ksym(
+    vmi_event_template_t tmpl,
+    vmi_instance_t reference,
+    const char *symbol,
+    size_t size,
+    vmi_mem_access_t access) NOEXCEPT;
+
+/**
+ * Add a breakpoint on a kernel symbol to a template. The byte it replaces
+ * is read from the reference.
+ *
+ * @param[in] tmpl Event template
+ * @param[in] reference LibVMI instance the symbol is resolved on
+ * @param[in] symbol Kernel symbol
+ * @return VMI_FAILURE or VMI_SUCCESS
+ */
+status_t vmi_event_template_breakpoint(
+    vmi_event_template_t tmpl,
+    vmi_instance_t reference,
+    const char *symbol) NOEXCEPT;
+
+/**
+ * Number of memory events applying a template registers.
+ *
+ * @param[in] tmpl Event template
+ * @return Number of watched frames
+ */
+size_t vmi_event_template_watches(
+    vmi_event_template_t tmpl) NOEXCEPT;
+
+/**
+ * Find the breakpoint of a template at a physical address, for example the
+ * one an INT3 interrupt event was raised by. Breakpoints the template
+ * doesn't know are the guest's and should be reinjected.
+ *
+ * @param[in] tmpl Event template
+ * @param[in] pa Physical address of the breakpoint
+ * @param[out] symbol Optional, the symbol of the breakpoint
+ * @param[out] orig Optional, the byte the breakpoint replaced
+ * @return VMI_FAILURE or VMI_SUCCESS
+ */
+status_t vmi_event_template_lookup_breakpoint(
+    vmi_event_template_t tmpl,
+    addr_t pa,
+    const char **symbol,
+    uint8_t *orig) NOEXCEPT;
+
+/**
+ * Arm a template in an instance. Each watched frame gets a memory event
+ * copied from mem_event, with the gfn and access of the frame. The INT3
+ * interrupt event handling the breakpoints is registered by the caller.
+ * Can't be called from an event callback.
+ *
+ * @param[in] tmpl Event template
+ * @param[in] vmi LibVMI instance, a clone of the reference
+ * @param[in] mem_event Memory event the watches are copied from, with its
+ *                      callback and data. Not needed without watches.
+ * @param[out] events Array of the registered memory events, in the order
+ *                    of their gfn, to give back to vmi_event_template_remove
+ * @return VMI_FAILURE or VMI_SUCCESS
+ */
+status_t vmi_event_template_apply(
+    vmi_event_template_t tmpl,
+    vmi_instance_t vmi,
+    const vmi_event_t *mem_event,
+    vmi_event_t **events) NOEXCEPT;
+
+/**
+ * Disarm a template in an instance: restore the bytes under its breakpoints
+ * and clear and free the memory events vmi_event_template_apply returned.
+ * Can't be called from an event callback.
+ *
+ * @param[in] tmpl Event template
+ * @param[in] vmi LibVMI instance the template was applied to
+ * @param[in] events The memory events returned when it was applied
+ * @return VMI_FAILURE or VMI_SUCCESS
+ */
+status_t vmi_event_template_remove(
+    vmi_event_template_t tmpl,
+    vmi_instance_t vmi,
+    vmi_event_t *events) NOEXCEPT;
+
+/**
+ * Free an event template. Instances it was applied to are left as they are.
+ *
+ * @param[in] tmpl Event template
+ */
+void vmi_event_template_destroy(
+    vmi_event_template_t tmpl) NOEXCEPT;
+
 #pragma GCC visibility pop
 
 #ifdef __cplusplus
@@ -0,0 +1,290 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Event filters. The rules of a filter are compiled into one test per
+ * field, each holding the sorted and merged ranges let through, so an
+ * event costs a bisection per field. The drivers test the fields of the
+ * request as they received it and answer the events dropped themselves,
+ * before filling the vmi_event_t or converting the registers.
+ */
+
+#include <string.h>
+
+#include "private.h"
+
+struct filter_range {
+    uint64_t lo;
+    uint64_t hi;
+};
+
+struct filter_test {
+    vmi_filter_field_t field;
+    reg_t reg;
+    unsigned int nranges;
+    struct filter_range *ranges;    /* sorted and disjoint */
+};
+
+struct event_filter {
+    unsigned int ntests;
+    struct filter_test tests[];
+};
+
+EVENT_FILTER_X86_REGS(event_filter_x86_regs, x86_registers_t)
+
+/* Values an event does not have can't be judged, the event goes through */
+static bool
+filter_value(
+    const event_fields_t *fields,
+    const struct filter_test *test,
+    uint64_t *value)
+{
+    switch (test->field) {
+        case VMI_FILTER_REGISTER:
+            return fields->reg && fields->regs && fields->reg(fields->regs, test->reg, value);
+        case VMI_FILTER_REG_VALUE:
+            *value = fields->value;
+            return true;
+        case VMI_FILTER_GLA:
+            if (!fields->gla_valid)
+                return false;
+            *value = fields->gla;
+            return true;
+        case VMI_FILTER_GFN:
+            *value = fields->gfn;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool
+filter_test_match(
+    const struct filter_test *test,
+    uint64_t value)
+{
+    unsigned int lo = 0, hi = test->nranges;
+
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+
+        if (value < test->ranges[mid].lo)
+            hi = mid;
+        else if (value > test->ranges[mid].hi)
+            lo = mid + 1;
+        else
+            return true;
+    }
+
+    return false;
+}
+
+bool
+event_filtered(
+    vmi_instance_t vmi,
+    vmi_event_t *event,
+    const event_fields_t *fields)
+{
+    struct event_filter *filter = g_hash_table_lookup(vmi->event_filters, event);
+    unsigned int i;
+
+    if (!filter)
+        return false;
+
+    for (i = 0; i < filter->ntests; i++) {
+        uint64_t value;
+
+        if (filter_value(fields, &filter->tests[i], &value) &&
+                !filter_test_match(&filter->tests[i], value))
+            goto filtered;
+    }
+
+    return false;
+
+filtered:
+    /* a dropped value still moves the vCPU to another address space */
+    if (VMI_EVENT_REGISTER == event->type && event->reg_event.onswitch) {
+        event->vcpu_id = fields->vcpu;
+        event->reg_event.value = fields->value;
+        reg_event_unswitched(vmi, event);
+    }
+
+    return true;
+}
+
+static int
+compare_rules(
+    const void *a,
+    const void *b)
+{
+    const vmi_filter_rule_t *x = a;
+    const vmi_filter_rule_t *y = b;
+
+    if (x->field != y->field)
+        return x->field < y->field ? -1 : 1;
+    if (x->field == VMI_FILTER_REGISTER && x->reg != y->reg)
+        return x->reg < y->reg ? -1 : 1;
+    if (x->lo != y->lo)
+        return x->lo < y->lo ? -1 : 1;
+    return 0;
+}
+
+static bool
+filter_rule_valid(
+    const vmi_event_t *event,
+    const vmi_filter_rule_t *rule)
+{
+    x86_registers_t regs = { 0 };
+    uint64_t value;
+
+    if (rule->lo > rule->hi)
+        return false;
+
+    switch (rule->field) {
+        case VMI_FILTER_REGISTER:
+            /* only the registers event_filter_x86_regs knows */
+            return event_filter_x86_regs(&regs, rule->reg, &value);
+        case VMI_FILTER_REG_VALUE:
+            return VMI_EVENT_REGISTER == event->type;
+        case VMI_FILTER_GLA:
+        case VMI_FILTER_GFN:
+            return VMI_EVENT_MEMORY == event->type;
+        default:
+            return false;
+    }
+}
+
+static struct event_filter *
+filter_compile(
+    const vmi_event_t *event,
+    const vmi_filter_rule_t *rules,
+    size_t nrules)
+{
+    struct event_filter *filter = NULL;
+    struct filter_range *ranges;
+    struct filter_test *test = NULL;
+    vmi_filter_rule_t *sorted;
+    size_t i;
+
+    sorted = g_try_new(vmi_filter_rule_t, nrules);
+    if (!sorted)
+        return NULL;
+
+    memcpy(sorted, rules, nrules * sizeof(vmi_filter_rule_t));
+    qsort(sorted, nrules, sizeof(vmi_filter_rule_t), compare_rules);
+
+    for (i = 0; i < nrules; i++) {
+        if (!filter_rule_valid(event, &sorted[i])) {
+            dbprint(VMI_DEBUG_EVENTS, "--%s: rule %zu does not apply to the event\n", __FUNCTION__, i);
+            goto done;
+        }
+    }
+
+    filter = g_try_malloc0(sizeof(struct event_filter) +
+                           nrules * (sizeof(struct filter_test) + sizeof(struct filter_range)));
+    if (!filter)
+        goto done;
+
+    ranges = (struct filter_range *)&filter->tests[nrules];
+
+    for (i = 0; i < nrules; i++) {
+        const vmi_filter_rule_t *rule = &sorted[i];
+        struct filter_range *last;
+
+        if (!test || test->field != rule->field ||
+                (rule->field == VMI_FILTER_REGISTER && test->reg != rule->reg)) {
+            test = &filter->tests[filter->ntests++];
+            test->field = rule->field;
+            test->reg = rule->reg;
+            test->ranges = ranges;
+        }
+
+        /* overlapping and adjacent ranges are merged */
+        last = test->nranges ? &test->ranges[test->nranges - 1] : NULL;
+        if (last && (rule->lo <= last->hi || rule->lo - 1 == last->hi)) {
+            last->hi = MAX(last->hi, rule->hi);
+            continue;
+        }
+
+        ranges->lo = rule->lo;
+        ranges->hi = rule->hi;
+        ranges++;
+        test->nranges++;
+    }
+
+done:
+    g_free(sorted);
+    return filter;
+}
+
+status_t
+vmi_event_set_filter(
+    vmi_instance_t vmi,
+    vmi_event_t *event,
+    const vmi_filter_rule_t *rules,
+    size_t nrules)
+{
+    struct event_filter *filter;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !event || (nrules && !rules))
+        return VMI_FAILURE;
+
+    if (!(vmi->init_flags & VMI_INIT_EVENTS))
+        return VMI_FAILURE;
+#endif
+
+    if (!nrules) {
+        event_filter_remove(vmi, event);
+        return VMI_SUCCESS;
+    }
+
+    /* the drivers only test the events they can answer without a callback */
+    if (VMI_EVENT_MEMORY != event->type && VMI_EVENT_REGISTER != event->type &&
+            (VMI_EVENT_INTERRUPT != event->type || INT3 != event->interrupt_event.intr))
+        return VMI_FAILURE;
+
+    filter = filter_compile(event, rules, nrules);
+    if (!filter)
+        return VMI_FAILURE;
+
+    if (!vmi->event_filters)
+        vmi->event_filters = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+    g_hash_table_insert(vmi->event_filters, event, filter);
+    return VMI_SUCCESS;
+}
+
+void
+event_filter_remove(
+    vmi_instance_t vmi,
+    vmi_event_t *event)
+{
+    if (!vmi->event_filters)
+        return;
+
+    g_hash_table_remove(vmi->event_filters, event);
+
+    /* dispatching only looks filters up while there are any */
+    if (!g_hash_table_size(vmi->event_filters)) {
+        g_hash_table_destroy(vmi->event_filters);
+        vmi->event_filters = NULL;
+    }
+}
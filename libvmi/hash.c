@@ -0,0 +1,387 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include "private.h"
+#include "driver/driver_wrapper.h"
+
+/*
+ * XXH64, as described in the xxHash specification. Page hashes have to be
+ * the same across processes and hosts so only the portable variant is used.
+ */
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t
+rotl64(
+    uint64_t x,
+    unsigned int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+read64(
+    const uint8_t *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return GUINT64_FROM_LE(v);
+}
+
+static inline uint32_t
+read32(
+    const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return GUINT32_FROM_LE(v);
+}
+
+static inline uint64_t
+xxh64_round(
+    uint64_t acc,
+    uint64_t input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t
+xxh64_merge(
+    uint64_t acc,
+    uint64_t val)
+{
+    acc ^= xxh64_round(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+uint64_t
+xxh64(
+    const void *data,
+    size_t len,
+    uint64_t seed)
+{
+    const uint8_t *p = data;
+    const uint8_t *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+        uint64_t v2 = seed + XXH_PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - XXH_PRIME64_1;
+
+        do {
+            v1 = xxh64_round(v1, read64(p));
+            v2 = xxh64_round(v2, read64(p + 8));
+            v3 = xxh64_round(v3, read64(p + 16));
+            v4 = xxh64_round(v4, read64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh64_merge(h, v1);
+        h = xxh64_merge(h, v2);
+        h = xxh64_merge(h, v3);
+        h = xxh64_merge(h, v4);
+    } else {
+        h = seed + XXH_PRIME64_5;
+    }
+
+    h += len;
+
+    for (; end - p >= 8; p += 8) {
+        h ^= xxh64_round(0, read64(p));
+        h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+
+    if (end - p >= 4) {
+        h ^= (uint64_t)read32(p) * XXH_PRIME64_1;
+        h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+
+    for (; p < end; p++) {
+        h ^= *p * XXH_PRIME64_5;
+        h = rotl64(h, 11) * XXH_PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/*
+ * Hash of a 4KB page frame. Drivers that keep page hashes around answer
+ * directly, the others have the page read and hashed.
+ */
+static status_t
+page_hash(
+    vmi_instance_t vmi,
+    uint8_t *buf,
+    addr_t pfn,
+    uint64_t *hash)
+{
+    if (vmi->driver.get_page_hash_ptr)
+        return driver_get_page_hash(vmi, pfn, hash);
+
+    if (VMI_FAILURE == vmi_read_pa(vmi, pfn << 12, VMI_PS_4KB, buf, NULL))
+        return VMI_FAILURE;
+
+    *hash = xxh64(buf, VMI_PS_4KB, 0);
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_diff_pages(
+    vmi_instance_t vmi,
+    vmi_instance_t other,
+    uint64_t *bitmap,
+    size_t nr_pages)
+{
+    uint8_t *buf;
+    size_t pfn;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !other || !bitmap)
+        return VMI_FAILURE;
+#endif
+
+    buf = g_try_malloc(VMI_PS_4KB);
+    if (!buf)
+        return VMI_FAILURE;
+
+    memset(bitmap, 0, ((nr_pages + 63) / 64) * sizeof(uint64_t));
+
+    for (pfn = 0; pfn < nr_pages; pfn++) {
+        uint64_t a = 0, b = 0;
+        status_t ra = page_hash(vmi, buf, pfn, &a);
+        status_t rb = page_hash(other, buf, pfn, &b);
+
+        /* a page missing from both images is no difference */
+        if (ra != rb || (VMI_SUCCESS == ra && a != b))
+            bitmap[pfn / 64] |= 1ull << (pfn % 64);
+    }
+
+    g_free(buf);
+    return VMI_SUCCESS;
+}
+
+static inline bool
+page_is_dirty(
+    const uint64_t *dirty,
+    size_t nr_dirty,
+    addr_t pfn)
+{
+    /* frames the bitmap does not cover are always hashed */
+    return !dirty || pfn >= nr_dirty || (dirty[pfn / 64] & (1ull << (pfn % 64)));
+}
+
+/*
+ * Hash a single frame. Only drivers that can't map guest memory have it
+ * read through the page cache.
+ */
+static status_t
+hash_frame(
+    vmi_instance_t vmi,
+    uint8_t *buf,
+    addr_t pfn,
+    uint64_t *hash)
+{
+    if (vmi->driver.mmap_guest) {
+        unsigned long _pfn = pfn;
+        void *map = driver_mmap_guest(vmi, &_pfn, 1);
+
+        if (MAP_FAILED == map || !map)
+            return VMI_FAILURE;
+
+        *hash = xxh64(map, vmi->page_size, 0);
+        munmap(map, vmi->page_size);
+        return VMI_SUCCESS;
+    }
+
+    if (vmi->page_size == VMI_PS_4KB)
+        return page_hash(vmi, buf, pfn, hash);
+
+    if (VMI_FAILURE == vmi_read_pa(vmi, pfn << vmi->page_shift, vmi->page_size, buf, NULL))
+        return VMI_FAILURE;
+
+    *hash = xxh64(buf, vmi->page_size, 0);
+    return VMI_SUCCESS;
+}
+
+static status_t
+hash_batch(
+    vmi_instance_t vmi,
+    uint8_t *buf,
+    unsigned long *pfns,
+    size_t *slots,
+    unsigned int n,
+    uint64_t *hashes)
+{
+    status_t ret = VMI_SUCCESS;
+    uint8_t *map = NULL;
+    unsigned int i;
+
+    if (vmi->driver.mmap_guest)
+        map = driver_mmap_guest(vmi, pfns, n);
+
+    if (map && MAP_FAILED != (void *)map) {
+        for (i = 0; i < n; i++)
+            hashes[slots[i]] = xxh64(map + ((size_t)i << vmi->page_shift), vmi->page_size, 0);
+
+        munmap(map, (size_t)n << vmi->page_shift);
+        return VMI_SUCCESS;
+    }
+
+    /* a single missing frame fails the whole mapping */
+    for (i = 0; i < n; i++) {
+        if (VMI_FAILURE == hash_frame(vmi, buf, pfns[i], &hashes[slots[i]])) {
+            dbprint(VMI_DEBUG_READ, "--%s: failed to hash pfn 0x%lx\n", __FUNCTION__, pfns[i]);
+            hashes[slots[i]] = 0;
+            ret = VMI_FAILURE;
+        }
+    }
+
+    return ret;
+}
+
+static status_t
+hash_range(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    size_t len,
+    vmi_hash_algo_t algo,
+    const uint64_t *dirty,
+    size_t nr_dirty,
+    uint64_t *hashes)
+{
+    status_t ret = VMI_SUCCESS;
+    access_handle_t handle;
+    page_mode_t pm;
+    addr_t start, paddr;
+    size_t npages, i;
+    unsigned long *pfns = NULL;
+    size_t *slots = NULL;
+    uint8_t *buf = NULL;
+    unsigned int n = 0;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !ctx || !hashes)
+        return VMI_FAILURE;
+#endif
+
+    if (algo != VMI_HASH_XXH64) {
+        dbprint(VMI_DEBUG_MISC, "--%s: unsupported hash algorithm %d\n", __FUNCTION__, algo);
+        return VMI_FAILURE;
+    }
+
+    if (!len)
+        return VMI_SUCCESS;
+
+    if (VMI_FAILURE == vmi_compile_access_context(vmi, ctx, &handle))
+        return VMI_FAILURE;
+
+    pm = VMI_TM_NONE == handle.ctx.tm ? VMI_PM_NONE : handle.ctx.pm;
+    start = handle.ctx.addr & ~((addr_t)vmi->page_size - 1);
+    npages = (handle.ctx.addr + len - start + vmi->page_size - 1) >> vmi->page_shift;
+
+    pfns = g_try_new(unsigned long, HASH_RANGE_BATCH);
+    slots = g_try_new(size_t, HASH_RANGE_BATCH);
+    buf = g_try_malloc(vmi->page_size);
+    if (!pfns || !slots || !buf) {
+        ret = VMI_FAILURE;
+        goto done;
+    }
+
+    for (i = 0; i < npages; i++) {
+        addr_t va = start + ((addr_t)i << vmi->page_shift);
+
+        if (VMI_FAILURE == translate_read_addr(vmi, &handle.ctx, handle.ctx.pt, pm, va, &paddr)) {
+            dbprint(VMI_DEBUG_READ, "--%s: 0x%"PRIx64" is not mapped\n", __FUNCTION__, va);
+            hashes[i] = 0;
+            ret = VMI_FAILURE;
+            continue;
+        }
+
+        if (!page_is_dirty(dirty, nr_dirty, paddr >> vmi->page_shift))
+            continue;
+
+        pfns[n] = paddr >> vmi->page_shift;
+        slots[n] = i;
+        if (++n < HASH_RANGE_BATCH)
+            continue;
+
+        if (VMI_FAILURE == hash_batch(vmi, buf, pfns, slots, n, hashes))
+            ret = VMI_FAILURE;
+        n = 0;
+    }
+
+    if (n && VMI_FAILURE == hash_batch(vmi, buf, pfns, slots, n, hashes))
+        ret = VMI_FAILURE;
+
+done:
+    g_free(buf);
+    g_free(slots);
+    g_free(pfns);
+    return ret;
+}
+
+status_t
+vmi_hash_range(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    size_t len,
+    vmi_hash_algo_t algo,
+    uint64_t *hashes)
+{
+    return hash_range(vmi, ctx, len, algo, NULL, 0, hashes);
+}
+
+status_t
+vmi_rehash_range(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    size_t len,
+    vmi_hash_algo_t algo,
+    const uint64_t *dirty,
+    size_t nr_pages,
+    uint64_t *hashes)
+{
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!dirty)
+        return VMI_FAILURE;
+#endif
+
+    return hash_range(vmi, ctx, len, algo, dirty, nr_pages, hashes);
+}
@@ -63,11 +63,13 @@ bool json_profile_init(vmi_instance_t vmi, const char* path)
             json->handler = volatility_ist_symbol_to_rva;
             json->bitfield_offset_and_size = volatility_profile_bitfield_offset_and_size;
             json->get_os_type = volatility_get_os_type;
+            json->symbol_foreach = volatility_ist_symbol_foreach;
             break;
         case JPT_REKALL_PROFILE:
             json->handler = rekall_profile_symbol_to_rva;
             json->bitfield_offset_and_size = rekall_profile_bitfield_offset_and_size;
             json->get_os_type = rekall_get_os_type;
+            json->symbol_foreach = rekall_profile_symbol_foreach;
             break;
         default:
             return false;
@@ -99,6 +101,14 @@ status_t vmi_get_symbol_addr_from_json(vmi_instance_t vmi, json_object* json, co
     return vmi->json.handler(json, symbol, NULL, addr, NULL);
 }
 
+status_t json_profile_symbol_foreach(vmi_instance_t vmi, json_symbol_cb_t callback, void *data)
+{
+    if ( !vmi->json.symbol_foreach )
+        return VMI_FAILURE;
+
+    return vmi->json.symbol_foreach(vmi->json.root, callback, data);
+}
+
 status_t vmi_get_struct_size_from_json(vmi_instance_t vmi, json_object* json, const char* struct_name, size_t* size)
 {
     if ( !vmi->json.handler )
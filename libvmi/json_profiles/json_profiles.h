@@ -28,6 +28,9 @@
 
 #include <json-c/json.h>
 #include "private.h"
+
+typedef void (*json_symbol_cb_t)(const char *symbol, addr_t rva, void *data);
+
 #include "json_profiles/rekall.h"
 #include "json_profiles/volatility_ist.h"
 
@@ -54,11 +57,19 @@ typedef struct json_interface {
 
     const char* (*get_os_type)(
         vmi_instance_t vmi);
+
+    status_t (*symbol_foreach)(
+        json_object *json,
+        json_symbol_cb_t callback,
+        void *data);
 } json_interface_t;
 
 bool json_profile_init(vmi_instance_t vmi, const char* path);
 
 void json_profile_destroy(vmi_instance_t vmi);
 
+/* Call back for each symbol of the kernel profile with its RVA */
+status_t json_profile_symbol_foreach(vmi_instance_t vmi, json_symbol_cb_t callback, void *data);
+
 #endif
 #endif /* LIBVMI_JSON_PROFILES_H */
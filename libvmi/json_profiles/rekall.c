@@ -288,3 +288,33 @@ const char* rekall_get_os_type(vmi_instance_t vmi)
 
     return NULL;
 }
+
+status_t
+rekall_profile_symbol_foreach(
+    json_object *json,
+    json_symbol_cb_t callback,
+    void *data)
+{
+    const char *sections[] = { "$CONSTANTS", "$FUNCTIONS" };
+    status_t ret = VMI_FAILURE;
+    json_object *section = NULL;
+    struct json_object_iterator iter, iend;
+    unsigned int i;
+
+    for (i = 0; i < sizeof(sections) / sizeof(sections[0]); i++) {
+        if (!json_object_object_get_ex(json, sections[i], &section)) {
+            dbprint(VMI_DEBUG_MISC, "Rekall profile: no %s section found\n", sections[i]);
+            continue;
+        }
+
+        iter = json_object_iter_begin(section);
+        iend = json_object_iter_end(section);
+
+        for (; !json_object_iter_equal(&iter, &iend); json_object_iter_next(&iter))
+            callback(json_object_iter_peek_name(&iter), json_object_get_int64(json_object_iter_peek_value(&iter)), data);
+
+        ret = VMI_SUCCESS;
+    }
+
+    return ret;
+}
@@ -43,6 +43,12 @@ rekall_profile_bitfield_offset_and_size(
     addr_t *rva,
     size_t *start_bit,
     size_t *end_bit);
+
+status_t
+rekall_profile_symbol_foreach(
+    json_object *json,
+    json_symbol_cb_t callback,
+    void *data);
 #else
 
 static inline status_t rekall_profile_symbol_to_rva(
@@ -72,5 +78,14 @@ static inline const char *rekall_get_os_type(vmi_instance_t vmi)
     return NULL;
 }
 
+static inline status_t
+rekall_profile_symbol_foreach(
+    json_object *json,
+    json_symbol_cb_t callback,
+    void *data)
+{
+    return VMI_FAILURE;
+}
+
 #endif
 #endif /* LIBVMI_REKALL_H */
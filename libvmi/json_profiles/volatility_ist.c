@@ -213,6 +213,37 @@ exit:
     return ret;
 }
 
+status_t
+volatility_ist_symbol_foreach(
+    json_object *json,
+    json_symbol_cb_t callback,
+    void *data)
+{
+    json_object *symbols = NULL, *address = NULL;
+    struct json_object_iterator iter, iend;
+
+    if (!json_object_object_get_ex(json, "symbols", &symbols)) {
+        dbprint(VMI_DEBUG_MISC, "Volatility IST profile: no symbols section found\n");
+        return VMI_FAILURE;
+    }
+
+    iter = json_object_iter_begin(symbols);
+    iend = json_object_iter_end(symbols);
+
+    for (; !json_object_iter_equal(&iter, &iend); json_object_iter_next(&iter)) {
+        if (!json_object_object_get_ex(json_object_iter_peek_value(&iter), "address", &address))
+            continue;
+
+#ifdef JSONC_UINT64_SUPPORT
+        callback(json_object_iter_peek_name(&iter), json_object_get_uint64(address), data);
+#else
+        callback(json_object_iter_peek_name(&iter), json_object_get_int64(address), data);
+#endif
+    }
+
+    return VMI_SUCCESS;
+}
+
 const char *volatility_get_os_type(vmi_instance_t vmi)
 {
     json_object *metadata = NULL, *os = NULL;
@@ -44,6 +44,12 @@ volatility_profile_bitfield_offset_and_size(
     size_t *start_bit,
     size_t *end_bit);
 
+status_t
+volatility_ist_symbol_foreach(
+    json_object *json,
+    json_symbol_cb_t callback,
+    void *data);
+
 #else
 
 static inline status_t volatility_ist_symbol_to_rva(
@@ -72,6 +78,15 @@ volatility_profile_bitfield_offset_and_size(
     return VMI_FAILURE;
 }
 
+static inline status_t
+volatility_ist_symbol_foreach(
+    __attribute__((__unused__)) json_object *json,
+    __attribute__((__unused__)) json_symbol_cb_t callback,
+    __attribute__((__unused__)) void *data)
+{
+    return VMI_FAILURE;
+}
+
 #endif
 
 #endif /* LIBVMI_VOLATILITY_IST_H */
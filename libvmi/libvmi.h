@@ -200,6 +200,13 @@ typedef enum page_size {
 
 } page_size_t;
 
+/**
+ * Hash algorithms of vmi_hash_range
+ */
+typedef enum {
+    VMI_HASH_XXH64  /**< 64-bit xxHash, seed 0 */
+} vmi_hash_algo_t;
+
 #define VMI_INVALID_DOMID ~0ULL /**< invalid domain id */
 
 /**
@@ -210,7 +217,9 @@ typedef enum {
 
     VMI_INIT_DATA_MEMMAP,    /**< memory_map_t pointer */
 
-    VMI_INIT_DATA_KVMI_SOCKET     /**< kvmi socket path */
+    VMI_INIT_DATA_KVMI_SOCKET,    /**< kvmi socket path */
+
+    VMI_INIT_DATA_FILE_PAGE_STORE /**< share file pages between instances, data unused */
 } vmi_init_data_type_t;
 
 /**
@@ -791,6 +800,19 @@ typedef struct {
     };
 } access_context_t;
 
+/**
+ * An access context with its kernel symbol or PID already resolved, see
+ * vmi_compile_access_context(). The resolved context can be passed to
+ * any access function directly as long as no symbol or PID cache entry
+ * changed since it was compiled, vmi_read_handle() and vmi_write_handle()
+ * check for that and recompile the handle when needed.
+ */
+typedef struct {
+    access_context_t ctx;       /**< resolved context, VMI_TM_NONE or VMI_TM_PROCESS_DTB */
+    access_context_t source;    /**< context the handle was compiled from */
+    uint64_t generation;        /**< cache generation the handle was compiled in */
+} access_handle_t;
+
 /**
  * Macro to test bitfield values (up to 64-bits)
  */
@@ -813,6 +835,132 @@ typedef struct _ustring {
     const char *encoding;  /**< holds iconv-compatible encoding of contents; do not free */
 } unicode_string_t;
 
+/**
+ * Struct describing an image loaded into an address space
+ * (kernel module, shared library, DLL)
+ */
+typedef struct module_info {
+    addr_t base;        /**< base virtual address of the image */
+    addr_t size;        /**< size of the image in bytes */
+    addr_t entry;       /**< virtual address of the OS structure describing the image */
+    addr_t name_addr;   /**< virtual address the name was read from */
+    const char *name;   /**< UTF-8 name of the image, owned by the module list */
+} module_info_t;
+
+/**
+ * Snapshot of the images loaded into an address space.
+ * Allocated as a single block, release it with vmi_free_module_list.
+ */
+typedef struct module_list {
+    vmi_pid_t pid;          /**< process the list was taken from (0 for kernel) */
+    uint32_t _pad;
+    size_t count;           /**< number of entries in modules */
+    module_info_t *modules; /**< entries in the order the OS keeps them */
+} module_list_t;
+
+/**
+ * Struct describing a virtual memory region of a process
+ * (vm_area_struct on Linux, VAD on Windows)
+ */
+typedef struct vm_region {
+    addr_t start;       /**< first virtual address of the region */
+    addr_t end;         /**< first virtual address past the region */
+    uint64_t flags;     /**< OS specific flags (vm_flags on Linux) */
+    uint32_t type;      /**< OS specific region type, 0 where unused */
+    uint8_t access;     /**< protection as VMI_MEMACCESS_R/W/X bits */
+    uint8_t _pad[3];
+    addr_t object;      /**< virtual address of the OS structure describing the region */
+    addr_t file;        /**< virtual address of the backing file object, 0 if anonymous */
+    const char *name;   /**< name of the backing file, NULL if anonymous */
+} vm_region_t;
+
+/**
+ * Snapshot of the memory regions of a process, sorted by start address.
+ * Allocated as a single block, release it with vmi_free_region_list.
+ */
+typedef struct vm_region_list {
+    vmi_pid_t pid;          /**< process the list was taken from */
+    uint32_t _pad;
+    size_t count;           /**< number of entries in regions */
+    vm_region_t *regions;   /**< entries sorted by start address */
+} vm_region_list_t;
+
+/**
+ * Member of a struct to include in a partial read, see
+ * vmi_read_struct_fields.
+ */
+typedef struct struct_field {
+    const char *member; /**< name of the member in the JSON profile */
+    size_t size;        /**< number of bytes of the member needed */
+} struct_field_t;
+
+/**
+ * Local copy of a guest struct read by vmi_read_struct or
+ * vmi_read_struct_fields. Zero initialize it before the first read, the
+ * buffer is reused by subsequent reads into the same view. Release it with
+ * vmi_free_struct_view.
+ */
+typedef struct struct_view {
+    const void *layout; /**< LibVMI internal, the memoised struct layout */
+    addr_t addr;        /**< guest virtual address of the struct */
+    size_t size;        /**< size of the struct according to the profile */
+    size_t start;       /**< struct offset of the first byte in data */
+    size_t len;         /**< number of bytes in data */
+    size_t capacity;    /**< allocated size of data */
+    uint8_t *data;      /**< the bytes read from the guest */
+} struct_view_t;
+
+/**
+ * Field captured from every node of a list walk, see vmi_walk_list.
+ */
+typedef struct list_field {
+    addr_t offset;      /**< offset of the field from the start of the node */
+    size_t size;        /**< size of the field in bytes */
+} list_field_t;
+
+/**
+ * Why a list walk stopped.
+ */
+typedef enum list_walk_end {
+    VMI_LIST_WALK_COMPLETE,     /**< the walk got back to the list head */
+    VMI_LIST_WALK_CYCLE,        /**< a node was reached twice without passing the head */
+    VMI_LIST_WALK_BAD_LINK,     /**< a link was NULL, misaligned or unreadable */
+    VMI_LIST_WALK_LIMIT         /**< the maximum number of nodes was reached */
+} list_walk_end_t;
+
+/**
+ * Nodes and captured fields of a list walk. The fields of node i start at
+ * records + i * record_size, in the order they were requested and without
+ * padding. Allocated as a single block, release it with vmi_free_list_walk.
+ */
+typedef struct list_walk {
+    list_walk_end_t end;    /**< why the walk stopped */
+    uint32_t _pad;
+    size_t count;           /**< number of nodes */
+    size_t record_size;     /**< sum of the sizes of the captured fields */
+    addr_t *nodes;          /**< address of each node, not of its links */
+    uint8_t *records;       /**< captured fields of each node */
+} list_walk_t;
+
+/**
+ * Header of a delta memory image, as opened by the file driver. It is
+ * followed by page_count page frame numbers (uint64_t, ascending) and then
+ * by the pages in the same order. Pages that are not in the delta are read
+ * from the parent image, the root of the chain is a raw memory image.
+ */
+#define VMI_DELTA_MAGIC "VMIDELTA"
+#define VMI_DELTA_VERSION 1
+
+typedef struct vmi_delta_header {
+    char magic[8];          /**< VMI_DELTA_MAGIC, not NUL terminated */
+    uint32_t version;       /**< VMI_DELTA_VERSION */
+    uint32_t page_shift;    /**< size of the pages in the delta */
+    uint64_t memory_size;   /**< size of the guest physical memory */
+    uint64_t page_count;    /**< number of pages in the delta */
+    char parent[4096];      /**< path of the parent image, relative to the
+                                 directory of the delta unless absolute */
+} vmi_delta_header_t;
+
 /**
  * @brief LibVMI Instance.
  *
@@ -823,6 +971,11 @@ typedef struct _ustring {
  */
 typedef struct vmi_instance *vmi_instance_t;
 
+/**
+ * @brief A lazily filled host mapping of guest memory, see vmi_window_create.
+ */
+typedef struct vmi_window *vmi_window_t;
+
 /*---------------------------------------------------------
  * Initialization and Destruction functions from core.c
  */
@@ -1208,6 +1361,40 @@ status_t vmi_read(
     void *buf,
     size_t *bytes_read) NOEXCEPT;
 
+/**
+ * Resolves the kernel symbol or PID of an access context once, so that
+ * repeated accesses through the handle skip the symbol and PID lookups.
+ * The handle keeps a copy of ctx, a kernel symbol string has to stay
+ * valid for as long as the handle is used.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] ctx Access context to resolve
+ * @param[out] handle The resolved handle
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_compile_access_context(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    access_handle_t *handle) NOEXCEPT;
+
+/**
+ * Reads count bytes from memory through a compiled access handle. The
+ * handle is recompiled first if the symbol or PID caches changed.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in,out] handle Compiled access handle
+ * @param[in] count The number of bytes to read
+ * @param[out] buf The data read from memory
+ * @param[out] bytes_read Optional. The number of bytes read
+ * @return VMI_SUCCESS if read is complete, VMI_FAILURE otherwise
+ */
+status_t vmi_read_handle(
+    vmi_instance_t vmi,
+    access_handle_t *handle,
+    size_t count,
+    void *buf,
+    size_t *bytes_read) NOEXCEPT;
+
 /**
  * Reads 8 bits from memory.
  *
@@ -1378,6 +1565,51 @@ status_t vmi_mmap_guest(
     void **access_ptrs
 ) NOEXCEPT;
 
+/**
+ * Reserves a host range mirroring num_pages of a guest address space,
+ * starting at the page of ctx.addr. Nothing is translated or read up
+ * front: the first access to each page translates its guest address and
+ * copies the frame in, through userfaultfd. Guest memory can then be
+ * used through plain pointers. A page that is not mapped in the guest
+ * reads as zeroes.
+ *
+ * Pages are filled from a thread of the window while the accessing thread
+ * waits, so the instance must not be used from other threads while the
+ * window is accessed. Only available on Linux hosts with userfaultfd.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] ctx Access context of the start of the window
+ * @param[in] num_pages Number of guest pages in the window
+ * @param[out] window The window, release it with vmi_window_destroy
+ * @param[out] base Host address of ctx.addr
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_window_create(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    size_t num_pages,
+    vmi_window_t *window,
+    void **base) NOEXCEPT;
+
+/**
+ * Drops the pages of a window filled so far and the cached translations
+ * of its address space, so the next access of each page translates and
+ * reads it again. Use it after the guest ran or changed its page tables.
+ *
+ * @param[in] window The window
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_window_invalidate(
+    vmi_window_t window) NOEXCEPT;
+
+/**
+ * Unmaps a window. Windows still open are destroyed with their instance.
+ *
+ * @param[in] window The window
+ */
+void vmi_window_destroy(
+    vmi_window_t window) NOEXCEPT;
+
 /**
  * Reads count bytes from memory located at the physical address paddr
  * and stores the output in a buf.
@@ -1705,6 +1937,24 @@ status_t vmi_write(
     void *buf,
     size_t *bytes_written) NOEXCEPT;
 
+/**
+ * Writes count bytes to memory through a compiled access handle. The
+ * handle is recompiled first if the symbol or PID caches changed.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in,out] handle Compiled access handle
+ * @param[in] count The number of bytes to write
+ * @param[in] buf The data written to memory
+ * @param[out] bytes_written Optional. The numer of bytes written
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_write_handle(
+    vmi_instance_t vmi,
+    access_handle_t *handle,
+    size_t count,
+    void *buf,
+    size_t *bytes_written) NOEXCEPT;
+
 /**
  * Writes count bytes to memory located at the kernel symbol sym
  * from a buf.
@@ -2466,6 +2716,100 @@ status_t vmi_pause_vm(
 status_t vmi_resume_vm(
     vmi_instance_t vmi) NOEXCEPT;
 
+/**
+ * Starts or stops logging the guest pages written by the VM. Only
+ * supported on Xen, where it uses the log-dirty mode also used by live
+ * migration.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] enable Start logging if set, stop it otherwise
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_set_dirty_logging(
+    vmi_instance_t vmi,
+    bool enable) NOEXCEPT;
+
+/**
+ * Retrieves the pages written since dirty logging was started or since
+ * the previous call, and clears the log. Bit n of the bitmap (bit n % 64
+ * of bitmap[n / 64]) is set if page frame n was written.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[out] bitmap Array of at least (nr_pages + 63) / 64 words
+ * @param[in] nr_pages Number of page frames covered by the bitmap
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_get_dirty_pages(
+    vmi_instance_t vmi,
+    uint64_t *bitmap,
+    size_t nr_pages) NOEXCEPT;
+
+/**
+ * Compares the physical memory of two instances page by page, typically
+ * two memory images of the same VM taken at different times. Bit n of the
+ * bitmap (bit n % 64 of bitmap[n / 64]) is set if the 4KB page frame n
+ * differs. Pages are compared by their 64-bit hash, which memory images
+ * keep once computed, so repeated comparisons only read the pages of the
+ * images not compared before.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] other LibVMI instance to compare with
+ * @param[out] bitmap Array of at least (nr_pages + 63) / 64 words
+ * @param[in] nr_pages Number of page frames to compare
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_diff_pages(
+    vmi_instance_t vmi,
+    vmi_instance_t other,
+    uint64_t *bitmap,
+    size_t nr_pages) NOEXCEPT;
+
+/**
+ * Hashes each page touched by a range of guest memory, such as the text
+ * of the kernel. The whole of every page is hashed, including the parts
+ * outside the range. The range is translated once and, where the driver
+ * supports it, the frames are mapped in batches instead of being read
+ * through the page cache.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] ctx Access context of the start of the range
+ * @param[in] len Length of the range in bytes
+ * @param[in] algo Hash algorithm
+ * @param[out] hashes One hash per page, an unmapped page hashes to 0
+ * @return VMI_SUCCESS, or VMI_FAILURE if any page could not be hashed
+ */
+status_t vmi_hash_range(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    size_t len,
+    vmi_hash_algo_t algo,
+    uint64_t *hashes) NOEXCEPT;
+
+/**
+ * Like vmi_hash_range, but only hashes the pages whose frame is set in a
+ * bitmap of dirty frames, as filled by vmi_get_dirty_pages. The hashes of
+ * the other pages are left as they are, so a sweep can keep the hashes of
+ * its previous run and only rehash the pages written since.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] ctx Access context of the start of the range
+ * @param[in] len Length of the range in bytes
+ * @param[in] algo Hash algorithm
+ * @param[in] dirty Bitmap of the frames to rehash
+ * @param[in] nr_pages Number of frames covered by the bitmap, frames
+ *                     beyond it are always hashed
+ * @param[in,out] hashes One hash per page, an unmapped page hashes to 0
+ * @return VMI_SUCCESS, or VMI_FAILURE if any page could not be hashed
+ */
+status_t vmi_rehash_range(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    size_t len,
+    vmi_hash_algo_t algo,
+    const uint64_t *dirty,
+    size_t nr_pages,
+    uint64_t *hashes) NOEXCEPT;
+
 /**
  * Removes all entries from LibVMI's internal virtual to physical address
  * cache.  This is generally only useful if you believe that an entry in
@@ -2662,6 +3006,291 @@ const char *vmi_get_rekall_path(
 const char *vmi_get_os_profile_path(
     vmi_instance_t vmi) NOEXCEPT;
 
+/*---------------------------------------------------------
+ * Loaded module functions from modules.c
+ */
+
+/**
+ * Takes a snapshot of the images loaded into the kernel or into a process.
+ * On Windows this walks PsLoadedModuleList or the PEB loader list, on Linux
+ * the kernel's modules list or the file-backed mappings of the process.
+ *
+ * Each list entry is fetched with a single read. If a previous snapshot of
+ * the same address space is provided, the names of entries that did not
+ * change since are copied from it instead of being read from the guest again.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] pid Process to enumerate, 0 for kernel modules
+ * @param[in] prev Optional. Previous snapshot of the same address space
+ * @param[out] list The snapshot, free with vmi_free_module_list
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_get_modules(
+    vmi_instance_t vmi,
+    vmi_pid_t pid,
+    const module_list_t *prev,
+    module_list_t **list) NOEXCEPT;
+
+/**
+ * Compares two snapshots of the same address space. A module is considered
+ * unchanged if an entry with the same base, size and name exists in both.
+ *
+ * @param[in] prev The older snapshot
+ * @param[in] curr The newer snapshot
+ * @param[out] loaded Optional. Modules only present in curr
+ * @param[out] unloaded Optional. Modules only present in prev
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_diff_module_lists(
+    const module_list_t *prev,
+    const module_list_t *curr,
+    module_list_t **loaded,
+    module_list_t **unloaded) NOEXCEPT;
+
+/**
+ * Frees a module list returned by vmi_get_modules or vmi_diff_module_lists.
+ *
+ * @param[in] list The list to free
+ */
+void vmi_free_module_list(
+    module_list_t *list) NOEXCEPT;
+
+/**
+ * Finds the module containing a virtual address, looking first at the
+ * images loaded into the process of the given DTB and then at the kernel
+ * modules. The per-DTB index is built on first use and refreshed lazily:
+ * an address that is not covered triggers a new snapshot, at most once
+ * every 100ms per address space. Hits never access guest memory.
+ * On Linux the core kernel text is reported as "vmlinux".
+ *
+ * The module base can be used with vmi_translate_v2sym to symbolise the
+ * address further.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] dtb The process address space, or 0 for kernel modules only
+ * @param[in] va Virtual address to look up
+ * @param[out] base Optional. Base address of the module
+ * @param[out] name Optional. Name of the module, owned by LibVMI and valid
+ *                  until the next call to this function or to
+ *                  vmi_module_index_flush
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_addr_to_module(
+    vmi_instance_t vmi,
+    addr_t dtb,
+    addr_t va,
+    addr_t *base,
+    const char **name) NOEXCEPT;
+
+/**
+ * Removes entries from LibVMI's internal address to module index. The
+ * index is refreshed on misses, so this is only needed if a module was
+ * replaced by another one at the same address or a DTB got reused.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] dtb The process address space to flush, 0 for the kernel
+ *                modules or ~0ull for all.
+ */
+void vmi_module_index_flush(
+    vmi_instance_t vmi,
+    addr_t dtb) NOEXCEPT;
+
+/*---------------------------------------------------------
+ * Memory region functions from regions.c
+ */
+
+/**
+ * Takes a snapshot of the virtual memory regions of a process, including
+ * the ones that are not currently backed by physical memory. On Linux this
+ * walks the maple tree of the mm_struct (or the VMA list on kernels before
+ * 6.1), on Windows the VAD tree.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] pid Process to enumerate
+ * @param[out] list The snapshot, free with vmi_free_region_list
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_get_regions(
+    vmi_instance_t vmi,
+    vmi_pid_t pid,
+    vm_region_list_t **list) NOEXCEPT;
+
+/**
+ * Finds the region containing a virtual address with a binary search
+ * over the snapshot.
+ *
+ * @param[in] list Snapshot from vmi_get_regions
+ * @param[in] va Virtual address to look up
+ * @return The region, or NULL if the address is not mapped
+ */
+const vm_region_t *vmi_find_region(
+    const vm_region_list_t *list,
+    addr_t va) NOEXCEPT;
+
+/**
+ * Frees a region list returned by vmi_get_regions.
+ *
+ * @param[in] list The list to free
+ */
+void vmi_free_region_list(
+    vm_region_list_t *list) NOEXCEPT;
+
+/*---------------------------------------------------------
+ * Struct access functions from structs.c
+ */
+
+/**
+ * Reads a whole struct with a single access, using the size of the struct
+ * from the JSON profile. Members are then accessed locally with
+ * vmi_struct_field and friends. Struct sizes and member offsets are looked
+ * up in the profile once and memoised in the instance.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] ctx Access context pointing at the struct
+ * @param[in] struct_name Name of the struct in the JSON profile
+ * @param[in,out] view The view to read into
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_read_struct(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    const char *struct_name,
+    struct_view_t *view) NOEXCEPT;
+
+/**
+ * Reads only the part of a struct spanning the given members, for structs
+ * too large to copy as a whole when just a few members are needed. Only
+ * the bytes between the lowest and the end of the highest member are read.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] ctx Access context pointing at the struct
+ * @param[in] struct_name Name of the struct in the JSON profile
+ * @param[in] fields Members to read
+ * @param[in] count Number of entries in fields
+ * @param[in,out] view The view to read into
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_read_struct_fields(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    const char *struct_name,
+    const struct_field_t *fields,
+    size_t count,
+    struct_view_t *view) NOEXCEPT;
+
+/**
+ * Returns a pointer to a member in a view without copying it.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] view A view filled by vmi_read_struct or vmi_read_struct_fields
+ * @param[in] member Name of the member
+ * @param[in] size Number of bytes of the member that will be accessed
+ * @return Pointer into the view's data, or NULL if the member is unknown
+ *         or was not read
+ */
+const void *vmi_struct_field(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    size_t size) NOEXCEPT;
+
+/**
+ * Copies an integer member of a view.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] view A view filled by vmi_read_struct or vmi_read_struct_fields
+ * @param[in] member Name of the member
+ * @param[out] value The value of the member
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_struct_read_8(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    uint8_t *value) NOEXCEPT;
+
+status_t vmi_struct_read_16(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    uint16_t *value) NOEXCEPT;
+
+status_t vmi_struct_read_32(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    uint32_t *value) NOEXCEPT;
+
+status_t vmi_struct_read_64(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    uint64_t *value) NOEXCEPT;
+
+/**
+ * Copies a pointer member of a view, using the address width of the guest.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] view A view filled by vmi_read_struct or vmi_read_struct_fields
+ * @param[in] member Name of the member
+ * @param[out] value The value of the member
+ * @return VMI_SUCCESS or VMI_FAILURE
+ */
+status_t vmi_struct_read_addr(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    addr_t *value) NOEXCEPT;
+
+/**
+ * Frees the buffer of a view. The view can be read into again afterwards.
+ *
+ * @param[in] view The view to release
+ */
+void vmi_free_struct_view(
+    struct_view_t *view) NOEXCEPT;
+
+/*---------------------------------------------------------
+ * List walking functions from lists.c
+ */
+
+/**
+ * Walks a circular doubly linked list (LIST_ENTRY on Windows, list_head on
+ * Linux) following the forward links. The links and the requested fields of
+ * a node are fetched with a single read per node. The walk stops at the
+ * list head, at the first node seen twice, at the first bad link or after
+ * max_nodes nodes, the reason is reported in the result.
+ *
+ * @param[in] vmi LibVMI instance
+ * @param[in] ctx Access context pointing at the list head
+ * @param[in] link_offset Offset of the links in a node
+ * @param[in] head_is_node Set if the head is itself the links of the first
+ *                         node (e.g. init_task.tasks), clear if it is a bare
+ *                         list head (e.g. PsActiveProcessHead)
+ * @param[in] fields Optional. Fields to capture from every node
+ * @param[in] nfields Number of entries in fields
+ * @param[in] max_nodes Maximum number of nodes to visit, 0 for the default
+ * @param[out] list The nodes found, free with vmi_free_list_walk
+ * @return VMI_SUCCESS if the head could be read, VMI_FAILURE otherwise
+ */
+status_t vmi_walk_list(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    addr_t link_offset,
+    bool head_is_node,
+    const list_field_t *fields,
+    size_t nfields,
+    size_t max_nodes,
+    list_walk_t **list) NOEXCEPT;
+
+/**
+ * Frees the result of vmi_walk_list.
+ *
+ * @param[in] list The list to free
+ */
+void vmi_free_list_walk(
+    list_walk_t *list) NOEXCEPT;
+
 #pragma GCC visibility pop
 
 #ifdef __cplusplus
@@ -0,0 +1,181 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "private.h"
+
+static list_walk_t *
+pack_list(
+    list_walk_end_t end,
+    GArray *nodes,
+    GByteArray *records,
+    size_t record_size)
+{
+    list_walk_t *list;
+    size_t count = nodes->len;
+
+    list = g_try_malloc0(sizeof(list_walk_t) + count * sizeof(addr_t) + records->len);
+    if (!list)
+        return NULL;
+
+    list->end = end;
+    list->count = count;
+    list->record_size = record_size;
+    list->nodes = (addr_t *)(list + 1);
+    list->records = (uint8_t *)(list->nodes + count);
+
+    if (count)
+        memcpy(list->nodes, nodes->data, count * sizeof(addr_t));
+    if (records->len)
+        memcpy(list->records, records->data, records->len);
+
+    return list;
+}
+
+status_t
+vmi_walk_list(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    addr_t link_offset,
+    bool head_is_node,
+    const list_field_t *fields,
+    size_t nfields,
+    size_t max_nodes,
+    list_walk_t **list)
+{
+    status_t ret = VMI_FAILURE;
+    list_walk_end_t end;
+    access_handle_t handle;
+    uint8_t width;
+    uint8_t *buf = NULL;
+    addr_t head, link = 0, lo, hi;
+    size_t record_size = 0;
+    GArray *nodes = NULL;
+    GByteArray *records = NULL;
+    GHashTable *seen = NULL;
+    size_t i;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !ctx || !list || (nfields && !fields))
+        return VMI_FAILURE;
+#endif
+
+    width = vmi_get_address_width(vmi);
+    if (!width)
+        return VMI_FAILURE;
+
+    if (!max_nodes)
+        max_nodes = LIST_WALK_MAX_ENTRIES;
+
+    /* the part of a node holding the links and all fields */
+    lo = link_offset;
+    hi = link_offset + width;
+    for (i = 0; i < nfields; i++) {
+        lo = MIN(lo, fields[i].offset);
+        hi = MAX(hi, fields[i].offset + fields[i].size);
+        record_size += fields[i].size;
+    }
+
+    if (hi - lo > LIST_WALK_MAX_SPAN) {
+        dbprint(VMI_DEBUG_MISC, "--%s: fields span 0x%"PRIx64" bytes, too much to read per node\n",
+                __FUNCTION__, hi - lo);
+        return VMI_FAILURE;
+    }
+
+    if (VMI_FAILURE == vmi_compile_access_context(vmi, ctx, &handle))
+        return VMI_FAILURE;
+
+    head = handle.ctx.addr;
+    if (head_is_node)
+        link = head;
+    else if (VMI_FAILURE == vmi_read_addr(vmi, &handle.ctx, &link))
+        return VMI_FAILURE;
+
+    buf = g_try_malloc0(hi - lo);
+    if (!buf)
+        return VMI_FAILURE;
+
+    nodes = g_array_new(FALSE, FALSE, sizeof(addr_t));
+    records = g_byte_array_new();
+    seen = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+
+    while (1) {
+        addr_t node, *key;
+
+        if (link == head && (nodes->len || !head_is_node)) {
+            end = VMI_LIST_WALK_COMPLETE;
+            break;
+        }
+
+        if (!link || (link & (width - 1))) {
+            dbprint(VMI_DEBUG_MISC, "--%s: bad link 0x%"PRIx64" after %u nodes\n", __FUNCTION__, link, nodes->len);
+            end = VMI_LIST_WALK_BAD_LINK;
+            break;
+        }
+
+        if (nodes->len >= max_nodes) {
+            end = VMI_LIST_WALK_LIMIT;
+            break;
+        }
+
+        node = link - link_offset;
+        if (g_hash_table_lookup_extended(seen, &node, NULL, NULL)) {
+            dbprint(VMI_DEBUG_MISC, "--%s: node 0x%"PRIx64" reached twice\n", __FUNCTION__, node);
+            end = VMI_LIST_WALK_CYCLE;
+            break;
+        }
+
+        handle.ctx.addr = node + lo;
+        if (VMI_FAILURE == vmi_read(vmi, &handle.ctx, hi - lo, buf, NULL)) {
+            dbprint(VMI_DEBUG_MISC, "--%s: failed to read node 0x%"PRIx64"\n", __FUNCTION__, node);
+            end = VMI_LIST_WALK_BAD_LINK;
+            break;
+        }
+
+        key = g_malloc(sizeof(addr_t));
+        *key = node;
+        g_hash_table_insert(seen, key, NULL);
+
+        g_array_append_val(nodes, node);
+        for (i = 0; i < nfields; i++)
+            g_byte_array_append(records, buf + fields[i].offset - lo, fields[i].size);
+
+        link = buf_read_addr(buf, link_offset - lo, width);
+    }
+
+    *list = pack_list(end, nodes, records, record_size);
+    if (*list)
+        ret = VMI_SUCCESS;
+
+    g_hash_table_destroy(seen);
+    g_byte_array_free(records, TRUE);
+    g_array_free(nodes, TRUE);
+    g_free(buf);
+
+    return ret;
+}
+
+void
+vmi_free_list_walk(
+    list_walk_t *list)
+{
+    g_free(list);
+}
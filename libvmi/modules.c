@@ -0,0 +1,514 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "private.h"
+
+/*
+ * State of a module list walk. The OS specific walkers feed entries in
+ * through module_walk_add, names are packed into the final list once
+ * the walk is over.
+ */
+struct module_walk {
+    GArray *modules;    /* module_info_t, names owned by the walk */
+    GHashTable *prev;   /* entry address -> module_info_t of the previous snapshot */
+};
+
+const char *
+module_walk_cached_name(
+    module_walk_t *walk,
+    addr_t entry,
+    addr_t base,
+    addr_t size,
+    addr_t name_addr)
+{
+    module_info_t *info;
+
+    if (!walk->prev)
+        return NULL;
+
+    info = g_hash_table_lookup(walk->prev, &entry);
+    if (!info || info->base != base || info->size != size || info->name_addr != name_addr)
+        return NULL;
+
+    return info->name;
+}
+
+status_t
+module_walk_add(
+    module_walk_t *walk,
+    addr_t entry,
+    addr_t base,
+    addr_t size,
+    addr_t name_addr,
+    const char *name)
+{
+    module_info_t info = {
+        .base = base,
+        .size = size,
+        .entry = entry,
+        .name_addr = name_addr,
+    };
+
+    if (walk->modules->len >= MODULE_WALK_MAX_ENTRIES) {
+        dbprint(VMI_DEBUG_MISC, "--%s: too many entries, list is likely corrupted\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    info.name = g_strdup(name ? name : "");
+    g_array_append_val(walk->modules, info);
+
+    return VMI_SUCCESS;
+}
+
+/*
+ * Copy the entries into a single allocation holding the list header,
+ * the module array and the names.
+ */
+static module_list_t *
+pack_modules(
+    vmi_pid_t pid,
+    const module_info_t *modules,
+    size_t count)
+{
+    module_list_t *list;
+    size_t names_len = 0;
+    char *names;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        names_len += strlen(modules[i].name) + 1;
+
+    list = g_try_malloc0(sizeof(module_list_t) + count * sizeof(module_info_t) + names_len);
+    if (!list)
+        return NULL;
+
+    list->pid = pid;
+    list->count = count;
+    list->modules = (module_info_t *)(list + 1);
+    names = (char *)(list->modules + count);
+
+    for (i = 0; i < count; i++) {
+        size_t len = strlen(modules[i].name) + 1;
+
+        list->modules[i] = modules[i];
+        list->modules[i].name = memcpy(names, modules[i].name, len);
+        names += len;
+    }
+
+    return list;
+}
+
+status_t
+vmi_get_modules(
+    vmi_instance_t vmi,
+    vmi_pid_t pid,
+    const module_list_t *prev,
+    module_list_t **list)
+{
+    status_t ret = VMI_FAILURE;
+    module_walk_t walk = { 0 };
+    size_t i;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !list)
+        return VMI_FAILURE;
+#endif
+
+    if (!vmi->os_interface || !vmi->os_interface->os_get_modules) {
+        dbprint(VMI_DEBUG_MISC, "--%s: module enumeration is not supported for this OS\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    walk.modules = g_array_new(FALSE, FALSE, sizeof(module_info_t));
+
+    if (prev && prev->pid == pid) {
+        walk.prev = g_hash_table_new(g_int64_hash, g_int64_equal);
+        for (i = 0; i < prev->count; i++)
+            g_hash_table_insert(walk.prev, &prev->modules[i].entry, &prev->modules[i]);
+    }
+
+    if (VMI_SUCCESS == vmi->os_interface->os_get_modules(vmi, pid, &walk)) {
+        *list = pack_modules(pid, (module_info_t *)walk.modules->data, walk.modules->len);
+        if (*list)
+            ret = VMI_SUCCESS;
+    }
+
+    for (i = 0; i < walk.modules->len; i++)
+        g_free((char *)g_array_index(walk.modules, module_info_t, i).name);
+
+    g_array_free(walk.modules, TRUE);
+    if (walk.prev)
+        g_hash_table_destroy(walk.prev);
+
+    return ret;
+}
+
+static bool
+same_module(
+    const module_info_t *a,
+    const module_info_t *b)
+{
+    return a->base == b->base && a->size == b->size && !strcmp(a->name, b->name);
+}
+
+/*
+ * Collect the entries of list a that have no matching entry in list b.
+ */
+static module_list_t *
+module_list_subtract(
+    const module_list_t *a,
+    GHashTable *b_by_base)
+{
+    module_list_t *ret;
+    GArray *missing = g_array_new(FALSE, FALSE, sizeof(module_info_t));
+    size_t i;
+
+    for (i = 0; i < a->count; i++) {
+        const module_info_t *match = g_hash_table_lookup(b_by_base, &a->modules[i].base);
+
+        if (!match || !same_module(match, &a->modules[i]))
+            g_array_append_val(missing, a->modules[i]);
+    }
+
+    ret = pack_modules(a->pid, (module_info_t *)missing->data, missing->len);
+    g_array_free(missing, TRUE);
+
+    return ret;
+}
+
+static GHashTable *
+index_by_base(
+    const module_list_t *list)
+{
+    GHashTable *index = g_hash_table_new(g_int64_hash, g_int64_equal);
+    size_t i;
+
+    for (i = 0; i < list->count; i++)
+        g_hash_table_insert(index, &list->modules[i].base, &list->modules[i]);
+
+    return index;
+}
+
+status_t
+vmi_diff_module_lists(
+    const module_list_t *prev,
+    const module_list_t *curr,
+    module_list_t **loaded,
+    module_list_t **unloaded)
+{
+    module_list_t *_loaded = NULL, *_unloaded = NULL;
+    GHashTable *index;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!prev || !curr)
+        return VMI_FAILURE;
+#endif
+
+    if (loaded) {
+        index = index_by_base(prev);
+        _loaded = module_list_subtract(curr, index);
+        g_hash_table_destroy(index);
+
+        if (!_loaded)
+            goto fail;
+    }
+
+    if (unloaded) {
+        index = index_by_base(curr);
+        _unloaded = module_list_subtract(prev, index);
+        g_hash_table_destroy(index);
+
+        if (!_unloaded)
+            goto fail;
+    }
+
+    if (loaded)
+        *loaded = _loaded;
+    if (unloaded)
+        *unloaded = _unloaded;
+
+    return VMI_SUCCESS;
+
+fail:
+    g_free(_loaded);
+    g_free(_unloaded);
+    return VMI_FAILURE;
+}
+
+void
+vmi_free_module_list(
+    module_list_t *list)
+{
+    g_free(list);
+}
+
+/*
+ * Address to module index of one address space: a module snapshot sorted
+ * by base address.
+ */
+typedef struct module_index {
+    vmi_pid_t pid;
+    size_t last;            /* slot of the last hit */
+    gint64 refreshed;       /* monotonic time of the last refresh */
+    module_list_t *list;
+} module_index_t;
+
+static void
+module_index_free(
+    gpointer data)
+{
+    module_index_t *index = data;
+
+    vmi_free_module_list(index->list);
+    g_free(index);
+}
+
+void
+module_index_init(
+    vmi_instance_t vmi)
+{
+    vmi->module_index = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                        g_free, module_index_free);
+}
+
+void
+module_index_destroy(
+    vmi_instance_t vmi)
+{
+    if (vmi->module_index)
+        g_hash_table_destroy(vmi->module_index);
+    vmi->module_index = NULL;
+}
+
+static int
+compare_base(
+    const void *a,
+    const void *b)
+{
+    const module_info_t *ma = a, *mb = b;
+
+    if (ma->base < mb->base)
+        return -1;
+    return ma->base > mb->base;
+}
+
+/*
+ * The Linux module list leaves the core kernel out, yet most kernel
+ * addresses looked up are in its text.
+ */
+static module_list_t *
+module_list_add_kernel(
+    vmi_instance_t vmi,
+    module_list_t *list)
+{
+    module_info_t *modules;
+    module_list_t *ret;
+    addr_t start, end;
+
+    if (VMI_FAILURE == vmi_translate_ksym2v(vmi, "_stext", &start) ||
+            VMI_FAILURE == vmi_translate_ksym2v(vmi, "_etext", &end) || end <= start)
+        return list;
+
+    modules = g_try_new(module_info_t, list->count + 1);
+    if (!modules)
+        return list;
+
+    memcpy(modules, list->modules, list->count * sizeof(module_info_t));
+    modules[list->count] = (module_info_t) {
+        .base = start,
+        .size = end - start,
+        .name = "vmlinux",
+    };
+
+    ret = pack_modules(list->pid, modules, list->count + 1);
+    g_free(modules);
+    if (!ret)
+        return list;
+
+    vmi_free_module_list(list);
+    return ret;
+}
+
+static void
+module_index_refresh(
+    vmi_instance_t vmi,
+    module_index_t *index,
+    addr_t dtb)
+{
+    module_list_t *list = NULL;
+    vmi_pid_t pid = 0;
+
+    index->refreshed = monotonic_time_us();
+
+    if (dtb && VMI_FAILURE == vmi_dtb_to_pid(vmi, dtb, &pid))
+        return;
+
+    /* the kernel's own address space is covered by the kernel index */
+    if (dtb && !pid)
+        return;
+
+    if (VMI_FAILURE == vmi_get_modules(vmi, pid, index->list, &list)) {
+        dbprint(VMI_DEBUG_MISC, "--%s: failed to refresh index of DTB 0x%"PRIx64"\n", __FUNCTION__, dtb);
+        return;
+    }
+
+    if (!pid && VMI_OS_LINUX == vmi->os_type)
+        list = module_list_add_kernel(vmi, list);
+
+    qsort(list->modules, list->count, sizeof(module_info_t), compare_base);
+
+    vmi_free_module_list(index->list);
+    index->list = list;
+    index->pid = pid;
+    index->last = 0;
+}
+
+static module_index_t *
+module_index_get(
+    vmi_instance_t vmi,
+    addr_t dtb)
+{
+    module_index_t *index = g_hash_table_lookup(vmi->module_index, &dtb);
+    addr_t *key;
+
+    if (index)
+        return index;
+
+    index = g_try_malloc0(sizeof(module_index_t));
+    key = g_try_malloc0(sizeof(addr_t));
+    if (!index || !key) {
+        g_free(index);
+        g_free(key);
+        return NULL;
+    }
+
+    *key = dtb;
+    g_hash_table_insert(vmi->module_index, key, index);
+    module_index_refresh(vmi, index, dtb);
+
+    return index;
+}
+
+static const module_info_t *
+module_index_find(
+    module_index_t *index,
+    addr_t va)
+{
+    const module_info_t *modules;
+    size_t lo = 0, hi;
+
+    if (!index->list || !index->list->count)
+        return NULL;
+
+    modules = index->list->modules;
+
+    /* events tend to hit the same module repeatedly */
+    if (va >= modules[index->last].base && va - modules[index->last].base < modules[index->last].size)
+        return &modules[index->last];
+
+    /* find the last module starting at or below va */
+    hi = index->list->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (modules[mid].base <= va)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (!lo || va - modules[lo - 1].base >= modules[lo - 1].size)
+        return NULL;
+
+    index->last = lo - 1;
+    return &modules[lo - 1];
+}
+
+status_t
+vmi_addr_to_module(
+    vmi_instance_t vmi,
+    addr_t dtb,
+    addr_t va,
+    addr_t *base,
+    const char **name)
+{
+    module_index_t *indexes[2] = { NULL, NULL };
+    const module_info_t *info = NULL;
+    gint64 now;
+    bool refreshed = false;
+    unsigned int i;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !vmi->module_index)
+        return VMI_FAILURE;
+#endif
+
+    if (dtb)
+        indexes[0] = module_index_get(vmi, dtb);
+    indexes[1] = module_index_get(vmi, 0);
+
+    for (i = 0; i < 2 && !info; i++)
+        if (indexes[i])
+            info = module_index_find(indexes[i], va);
+
+    if (!info) {
+        now = monotonic_time_us();
+
+        for (i = 0; i < 2; i++) {
+            if (!indexes[i] || now - indexes[i]->refreshed < MODULE_INDEX_REFRESH_US)
+                continue;
+
+            module_index_refresh(vmi, indexes[i], i ? 0 : dtb);
+            refreshed = true;
+        }
+
+        for (i = 0; i < 2 && refreshed && !info; i++)
+            if (indexes[i])
+                info = module_index_find(indexes[i], va);
+    }
+
+    if (!info)
+        return VMI_FAILURE;
+
+    if (base)
+        *base = info->base;
+    if (name)
+        *name = info->name;
+
+    return VMI_SUCCESS;
+}
+
+void
+vmi_module_index_flush(
+    vmi_instance_t vmi,
+    addr_t dtb)
+{
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !vmi->module_index)
+        return;
+#endif
+
+    if (dtb == ~0ull)
+        g_hash_table_remove_all(vmi->module_index);
+    else
+        g_hash_table_remove(vmi->module_index, &dtb);
+}
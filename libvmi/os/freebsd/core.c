@@ -131,6 +131,8 @@ status_t freebsd_init(vmi_instance_t vmi, GHashTable *config)
     os_interface->os_usym2rva = NULL;
     os_interface->os_v2sym = freebsd_system_map_address_to_symbol;
     os_interface->os_read_unicode_struct = NULL;
+    os_interface->os_get_modules = NULL;
+    os_interface->os_get_regions = NULL;
     os_interface->os_teardown = freebsd_teardown;
 
     vmi->os_interface = os_interface;
@@ -591,6 +591,17 @@ status_t linux_init(vmi_instance_t vmi, GHashTable *config)
     dbprint(VMI_DEBUG_MISC, "**set vmi->kpgd (0x%.16"PRIx64").\n", vmi->kpgd);
     dbprint(VMI_DEBUG_MISC, "**set vmi->init_task (0x%.16"PRIx64").\n", vmi->init_task);
 
+#if defined(I386) || defined(X86_64)
+    /*
+     * Kernels built with KPTI allocate every PGD as an 8KB pair, the user
+     * half being the upper page. Otherwise bit 12 is part of the address.
+     */
+    addr_t pti_init = 0;
+    vmi->kpti = !(vmi->kpgd & 0x1000ull) &&
+                VMI_SUCCESS == linux_symbol_to_address(vmi, "pti_init", NULL, &pti_init);
+    dbprint(VMI_DEBUG_MISC, "**KPTI page table pairs: %s\n", vmi->kpti ? "yes" : "no");
+#endif
+
     os_interface = g_malloc(sizeof(struct os_interface));
     if ( !os_interface )
         goto _exit;
@@ -605,6 +616,8 @@ status_t linux_init(vmi_instance_t vmi, GHashTable *config)
     os_interface->os_v2sym = NULL;
     os_interface->os_v2ksym = linux_system_map_address_to_symbol;
     os_interface->os_read_unicode_struct = NULL;
+    os_interface->os_get_modules = linux_get_modules;
+    os_interface->os_get_regions = linux_get_regions;
     os_interface->os_teardown = linux_teardown;
 
     vmi->os_interface = os_interface;
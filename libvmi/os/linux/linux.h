@@ -22,6 +22,12 @@
 
 #include "private.h"
 
+typedef enum linux_vma_layout {
+    LINUX_VMA_UNKNOWN,
+    LINUX_VMA_LIST,     /**< mm_struct->mmap list, before 6.1 */
+    LINUX_VMA_MAPLE,    /**< mm_struct->mm_mt maple tree, since 6.1 */
+} linux_vma_layout_t;
+
 struct linux_instance {
     char *sysmap; /**< system map file for domain's running kernel */
 
@@ -38,9 +44,48 @@ struct linux_instance {
     addr_t kaslr_offset; /**< offset generated at boot time for KASLR */
 
     addr_t init_task_fixed; /**< Rekall's location for init task, ignoring KASLR */
+
+    addr_t mod_list_offset; /**< module->list */
+
+    addr_t mod_name_offset; /**< module->name */
+
+    addr_t mod_base_offset; /**< base of the module's core (text) region */
+
+    addr_t mod_size_offset; /**< size of the module's core (text) region */
+
+    linux_vma_layout_t vma_layout; /**< how the VMAs of a process are kept */
+
+    addr_t mmap_offset; /**< mm_struct->mmap */
+
+    addr_t mm_mt_root_offset; /**< mm_struct->mm_mt.ma_root */
+
+    addr_t vma_start_offset; /**< vm_area_struct->vm_start */
+
+    addr_t vma_end_offset; /**< vm_area_struct->vm_end */
+
+    addr_t vma_next_offset; /**< vm_area_struct->vm_next */
+
+    addr_t vma_flags_offset; /**< vm_area_struct->vm_flags */
+
+    addr_t vma_file_offset; /**< vm_area_struct->vm_file */
+
+    addr_t file_dentry_offset; /**< file->f_path.dentry */
+
+    addr_t dentry_name_offset; /**< dentry->d_name.name */
 };
 typedef struct linux_instance *linux_instance_t;
 
+/** The fields of a vm_area_struct read by linux_walk_vmas */
+typedef struct linux_vma {
+    addr_t addr;    /**< address of the vm_area_struct */
+    addr_t start;   /**< vm_start */
+    addr_t end;     /**< vm_end */
+    uint64_t flags; /**< vm_flags */
+    addr_t file;    /**< vm_file */
+} linux_vma_t;
+
+typedef status_t (*linux_vma_cb_t)(vmi_instance_t vmi, const linux_vma_t *vma, void *data);
+
 status_t linux_init(vmi_instance_t instance, GHashTable *config);
 
 status_t linux_get_offset(vmi_instance_t vmi, const char* offset_name, addr_t *offset);
@@ -58,6 +103,16 @@ status_t linux_pid_to_pgd(vmi_instance_t vmi, vmi_pid_t pid, addr_t *pgd);
 
 status_t linux_pgd_to_pid(vmi_instance_t vmi, addr_t pgd, vmi_pid_t *pid);
 
+addr_t linux_get_taskstruct_addr_from_pid(vmi_instance_t vmi, vmi_pid_t pid);
+
+status_t linux_get_modules(vmi_instance_t vmi, vmi_pid_t pid, module_walk_t *walk);
+
+status_t linux_walk_vmas(vmi_instance_t vmi, vmi_pid_t pid, linux_vma_cb_t cb, void *data);
+
+char *linux_read_file_name(vmi_instance_t vmi, addr_t file);
+
+status_t linux_get_regions(vmi_instance_t vmi, vmi_pid_t pid, region_walk_t *walk);
+
 status_t linux_teardown(vmi_instance_t vmi);
 
 #endif /* OS_LINUX_H_ */
@@ -32,17 +32,16 @@
 #include "driver/driver_wrapper.h"
 
 /* finds the task struct for a given pid, with init_task pointing to actual task */
-static addr_t
+addr_t
 linux_get_taskstruct_addr_from_pid(
     vmi_instance_t vmi,
     vmi_pid_t pid)
 {
-    addr_t list_head = 0, curr_entry = 0;
-    addr_t curr_proc = 0;
-    vmi_pid_t task_pid = -1;
+    addr_t ts_addr = 0;
     linux_instance_t linux_instance = NULL;
-    int pid_offset = 0;
-    int tasks_offset = 0;
+    list_walk_t *tasks = NULL;
+    list_field_t field;
+    size_t i;
 
     if (vmi->os_data == NULL) {
         errprint("VMI_ERROR: No os_data initialized\n");
@@ -51,34 +50,35 @@ linux_get_taskstruct_addr_from_pid(
 
     linux_instance = vmi->os_data;
 
-    pid_offset = linux_instance->pid_offset;
-    tasks_offset = linux_instance->tasks_offset;
+    field.offset = linux_instance->pid_offset;
+    field.size = sizeof(vmi_pid_t);
 
-    /* First we need a pointer to the initial entry in the tasks list.
-     * In newer versions of Linux, the global "init_task" points to
+    /* In newer versions of Linux, the global "init_task" points to
      * the actual task struct, not to the linked list entry.
      */
-    curr_proc = vmi->init_task;
-    curr_entry = curr_proc + tasks_offset;
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_PID,
+                   .pid = 0,
+                   .addr = vmi->init_task + linux_instance->tasks_offset);
+
+    if (VMI_FAILURE == vmi_walk_list(vmi, &ctx, linux_instance->tasks_offset, true, &field, 1, 0, &tasks))
+        return 0;
 
-    list_head = curr_entry;
+    if (VMI_LIST_WALK_COMPLETE != tasks->end)
+        dbprint(VMI_DEBUG_MISC, "--%s: task list is corrupted, searched %zu tasks\n", __FUNCTION__, tasks->count);
 
-    do {
-        vmi_read_32_va(vmi, curr_proc + pid_offset, 0, (uint32_t*)&task_pid);
+    for (i = 0; i < tasks->count; i++) {
+        vmi_pid_t task_pid;
 
-        /* if pid matches, then we found what we want */
+        memcpy(&task_pid, tasks->records + i * tasks->record_size, sizeof(task_pid));
         if (task_pid == pid) {
-            return curr_proc;
+            ts_addr = tasks->nodes[i];
+            break;
         }
+    }
 
-        /* Advance in the linked list */
-        vmi_read_addr_va(vmi, curr_entry, 0, &curr_entry);
-        curr_proc = curr_entry - tasks_offset;
-
-        /* if we are back at the list head, we are done */
-    } while (list_head != curr_entry);
-
-    return 0;
+    vmi_free_list_walk(tasks);
+    return ts_addr;
 }
 
 static addr_t
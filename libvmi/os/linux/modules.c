@@ -0,0 +1,251 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "private.h"
+#include "os/linux/linux.h"
+
+/* Largest span of a struct we are willing to read in one go */
+#define STRUCT_MAX_READ 0x800
+
+static status_t
+init_module_offsets(
+    vmi_instance_t vmi,
+    linux_instance_t linux_instance)
+{
+    addr_t layout = 0, base = 0, size = 0;
+
+    if (linux_instance->mod_name_offset)
+        return VMI_SUCCESS;
+
+    if (VMI_FAILURE == json_profile_lookup(vmi, "module", "list", &linux_instance->mod_list_offset) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "module", "name", &linux_instance->mod_name_offset))
+        goto fail;
+
+    /*
+     * The location of the module's text changed a couple of times:
+     * module_core/core_size before 4.5, core_layout until 6.4 and
+     * mem[MOD_TEXT] afterwards.
+     */
+    if (VMI_SUCCESS == json_profile_lookup(vmi, "module", "core_layout", &layout) &&
+            VMI_SUCCESS == json_profile_lookup(vmi, "module_layout", "base", &base) &&
+            VMI_SUCCESS == json_profile_lookup(vmi, "module_layout", "size", &size)) {
+        linux_instance->mod_base_offset = layout + base;
+        linux_instance->mod_size_offset = layout + size;
+    } else if (VMI_SUCCESS == json_profile_lookup(vmi, "module", "mem", &layout) &&
+               VMI_SUCCESS == json_profile_lookup(vmi, "module_memory", "base", &base) &&
+               VMI_SUCCESS == json_profile_lookup(vmi, "module_memory", "size", &size)) {
+        linux_instance->mod_base_offset = layout + base;
+        linux_instance->mod_size_offset = layout + size;
+    } else if (VMI_FAILURE == json_profile_lookup(vmi, "module", "module_core", &linux_instance->mod_base_offset) ||
+               VMI_FAILURE == json_profile_lookup(vmi, "module", "core_size", &linux_instance->mod_size_offset)) {
+        goto fail;
+    }
+
+    return VMI_SUCCESS;
+
+fail:
+    dbprint(VMI_DEBUG_MISC, "--struct module offsets are not available in the JSON profile\n");
+    linux_instance->mod_name_offset = 0;
+    return VMI_FAILURE;
+}
+
+/*
+ * Read the bytes of a struct between the lowest and the highest of the
+ * offsets we need with a single access.
+ */
+static status_t
+read_span(
+    vmi_instance_t vmi,
+    access_context_t *ctx,
+    addr_t lo,
+    addr_t hi,
+    uint8_t *buf)
+{
+    addr_t addr = ctx->addr;
+    status_t ret;
+
+    if (hi <= lo || hi - lo > STRUCT_MAX_READ)
+        return VMI_FAILURE;
+
+    ctx->addr += lo;
+    ret = vmi_read(vmi, ctx, hi - lo, buf, NULL);
+    ctx->addr = addr;
+
+    return ret;
+}
+
+static status_t
+walk_kernel_modules(
+    vmi_instance_t vmi,
+    linux_instance_t linux_instance,
+    module_walk_t *walk)
+{
+    uint8_t width = vmi_get_address_width(vmi);
+    uint8_t buf[STRUCT_MAX_READ];
+    addr_t list_head = 0, next = 0, lo, hi;
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_DTB,
+                   .dtb = vmi->kpgd);
+
+    if (!width)
+        return VMI_FAILURE;
+
+    if (VMI_FAILURE == vmi_translate_ksym2v(vmi, "modules", &list_head))
+        return VMI_FAILURE;
+
+    lo = MIN(linux_instance->mod_list_offset, MIN(linux_instance->mod_base_offset, linux_instance->mod_size_offset));
+    hi = MAX(linux_instance->mod_list_offset, linux_instance->mod_base_offset) + width;
+    hi = MAX(hi, linux_instance->mod_size_offset + sizeof(uint32_t));
+
+    ctx.addr = list_head;
+    if (VMI_FAILURE == vmi_read_addr(vmi, &ctx, &next))
+        return VMI_FAILURE;
+
+    while (next && next != list_head) {
+        addr_t module = next - linux_instance->mod_list_offset;
+        addr_t name_addr = module + linux_instance->mod_name_offset;
+        addr_t base;
+        uint32_t size;
+        const char *name;
+        char *_name = NULL;
+        status_t ret;
+
+        ctx.addr = module;
+        if (VMI_FAILURE == read_span(vmi, &ctx, lo, hi, buf)) {
+            dbprint(VMI_DEBUG_MISC, "--%s: failed to read module at 0x%"PRIx64"\n", __FUNCTION__, module);
+            return VMI_FAILURE;
+        }
+
+        next = buf_read_addr(buf, linux_instance->mod_list_offset - lo, width);
+        base = buf_read_addr(buf, linux_instance->mod_base_offset - lo, width);
+        memcpy(&size, buf + linux_instance->mod_size_offset - lo, sizeof(size));
+
+        name = module_walk_cached_name(walk, module, base, size, name_addr);
+        if (!name) {
+            ctx.addr = name_addr;
+            name = _name = vmi_read_str(vmi, &ctx);
+        }
+
+        ret = module_walk_add(walk, module, base, size, name_addr, name);
+        free(_name);
+
+        if (VMI_FAILURE == ret)
+            return VMI_FAILURE;
+    }
+
+    return VMI_SUCCESS;
+}
+
+/* Consecutive file-backed mappings being merged into one module */
+struct mapping_group {
+    module_walk_t *walk;
+    addr_t first;
+    addr_t start;
+    addr_t end;
+    addr_t file;
+};
+
+static status_t
+add_file_mapping(
+    vmi_instance_t vmi,
+    struct mapping_group *group)
+{
+    const char *name;
+    char *_name = NULL;
+    addr_t size = group->end - group->start;
+    status_t ret;
+
+    name = module_walk_cached_name(group->walk, group->first, group->start, size, group->file);
+    if (!name)
+        name = _name = linux_read_file_name(vmi, group->file);
+
+    ret = module_walk_add(group->walk, group->first, group->start, size, group->file, name);
+    free(_name);
+
+    return ret;
+}
+
+static status_t
+group_mapping(
+    vmi_instance_t vmi,
+    const linux_vma_t *vma,
+    void *data)
+{
+    struct mapping_group *group = data;
+
+    if (group->file && (vma->file != group->file || vma->start != group->end)) {
+        if (VMI_FAILURE == add_file_mapping(vmi, group))
+            return VMI_FAILURE;
+        group->file = 0;
+    }
+
+    if (vma->file && !group->file) {
+        group->first = vma->addr;
+        group->start = vma->start;
+        group->file = vma->file;
+    }
+
+    group->end = vma->end;
+    return VMI_SUCCESS;
+}
+
+/*
+ * Walk the mappings of a process. Consecutive mappings backed by the
+ * same file are reported as one module.
+ */
+static status_t
+walk_user_mappings(
+    vmi_instance_t vmi,
+    vmi_pid_t pid,
+    module_walk_t *walk)
+{
+    struct mapping_group group = { .walk = walk };
+
+    if (VMI_FAILURE == linux_walk_vmas(vmi, pid, group_mapping, &group))
+        return VMI_FAILURE;
+
+    if (group.file)
+        return add_file_mapping(vmi, &group);
+
+    return VMI_SUCCESS;
+}
+
+status_t
+linux_get_modules(
+    vmi_instance_t vmi,
+    vmi_pid_t pid,
+    module_walk_t *walk)
+{
+    linux_instance_t linux_instance = vmi->os_data;
+
+    if (!linux_instance)
+        return VMI_FAILURE;
+
+    if (!pid) {
+        if (VMI_FAILURE == init_module_offsets(vmi, linux_instance))
+            return VMI_FAILURE;
+
+        return walk_kernel_modules(vmi, linux_instance, walk);
+    }
+
+    return walk_user_mappings(vmi, pid, walk);
+}
@@ -0,0 +1,385 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "private.h"
+#include "os/linux/linux.h"
+
+/* Upper bound on mappings, the default vm.max_map_count is 65530 */
+#define VMA_MAX_COUNT 0x10000
+
+/* Largest span of vm_area_struct we are willing to read in one go */
+#define VMA_MAX_READ 0x200
+
+/* vm_area_struct->vm_flags */
+#define VM_READ     0x1
+#define VM_WRITE    0x2
+#define VM_EXEC     0x4
+
+/*
+ * Maple tree node encoding, see include/linux/maple_tree.h. Nodes are
+ * 256 byte aligned, the low bits of a node pointer hold its type.
+ */
+#define MAPLE_NODE_SIZE         256
+#define MAPLE_NODE_MASK         0xFF
+#define MAPLE_NODE_TYPE_SHIFT   0x03
+#define MAPLE_NODE_TYPE_MASK    0x0F
+#define MAPLE_HEIGHT_MAX        31
+
+enum maple_type {
+    maple_dense,
+    maple_leaf_64,
+    maple_range_64,
+    maple_arange_64,
+};
+
+struct vma_walk {
+    linux_instance_t linux_instance;
+    linux_vma_cb_t cb;
+    void *data;
+    uint8_t width;
+    addr_t lo;          /* span of the vm_area_struct fields we read */
+    addr_t hi;
+    unsigned int count;
+    access_context_t ctx;
+};
+
+static status_t
+init_vma_offsets(
+    vmi_instance_t vmi,
+    linux_instance_t linux_instance)
+{
+    addr_t f_path = 0, dentry = 0, d_name = 0, name = 0, mm_mt = 0, ma_root = 0;
+
+    if (linux_instance->vma_layout != LINUX_VMA_UNKNOWN)
+        return VMI_SUCCESS;
+
+    if (VMI_FAILURE == json_profile_lookup(vmi, "vm_area_struct", "vm_start", &linux_instance->vma_start_offset) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "vm_area_struct", "vm_end", &linux_instance->vma_end_offset) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "vm_area_struct", "vm_flags", &linux_instance->vma_flags_offset) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "vm_area_struct", "vm_file", &linux_instance->vma_file_offset) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "file", "f_path", &f_path) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "path", "dentry", &dentry) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "dentry", "d_name", &d_name) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "qstr", "name", &name)) {
+        dbprint(VMI_DEBUG_MISC, "--vm_area_struct offsets are not available in the JSON profile\n");
+        return VMI_FAILURE;
+    }
+
+    linux_instance->file_dentry_offset = f_path + dentry;
+    linux_instance->dentry_name_offset = d_name + name;
+
+    /* VMAs moved from a list (and rb-tree) to a maple tree in 6.1 */
+    if (VMI_SUCCESS == json_profile_lookup(vmi, "mm_struct", "mm_mt", &mm_mt) &&
+            VMI_SUCCESS == json_profile_lookup(vmi, "maple_tree", "ma_root", &ma_root)) {
+        linux_instance->mm_mt_root_offset = mm_mt + ma_root;
+        linux_instance->vma_layout = LINUX_VMA_MAPLE;
+    } else if (VMI_SUCCESS == json_profile_lookup(vmi, "mm_struct", "mmap", &linux_instance->mmap_offset) &&
+               VMI_SUCCESS == json_profile_lookup(vmi, "vm_area_struct", "vm_next", &linux_instance->vma_next_offset)) {
+        linux_instance->vma_layout = LINUX_VMA_LIST;
+    } else {
+        dbprint(VMI_DEBUG_MISC, "--neither mm_struct->mm_mt nor mm_struct->mmap is in the JSON profile\n");
+        return VMI_FAILURE;
+    }
+
+    return VMI_SUCCESS;
+}
+
+char *
+linux_read_file_name(
+    vmi_instance_t vmi,
+    addr_t file)
+{
+    linux_instance_t linux_instance = vmi->os_data;
+    addr_t dentry = 0, name = 0;
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_DTB,
+                   .dtb = vmi->kpgd,
+                   .addr = file + linux_instance->file_dentry_offset);
+
+    if (VMI_FAILURE == vmi_read_addr(vmi, &ctx, &dentry) || !dentry)
+        return NULL;
+
+    ctx.addr = dentry + linux_instance->dentry_name_offset;
+    if (VMI_FAILURE == vmi_read_addr(vmi, &ctx, &name) || !name)
+        return NULL;
+
+    ctx.addr = name;
+    return vmi_read_str(vmi, &ctx);
+}
+
+/*
+ * Read the fields of one vm_area_struct with a single access and hand it
+ * to the callback. Returns the vm_next pointer in list mode.
+ */
+static status_t
+visit_vma(
+    vmi_instance_t vmi,
+    struct vma_walk *walk,
+    addr_t addr,
+    addr_t *next)
+{
+    linux_instance_t linux_instance = walk->linux_instance;
+    uint8_t buf[VMA_MAX_READ];
+    linux_vma_t vma = { .addr = addr };
+
+    if (++walk->count > VMA_MAX_COUNT) {
+        dbprint(VMI_DEBUG_MISC, "--%s: too many mappings, tree is likely corrupted\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    walk->ctx.addr = addr + walk->lo;
+    if (VMI_FAILURE == vmi_read(vmi, &walk->ctx, walk->hi - walk->lo, buf, NULL)) {
+        dbprint(VMI_DEBUG_MISC, "--%s: failed to read vma at 0x%"PRIx64"\n", __FUNCTION__, addr);
+        return VMI_FAILURE;
+    }
+
+    vma.start = buf_read_addr(buf, linux_instance->vma_start_offset - walk->lo, walk->width);
+    vma.end = buf_read_addr(buf, linux_instance->vma_end_offset - walk->lo, walk->width);
+    vma.flags = buf_read_addr(buf, linux_instance->vma_flags_offset - walk->lo, walk->width);
+    vma.file = buf_read_addr(buf, linux_instance->vma_file_offset - walk->lo, walk->width);
+
+    if (next)
+        *next = buf_read_addr(buf, linux_instance->vma_next_offset - walk->lo, walk->width);
+
+    return walk->cb(vmi, &vma, walk->data);
+}
+
+static status_t
+walk_vma_list(
+    vmi_instance_t vmi,
+    struct vma_walk *walk,
+    addr_t vma)
+{
+    while (vma)
+        if (VMI_FAILURE == visit_vma(vmi, walk, vma, &vma))
+            return VMI_FAILURE;
+
+    return VMI_SUCCESS;
+}
+
+static inline bool
+maple_is_node(
+    addr_t entry)
+{
+    return (entry & 3) == 2 && entry > 4096;
+}
+
+/*
+ * Visit the entries of a maple tree node covering [min, max] in index
+ * order. Each node is fetched with a single read.
+ */
+static status_t
+walk_maple_node(
+    vmi_instance_t vmi,
+    struct vma_walk *walk,
+    addr_t entry,
+    addr_t min,
+    addr_t max,
+    unsigned int depth)
+{
+    uint8_t width = walk->width;
+    uint8_t node[MAPLE_NODE_SIZE];
+    enum maple_type type = (entry >> MAPLE_NODE_TYPE_SHIFT) & MAPLE_NODE_TYPE_MASK;
+    unsigned int slots, i;
+    size_t slot_offset;
+    addr_t lo = min;
+
+    if (depth > MAPLE_HEIGHT_MAX) {
+        dbprint(VMI_DEBUG_MISC, "--%s: maple tree is too deep\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    switch (type) {
+        case maple_leaf_64:
+        case maple_range_64:
+            slots = width == 8 ? 16 : 32;
+            break;
+        case maple_arange_64:
+            slots = width == 8 ? 10 : 21;
+            break;
+        default:
+            dbprint(VMI_DEBUG_MISC, "--%s: unexpected maple node type %u\n", __FUNCTION__, type);
+            return VMI_FAILURE;
+    }
+
+    /* struct { parent; pivot[slots - 1]; slot[slots]; ... } */
+    slot_offset = width + (slots - 1) * width;
+
+    walk->ctx.addr = entry & ~(addr_t)MAPLE_NODE_MASK;
+    if (VMI_FAILURE == vmi_read(vmi, &walk->ctx, MAPLE_NODE_SIZE, node, NULL)) {
+        dbprint(VMI_DEBUG_MISC, "--%s: failed to read maple node 0x%"PRIx64"\n", __FUNCTION__, entry);
+        return VMI_FAILURE;
+    }
+
+    for (i = 0; i < slots; i++) {
+        addr_t pivot = i < slots - 1 ? buf_read_addr(node, width + i * width, width) : max;
+        addr_t slot = buf_read_addr(node, slot_offset + i * width, width);
+
+        /* unused pivots are 0, only the first range may end at 0 */
+        if (i && !pivot)
+            break;
+
+        if (slot) {
+            status_t ret;
+
+            if (type == maple_leaf_64)
+                ret = visit_vma(vmi, walk, slot, NULL);
+            else if (maple_is_node(slot))
+                ret = walk_maple_node(vmi, walk, slot, lo, pivot, depth + 1);
+            else
+                ret = VMI_FAILURE;
+
+            if (VMI_FAILURE == ret)
+                return VMI_FAILURE;
+        }
+
+        if (pivot >= max)
+            break;
+
+        lo = pivot + 1;
+    }
+
+    return VMI_SUCCESS;
+}
+
+status_t
+linux_walk_vmas(
+    vmi_instance_t vmi,
+    vmi_pid_t pid,
+    linux_vma_cb_t cb,
+    void *data)
+{
+    linux_instance_t linux_instance = vmi->os_data;
+    struct vma_walk walk = {
+        .linux_instance = linux_instance,
+        .cb = cb,
+        .data = data,
+        .width = vmi_get_address_width(vmi),
+        .ctx = {
+            .version = ACCESS_CONTEXT_VERSION,
+            .translate_mechanism = VMI_TM_PROCESS_DTB,
+            .dtb = vmi->kpgd,
+        },
+    };
+    addr_t task, mm = 0, root = 0;
+
+    if (!linux_instance || !walk.width)
+        return VMI_FAILURE;
+
+    if (VMI_FAILURE == init_vma_offsets(vmi, linux_instance))
+        return VMI_FAILURE;
+
+    walk.lo = MIN(MIN(linux_instance->vma_start_offset, linux_instance->vma_end_offset),
+                  MIN(linux_instance->vma_flags_offset, linux_instance->vma_file_offset));
+    walk.hi = MAX(MAX(linux_instance->vma_start_offset, linux_instance->vma_end_offset),
+                  MAX(linux_instance->vma_flags_offset, linux_instance->vma_file_offset));
+
+    if (linux_instance->vma_layout == LINUX_VMA_LIST) {
+        walk.lo = MIN(walk.lo, linux_instance->vma_next_offset);
+        walk.hi = MAX(walk.hi, linux_instance->vma_next_offset);
+    }
+
+    walk.hi += walk.width;
+    if (walk.hi - walk.lo > VMA_MAX_READ) {
+        errprint("%s: vm_area_struct offsets are out of range\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    task = linux_get_taskstruct_addr_from_pid(vmi, pid);
+    if (!task)
+        return VMI_FAILURE;
+
+    walk.ctx.addr = task + linux_instance->mm_offset;
+    if (VMI_FAILURE == vmi_read_addr(vmi, &walk.ctx, &mm))
+        return VMI_FAILURE;
+
+    /* kernel threads have no address space */
+    if (!mm)
+        return VMI_SUCCESS;
+
+    if (linux_instance->vma_layout == LINUX_VMA_LIST) {
+        walk.ctx.addr = mm + linux_instance->mmap_offset;
+        if (VMI_FAILURE == vmi_read_addr(vmi, &walk.ctx, &root))
+            return VMI_FAILURE;
+
+        return walk_vma_list(vmi, &walk, root);
+    }
+
+    walk.ctx.addr = mm + linux_instance->mm_mt_root_offset;
+    if (VMI_FAILURE == vmi_read_addr(vmi, &walk.ctx, &root))
+        return VMI_FAILURE;
+
+    if (!root)
+        return VMI_SUCCESS;
+
+    /* a tree holding a single entry stores it directly in the root */
+    if (!maple_is_node(root))
+        return visit_vma(vmi, &walk, root, NULL);
+
+    return walk_maple_node(vmi, &walk, root, 0, walk.width == 8 ? ~0ull : 0xffffffffull, 0);
+}
+
+static status_t
+add_region(
+    vmi_instance_t vmi,
+    const linux_vma_t *vma,
+    void *data)
+{
+    region_walk_t *walk = data;
+    vm_region_t region = {
+        .start = vma->start,
+        .end = vma->end,
+        .flags = vma->flags,
+        .object = vma->addr,
+        .file = vma->file,
+    };
+    char *name = NULL;
+    bool found = false;
+    status_t ret;
+
+    if (vma->flags & VM_READ)
+        region.access |= VMI_MEMACCESS_R;
+    if (vma->flags & VM_WRITE)
+        region.access |= VMI_MEMACCESS_W;
+    if (vma->flags & VM_EXEC)
+        region.access |= VMI_MEMACCESS_X;
+
+    if (vma->file) {
+        region.name = region_walk_cached_name(walk, vma->file, &found);
+        if (!found)
+            region.name = name = linux_read_file_name(vmi, vma->file);
+    }
+
+    ret = region_walk_add(walk, &region);
+    free(name);
+
+    return ret;
+}
+
+status_t
+linux_get_regions(
+    vmi_instance_t vmi,
+    vmi_pid_t pid,
+    region_walk_t *walk)
+{
+    return linux_walk_vmas(vmi, pid, add_region, walk);
+}
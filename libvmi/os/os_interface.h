@@ -22,6 +22,10 @@
 #define OS_INTERFACE_H_
 
 #include "private.h"
+
+typedef struct module_walk module_walk_t;
+typedef struct region_walk region_walk_t;
+
 #include "os/windows/windows.h"
 #include "os/linux/linux.h"
 #include "os/freebsd/freebsd.h"
@@ -54,6 +58,12 @@ typedef unicode_string_t* (*os_read_unicode_struct_t)(vmi_instance_t vmi,
 typedef unicode_string_t* (*os_read_unicode_struct_pm_t)(vmi_instance_t vmi,
         const access_context_t *ctx, page_mode_t page_mode);
 
+typedef status_t (*os_get_modules_t)(vmi_instance_t vmi, vmi_pid_t pid,
+                                     module_walk_t *walk);
+
+typedef status_t (*os_get_regions_t)(vmi_instance_t vmi, vmi_pid_t pid,
+                                     region_walk_t *walk);
+
 typedef status_t (*os_teardown_t)(vmi_instance_t vmi);
 
 typedef struct os_interface {
@@ -67,6 +77,8 @@ typedef struct os_interface {
     os_address_to_symbol_kaslr_t os_v2ksym;
     os_read_unicode_struct_t os_read_unicode_struct;
     os_read_unicode_struct_pm_t os_read_unicode_struct_pm;
+    os_get_modules_t os_get_modules;
+    os_get_regions_t os_get_regions;
     os_teardown_t os_teardown;
 } *os_interface_t;
 
@@ -1050,6 +1050,8 @@ windows_init(vmi_instance_t vmi, GHashTable *config)
     os_interface->os_v2ksym = NULL;
     os_interface->os_read_unicode_struct = windows_read_unicode_struct;
     os_interface->os_read_unicode_struct_pm = windows_read_unicode_struct_pm;
+    os_interface->os_get_modules = windows_get_modules;
+    os_interface->os_get_regions = windows_get_regions;
     os_interface->os_teardown = windows_teardown;
 
     vmi->os_interface = os_interface;
@@ -0,0 +1,252 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "private.h"
+#include "os/windows/windows.h"
+
+/* Largest LDR_DATA_TABLE_ENTRY prefix we read in one go */
+#define LDR_ENTRY_MAX_READ 0x100
+
+static status_t
+init_ldr_offsets(
+    vmi_instance_t vmi,
+    windows_instance_t windows)
+{
+    if (windows->ldr_name_offset)
+        return VMI_SUCCESS;
+
+    if (VMI_SUCCESS == json_profile_lookup(vmi, "_LDR_DATA_TABLE_ENTRY", "InLoadOrderLinks", &windows->ldr_links_offset) &&
+            VMI_SUCCESS == json_profile_lookup(vmi, "_LDR_DATA_TABLE_ENTRY", "DllBase", &windows->ldr_base_offset) &&
+            VMI_SUCCESS == json_profile_lookup(vmi, "_LDR_DATA_TABLE_ENTRY", "SizeOfImage", &windows->ldr_size_offset) &&
+            VMI_SUCCESS == json_profile_lookup(vmi, "_LDR_DATA_TABLE_ENTRY", "BaseDllName", &windows->ldr_name_offset))
+        return VMI_SUCCESS;
+
+    /*
+     * These offsets are stable (at least) between XP and Windows 10.
+     */
+    windows->ldr_links_offset = 0;
+    if (VMI_PM_IA32E == vmi->page_mode) {
+        windows->ldr_base_offset = 0x30;
+        windows->ldr_size_offset = 0x40;
+        windows->ldr_name_offset = 0x58;
+    } else {
+        windows->ldr_base_offset = 0x18;
+        windows->ldr_size_offset = 0x20;
+        windows->ldr_name_offset = 0x2c;
+    }
+
+    dbprint(VMI_DEBUG_MISC, "--using default LDR_DATA_TABLE_ENTRY offsets\n");
+    return VMI_SUCCESS;
+}
+
+static status_t
+init_peb_offsets(
+    vmi_instance_t vmi,
+    windows_instance_t windows)
+{
+    if (windows->peb_offset)
+        return VMI_SUCCESS;
+
+    if (VMI_FAILURE == json_profile_lookup(vmi, "_PEB", "Ldr", &windows->peb_ldr_offset) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "_PEB_LDR_DATA", "InLoadOrderModuleList", &windows->ldr_list_offset) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "_EPROCESS", "Peb", &windows->peb_offset)) {
+        dbprint(VMI_DEBUG_MISC, "--PEB offsets are not available in the JSON profile\n");
+        windows->peb_offset = 0;
+        return VMI_FAILURE;
+    }
+
+    return VMI_SUCCESS;
+}
+
+static char *
+read_ldr_name(
+    vmi_instance_t vmi,
+    addr_t dtb,
+    addr_t buffer,
+    uint16_t length)
+{
+    unicode_string_t us = { .length = length, .encoding = "UTF-16" };
+    unicode_string_t out = { 0 };
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_DTB,
+                   .dtb = dtb,
+                   .addr = buffer);
+
+    if (!length || length > VMI_PS_4KB)
+        return NULL;
+
+    us.contents = g_try_malloc0(length + 2);
+    if (!us.contents)
+        return NULL;
+
+    if (VMI_SUCCESS == vmi_read(vmi, &ctx, length, us.contents, NULL))
+        vmi_convert_str_encoding(&us, &out, "UTF-8");
+
+    g_free(us.contents);
+    return (char *)out.contents;
+}
+
+/*
+ * Walk a list of LDR_DATA_TABLE_ENTRY structures, reading the interesting
+ * part of each entry with a single access.
+ */
+static status_t
+walk_ldr_list(
+    vmi_instance_t vmi,
+    module_walk_t *walk,
+    addr_t dtb,
+    addr_t list_head)
+{
+    windows_instance_t windows = vmi->os_data;
+    uint8_t width = vmi_get_address_width(vmi);
+    uint8_t buf[LDR_ENTRY_MAX_READ];
+    size_t read_len;
+    addr_t next = 0;
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_DTB,
+                   .dtb = dtb,
+                   .addr = list_head);
+
+    if (!width)
+        return VMI_FAILURE;
+
+    read_len = windows->ldr_name_offset + 2 * width;
+    read_len = MAX(read_len, windows->ldr_base_offset + width);
+    read_len = MAX(read_len, windows->ldr_size_offset + sizeof(uint32_t));
+    read_len = MAX(read_len, windows->ldr_links_offset + width);
+
+    if (read_len > sizeof(buf)) {
+        errprint("%s: LDR_DATA_TABLE_ENTRY offsets are out of range\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    if (VMI_FAILURE == vmi_read_addr(vmi, &ctx, &next))
+        return VMI_FAILURE;
+
+    while (next && next != list_head) {
+        addr_t entry = next - windows->ldr_links_offset;
+        addr_t base, name_addr;
+        uint32_t size;
+        uint16_t name_len;
+        const char *name;
+        char *_name = NULL;
+        status_t ret;
+
+        ctx.addr = entry;
+        if (VMI_FAILURE == vmi_read(vmi, &ctx, read_len, buf, NULL)) {
+            dbprint(VMI_DEBUG_MISC, "--%s: failed to read entry at 0x%"PRIx64"\n", __FUNCTION__, entry);
+            return VMI_FAILURE;
+        }
+
+        next = buf_read_addr(buf, windows->ldr_links_offset, width);
+        base = buf_read_addr(buf, windows->ldr_base_offset, width);
+        memcpy(&size, buf + windows->ldr_size_offset, sizeof(size));
+
+        /* UNICODE_STRING: Length, MaximumLength, Buffer (pointer aligned) */
+        memcpy(&name_len, buf + windows->ldr_name_offset, sizeof(name_len));
+        name_addr = buf_read_addr(buf, windows->ldr_name_offset + width, width);
+
+        name = module_walk_cached_name(walk, entry, base, size, name_addr);
+        if (!name)
+            name = _name = read_ldr_name(vmi, dtb, name_addr, name_len);
+
+        ret = module_walk_add(walk, entry, base, size, name_addr, name);
+        free(_name);
+
+        if (VMI_FAILURE == ret)
+            return VMI_FAILURE;
+    }
+
+    return VMI_SUCCESS;
+}
+
+static status_t
+get_user_ldr_list(
+    vmi_instance_t vmi,
+    windows_instance_t windows,
+    vmi_pid_t pid,
+    addr_t *dtb,
+    addr_t *list_head)
+{
+    addr_t eprocess, peb = 0, ldr = 0;
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_DTB,
+                   .dtb = vmi->kpgd);
+
+    if (VMI_FAILURE == init_peb_offsets(vmi, windows))
+        return VMI_FAILURE;
+
+    if (VMI_FAILURE == vmi_pid_to_dtb(vmi, pid, dtb))
+        return VMI_FAILURE;
+
+    /* returns the address of EPROCESS->ActiveProcessLinks */
+    eprocess = windows_find_eprocess_list_pid(vmi, pid);
+    if (!eprocess)
+        return VMI_FAILURE;
+
+    ctx.addr = eprocess - windows->tasks_offset + windows->peb_offset;
+    if (VMI_FAILURE == vmi_read_addr(vmi, &ctx, &peb))
+        return VMI_FAILURE;
+
+    /* kernel only processes have no PEB */
+    if (!peb) {
+        *list_head = 0;
+        return VMI_SUCCESS;
+    }
+
+    ctx.dtb = *dtb;
+    ctx.addr = peb + windows->peb_ldr_offset;
+    if (VMI_FAILURE == vmi_read_addr(vmi, &ctx, &ldr))
+        return VMI_FAILURE;
+
+    *list_head = ldr ? ldr + windows->ldr_list_offset : 0;
+    return VMI_SUCCESS;
+}
+
+status_t
+windows_get_modules(
+    vmi_instance_t vmi,
+    vmi_pid_t pid,
+    module_walk_t *walk)
+{
+    windows_instance_t windows = vmi->os_data;
+    addr_t dtb = vmi->kpgd;
+    addr_t list_head = 0;
+
+    if (!windows)
+        return VMI_FAILURE;
+
+    if (VMI_FAILURE == init_ldr_offsets(vmi, windows))
+        return VMI_FAILURE;
+
+    if (!pid) {
+        if (VMI_FAILURE == vmi_translate_ksym2v(vmi, "PsLoadedModuleList", &list_head))
+            return VMI_FAILURE;
+    } else if (VMI_FAILURE == get_user_ldr_list(vmi, windows, pid, &dtb, &list_head)) {
+        return VMI_FAILURE;
+    }
+
+    if (!list_head)
+        return VMI_SUCCESS;
+
+    return walk_ldr_list(vmi, walk, dtb, list_head);
+}
@@ -269,51 +269,31 @@ eprocess_list_search(
     size_t len,
     void *value)
 {
-    addr_t next_process = 0;
     addr_t tasks_offset = 0;
     addr_t rtnval = 0;
-    void *buf = g_try_malloc0(len);
-
-    if ( !buf )
-        goto exit;
+    list_walk_t *procs = NULL;
+    list_field_t field = { .offset = offset, .size = len };
+    size_t i;
 
     if ( VMI_FAILURE == vmi_get_offset(vmi, "win_tasks", &tasks_offset) )
-        goto exit;
-
-    if ( VMI_FAILURE == vmi_read_addr_va(vmi, list_head + tasks_offset, 0, &next_process) )
-        goto exit;
-
-    if ( VMI_FAILURE == vmi_read_va(vmi, list_head + offset, 0, len, buf, NULL) )
-        goto exit;
-
-    if (memcmp(buf, value, len) == 0) {
-        rtnval = list_head + tasks_offset;
-        goto exit;
-    }
-    list_head = next_process;
+        return 0;
 
-    while (1) {
-        addr_t tmp_next = 0;
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_PID,
+                   .pid = 0,
+                   .addr = list_head + tasks_offset);
 
-        if ( VMI_FAILURE == vmi_read_addr_va(vmi, next_process, 0, &tmp_next) )
-            goto exit;
+    if ( VMI_FAILURE == vmi_walk_list(vmi, &ctx, tasks_offset, true, &field, 1, 0, &procs) )
+        return 0;
 
-        if (list_head == tmp_next) {
+    for (i = 0; i < procs->count; i++) {
+        if (memcmp(procs->records + i * procs->record_size, value, len) == 0) {
+            rtnval = procs->nodes[i] + tasks_offset;
             break;
         }
-
-        if ( VMI_FAILURE == vmi_read_va(vmi, next_process + offset - tasks_offset, 0, len, buf, NULL) )
-            goto exit;
-
-        if (memcmp(buf, value, len) == 0) {
-            rtnval = next_process;
-            goto exit;
-        }
-        next_process = tmp_next;
     }
 
-exit:
-    g_free(buf);
+    vmi_free_list_walk(procs);
     return rtnval;
 }
 
@@ -0,0 +1,366 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "private.h"
+#include "os/windows/windows.h"
+
+/* Largest MMVAD_SHORT prefix we read in one go */
+#define VAD_MAX_READ 0x100
+
+/* The tree is AVL balanced, this is plenty for REGION_WALK_MAX_ENTRIES */
+#define VAD_MAX_DEPTH 64
+
+static const uint8_t protection_to_access[8] = {
+    [1] = VMI_MEMACCESS_R,      /* PAGE_READONLY */
+    [2] = VMI_MEMACCESS_X,      /* PAGE_EXECUTE */
+    [3] = VMI_MEMACCESS_RX,     /* PAGE_EXECUTE_READ */
+    [4] = VMI_MEMACCESS_RW,     /* PAGE_READWRITE */
+    [5] = VMI_MEMACCESS_RW,     /* PAGE_WRITECOPY */
+    [6] = VMI_MEMACCESS_RWX,    /* PAGE_EXECUTE_READWRITE */
+    [7] = VMI_MEMACCESS_RWX,    /* PAGE_EXECUTE_WRITECOPY */
+};
+
+static void
+lookup_vad_flag(
+    vmi_instance_t vmi,
+    const char *member,
+    uint8_t *shift,
+    uint8_t *bits)
+{
+#ifdef ENABLE_JSON_PROFILES
+    addr_t offset = 0;
+    size_t start = 0, end = 0;
+
+    if (VMI_SUCCESS == vmi_get_bitfield_offset_and_size_from_json(vmi, json_profile(vmi), "_MMVAD_FLAGS",
+            member, &offset, &start, &end) && !offset && end > start && end <= 64) {
+        *shift = start;
+        *bits = end - start;
+        return;
+    }
+#endif
+
+    dbprint(VMI_DEBUG_MISC, "--_MMVAD_FLAGS.%s is not available in the JSON profile\n", member);
+    *shift = 0;
+    *bits = 0;
+}
+
+static void
+init_file_offsets(
+    vmi_instance_t vmi,
+    windows_instance_t windows)
+{
+    if (VMI_SUCCESS == json_profile_lookup(vmi, "_MMVAD", "Subsection", &windows->vad_subsection_offset) &&
+            VMI_SUCCESS == json_profile_lookup(vmi, "_SUBSECTION", "ControlArea", &windows->subsection_ca_offset) &&
+            VMI_SUCCESS == json_profile_lookup(vmi, "_CONTROL_AREA", "FilePointer", &windows->ca_file_offset) &&
+            VMI_SUCCESS == json_profile_lookup(vmi, "_FILE_OBJECT", "FileName", &windows->file_name_offset))
+        return;
+
+    dbprint(VMI_DEBUG_MISC, "--mapped file offsets are not available, VAD names disabled\n");
+    windows->vad_subsection_offset = 0;
+}
+
+static status_t
+init_vad_offsets(
+    vmi_instance_t vmi,
+    windows_instance_t windows)
+{
+    addr_t left = 0, right = 0;
+
+    if (windows->vad_layout != WINDOWS_VAD_UNKNOWN)
+        return VMI_SUCCESS;
+
+    if (VMI_FAILURE == json_profile_lookup(vmi, "_EPROCESS", "VadRoot", &windows->vad_root_offset) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "_MMVAD_SHORT", "StartingVpn", &windows->vad_start_offset) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "_MMVAD_SHORT", "EndingVpn", &windows->vad_end_offset) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "_MMVAD_SHORT", "u", &windows->vad_flags_offset))
+        goto fail;
+
+    /*
+     * Windows 8 moved the tree links into an embedded VadNode, 8.1 switched
+     * it to RTL_BALANCED_NODE and the root to RTL_AVL_TREE. Before that the
+     * links are the first members of MMVAD_SHORT.
+     */
+    if (VMI_SUCCESS == json_profile_lookup(vmi, "_MMVAD_SHORT", "VadNode", &windows->vad_node_offset)) {
+        windows->vad_field_size = sizeof(uint32_t);
+        if (VMI_FAILURE == json_profile_lookup(vmi, "_RTL_BALANCED_NODE", "Left", &left) ||
+                VMI_FAILURE == json_profile_lookup(vmi, "_RTL_BALANCED_NODE", "Right", &right)) {
+            if (VMI_FAILURE == json_profile_lookup(vmi, "_MM_AVL_NODE", "LeftChild", &left) ||
+                    VMI_FAILURE == json_profile_lookup(vmi, "_MM_AVL_NODE", "RightChild", &right))
+                goto fail;
+        }
+    } else {
+        windows->vad_node_offset = 0;
+        windows->vad_field_size = vmi_get_address_width(vmi);
+        if (VMI_FAILURE == json_profile_lookup(vmi, "_MMVAD_SHORT", "LeftChild", &left) ||
+                VMI_FAILURE == json_profile_lookup(vmi, "_MMVAD_SHORT", "RightChild", &right))
+            goto fail;
+    }
+
+    windows->vad_left_offset = windows->vad_node_offset + left;
+    windows->vad_right_offset = windows->vad_node_offset + right;
+
+    if (VMI_FAILURE == json_profile_lookup(vmi, "_MMVAD_SHORT", "StartingVpnHigh", &windows->vad_start_high_offset) ||
+            VMI_FAILURE == json_profile_lookup(vmi, "_MMVAD_SHORT", "EndingVpnHigh", &windows->vad_end_high_offset)) {
+        windows->vad_start_high_offset = 0;
+        windows->vad_end_high_offset = 0;
+    }
+
+    lookup_vad_flag(vmi, "VadType", &windows->vad_type_shift, &windows->vad_type_bits);
+    lookup_vad_flag(vmi, "Protection", &windows->vad_protection_shift, &windows->vad_protection_bits);
+    lookup_vad_flag(vmi, "PrivateMemory", &windows->vad_private_shift, &windows->vad_private_bits);
+    init_file_offsets(vmi, windows);
+
+    windows->vad_layout = VMI_SUCCESS == json_profile_lookup(vmi, "_RTL_AVL_TREE", "Root", &left) ?
+                          WINDOWS_VAD_AVL_TREE : WINDOWS_VAD_AVL_TABLE;
+
+    return VMI_SUCCESS;
+
+fail:
+    dbprint(VMI_DEBUG_MISC, "--VAD offsets are not available in the JSON profile\n");
+    return VMI_FAILURE;
+}
+
+static inline uint64_t
+bits_get(
+    uint64_t value,
+    uint8_t shift,
+    uint8_t bits)
+{
+    if (!bits)
+        return 0;
+
+    return (value >> shift) & (bits < 64 ? (1ull << bits) - 1 : ~0ull);
+}
+
+static char *
+read_vad_file_name(
+    vmi_instance_t vmi,
+    windows_instance_t windows,
+    addr_t file)
+{
+    unicode_string_t *us;
+    unicode_string_t out = { 0 };
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_DTB,
+                   .dtb = vmi->kpgd,
+                   .addr = file + windows->file_name_offset);
+
+    us = windows_read_unicode_struct(vmi, &ctx);
+    if (!us)
+        return NULL;
+
+    if (VMI_FAILURE == vmi_convert_str_encoding(us, &out, "UTF-8"))
+        out.contents = NULL;
+
+    vmi_free_unicode_str(us);
+    return (char *)out.contents;
+}
+
+/* Resolve MMVAD->Subsection->ControlArea->FilePointer */
+static addr_t
+vad_file_object(
+    vmi_instance_t vmi,
+    windows_instance_t windows,
+    addr_t vad)
+{
+    addr_t subsection = 0, ca = 0, file = 0;
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_DTB,
+                   .dtb = vmi->kpgd,
+                   .addr = vad + windows->vad_subsection_offset);
+
+    if (VMI_FAILURE == vmi_read_addr(vmi, &ctx, &subsection) || !subsection)
+        return 0;
+
+    ctx.addr = subsection + windows->subsection_ca_offset;
+    if (VMI_FAILURE == vmi_read_addr(vmi, &ctx, &ca) || !ca)
+        return 0;
+
+    ctx.addr = ca + windows->ca_file_offset;
+    if (VMI_FAILURE == vmi_read_addr(vmi, &ctx, &file))
+        return 0;
+
+    /* EX_FAST_REF keeps a reference count in the low bits */
+    return file & ~(addr_t)(vmi_get_address_width(vmi) == 8 ? 0xf : 0x7);
+}
+
+static status_t
+add_vad(
+    vmi_instance_t vmi,
+    windows_instance_t windows,
+    region_walk_t *walk,
+    addr_t vad,
+    const uint8_t *buf,
+    addr_t lo)
+{
+    uint8_t size = windows->vad_field_size;
+    vm_region_t region = { .object = vad };
+    uint64_t start = 0, end = 0;
+    uint8_t high;
+    char *name = NULL;
+    bool found = false;
+    status_t ret;
+
+    memcpy(&start, buf + windows->vad_start_offset - lo, size);
+    memcpy(&end, buf + windows->vad_end_offset - lo, size);
+    memcpy(&region.flags, buf + windows->vad_flags_offset - lo, size);
+
+    if (windows->vad_start_high_offset) {
+        high = buf[windows->vad_start_high_offset - lo];
+        start |= (uint64_t)high << 32;
+        high = buf[windows->vad_end_high_offset - lo];
+        end |= (uint64_t)high << 32;
+    }
+
+    /* EndingVpn is inclusive */
+    region.start = start << 12;
+    region.end = (end + 1) << 12;
+    region.type = bits_get(region.flags, windows->vad_type_shift, windows->vad_type_bits);
+    region.access = protection_to_access[bits_get(region.flags, windows->vad_protection_shift,
+                                         windows->vad_protection_bits) & 7];
+
+    /* only mapped views have a subsection, MMVAD_SHORT ends before it */
+    if (windows->vad_subsection_offset && windows->vad_private_bits &&
+            !bits_get(region.flags, windows->vad_private_shift, windows->vad_private_bits))
+        region.file = vad_file_object(vmi, windows, vad);
+
+    if (region.file) {
+        region.name = region_walk_cached_name(walk, region.file, &found);
+        if (!found)
+            region.name = name = read_vad_file_name(vmi, windows, region.file);
+    }
+
+    ret = region_walk_add(walk, &region);
+    free(name);
+
+    return ret;
+}
+
+/*
+ * Depth-first walk of the VAD tree, fetching the interesting part of each
+ * node with a single read. The snapshot gets sorted afterwards, so there
+ * is no need for an in-order traversal.
+ */
+static status_t
+walk_vad_tree(
+    vmi_instance_t vmi,
+    windows_instance_t windows,
+    region_walk_t *walk,
+    addr_t root)
+{
+    uint8_t width = vmi_get_address_width(vmi);
+    uint8_t size = windows->vad_field_size;
+    uint8_t buf[VAD_MAX_READ];
+    addr_t stack[VAD_MAX_DEPTH];
+    unsigned int depth = 0, count = 0;
+    addr_t lo, hi;
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_DTB,
+                   .dtb = vmi->kpgd);
+
+    if (!width || !size)
+        return VMI_FAILURE;
+
+    lo = MIN(MIN(windows->vad_left_offset, windows->vad_right_offset),
+             MIN(windows->vad_start_offset, MIN(windows->vad_end_offset, windows->vad_flags_offset)));
+    hi = MAX(MAX(windows->vad_left_offset, windows->vad_right_offset) + width,
+             MAX(windows->vad_start_offset, MAX(windows->vad_end_offset, windows->vad_flags_offset)) + size);
+    if (windows->vad_start_high_offset)
+        hi = MAX(hi, MAX(windows->vad_start_high_offset, windows->vad_end_high_offset) + 1);
+
+    if (hi - lo > sizeof(buf)) {
+        errprint("%s: MMVAD_SHORT offsets are out of range\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    if (root)
+        stack[depth++] = root;
+
+    while (depth) {
+        addr_t vad = stack[--depth] - windows->vad_node_offset;
+        addr_t left, right;
+
+        if (++count > REGION_WALK_MAX_ENTRIES) {
+            dbprint(VMI_DEBUG_MISC, "--%s: too many VADs, tree is likely corrupted\n", __FUNCTION__);
+            return VMI_FAILURE;
+        }
+
+        ctx.addr = vad + lo;
+        if (VMI_FAILURE == vmi_read(vmi, &ctx, hi - lo, buf, NULL)) {
+            dbprint(VMI_DEBUG_MISC, "--%s: failed to read VAD at 0x%"PRIx64"\n", __FUNCTION__, vad);
+            return VMI_FAILURE;
+        }
+
+        if (VMI_FAILURE == add_vad(vmi, windows, walk, vad, buf, lo))
+            return VMI_FAILURE;
+
+        left = buf_read_addr(buf, windows->vad_left_offset - lo, width);
+        right = buf_read_addr(buf, windows->vad_right_offset - lo, width);
+
+        if (depth + 2 > VAD_MAX_DEPTH) {
+            dbprint(VMI_DEBUG_MISC, "--%s: VAD tree is too deep\n", __FUNCTION__);
+            return VMI_FAILURE;
+        }
+
+        if (right)
+            stack[depth++] = right;
+        if (left)
+            stack[depth++] = left;
+    }
+
+    return VMI_SUCCESS;
+}
+
+status_t
+windows_get_regions(
+    vmi_instance_t vmi,
+    vmi_pid_t pid,
+    region_walk_t *walk)
+{
+    windows_instance_t windows = vmi->os_data;
+    addr_t eprocess, root = 0;
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_DTB,
+                   .dtb = vmi->kpgd);
+
+    if (!windows)
+        return VMI_FAILURE;
+
+    if (VMI_FAILURE == init_vad_offsets(vmi, windows))
+        return VMI_FAILURE;
+
+    /* returns the address of EPROCESS->ActiveProcessLinks */
+    eprocess = windows_find_eprocess_list_pid(vmi, pid);
+    if (!eprocess)
+        return VMI_FAILURE;
+
+    ctx.addr = eprocess - windows->tasks_offset + windows->vad_root_offset;
+
+    /* MM_AVL_TABLE keeps the tree under BalancedRoot.RightChild */
+    if (windows->vad_layout == WINDOWS_VAD_AVL_TABLE)
+        ctx.addr += windows->vad_right_offset - windows->vad_node_offset;
+
+    if (VMI_FAILURE == vmi_read_addr(vmi, &ctx, &root))
+        return VMI_FAILURE;
+
+    return walk_vad_tree(vmi, windows, walk, root);
+}
@@ -23,6 +23,12 @@
 
 #include "private.h"
 
+typedef enum windows_vad_layout {
+    WINDOWS_VAD_UNKNOWN,
+    WINDOWS_VAD_AVL_TABLE,  /**< EPROCESS->VadRoot is an MM_AVL_TABLE, up to 8 */
+    WINDOWS_VAD_AVL_TREE,   /**< EPROCESS->VadRoot is an RTL_AVL_TREE, since 8.1 */
+} windows_vad_layout_t;
+
 struct windows_instance {
 
     addr_t ntoskrnl; /**< base phys address for ntoskrnl image */
@@ -45,6 +51,62 @@ struct windows_instance {
 
     uint64_t pname_offset; /**< EPROCESS->ImageFileName */
 
+    uint64_t peb_offset; /**< EPROCESS->Peb */
+
+    uint64_t peb_ldr_offset; /**< PEB->Ldr */
+
+    uint64_t ldr_list_offset; /**< PEB_LDR_DATA->InLoadOrderModuleList */
+
+    uint64_t ldr_links_offset; /**< LDR_DATA_TABLE_ENTRY->InLoadOrderLinks */
+
+    uint64_t ldr_base_offset; /**< LDR_DATA_TABLE_ENTRY->DllBase */
+
+    uint64_t ldr_size_offset; /**< LDR_DATA_TABLE_ENTRY->SizeOfImage */
+
+    uint64_t ldr_name_offset; /**< LDR_DATA_TABLE_ENTRY->BaseDllName */
+
+    windows_vad_layout_t vad_layout; /**< how the VAD tree is rooted */
+
+    uint64_t vad_root_offset; /**< EPROCESS->VadRoot */
+
+    uint64_t vad_node_offset; /**< MMVAD_SHORT->VadNode, what child pointers point to */
+
+    uint64_t vad_left_offset; /**< left child within MMVAD_SHORT */
+
+    uint64_t vad_right_offset; /**< right child within MMVAD_SHORT */
+
+    uint64_t vad_start_offset; /**< MMVAD_SHORT->StartingVpn */
+
+    uint64_t vad_end_offset; /**< MMVAD_SHORT->EndingVpn */
+
+    uint64_t vad_start_high_offset; /**< MMVAD_SHORT->StartingVpnHigh, 0 if absent */
+
+    uint64_t vad_end_high_offset; /**< MMVAD_SHORT->EndingVpnHigh, 0 if absent */
+
+    uint64_t vad_flags_offset; /**< MMVAD_SHORT->u */
+
+    uint8_t vad_field_size; /**< size of the VPNs and flags, pointer sized before 8 */
+
+    uint64_t vad_subsection_offset; /**< MMVAD->Subsection, 0 if unknown */
+
+    uint64_t subsection_ca_offset; /**< SUBSECTION->ControlArea */
+
+    uint64_t ca_file_offset; /**< CONTROL_AREA->FilePointer */
+
+    uint64_t file_name_offset; /**< FILE_OBJECT->FileName */
+
+    uint8_t vad_type_shift; /**< MMVAD_FLAGS.VadType bit position */
+
+    uint8_t vad_type_bits; /**< MMVAD_FLAGS.VadType width, 0 if unknown */
+
+    uint8_t vad_protection_shift; /**< MMVAD_FLAGS.Protection bit position */
+
+    uint8_t vad_protection_bits; /**< MMVAD_FLAGS.Protection width, 0 if unknown */
+
+    uint8_t vad_private_shift; /**< MMVAD_FLAGS.PrivateMemory bit position */
+
+    uint8_t vad_private_bits; /**< MMVAD_FLAGS.PrivateMemory width, 0 if unknown */
+
     uint16_t build; /**< Windows build number */
 
     win_ver_t version; /**< version of Windows */
@@ -89,4 +151,8 @@ unicode_string_t *windows_read_unicode_struct(vmi_instance_t vmi, const access_c
 
 unicode_string_t *windows_read_unicode_struct_pm( vmi_instance_t vmi, const access_context_t *ctx, page_mode_t page_mode );
 
+status_t windows_get_modules(vmi_instance_t vmi, vmi_pid_t pid, module_walk_t *walk);
+
+status_t windows_get_regions(vmi_instance_t vmi, vmi_pid_t pid, region_walk_t *walk);
+
 #endif /* OS_WINDOWS_H_ */
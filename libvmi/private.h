@@ -92,10 +92,14 @@ struct vmi_instance {
 
     addr_t kpgd;            /**< kernel page global directory */
 
+    bool kpti;              /**< Linux page tables come in kernel and user pairs */
+
     addr_t init_task;       /**< address of task struct for init */
 
     bool actx_version_warn_once; /**< print warning about actx version mismatch once only */
 
+    uint64_t access_generation; /**< bumped when a symbol or PID translation may have changed */
+
     union {
         struct {
             bool pse;        /**< true if PSE is enabled */
@@ -140,6 +144,32 @@ struct vmi_instance {
 
     GHashTable *v2p_cache;  /**< hash table to hold the v2p cache data */
 
+    GHashTable *module_index; /**< address to module index (key: dtb) */
+
+    GHashTable *struct_layouts; /**< memoised struct sizes and member offsets */
+
+    GSList *windows;        /**< open vmi_window_t windows */
+
+    struct event_trace *event_trace; /**< set while recording events, see vmi_events_record */
+
+    GHashTable *event_filters; /**< vmi_event_t -> compiled filter, NULL if none */
+
+    struct vmi_syscall_tracer *syscall_tracer; /**< see vmi_syscall_trace_start */
+
+    struct event_defer *event_defer; /**< deferred event queues, see VMI_EVENT_RESPONSE_DEFER */
+
+#ifdef ENABLE_ADDRESS_CACHE
+    struct {
+        addr_t va;          /**< page aligned address of the last read */
+        addr_t pt;          /**< page table used for the translation */
+        addr_t npt;         /**< nested page table used for the translation */
+        page_mode_t pm;     /**< page mode used for the translation */
+        page_mode_t npm;    /**< nested page mode used for the translation */
+        time_t expires;     /**< memory cache deadline of the page, 0 if none */
+        uint8_t *page;      /**< memory cache data of the page, NULL if empty */
+    } read_lookaside;       /**< one-entry cache for the fixed-width reads */
+#endif
+
 #ifdef ENABLE_PAGE_CACHE
     GHashTable *memory_cache;  /**< hash table for memory cache */
 
@@ -180,8 +210,16 @@ struct vmi_instance {
 
     GHashTable *mem_events_generic; /**< mem event to functions mapping (key: access type) */
 
+    void **mem_events_table; /**< radix index of mem_events_on_gfn, see mem_event_on_gfn */
+
+    vmi_event_t **mem_events_access[8]; /**< generic mem events matching each R/W/X access */
+
+    GSList *mem_events_retired; /**< mem_events_access arrays replaced in a callback, still walked */
+
     GHashTable *reg_events; /**< reg event to functions mapping (key: reg) */
 
+    GHashTable *reg_last_values; /**< onswitch reg event -> value last delivered per vCPU */
+
     GHashTable *msr_events; /**< reg event to functions mapping (key: msr index) */
 
     GHashTable *ss_events; /**< single step event to functions mapping (key: vcpu_id) */
@@ -198,6 +236,8 @@ struct vmi_instance {
 
     GSList *swap_events; /**< list to save vmi_swap_events requests when event_callback is set */
 
+    uint32_t events_budget; /**< max events handled per vmi_events_listen call, 0 for all */
+
     void *(*get_data_callback) (vmi_instance_t, addr_t, uint32_t); /**< memory_cache function */
 
     void (*release_data_callback) (vmi_instance_t, void *, size_t); /**< memory_cache function */
@@ -253,6 +293,16 @@ addr_t canonical_addr(addr_t va)
     return VMI_GET_BIT(va, 47) ? (va | 0xffff000000000000) : va;
 }
 
+/* Monotonic time in us, g_get_monotonic_time needs a newer glib */
+static inline
+gint64 monotonic_time_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ll + ts.tv_nsec / 1000;
+}
+
 /*----------------------------------------------
  * convenience.c
  */
@@ -313,6 +363,34 @@ status_t vmi_pagetable_lookup_cache(
     addr_t vaddr,
     addr_t *paddr);
 
+/*-------------------------------------
+ * read.c
+ */
+
+status_t translate_read_addr(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    addr_t pt,
+    page_mode_t pm,
+    addr_t addr,
+    addr_t *paddr);
+
+/*
+ * The read lookaside holds a page owned by the memory cache and a
+ * translation the v2p cache may drop, so both caches have to empty it
+ * when they let go of either.
+ */
+static inline void
+read_lookaside_flush(
+    vmi_instance_t vmi)
+{
+#ifdef ENABLE_ADDRESS_CACHE
+    vmi->read_lookaside.page = NULL;
+#else
+    (void)vmi;
+#endif
+}
+
 /*-----------------------------------------
  * strmatch.c
  */
@@ -358,10 +436,307 @@ gboolean clear_events_full(
     gpointer value,
     gpointer data);
 
+bool reg_event_unswitched(
+    vmi_instance_t vmi,
+    vmi_event_t *event);
+status_t register_mem_events_sorted(
+    vmi_instance_t vmi,
+    vmi_event_t *events,
+    size_t count,
+    bool *held);
+status_t clear_mem_events_sorted(
+    vmi_instance_t vmi,
+    vmi_event_t *events,
+    size_t count);
+
+/*
+ * The page table a CR3 value points to, without the PCID bits, the no
+ * flush bit 63 of writes and, when Linux uses KPTI, the bit telling the
+ * user and kernel page tables apart.
+ */
+static inline addr_t
+cr3_page_table(
+    vmi_instance_t vmi,
+    addr_t cr3)
+{
+    return cr3 & VMI_BIT_MASK(vmi->kpti ? 13 : 12, 62);
+}
+
+/*
+ * mem_events_on_gfn is indexed by a four level radix table of 512 entry
+ * nodes, like a page table, for the frames below MEM_EVENT_TABLE_GFNS.
+ */
+#define MEM_EVENT_NODE_BITS 9
+#define MEM_EVENT_TOP_BITS 13
+#define MEM_EVENT_TABLE_GFNS (1ULL << (3 * MEM_EVENT_NODE_BITS + MEM_EVENT_TOP_BITS))
+
+static inline vmi_event_t *
+mem_event_on_gfn(
+    vmi_instance_t vmi,
+    addr_t gfn)
+{
+    const addr_t mask = (1u << MEM_EVENT_NODE_BITS) - 1;
+    void **node = vmi->mem_events_table;
+
+    if (G_UNLIKELY(gfn >= MEM_EVENT_TABLE_GFNS))
+        return g_hash_table_lookup(vmi->mem_events_on_gfn, &gfn);
+
+    if (!node ||
+            !(node = node[gfn >> (3 * MEM_EVENT_NODE_BITS)]) ||
+            !(node = node[(gfn >> (2 * MEM_EVENT_NODE_BITS)) & mask]) ||
+            !(node = node[(gfn >> MEM_EVENT_NODE_BITS) & mask]))
+        return NULL;
+
+    return node[gfn & mask];
+}
+
+/*
+ * The generic mem events an access matches, NULL terminated, or NULL if
+ * there are none. Only the R, W and X bits of the access are looked at.
+ */
+static inline vmi_event_t **
+mem_events_for_access(
+    vmi_instance_t vmi,
+    vmi_mem_access_t out_access)
+{
+    return vmi->mem_events_access[(out_access >> 1) & 7];
+}
+
 #define ghashtable_foreach(table, iter, key, val) \
         g_hash_table_iter_init(&iter, table); \
         while(g_hash_table_iter_next(&iter,(void**)key,(void**)val))
 
+/* Read a guest pointer of the given width from a local buffer */
+static inline addr_t
+buf_read_addr(
+    const uint8_t *buf,
+    size_t offset,
+    uint8_t width)
+{
+    uint32_t addr32;
+    uint64_t addr64;
+
+    if (width == 8) {
+        memcpy(&addr64, buf + offset, sizeof(addr64));
+        return addr64;
+    }
+
+    memcpy(&addr32, buf + offset, sizeof(addr32));
+    return addr32;
+}
+
+/*----------------------------------------------
+ * modules.c
+ */
+
+/* Upper bound on entries taken from a single module list walk */
+#define MODULE_WALK_MAX_ENTRIES 0x4000
+
+/* Minimum time between two miss-triggered refreshes of a module index */
+#define MODULE_INDEX_REFRESH_US 100000
+
+void module_index_init(
+    vmi_instance_t vmi);
+void module_index_destroy(
+    vmi_instance_t vmi);
+
+const char *module_walk_cached_name(
+    module_walk_t *walk,
+    addr_t entry,
+    addr_t base,
+    addr_t size,
+    addr_t name_addr);
+status_t module_walk_add(
+    module_walk_t *walk,
+    addr_t entry,
+    addr_t base,
+    addr_t size,
+    addr_t name_addr,
+    const char *name);
+
+/*----------------------------------------------
+ * regions.c
+ */
+
+/* Upper bound on regions taken from a single walk */
+#define REGION_WALK_MAX_ENTRIES 0x10000
+
+const char *region_walk_cached_name(
+    region_walk_t *walk,
+    addr_t file,
+    bool *found);
+status_t region_walk_add(
+    region_walk_t *walk,
+    const vm_region_t *region);
+
+/*----------------------------------------------
+ * hash.c
+ */
+
+/* Frames mapped at once when hashing a range */
+#define HASH_RANGE_BATCH 256
+
+uint64_t xxh64(
+    const void *data,
+    size_t len,
+    uint64_t seed);
+
+/*----------------------------------------------
+ * lists.c
+ */
+
+/* Default upper bound on the nodes visited by a list walk */
+#define LIST_WALK_MAX_ENTRIES 0x20000
+
+/* Largest part of a node read per hop */
+#define LIST_WALK_MAX_SPAN 0x1000
+
+/*----------------------------------------------
+ * structs.c
+ */
+
+/* Largest struct we are willing to copy as a whole */
+#define STRUCT_VIEW_MAX_SIZE 0x10000
+
+void struct_layout_cache_init(
+    vmi_instance_t vmi);
+void struct_layout_cache_destroy(
+    vmi_instance_t vmi);
+
+/*----------------------------------------------
+ * window.c
+ */
+
+void window_destroy_all(
+    vmi_instance_t vmi);
+
+/*----------------------------------------------
+ * defer.c
+ */
+
+status_t event_defer(
+    vmi_instance_t vmi,
+    const vmi_event_t *event);
+status_t event_defer_response(
+    vmi_instance_t vmi,
+    unsigned int vcpu,
+    vmi_deferred_event_t *deferred,
+    event_response_t *response);
+int event_defer_fd(
+    vmi_instance_t vmi);
+void event_defer_clear_wake(
+    vmi_instance_t vmi);
+void event_defer_destroy(
+    vmi_instance_t vmi);
+
+/*----------------------------------------------
+ * filter.c
+ */
+
+/*
+ * The fields of an event filters test, taken by the driver from the
+ * request it received before filling the vmi_event_t and converting the
+ * registers. reg reads one register from regs, in the layout the driver
+ * received them in, NULL if there are none.
+ */
+typedef struct {
+    bool (*reg)(const void *regs, reg_t reg, uint64_t *value);
+    const void *regs;
+    unsigned int vcpu;
+    uint64_t value;         /* reg_event.value of register events */
+    addr_t gfn;
+    addr_t gla;
+    bool gla_valid;
+} event_fields_t;
+
+/*
+ * A reader of the registers filters test, for a structure with the field
+ * names of x86_registers_t, like the requests of the Xen rings.
+ */
+#define EVENT_FILTER_X86_REGS(name, type)                   \
+bool name(const void *data, reg_t reg, uint64_t *value)     \
+{                                                           \
+    const type *regs = data;                                \
+                                                            \
+    switch (reg) {                                          \
+        case RAX: *value = regs->rax; break;                \
+        case RBX: *value = regs->rbx; break;                \
+        case RCX: *value = regs->rcx; break;                \
+        case RDX: *value = regs->rdx; break;                \
+        case RSI: *value = regs->rsi; break;                \
+        case RDI: *value = regs->rdi; break;                \
+        case RBP: *value = regs->rbp; break;                \
+        case RSP: *value = regs->rsp; break;                \
+        case R8: *value = regs->r8; break;                  \
+        case R9: *value = regs->r9; break;                  \
+        case R10: *value = regs->r10; break;                \
+        case R11: *value = regs->r11; break;                \
+        case R12: *value = regs->r12; break;                \
+        case R13: *value = regs->r13; break;                \
+        case R14: *value = regs->r14; break;                \
+        case R15: *value = regs->r15; break;                \
+        case RIP: *value = regs->rip; break;                \
+        case RFLAGS: *value = regs->rflags; break;          \
+        case CR0: *value = regs->cr0; break;                \
+        case CR2: *value = regs->cr2; break;                \
+        case CR3: *value = regs->cr3; break;                \
+        case CR4: *value = regs->cr4; break;                \
+        case FS_BASE: *value = regs->fs_base; break;        \
+        case GS_BASE: *value = regs->gs_base; break;        \
+        default: return false;                              \
+    }                                                       \
+                                                            \
+    return true;                                            \
+}
+
+bool event_filter_x86_regs(
+    const void *regs,
+    reg_t reg,
+    uint64_t *value);
+bool event_filtered(
+    vmi_instance_t vmi,
+    vmi_event_t *event,
+    const event_fields_t *fields);
+void event_filter_remove(
+    vmi_instance_t vmi,
+    vmi_event_t *event);
+
+/* The answer to an event the filters dropped */
+static inline event_response_t
+event_filter_response(
+    const vmi_event_t *event)
+{
+    /* with the page still restricted the access would only fault again */
+    return VMI_EVENT_MEMORY == event->type ? VMI_EVENT_RESPONSE_EMULATE : VMI_EVENT_RESPONSE_NONE;
+}
+
+/*----------------------------------------------
+ * trace.c
+ */
+
+event_response_t event_trace_dispatch(
+    vmi_instance_t vmi,
+    vmi_event_t *event);
+void event_trace_page(
+    vmi_instance_t vmi,
+    addr_t pfn,
+    const void *page);
+
+/*
+ * Issue the callback of an event. Drivers go through here so the events
+ * can be recorded.
+ */
+static inline event_response_t
+event_dispatch(
+    vmi_instance_t vmi,
+    vmi_event_t *event)
+{
+    if (G_UNLIKELY(vmi->event_trace))
+        return event_trace_dispatch(vmi, event);
+
+    return event->callback(vmi, event);
+}
+
 /*----------------------------------------------
  * os/windows/core.c
  */
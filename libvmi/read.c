@@ -30,6 +30,7 @@
 
 #include "private.h"
 #include "driver/driver_wrapper.h"
+#include "driver/memory_cache.h"
 
 ///////////////////////////////////////////////////////////
 // Classic read functions for access to memory
@@ -148,6 +149,39 @@ done:
     return ret;
 }
 
+/*
+ * Translate an address of a read to a guest physical address. pt and pm
+ * are what the translation mechanism of the access context resolved to.
+ */
+status_t
+translate_read_addr(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    addr_t pt,
+    page_mode_t pm,
+    addr_t addr,
+    addr_t *paddr)
+{
+    addr_t naddr;
+
+    if (valid_pm(pm)) {
+        if (VMI_SUCCESS != vmi_nested_pagetable_lookup(vmi, ctx->npt, ctx->npm, pt, pm, addr, paddr, &naddr))
+            return VMI_FAILURE;
+
+        if (valid_npm(ctx->npm)) {
+            dbprint(VMI_DEBUG_READ, "--Setting paddr to nested address 0x%lx\n", naddr);
+            *paddr = naddr;
+        }
+    } else {
+        *paddr = addr;
+
+        if (valid_npm(ctx->npm) && VMI_SUCCESS != vmi_nested_pagetable_lookup(vmi, 0, 0, ctx->npt, ctx->npm, *paddr, paddr, NULL) )
+            return VMI_FAILURE;
+    }
+
+    return VMI_SUCCESS;
+}
+
 status_t
 vmi_read(
     vmi_instance_t vmi,
@@ -161,7 +195,6 @@ vmi_read(
     unsigned char *memory;
     addr_t start_addr;
     addr_t paddr;
-    addr_t naddr;
     addr_t pfn;
     addr_t offset;
     addr_t pt;
@@ -259,20 +292,8 @@ vmi_read(
     while (count > 0) {
         size_t read_len = 0;
 
-        if (valid_pm(pm)) {
-            if (VMI_SUCCESS != vmi_nested_pagetable_lookup(vmi, ctx->npt, ctx->npm, pt, pm, start_addr + buf_offset, &paddr, &naddr))
-                goto done;
-
-            if (valid_npm(ctx->npm)) {
-                dbprint(VMI_DEBUG_READ, "--Setting paddr to nested address 0x%lx\n", naddr);
-                paddr = naddr;
-            }
-        } else {
-            paddr = start_addr + buf_offset;
-
-            if (valid_npm(ctx->npm) && VMI_SUCCESS != vmi_nested_pagetable_lookup(vmi, 0, 0, ctx->npt, ctx->npm, paddr, &paddr, NULL) )
-                goto done;
-        }
+        if (VMI_FAILURE == translate_read_addr(vmi, ctx, pt, pm, start_addr + buf_offset, &paddr))
+            goto done;
 
         /* access the memory */
         pfn = paddr >> vmi->page_shift;
@@ -307,6 +328,86 @@ done:
     return ret;
 }
 
+status_t
+vmi_compile_access_context(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    access_handle_t *handle)
+{
+    access_context_t source;
+    addr_t addr = 0;
+    addr_t pt = 0;
+    page_mode_t pm;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !ctx || !handle)
+        return VMI_FAILURE;
+#endif
+
+    /* ctx may point into the handle when it is recompiled */
+    source = *ctx;
+    pm = source.pm;
+
+    switch (source.tm) {
+        case VMI_TM_NONE:
+            addr = source.addr;
+            pm = VMI_PM_NONE;
+            break;
+        case VMI_TM_KERNEL_SYMBOL:
+#ifdef ENABLE_SAFETY_CHECKS
+            if (!vmi->os_interface || !vmi->kpgd)
+                return VMI_FAILURE;
+#endif
+            if ( VMI_FAILURE == vmi_translate_ksym2v(vmi, source.ksym, &addr) )
+                return VMI_FAILURE;
+
+            pt = vmi->kpgd;
+            if (!pm)
+                pm = vmi->page_mode;
+            break;
+        case VMI_TM_PROCESS_PID:
+#ifdef ENABLE_SAFETY_CHECKS
+            if (!vmi->os_interface)
+                return VMI_FAILURE;
+#endif
+            addr = source.addr;
+
+            if ( !source.pid )
+                pt = vmi->kpgd;
+            else if (source.pid > 0) {
+                if ( VMI_FAILURE == vmi_pid_to_dtb(vmi, source.pid, &pt) )
+                    return VMI_FAILURE;
+            }
+            if (!pm)
+                pm = vmi->page_mode;
+            if (!pt)
+                return VMI_FAILURE;
+            break;
+        case VMI_TM_PROCESS_DTB:
+            addr = source.addr;
+            pt = source.pt;
+            if (!pm)
+                pm = vmi->page_mode;
+            break;
+        default:
+            errprint("%s error: translation mechanism is not defined.\n", __FUNCTION__);
+            return VMI_FAILURE;
+    }
+
+    memset(handle, 0, sizeof(*handle));
+    handle->ctx.version = ACCESS_CONTEXT_VERSION;
+    handle->ctx.tm = VMI_TM_NONE == source.tm ? VMI_TM_NONE : VMI_TM_PROCESS_DTB;
+    handle->ctx.addr = addr;
+    handle->ctx.pt = pt;
+    handle->ctx.pm = pm;
+    handle->ctx.npt = source.npt;
+    handle->ctx.npm = source.npm;
+    handle->source = source;
+    handle->generation = vmi->access_generation;
+
+    return VMI_SUCCESS;
+}
+
 // Reads memory at a guest's physical address
 status_t
 vmi_read_pa(
@@ -355,12 +456,120 @@ vmi_read_ksym(
 
 ///////////////////////////////////////////////////////////
 // Easy access to memory
+
+#ifdef ENABLE_ADDRESS_CACHE
+/*
+ * Lookaside miss: translate the address, map the page through the
+ * memory cache and remember both for the next read.
+ */
+static status_t
+read_fixed_miss(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    addr_t pt,
+    page_mode_t pm,
+    size_t width,
+    void *value)
+{
+    addr_t paddr, pfn;
+    uint8_t *page;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    /* let vmi_read report invalid contexts */
+    if ((pt && !valid_pm(pm)) || (ctx->npt && !valid_npm(ctx->npm)))
+        return vmi_read(vmi, ctx, width, value, NULL);
+#endif
+
+    if (VMI_FAILURE == translate_read_addr(vmi, ctx, pt, pm, ctx->addr, &paddr))
+        return VMI_FAILURE;
+
+    pfn = paddr >> vmi->page_shift;
+    page = vmi_read_page(vmi, pfn);
+    if (!page)
+        return VMI_FAILURE;
+
+    vmi->read_lookaside.va = ctx->addr & ~((addr_t)vmi->page_size - 1);
+    vmi->read_lookaside.pt = pt;
+    vmi->read_lookaside.npt = ctx->npt;
+    vmi->read_lookaside.pm = pm;
+    vmi->read_lookaside.npm = ctx->npm;
+    vmi->read_lookaside.expires = memory_cache_expires(vmi, pfn << vmi->page_shift);
+    vmi->read_lookaside.page = page;
+
+    memcpy(value, page + (paddr & (vmi->page_size - 1)), width);
+    return VMI_SUCCESS;
+}
+#endif
+
+/*
+ * Fixed-width reads mostly hit the page of the previous read, e.g. when
+ * walking a list or the fields of a struct. A naturally aligned access
+ * never crosses a page, so on a lookaside hit it is a single load from
+ * the page the memory cache already mapped. Everything else goes
+ * through vmi_read.
+ */
+static inline status_t
+read_fixed(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    size_t width,
+    void *value)
+{
+#ifdef ENABLE_ADDRESS_CACHE
+    addr_t pt;
+    page_mode_t pm;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !ctx || !value)
+        return vmi_read(vmi, ctx, width, value, NULL);
+#endif
+
+    if (ctx->addr & (width - 1))
+        return vmi_read(vmi, ctx, width, value, NULL);
+
+    switch (ctx->tm) {
+        case VMI_TM_NONE:
+            pt = 0;
+            pm = VMI_PM_NONE;
+            break;
+        case VMI_TM_PROCESS_PID:
+            if (ctx->pid || !vmi->os_interface || !vmi->kpgd)
+                return vmi_read(vmi, ctx, width, value, NULL);
+
+            pt = vmi->kpgd;
+            pm = ctx->pm ? ctx->pm : vmi->page_mode;
+            break;
+        case VMI_TM_PROCESS_DTB:
+            pt = ctx->pt;
+            pm = ctx->pm ? ctx->pm : vmi->page_mode;
+            break;
+        default:
+            return vmi_read(vmi, ctx, width, value, NULL);
+    }
+
+    if (vmi->read_lookaside.page &&
+            vmi->read_lookaside.va == (ctx->addr & ~((addr_t)vmi->page_size - 1)) &&
+            vmi->read_lookaside.pt == pt &&
+            vmi->read_lookaside.npt == ctx->npt &&
+            vmi->read_lookaside.pm == pm &&
+            vmi->read_lookaside.npm == ctx->npm &&
+            (!vmi->read_lookaside.expires || time(NULL) <= vmi->read_lookaside.expires)) {
+        memcpy(value, vmi->read_lookaside.page + (ctx->addr & (vmi->page_size - 1)), width);
+        return VMI_SUCCESS;
+    }
+
+    return read_fixed_miss(vmi, ctx, pt, pm, width, value);
+#else
+    return vmi_read(vmi, ctx, width, value, NULL);
+#endif
+}
+
 status_t
 vmi_read_8(vmi_instance_t vmi,
            const access_context_t *ctx,
            uint8_t * value)
 {
-    return vmi_read(vmi, ctx, 1, value, NULL);
+    return read_fixed(vmi, ctx, 1, value);
 }
 
 status_t
@@ -368,7 +577,7 @@ vmi_read_16(vmi_instance_t vmi,
             const access_context_t *ctx,
             uint16_t * value)
 {
-    return vmi_read(vmi, ctx, 2, value, NULL);
+    return read_fixed(vmi, ctx, 2, value);
 }
 
 status_t
@@ -377,7 +586,7 @@ vmi_read_32(
     const access_context_t *ctx,
     uint32_t * value)
 {
-    return vmi_read(vmi, ctx, 4, value, NULL);
+    return read_fixed(vmi, ctx, 4, value);
 }
 
 status_t
@@ -386,7 +595,43 @@ vmi_read_64(
     const access_context_t *ctx,
     uint64_t * value)
 {
-    return vmi_read(vmi, ctx, 8, value, NULL);
+    return read_fixed(vmi, ctx, 8, value);
+}
+
+status_t
+vmi_read_handle(
+    vmi_instance_t vmi,
+    access_handle_t *handle,
+    size_t count,
+    void *buf,
+    size_t *bytes_read)
+{
+    status_t ret;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !handle)
+        return VMI_FAILURE;
+#endif
+
+    if (handle->generation != vmi->access_generation &&
+            VMI_FAILURE == vmi_compile_access_context(vmi, &handle->source, handle)) {
+        if ( bytes_read )
+            *bytes_read = 0;
+        return VMI_FAILURE;
+    }
+
+    switch (count) {
+        case 1: // intentional fall-through
+        case 2: // intentional fall-through
+        case 4: // intentional fall-through
+        case 8:
+            ret = read_fixed(vmi, &handle->ctx, count, buf);
+            if ( bytes_read )
+                *bytes_read = VMI_SUCCESS == ret ? count : 0;
+            return ret;
+        default:
+            return vmi_read(vmi, &handle->ctx, count, buf, bytes_read);
+    }
 }
 
 status_t
@@ -407,13 +652,13 @@ vmi_read_addr(
     switch (vmi->page_mode) {
         case VMI_PM_AARCH64:// intentional fall-through
         case VMI_PM_IA32E:
-            ret = vmi_read(vmi, ctx, 8, value, NULL);
+            ret = read_fixed(vmi, ctx, 8, value);
             break;
         case VMI_PM_AARCH32:// intentional fall-through
         case VMI_PM_LEGACY: // intentional fall-through
         case VMI_PM_PAE: {
             uint32_t tmp = 0;
-            ret = vmi_read(vmi, ctx, 4, &tmp, NULL);
+            ret = read_fixed(vmi, ctx, 4, &tmp);
             *value = 0;
             *value = (addr_t) tmp;
             break;
@@ -522,7 +767,8 @@ vmi_read_8_pa(
     addr_t paddr,
     uint8_t * value)
 {
-    return vmi_read_pa(vmi, paddr, 1, value, NULL);
+    ACCESS_CONTEXT(ctx, .addr = paddr);
+    return read_fixed(vmi, &ctx, 1, value);
 }
 
 status_t
@@ -531,7 +777,8 @@ vmi_read_16_pa(
     addr_t paddr,
     uint16_t * value)
 {
-    return vmi_read_pa(vmi, paddr, 2, value, NULL);
+    ACCESS_CONTEXT(ctx, .addr = paddr);
+    return read_fixed(vmi, &ctx, 2, value);
 }
 
 status_t
@@ -540,7 +787,8 @@ vmi_read_32_pa(
     addr_t paddr,
     uint32_t * value)
 {
-    return vmi_read_pa(vmi, paddr, 4, value, NULL);
+    ACCESS_CONTEXT(ctx, .addr = paddr);
+    return read_fixed(vmi, &ctx, 4, value);
 }
 
 status_t
@@ -549,7 +797,8 @@ vmi_read_64_pa(
     addr_t paddr,
     uint64_t * value)
 {
-    return vmi_read_pa(vmi, paddr, 8, value, NULL);
+    ACCESS_CONTEXT(ctx, .addr = paddr);
+    return read_fixed(vmi, &ctx, 8, value);
 }
 
 status_t
@@ -558,38 +807,8 @@ vmi_read_addr_pa(
     addr_t paddr,
     addr_t *value)
 {
-    status_t ret = VMI_FAILURE;
-
-#ifdef ENABLE_SAFETY_CHECKS
-    if (!vmi) {
-        dbprint(VMI_DEBUG_READ, "--%s: vmi passed as NULL, returning without read",
-                __FUNCTION__);
-        return VMI_FAILURE;
-    }
-#endif
-
-    switch (vmi->page_mode) {
-        case VMI_PM_AARCH64:// intentional fall-through
-        case VMI_PM_IA32E:
-            ret = vmi_read_pa(vmi, paddr, 8, value, NULL);
-            break;
-        case VMI_PM_AARCH32:// intentional fall-through
-        case VMI_PM_LEGACY: // intentional fall-through
-        case VMI_PM_PAE: {
-            uint32_t tmp = 0;
-            ret = vmi_read_pa(vmi, paddr, 4, &tmp, NULL);
-            *value = 0;
-            *value = (addr_t) tmp;
-            break;
-        }
-        default:
-            dbprint(VMI_DEBUG_READ,
-                    "--%s: unknown page mode, can't read addr as width is unknown",
-                    __FUNCTION__);
-            break;
-    }
-
-    return ret;
+    ACCESS_CONTEXT(ctx, .addr = paddr);
+    return vmi_read_addr(vmi, &ctx, value);
 }
 
 char *
@@ -610,7 +829,12 @@ vmi_read_8_va(
     vmi_pid_t pid,
     uint8_t * value)
 {
-    return vmi_read_va(vmi, vaddr, pid, 1, value, NULL);
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_PID,
+                   .addr = vaddr,
+                   .pid = pid);
+
+    return read_fixed(vmi, &ctx, 1, value);
 }
 
 status_t
@@ -620,7 +844,12 @@ vmi_read_16_va(
     vmi_pid_t pid,
     uint16_t * value)
 {
-    return vmi_read_va(vmi, vaddr, pid, 2, value, NULL);
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_PID,
+                   .addr = vaddr,
+                   .pid = pid);
+
+    return read_fixed(vmi, &ctx, 2, value);
 }
 
 status_t
@@ -630,7 +859,12 @@ vmi_read_32_va(
     vmi_pid_t pid,
     uint32_t * value)
 {
-    return vmi_read_va(vmi, vaddr, pid, 4, value, NULL);
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_PID,
+                   .addr = vaddr,
+                   .pid = pid);
+
+    return read_fixed(vmi, &ctx, 4, value);
 }
 
 status_t
@@ -640,7 +874,12 @@ vmi_read_64_va(
     vmi_pid_t pid,
     uint64_t * value)
 {
-    return vmi_read_va(vmi, vaddr, pid, 8, value, NULL);
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_PID,
+                   .addr = vaddr,
+                   .pid = pid);
+
+    return read_fixed(vmi, &ctx, 8, value);
 }
 
 status_t
@@ -650,38 +889,12 @@ vmi_read_addr_va(
     vmi_pid_t pid,
     addr_t *value)
 {
-    status_t ret = VMI_FAILURE;
-
-#ifdef ENABLE_SAFETY_CHECKS
-    if (!vmi) {
-        dbprint(VMI_DEBUG_READ, "--%s: vmi passed as NULL, returning without read",
-                __FUNCTION__);
-        return VMI_FAILURE;
-    }
-#endif
-
-    switch (vmi->page_mode) {
-        case VMI_PM_AARCH64:// intentional fall-through
-        case VMI_PM_IA32E:
-            ret = vmi_read_va(vmi, vaddr, pid, 8, value, NULL);
-            break;
-        case VMI_PM_AARCH32:// intentional fall-through
-        case VMI_PM_LEGACY: // intentional fall-through
-        case VMI_PM_PAE: {
-            uint32_t tmp = 0;
-            ret = vmi_read_va(vmi, vaddr, pid, 4, &tmp, NULL);
-            *value = 0;
-            *value = (addr_t) tmp;
-            break;
-        }
-        default:
-            dbprint(VMI_DEBUG_READ,
-                    "--%s: unknown page mode, can't read addr as width is unknown",
-                    __FUNCTION__);
-            break;
-    }
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_PID,
+                   .addr = vaddr,
+                   .pid = pid);
 
-    return ret;
+    return vmi_read_addr(vmi, &ctx, value);
 }
 
 char *
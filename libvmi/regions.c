@@ -0,0 +1,216 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "private.h"
+
+/*
+ * State of a region walk. Many regions are usually backed by the same
+ * file, so names are read once per file object and shared.
+ */
+struct region_walk {
+    GArray *regions;    /* vm_region_t, names owned by the names table */
+    GHashTable *names;  /* file object address -> name */
+};
+
+const char *
+region_walk_cached_name(
+    region_walk_t *walk,
+    addr_t file,
+    bool *found)
+{
+    gpointer name = NULL;
+
+    *found = g_hash_table_lookup_extended(walk->names, &file, NULL, &name);
+    return name;
+}
+
+status_t
+region_walk_add(
+    region_walk_t *walk,
+    const vm_region_t *region)
+{
+    vm_region_t copy = *region;
+
+    if (walk->regions->len >= REGION_WALK_MAX_ENTRIES) {
+        dbprint(VMI_DEBUG_MISC, "--%s: too many regions, tree is likely corrupted\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    if (copy.file) {
+        gpointer name = NULL;
+
+        if (!g_hash_table_lookup_extended(walk->names, &copy.file, NULL, &name)) {
+            addr_t *key = g_malloc(sizeof(addr_t));
+
+            *key = copy.file;
+            name = g_strdup(copy.name);
+            g_hash_table_insert(walk->names, key, name);
+        }
+
+        copy.name = name;
+    } else {
+        copy.name = NULL;
+    }
+
+    g_array_append_val(walk->regions, copy);
+    return VMI_SUCCESS;
+}
+
+static gint
+compare_start(
+    gconstpointer a,
+    gconstpointer b)
+{
+    const vm_region_t *ra = a, *rb = b;
+
+    if (ra->start < rb->start)
+        return -1;
+    return ra->start > rb->start;
+}
+
+/*
+ * Copy the regions into a single allocation holding the list header,
+ * the region array and one copy of each distinct name.
+ */
+static vm_region_list_t *
+pack_regions(
+    vmi_pid_t pid,
+    region_walk_t *walk)
+{
+    vm_region_list_t *list;
+    GHashTable *packed;
+    GHashTableIter iter;
+    gpointer key, name;
+    size_t names_len = 0;
+    size_t count = walk->regions->len;
+    char *names;
+    size_t i;
+
+    g_array_sort(walk->regions, compare_start);
+
+    ghashtable_foreach(walk->names, iter, &key, &name) {
+        if (name)
+            names_len += strlen(name) + 1;
+    }
+
+    list = g_try_malloc0(sizeof(vm_region_list_t) + count * sizeof(vm_region_t) + names_len);
+    if (!list)
+        return NULL;
+
+    list->pid = pid;
+    list->count = count;
+    list->regions = (vm_region_t *)(list + 1);
+    names = (char *)(list->regions + count);
+
+    /* old name pointer -> packed copy */
+    packed = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    ghashtable_foreach(walk->names, iter, &key, &name) {
+        size_t len;
+
+        if (!name)
+            continue;
+
+        len = strlen(name) + 1;
+        g_hash_table_insert(packed, name, memcpy(names, name, len));
+        names += len;
+    }
+
+    for (i = 0; i < count; i++) {
+        list->regions[i] = g_array_index(walk->regions, vm_region_t, i);
+        if (list->regions[i].name)
+            list->regions[i].name = g_hash_table_lookup(packed, list->regions[i].name);
+    }
+
+    g_hash_table_destroy(packed);
+    return list;
+}
+
+status_t
+vmi_get_regions(
+    vmi_instance_t vmi,
+    vmi_pid_t pid,
+    vm_region_list_t **list)
+{
+    status_t ret = VMI_FAILURE;
+    region_walk_t walk = { 0 };
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !list)
+        return VMI_FAILURE;
+#endif
+
+    if (!vmi->os_interface || !vmi->os_interface->os_get_regions) {
+        dbprint(VMI_DEBUG_MISC, "--%s: region enumeration is not supported for this OS\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    walk.regions = g_array_new(FALSE, FALSE, sizeof(vm_region_t));
+    walk.names = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, g_free);
+
+    if (VMI_SUCCESS == vmi->os_interface->os_get_regions(vmi, pid, &walk)) {
+        *list = pack_regions(pid, &walk);
+        if (*list)
+            ret = VMI_SUCCESS;
+    }
+
+    g_array_free(walk.regions, TRUE);
+    g_hash_table_destroy(walk.names);
+
+    return ret;
+}
+
+const vm_region_t *
+vmi_find_region(
+    const vm_region_list_t *list,
+    addr_t va)
+{
+    size_t lo = 0, hi;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!list)
+        return NULL;
+#endif
+
+    /* find the last region starting at or below va */
+    hi = list->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (list->regions[mid].start <= va)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (!lo || va >= list->regions[lo - 1].end)
+        return NULL;
+
+    return &list->regions[lo - 1];
+}
+
+void
+vmi_free_region_list(
+    vm_region_list_t *list)
+{
+    g_free(list);
+}
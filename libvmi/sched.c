@@ -0,0 +1,558 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Event scheduler. A poller thread looks every tick for instances with
+ * events on their ring, deferred responses or periodic tasks due, and
+ * queues them by priority for a fixed pool of workers. A worker owns an
+ * instance for one slice: a non-blocking listen and its due tasks. The
+ * worker's CPU time is charged to the instance, which isn't queued again
+ * in a period once it has used its quota.
+ */
+
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "private.h"
+
+/* how often instances are checked for work, in us */
+#define SCHED_TICK 1000
+
+struct sched_task {
+    vmi_sched_task_t task;
+    void *data;
+    gint64 interval;
+    gint64 due;
+};
+
+struct sched_entry {
+    vmi_instance_t vmi;
+    vmi_sched_params_t params;
+    GSList *tasks;
+    bool queued;
+    bool running;
+    bool removed;
+    bool probing;           /* the poller is probing it without the lock */
+    bool pending;           /* the probe found events or responses */
+    bool throttled;         /* quota of the current period is used up */
+    gint64 queued_at;
+    gint64 period_start;
+    uint64_t period_cpu;    /* ns used in the current period */
+    vmi_sched_stats_t stats;
+};
+
+struct vmi_scheduler {
+    pthread_mutex_t lock;
+    pthread_cond_t work;    /* an entry was queued, or stopping */
+    pthread_cond_t idle;    /* a worker finished its slice or the poller its probes */
+    pthread_t poller;
+    pthread_t *workers;
+    unsigned int nworkers;
+    bool stop;
+    gint64 period;
+    GSList *entries;
+    GQueue ready;           /* highest priority first, FIFO within one */
+};
+
+static uint64_t
+thread_cpu_ns(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+        return 0;
+
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct sched_entry *
+sched_lookup(
+    vmi_scheduler_t sched,
+    vmi_instance_t vmi)
+{
+    GSList *loop;
+
+    for (loop = sched->entries; loop; loop = loop->next) {
+        struct sched_entry *entry = loop->data;
+
+        if (entry->vmi == vmi)
+            return entry;
+    }
+
+    return NULL;
+}
+
+/* Called with the lock held */
+static void
+sched_enqueue(
+    vmi_scheduler_t sched,
+    struct sched_entry *entry,
+    gint64 now)
+{
+    GList *loop;
+
+    for (loop = sched->ready.head; loop; loop = loop->next)
+        if (((struct sched_entry *)loop->data)->params.priority < entry->params.priority)
+            break;
+
+    if (loop)
+        g_queue_insert_before(&sched->ready, loop, entry);
+    else
+        g_queue_push_tail(&sched->ready, entry);
+
+    entry->queued = true;
+    entry->queued_at = now;
+    pthread_cond_signal(&sched->work);
+}
+
+/* Called with the lock held */
+static bool
+sched_within_quota(
+    vmi_scheduler_t sched,
+    struct sched_entry *entry,
+    gint64 now)
+{
+    if (!entry->params.cpu_quota) {
+        entry->period_cpu = 0;
+        return true;
+    }
+
+    if (now - entry->period_start >= sched->period) {
+        gint64 periods = (now - entry->period_start) / sched->period;
+        uint64_t allowance = (uint64_t)periods * sched->period * entry->params.cpu_quota;
+
+        /* a slice that ran past the quota is paid for from the next periods */
+        entry->period_cpu = entry->period_cpu > allowance ? entry->period_cpu - allowance : 0;
+        entry->period_start += periods * sched->period;
+        entry->throttled = false;
+    }
+
+    /* the quota is in permille of a CPU, the period in us */
+    if (entry->period_cpu < (uint64_t)sched->period * entry->params.cpu_quota)
+        return true;
+
+    if (!entry->throttled) {
+        entry->throttled = true;
+        entry->stats.throttled++;
+    }
+
+    return false;
+}
+
+/* Called with the lock held */
+static bool
+sched_task_due(
+    struct sched_entry *entry,
+    gint64 now)
+{
+    GSList *loop;
+
+    for (loop = entry->tasks; loop; loop = loop->next)
+        if (((struct sched_task *)loop->data)->due <= now)
+            return true;
+
+    return false;
+}
+
+/* Called without the lock, only for entries neither queued nor running */
+static bool
+sched_has_events(
+    vmi_instance_t vmi)
+{
+    struct pollfd fd = { .events = POLLIN };
+
+    if (vmi_are_events_pending(vmi) > 0)
+        return true;
+
+    /* responses to deferred events are only sent back by listening */
+    fd.fd = event_defer_fd(vmi);
+    return fd.fd >= 0 && poll(&fd, 1, 0) > 0;
+}
+
+static void *
+sched_poller(
+    void *data)
+{
+    vmi_scheduler_t sched = data;
+    GPtrArray *idle = g_ptr_array_new();
+
+    pthread_mutex_lock(&sched->lock);
+
+    while (!sched->stop) {
+        gint64 now = monotonic_time_us();
+        GSList *loop;
+        guint i;
+
+        g_ptr_array_set_size(idle, 0);
+
+        for (loop = sched->entries; loop; loop = loop->next) {
+            struct sched_entry *entry = loop->data;
+
+            if (entry->queued || entry->running || !sched_within_quota(sched, entry, now))
+                continue;
+
+            if (sched_task_due(entry, now)) {
+                sched_enqueue(sched, entry, now);
+                continue;
+            }
+
+            /* removing it now waits for the probe */
+            entry->probing = true;
+            g_ptr_array_add(idle, entry);
+        }
+
+        /* probing every ring under the lock would hold up the workers */
+        pthread_mutex_unlock(&sched->lock);
+
+        for (i = 0; i < idle->len; i++) {
+            struct sched_entry *entry = g_ptr_array_index(idle, i);
+
+            entry->pending = sched_has_events(entry->vmi);
+        }
+
+        pthread_mutex_lock(&sched->lock);
+
+        for (i = 0; i < idle->len; i++) {
+            struct sched_entry *entry = g_ptr_array_index(idle, i);
+
+            entry->probing = false;
+            if (entry->pending && !entry->removed && !sched->stop)
+                sched_enqueue(sched, entry, now);
+        }
+
+        if (idle->len)
+            pthread_cond_broadcast(&sched->idle);
+
+        pthread_mutex_unlock(&sched->lock);
+        usleep(SCHED_TICK);
+        pthread_mutex_lock(&sched->lock);
+    }
+
+    pthread_mutex_unlock(&sched->lock);
+    g_ptr_array_free(idle, TRUE);
+    return NULL;
+}
+
+static void
+sched_slice(
+    struct sched_entry *entry,
+    GSList *tasks)
+{
+    gint64 now = monotonic_time_us();
+
+    if (VMI_FAILURE == vmi_events_listen(entry->vmi, 0))
+        dbprint(VMI_DEBUG_EVENTS, "--%s: listening failed\n", __FUNCTION__);
+
+    for (; tasks; tasks = tasks->next) {
+        struct sched_task *task = tasks->data;
+
+        if (task->due > now)
+            continue;
+
+        task->task(entry->vmi, task->data);
+        task->due = now + task->interval;
+    }
+}
+
+static void *
+sched_worker(
+    void *data)
+{
+    vmi_scheduler_t sched = data;
+
+    pthread_mutex_lock(&sched->lock);
+
+    for (;;) {
+        struct sched_entry *entry;
+        uint64_t start, used;
+        GSList *tasks;
+        gint64 now, delay;
+        bool more;
+
+        while (!sched->stop && g_queue_is_empty(&sched->ready))
+            pthread_cond_wait(&sched->work, &sched->lock);
+
+        if (sched->stop)
+            break;
+
+        entry = g_queue_pop_head(&sched->ready);
+        entry->queued = false;
+        entry->running = true;
+        tasks = entry->tasks;
+
+        delay = monotonic_time_us() - entry->queued_at;
+        entry->stats.delay_ns += delay * 1000;
+        entry->stats.max_delay_ns = MAX(entry->stats.max_delay_ns, (uint64_t)delay * 1000);
+        entry->stats.slices++;
+
+        pthread_mutex_unlock(&sched->lock);
+
+        start = thread_cpu_ns();
+        sched_slice(entry, tasks);
+        used = thread_cpu_ns() - start;
+
+        /* events a budget left behind go to the back of the queue */
+        more = vmi_are_events_pending(entry->vmi) > 0;
+
+        pthread_mutex_lock(&sched->lock);
+
+        now = monotonic_time_us();
+        entry->running = false;
+        entry->period_cpu += used;
+        entry->stats.cpu_ns += used;
+
+        if (more && !sched->stop && !entry->removed &&
+                sched_within_quota(sched, entry, now))
+            sched_enqueue(sched, entry, now);
+
+        pthread_cond_broadcast(&sched->idle);
+    }
+
+    pthread_mutex_unlock(&sched->lock);
+    return NULL;
+}
+
+static void
+sched_entry_free(
+    struct sched_entry *entry)
+{
+    g_slist_free_full(entry->tasks, g_free);
+    g_free(entry);
+}
+
+vmi_scheduler_t
+vmi_scheduler_create(
+    unsigned int workers,
+    uint32_t period_ms)
+{
+    vmi_scheduler_t sched;
+    unsigned int i;
+
+    if (!workers || !period_ms)
+        return NULL;
+
+    sched = g_try_malloc0(sizeof(struct vmi_scheduler));
+    if (!sched)
+        return NULL;
+
+    sched->workers = g_try_malloc0(workers * sizeof(pthread_t));
+    if (!sched->workers) {
+        g_free(sched);
+        return NULL;
+    }
+
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->work, NULL);
+    pthread_cond_init(&sched->idle, NULL);
+    g_queue_init(&sched->ready);
+    sched->period = period_ms * 1000ll;
+
+    if (pthread_create(&sched->poller, NULL, sched_poller, sched)) {
+        errprint("%s: failed to start the poller thread\n", __FUNCTION__);
+        goto error;
+    }
+
+    for (i = 0; i < workers; i++) {
+        if (pthread_create(&sched->workers[i], NULL, sched_worker, sched)) {
+            errprint("%s: failed to start worker %u\n", __FUNCTION__, i);
+            vmi_scheduler_destroy(sched);
+            return NULL;
+        }
+        sched->nworkers++;
+    }
+
+    return sched;
+
+error:
+    pthread_cond_destroy(&sched->idle);
+    pthread_cond_destroy(&sched->work);
+    pthread_mutex_destroy(&sched->lock);
+    g_free(sched->workers);
+    g_free(sched);
+    return NULL;
+}
+
+status_t
+vmi_scheduler_add(
+    vmi_scheduler_t sched,
+    vmi_instance_t vmi,
+    const vmi_sched_params_t *params)
+{
+    struct sched_entry *entry;
+    status_t ret = VMI_FAILURE;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!sched || !vmi)
+        return VMI_FAILURE;
+#endif
+
+    if (!(vmi->init_flags & VMI_INIT_EVENTS))
+        return VMI_FAILURE;
+
+    pthread_mutex_lock(&sched->lock);
+
+    if (sched_lookup(sched, vmi))
+        goto done;
+
+    entry = g_try_malloc0(sizeof(struct sched_entry));
+    if (!entry)
+        goto done;
+
+    entry->vmi = vmi;
+    if (params)
+        entry->params = *params;
+    entry->period_start = monotonic_time_us();
+
+    sched->entries = g_slist_prepend(sched->entries, entry);
+    ret = VMI_SUCCESS;
+
+done:
+    pthread_mutex_unlock(&sched->lock);
+    return ret;
+}
+
+status_t
+vmi_scheduler_add_task(
+    vmi_scheduler_t sched,
+    vmi_instance_t vmi,
+    uint32_t interval_ms,
+    vmi_sched_task_t task,
+    void *data)
+{
+    struct sched_entry *entry;
+    struct sched_task *t;
+    status_t ret = VMI_FAILURE;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!sched || !vmi || !task || !interval_ms)
+        return VMI_FAILURE;
+#endif
+
+    pthread_mutex_lock(&sched->lock);
+
+    entry = sched_lookup(sched, vmi);
+    if (!entry)
+        goto done;
+
+    t = g_try_malloc0(sizeof(struct sched_task));
+    if (!t)
+        goto done;
+
+    t->task = task;
+    t->data = data;
+    t->interval = interval_ms * 1000ll;
+    t->due = monotonic_time_us() + t->interval;
+
+    /* a running slice walks the list it started with */
+    entry->tasks = g_slist_prepend(entry->tasks, t);
+    ret = VMI_SUCCESS;
+
+done:
+    pthread_mutex_unlock(&sched->lock);
+    return ret;
+}
+
+status_t
+vmi_scheduler_remove(
+    vmi_scheduler_t sched,
+    vmi_instance_t vmi)
+{
+    struct sched_entry *entry;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!sched || !vmi)
+        return VMI_FAILURE;
+#endif
+
+    pthread_mutex_lock(&sched->lock);
+
+    entry = sched_lookup(sched, vmi);
+    if (!entry) {
+        pthread_mutex_unlock(&sched->lock);
+        return VMI_FAILURE;
+    }
+
+    sched->entries = g_slist_remove(sched->entries, entry);
+    entry->removed = true;
+    if (entry->queued)
+        g_queue_remove(&sched->ready, entry);
+
+    while (entry->running || entry->probing)
+        pthread_cond_wait(&sched->idle, &sched->lock);
+
+    pthread_mutex_unlock(&sched->lock);
+
+    sched_entry_free(entry);
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_scheduler_get_stats(
+    vmi_scheduler_t sched,
+    vmi_instance_t vmi,
+    vmi_sched_stats_t *stats)
+{
+    struct sched_entry *entry;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!sched || !vmi || !stats)
+        return VMI_FAILURE;
+#endif
+
+    pthread_mutex_lock(&sched->lock);
+
+    entry = sched_lookup(sched, vmi);
+    if (entry)
+        *stats = entry->stats;
+
+    pthread_mutex_unlock(&sched->lock);
+
+    return entry ? VMI_SUCCESS : VMI_FAILURE;
+}
+
+void
+vmi_scheduler_destroy(
+    vmi_scheduler_t sched)
+{
+    unsigned int i;
+
+    if (!sched)
+        return;
+
+    pthread_mutex_lock(&sched->lock);
+    sched->stop = true;
+    pthread_cond_broadcast(&sched->work);
+    pthread_mutex_unlock(&sched->lock);
+
+    pthread_join(sched->poller, NULL);
+    for (i = 0; i < sched->nworkers; i++)
+        pthread_join(sched->workers[i], NULL);
+
+    g_queue_clear(&sched->ready);
+    g_slist_free_full(sched->entries, (GDestroyNotify)sched_entry_free);
+
+    pthread_cond_destroy(&sched->idle);
+    pthread_cond_destroy(&sched->work);
+    pthread_mutex_destroy(&sched->lock);
+    g_free(sched->workers);
+    g_free(sched);
+}
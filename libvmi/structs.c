@@ -0,0 +1,364 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "private.h"
+
+/*
+ * Profile data of a struct. Offsets are memoised as they are asked for,
+ * including the members the profile does not know.
+ */
+struct struct_layout {
+    char *name;             /* also the key in vmi->struct_layouts */
+    size_t size;
+    GHashTable *members;    /* name -> offset + 1, NULL if not in the profile */
+};
+
+static void
+struct_layout_free(
+    gpointer data)
+{
+    struct struct_layout *layout = data;
+
+    g_hash_table_destroy(layout->members);
+    g_free(layout->name);
+    g_free(layout);
+}
+
+void
+struct_layout_cache_init(
+    vmi_instance_t vmi)
+{
+    vmi->struct_layouts = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, struct_layout_free);
+}
+
+void
+struct_layout_cache_destroy(
+    vmi_instance_t vmi)
+{
+    if (vmi->struct_layouts)
+        g_hash_table_destroy(vmi->struct_layouts);
+    vmi->struct_layouts = NULL;
+}
+
+static struct struct_layout *
+get_layout(
+    vmi_instance_t vmi,
+    const char *struct_name)
+{
+    struct struct_layout *layout;
+    size_t size = 0;
+
+    layout = g_hash_table_lookup(vmi->struct_layouts, struct_name);
+    if (layout)
+        return layout;
+
+#ifdef ENABLE_JSON_PROFILES
+    if (VMI_FAILURE == vmi_get_struct_size_from_json(vmi, json_profile(vmi), struct_name, &size))
+        size = 0;
+#endif
+
+    if (!size || size > STRUCT_VIEW_MAX_SIZE) {
+        dbprint(VMI_DEBUG_MISC, "--%s: no usable size for struct %s in the JSON profile\n",
+                __FUNCTION__, struct_name);
+        return NULL;
+    }
+
+    layout = g_try_malloc0(sizeof(struct struct_layout));
+    if (!layout)
+        return NULL;
+
+    layout->name = g_strdup(struct_name);
+    layout->size = size;
+    layout->members = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    g_hash_table_insert(vmi->struct_layouts, layout->name, layout);
+
+    return layout;
+}
+
+static status_t
+member_offset(
+    vmi_instance_t vmi,
+    struct struct_layout *layout,
+    const char *member,
+    size_t *offset)
+{
+    gpointer value = NULL;
+    addr_t _offset = 0;
+
+    if (g_hash_table_lookup_extended(layout->members, member, NULL, &value)) {
+        if (!value)
+            return VMI_FAILURE;
+
+        *offset = GPOINTER_TO_SIZE(value) - 1;
+        return VMI_SUCCESS;
+    }
+
+    if (VMI_FAILURE == json_profile_lookup(vmi, layout->name, member, &_offset)) {
+        g_hash_table_insert(layout->members, g_strdup(member), NULL);
+        return VMI_FAILURE;
+    }
+
+    g_hash_table_insert(layout->members, g_strdup(member), GSIZE_TO_POINTER(_offset + 1));
+    *offset = _offset;
+    return VMI_SUCCESS;
+}
+
+/*
+ * Read len bytes of the struct starting at struct offset start into the
+ * view, growing its buffer if needed.
+ */
+static status_t
+read_view(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    struct struct_layout *layout,
+    size_t start,
+    size_t len,
+    struct_view_t *view)
+{
+    access_handle_t handle;
+
+    view->len = 0;
+
+    /* turns a kernel symbol or PID into an address we can offset */
+    if (VMI_FAILURE == vmi_compile_access_context(vmi, ctx, &handle))
+        return VMI_FAILURE;
+
+    if (len > view->capacity) {
+        uint8_t *data = g_try_realloc(view->data, len);
+
+        if (!data)
+            return VMI_FAILURE;
+
+        view->data = data;
+        view->capacity = len;
+    }
+
+    view->layout = layout;
+    view->addr = handle.ctx.addr;
+    view->size = layout->size;
+    view->start = start;
+
+    handle.ctx.addr += start;
+    if (VMI_FAILURE == vmi_read(vmi, &handle.ctx, len, view->data, NULL)) {
+        dbprint(VMI_DEBUG_READ, "--%s: failed to read %s at 0x%"PRIx64"\n",
+                __FUNCTION__, layout->name, view->addr);
+        return VMI_FAILURE;
+    }
+
+    view->len = len;
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_read_struct(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    const char *struct_name,
+    struct_view_t *view)
+{
+    struct struct_layout *layout;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !ctx || !struct_name || !view)
+        return VMI_FAILURE;
+#endif
+
+    layout = get_layout(vmi, struct_name);
+    if (!layout)
+        return VMI_FAILURE;
+
+    return read_view(vmi, ctx, layout, 0, layout->size, view);
+}
+
+status_t
+vmi_read_struct_fields(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    const char *struct_name,
+    const struct_field_t *fields,
+    size_t count,
+    struct_view_t *view)
+{
+    struct struct_layout *layout;
+    size_t start = ~0ul, end = 0;
+    size_t i;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !ctx || !struct_name || !fields || !count || !view)
+        return VMI_FAILURE;
+#endif
+
+    layout = get_layout(vmi, struct_name);
+    if (!layout)
+        return VMI_FAILURE;
+
+    for (i = 0; i < count; i++) {
+        size_t offset;
+
+        if (VMI_FAILURE == member_offset(vmi, layout, fields[i].member, &offset)) {
+            dbprint(VMI_DEBUG_MISC, "--%s: %s has no member %s\n", __FUNCTION__, struct_name, fields[i].member);
+            return VMI_FAILURE;
+        }
+
+        if (offset + fields[i].size > layout->size) {
+            dbprint(VMI_DEBUG_MISC, "--%s: %s.%s extends past the end of the struct\n",
+                    __FUNCTION__, struct_name, fields[i].member);
+            return VMI_FAILURE;
+        }
+
+        start = MIN(start, offset);
+        end = MAX(end, offset + fields[i].size);
+    }
+
+    if (end <= start)
+        return VMI_FAILURE;
+
+    return read_view(vmi, ctx, layout, start, end - start, view);
+}
+
+const void *
+vmi_struct_field(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    size_t size)
+{
+    size_t offset;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !view || !member)
+        return NULL;
+#endif
+
+    if (!view->layout || !view->len)
+        return NULL;
+
+    if (VMI_FAILURE == member_offset(vmi, (struct struct_layout *)view->layout, member, &offset))
+        return NULL;
+
+    if (offset < view->start || offset + size > view->start + view->len)
+        return NULL;
+
+    return view->data + (offset - view->start);
+}
+
+static status_t
+struct_read(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    size_t size,
+    void *value)
+{
+    const void *field;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!value)
+        return VMI_FAILURE;
+#endif
+
+    field = vmi_struct_field(vmi, view, member, size);
+    if (!field)
+        return VMI_FAILURE;
+
+    memcpy(value, field, size);
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_struct_read_8(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    uint8_t *value)
+{
+    return struct_read(vmi, view, member, sizeof(*value), value);
+}
+
+status_t
+vmi_struct_read_16(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    uint16_t *value)
+{
+    return struct_read(vmi, view, member, sizeof(*value), value);
+}
+
+status_t
+vmi_struct_read_32(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    uint32_t *value)
+{
+    return struct_read(vmi, view, member, sizeof(*value), value);
+}
+
+status_t
+vmi_struct_read_64(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    uint64_t *value)
+{
+    return struct_read(vmi, view, member, sizeof(*value), value);
+}
+
+status_t
+vmi_struct_read_addr(
+    vmi_instance_t vmi,
+    const struct_view_t *view,
+    const char *member,
+    addr_t *value)
+{
+    const void *field;
+    uint8_t width;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !value)
+        return VMI_FAILURE;
+#endif
+
+    width = vmi_get_address_width(vmi);
+    if (!width)
+        return VMI_FAILURE;
+
+    field = vmi_struct_field(vmi, view, member, width);
+    if (!field)
+        return VMI_FAILURE;
+
+    *value = buf_read_addr(field, 0, width);
+    return VMI_SUCCESS;
+}
+
+void
+vmi_free_struct_view(
+    struct_view_t *view)
+{
+    if (!view)
+        return;
+
+    g_free(view->data);
+    memset(view, 0, sizeof(*view));
+}
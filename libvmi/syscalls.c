@@ -0,0 +1,468 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Syscall tracing. The page holding the syscall entry (LSTAR) is shadowed
+ * in a SLAT view by a copy with a breakpoint on the entry. A hit switches
+ * the vCPU to the original view for one instruction and the VMM switches
+ * it back by itself, so there is no singlestep event per syscall.
+ */
+
+#include <string.h>
+
+#include "private.h"
+#include "os/windows/windows.h"
+
+/* Entries of the syscall table looked at */
+#define SYSCALL_TABLE_MAX 1024
+
+/* Windows passes the first four arguments in registers, the others on the
+ * stack above the home space of the caller */
+#define WINDOWS_STACK_ARGS_OFFSET 0x28
+
+struct syscall_entry {
+    gchar *name;
+    unsigned int nargs;
+};
+
+struct vmi_syscall_tracer {
+    vmi_instance_t vmi;
+    vmi_syscall_cb_t callback;
+    void *data;
+
+    addr_t entry;               /* LSTAR */
+    addr_t entry_gfn;
+    addr_t shadow_gfn;
+    uint16_t view;
+    bool slat_enabled;          /* SLAT was on before the tracer */
+    vmi_event_t trap;
+
+    struct syscall_entry *table;
+    unsigned int table_size;
+
+    struct {
+        addr_t dtb;
+        vmi_pid_t pid;
+    } *current;                 /* last process seen on each vCPU */
+};
+
+static void
+syscall_table_linux(
+    vmi_instance_t vmi,
+    struct vmi_syscall_tracer *tracer,
+    addr_t *entries)
+{
+    access_context_t ctx = {
+        .version = ACCESS_CONTEXT_VERSION,
+        .translate_mechanism = VMI_TM_PROCESS_DTB,
+        .dtb = vmi->kpgd
+    };
+    unsigned int i;
+
+    if (VMI_FAILURE == vmi_translate_ksym2v(vmi, "sys_call_table", &ctx.addr) ||
+            VMI_FAILURE == vmi_read(vmi, &ctx, SYSCALL_TABLE_MAX * sizeof(addr_t), entries, NULL))
+        return;
+
+    /* the table ends where its entries stop being functions */
+    for (i = 0; i < SYSCALL_TABLE_MAX; i++) {
+        const char *name = vmi_translate_v2ksym(vmi, &ctx, entries[i]);
+
+        if (!name)
+            break;
+
+        tracer->table[i].name = g_strdup(name);
+        tracer->table[i].nargs = VMI_SYSCALL_LINUX_ARGS;
+    }
+
+    tracer->table_size = i;
+}
+
+#ifdef ENABLE_JSON_PROFILES
+static void
+syscall_name_from_profile(
+    const char *symbol,
+    addr_t rva,
+    void *data)
+{
+    GHashTable *names = data;
+
+    /* the first symbol found at an address names it */
+    if (g_hash_table_contains(names, &rva) && !g_hash_table_lookup(names, &rva))
+        g_hash_table_replace(names, g_slice_dup(addr_t, &rva), (gpointer)symbol);
+}
+
+/*
+ * Windows has no v2ksym, the entries are named by looking their RVAs up
+ * in the symbols of the profile, walked once for the whole table.
+ */
+static void
+syscall_names_windows(
+    vmi_instance_t vmi,
+    struct vmi_syscall_tracer *tracer,
+    const addr_t *entries)
+{
+    windows_instance_t windows = vmi->os_data;
+    GHashTable *names;
+    unsigned int i;
+    addr_t rva;
+
+    if (!windows || !windows->ntoskrnl_va)
+        return;
+
+    names = g_hash_table_new_full(g_int64_hash, g_int64_equal, free_gint64, NULL);
+
+    for (i = 0; i < tracer->table_size; i++) {
+        rva = entries[i] - windows->ntoskrnl_va;
+        if (!tracer->table[i].name)
+            g_hash_table_insert(names, g_slice_dup(addr_t, &rva), NULL);
+    }
+
+    if (g_hash_table_size(names) && VMI_SUCCESS == json_profile_symbol_foreach(vmi, syscall_name_from_profile, names)) {
+        for (i = 0; i < tracer->table_size; i++) {
+            rva = entries[i] - windows->ntoskrnl_va;
+            if (!tracer->table[i].name)
+                tracer->table[i].name = g_strdup(g_hash_table_lookup(names, &rva));
+        }
+    }
+
+    g_hash_table_destroy(names);
+}
+#endif
+
+static void
+syscall_table_windows(
+    vmi_instance_t vmi,
+    struct vmi_syscall_tracer *tracer,
+    addr_t *entries)
+{
+    access_context_t ctx = {
+        .version = ACCESS_CONTEXT_VERSION,
+        .translate_mechanism = VMI_TM_PROCESS_DTB,
+        .dtb = vmi->kpgd
+    };
+    int32_t *offsets = (int32_t *)entries;
+    addr_t table, limit_va;
+    uint32_t limit, i;
+
+    if (VMI_FAILURE == vmi_translate_ksym2v(vmi, "KiServiceTable", &table) ||
+            VMI_FAILURE == vmi_translate_ksym2v(vmi, "KiServiceLimit", &limit_va) ||
+            VMI_FAILURE == vmi_read_32_va(vmi, limit_va, 0, &limit))
+        return;
+
+    limit = MIN(limit, SYSCALL_TABLE_MAX);
+    ctx.addr = table;
+    if (VMI_FAILURE == vmi_read(vmi, &ctx, limit * sizeof(int32_t), offsets, NULL))
+        return;
+
+    /*
+     * entries are offsets from the table, the low bits count stack arguments.
+     * The addresses replace the offsets they are read from, back to front.
+     */
+    for (i = limit; i-- > 0;) {
+        int32_t offset = offsets[i];
+
+        entries[i] = table + (offset >> 4);
+        tracer->table[i].name = g_strdup(vmi_translate_v2ksym(vmi, &ctx, entries[i]));
+        tracer->table[i].nargs = 4 + (offset & 0xf);
+    }
+
+    tracer->table_size = limit;
+
+#ifdef ENABLE_JSON_PROFILES
+    syscall_names_windows(vmi, tracer, entries);
+#endif
+}
+
+static vmi_pid_t
+syscall_pid(
+    vmi_instance_t vmi,
+    struct vmi_syscall_tracer *tracer,
+    uint32_t vcpu,
+    addr_t cr3)
+{
+    /* user page tables of KPTI and PCID bits are not what processes hold */
+    addr_t dtb = cr3_page_table(vmi, cr3);
+    vmi_pid_t pid;
+
+    if (vcpu >= vmi->num_vcpus)
+        return -1;
+
+    if (tracer->current[vcpu].dtb == dtb)
+        return tracer->current[vcpu].pid;
+
+    if (VMI_FAILURE == vmi_dtb_to_pid(vmi, dtb, &pid))
+        pid = -1;
+
+    tracer->current[vcpu].dtb = dtb;
+    tracer->current[vcpu].pid = pid;
+    return pid;
+}
+
+static void
+syscall_decode(
+    vmi_instance_t vmi,
+    struct vmi_syscall_tracer *tracer,
+    vmi_event_t *event,
+    vmi_syscall_t *syscall)
+{
+    const x86_registers_t *regs = event->x86_regs;
+
+    syscall->vcpu = event->vcpu_id;
+    syscall->number = regs->rax;
+    syscall->dtb = regs->cr3;
+    syscall->ret = regs->rcx;
+    syscall->pid = syscall_pid(vmi, tracer, event->vcpu_id, regs->cr3);
+
+    if (syscall->number < tracer->table_size) {
+        syscall->name = tracer->table[syscall->number].name;
+        syscall->nargs = tracer->table[syscall->number].nargs;
+    } else {
+        syscall->name = NULL;
+        syscall->nargs = VMI_OS_WINDOWS == vmi->os_type ? 4 : VMI_SYSCALL_LINUX_ARGS;
+    }
+
+    if (VMI_OS_WINDOWS == vmi->os_type) {
+        access_context_t ctx = {
+            .version = ACCESS_CONTEXT_VERSION,
+            .translate_mechanism = VMI_TM_PROCESS_DTB,
+            .dtb = regs->cr3,
+            .addr = regs->rsp + WINDOWS_STACK_ARGS_OFFSET
+        };
+
+        syscall->args[0] = regs->r10;
+        syscall->args[1] = regs->rdx;
+        syscall->args[2] = regs->r8;
+        syscall->args[3] = regs->r9;
+
+        /* the stack arguments in one read */
+        if (syscall->nargs > 4 &&
+                VMI_FAILURE == vmi_read(vmi, &ctx, (syscall->nargs - 4) * sizeof(uint64_t), &syscall->args[4], NULL))
+            syscall->nargs = 4;
+    } else {
+        syscall->args[0] = regs->rdi;
+        syscall->args[1] = regs->rsi;
+        syscall->args[2] = regs->rdx;
+        syscall->args[3] = regs->r10;
+        syscall->args[4] = regs->r8;
+        syscall->args[5] = regs->r9;
+    }
+}
+
+static event_response_t
+syscall_trap(
+    vmi_instance_t vmi,
+    vmi_event_t *event)
+{
+    struct vmi_syscall_tracer *tracer = event->data;
+    vmi_syscall_t syscall;
+
+    if (event->interrupt_event.gla != tracer->entry) {
+        event->interrupt_event.reinject = 1;
+        return VMI_EVENT_RESPONSE_NONE;
+    }
+
+    event->interrupt_event.reinject = 0;
+
+    syscall_decode(vmi, tracer, event, &syscall);
+    tracer->callback(vmi, &syscall, tracer->data);
+
+    /* execute the entry in the original page and come back */
+    event->slat_id = 0;
+    event->next_slat_id = tracer->view;
+    return VMI_EVENT_RESPONSE_SLAT_ID | VMI_EVENT_RESPONSE_NEXT_SLAT_ID;
+}
+
+static void
+syscall_tracer_free(
+    struct vmi_syscall_tracer *tracer)
+{
+    unsigned int i;
+
+    if (tracer->table) {
+        for (i = 0; i < tracer->table_size; i++)
+            g_free(tracer->table[i].name);
+        g_free(tracer->table);
+    }
+    g_free(tracer->current);
+    g_free(tracer);
+}
+
+/* SLAT is left off again if the tracer turned it on */
+static void
+syscall_slat_restore(
+    vmi_instance_t vmi,
+    struct vmi_syscall_tracer *tracer)
+{
+    if (!tracer->slat_enabled)
+        vmi_slat_set_domain_state(vmi, false);
+}
+
+static status_t
+syscall_shadow(
+    vmi_instance_t vmi,
+    struct vmi_syscall_tracer *tracer)
+{
+    uint8_t *page;
+    addr_t paddr;
+    status_t ret = VMI_FAILURE;
+
+    if (VMI_FAILURE == vmi_translate_kv2p(vmi, tracer->entry, &paddr))
+        return VMI_FAILURE;
+
+    tracer->entry_gfn = paddr >> 12;
+
+    page = g_try_malloc(VMI_PS_4KB);
+    if (!page)
+        return VMI_FAILURE;
+
+    if (VMI_FAILURE == vmi_read_pa(vmi, tracer->entry_gfn << 12, VMI_PS_4KB, page, NULL))
+        goto done;
+
+    page[paddr & (VMI_PS_4KB - 1)] = 0xCC;
+
+    if (VMI_FAILURE == vmi_write_pa(vmi, tracer->shadow_gfn << 12, VMI_PS_4KB, page, NULL))
+        goto done;
+
+    if (VMI_FAILURE == vmi_slat_get_domain_state(vmi, &tracer->slat_enabled) ||
+            VMI_FAILURE == vmi_slat_set_domain_state(vmi, true))
+        goto done;
+
+    if (VMI_FAILURE == vmi_slat_create(vmi, &tracer->view)) {
+        syscall_slat_restore(vmi, tracer);
+        goto done;
+    }
+
+    if (VMI_FAILURE == vmi_slat_change_gfn(vmi, tracer->view, tracer->entry_gfn, tracer->shadow_gfn)) {
+        vmi_slat_destroy(vmi, tracer->view);
+        syscall_slat_restore(vmi, tracer);
+        goto done;
+    }
+
+    ret = VMI_SUCCESS;
+
+done:
+    g_free(page);
+    return ret;
+}
+
+status_t
+vmi_syscall_trace_start(
+    vmi_instance_t vmi,
+    addr_t shadow_gfn,
+    vmi_syscall_cb_t callback,
+    void *data,
+    vmi_syscall_tracer_t *_tracer)
+{
+    struct vmi_syscall_tracer *tracer;
+    addr_t *entries;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !shadow_gfn || !callback || !_tracer)
+        return VMI_FAILURE;
+
+    if (!(vmi->init_flags & VMI_INIT_EVENTS))
+        return VMI_FAILURE;
+#endif
+
+    if (vmi->syscall_tracer) {
+        dbprint(VMI_DEBUG_EVENTS, "--%s: syscalls are already traced\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    if (VMI_OS_LINUX != vmi->os_type && VMI_OS_WINDOWS != vmi->os_type) {
+        errprint("%s: syscalls can only be traced on Linux and Windows\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    tracer = g_try_malloc0(sizeof(struct vmi_syscall_tracer));
+    if (!tracer)
+        return VMI_FAILURE;
+
+    tracer->vmi = vmi;
+    tracer->callback = callback;
+    tracer->data = data;
+    tracer->shadow_gfn = shadow_gfn;
+    tracer->table = g_try_new0(struct syscall_entry, SYSCALL_TABLE_MAX);
+    tracer->current = g_try_malloc0(sizeof(*tracer->current) * vmi->num_vcpus);
+    entries = g_try_new(addr_t, SYSCALL_TABLE_MAX);
+    if (!tracer->table || (vmi->num_vcpus && !tracer->current) || !entries) {
+        g_free(entries);
+        syscall_tracer_free(tracer);
+        return VMI_FAILURE;
+    }
+
+    if (VMI_OS_LINUX == vmi->os_type)
+        syscall_table_linux(vmi, tracer, entries);
+    else
+        syscall_table_windows(vmi, tracer, entries);
+    g_free(entries);
+
+    dbprint(VMI_DEBUG_EVENTS, "--%s: %u syscalls in the table\n", __FUNCTION__, tracer->table_size);
+
+    if (VMI_FAILURE == vmi_get_vcpureg(vmi, &tracer->entry, MSR_LSTAR, 0) || !tracer->entry) {
+        errprint("%s: failed to find the syscall entry\n", __FUNCTION__);
+        syscall_tracer_free(tracer);
+        return VMI_FAILURE;
+    }
+
+    if (VMI_FAILURE == syscall_shadow(vmi, tracer)) {
+        errprint("%s: failed to shadow the syscall entry 0x%"PRIx64"\n", __FUNCTION__, tracer->entry);
+        syscall_tracer_free(tracer);
+        return VMI_FAILURE;
+    }
+
+    SETUP_INTERRUPT_EVENT(&tracer->trap, syscall_trap);
+    tracer->trap.data = tracer;
+
+    if (VMI_FAILURE == vmi_register_event(vmi, &tracer->trap) ||
+            VMI_FAILURE == vmi_slat_switch(vmi, tracer->view)) {
+        vmi_clear_event(vmi, &tracer->trap, NULL);
+        vmi_slat_destroy(vmi, tracer->view);
+        syscall_slat_restore(vmi, tracer);
+        syscall_tracer_free(tracer);
+        return VMI_FAILURE;
+    }
+
+    vmi->syscall_tracer = tracer;
+    *_tracer = tracer;
+    return VMI_SUCCESS;
+}
+
+void
+vmi_syscall_trace_stop(
+    vmi_syscall_tracer_t tracer)
+{
+    vmi_instance_t vmi;
+
+    if (!tracer)
+        return;
+
+    vmi = tracer->vmi;
+
+    vmi_pause_vm(vmi);
+    vmi_slat_switch(vmi, 0);
+    vmi_clear_event(vmi, &tracer->trap, NULL);
+    vmi_slat_destroy(vmi, tracer->view);
+    syscall_slat_restore(vmi, tracer);
+    vmi_resume_vm(vmi);
+
+    vmi->syscall_tracer = NULL;
+    syscall_tracer_free(tracer);
+}
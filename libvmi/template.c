@@ -0,0 +1,363 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Event templates. Symbols are resolved against a reference instance once
+ * and the plan is kept in physical terms: watched frames sorted by gfn and
+ * breakpoints with the byte they replace. Applying it to a clone of the
+ * reference only checks the original bytes and arms the frames and
+ * breakpoints, without any translation.
+ */
+
+#include "private.h"
+
+struct template_watch {
+    addr_t gfn;
+    vmi_mem_access_t access;
+};
+
+struct template_breakpoint {
+    addr_t pa;
+    uint8_t orig;
+    char *symbol;
+};
+
+struct vmi_event_template {
+    GArray *watches;        /* struct template_watch, sorted by gfn */
+    GArray *breakpoints;    /* struct template_breakpoint, sorted by pa */
+};
+
+/* Index of the first element not below key in an array sorted by its first field */
+static guint
+template_bisect(
+    GArray *array,
+    size_t size,
+    addr_t key)
+{
+    guint lo = 0, hi = array->len;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+
+        if (*(addr_t *)(array->data + mid * size) < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* N, W2X and RWX2N are only set on their own, the others combine */
+static bool
+template_access_valid(vmi_mem_access_t access)
+{
+    return VMI_MEMACCESS_N == access || VMI_MEMACCESS_W2X == access || VMI_MEMACCESS_RWX2N == access ||
+           (access && !(access & ~VMI_MEMACCESS_RWX));
+}
+
+vmi_event_template_t
+vmi_event_template_create(void)
+{
+    vmi_event_template_t tmpl = g_try_malloc0(sizeof(struct vmi_event_template));
+
+    if (!tmpl)
+        return NULL;
+
+    tmpl->watches = g_array_new(FALSE, FALSE, sizeof(struct template_watch));
+    tmpl->breakpoints = g_array_new(FALSE, FALSE, sizeof(struct template_breakpoint));
+    return tmpl;
+}
+
+status_t
+vmi_event_template_watch(
+    vmi_event_template_t tmpl,
+    addr_t gfn,
+    vmi_mem_access_t access)
+{
+    struct template_watch watch = { .gfn = gfn, .access = access };
+    guint i;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!tmpl)
+        return VMI_FAILURE;
+#endif
+
+    if (!template_access_valid(access))
+        return VMI_FAILURE;
+
+    i = template_bisect(tmpl->watches, sizeof(watch), gfn);
+
+    /* a page watched twice traps on either access */
+    if (i < tmpl->watches->len && g_array_index(tmpl->watches, struct template_watch, i).gfn == gfn) {
+        vmi_mem_access_t merged = g_array_index(tmpl->watches, struct template_watch, i).access | access;
+
+        if (!template_access_valid(merged))
+            return VMI_FAILURE;
+
+        g_array_index(tmpl->watches, struct template_watch, i).access = merged;
+        return VMI_SUCCESS;
+    }
+
+    g_array_insert_val(tmpl->watches, i, watch);
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_event_template_watch_ksym(
+    vmi_event_template_t tmpl,
+    vmi_instance_t reference,
+    const char *symbol,
+    size_t size,
+    vmi_mem_access_t access)
+{
+    addr_t va, end, pa;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!tmpl || !reference || !symbol || !size)
+        return VMI_FAILURE;
+#endif
+
+    if (VMI_FAILURE == vmi_translate_ksym2v(reference, symbol, &va)) {
+        dbprint(VMI_DEBUG_EVENTS, "--%s: can't resolve %s\n", __FUNCTION__, symbol);
+        return VMI_FAILURE;
+    }
+
+    end = va + size;
+    va &= ~((addr_t)reference->page_size - 1);
+
+    for (; va < end; va += reference->page_size) {
+        if (VMI_FAILURE == vmi_translate_kv2p(reference, va, &pa))
+            return VMI_FAILURE;
+
+        if (VMI_FAILURE == vmi_event_template_watch(tmpl, pa >> reference->page_shift, access))
+            return VMI_FAILURE;
+    }
+
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_event_template_breakpoint(
+    vmi_event_template_t tmpl,
+    vmi_instance_t reference,
+    const char *symbol)
+{
+    struct template_breakpoint bp = { 0 };
+    addr_t va;
+    guint i;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!tmpl || !reference || !symbol)
+        return VMI_FAILURE;
+#endif
+
+    if (VMI_FAILURE == vmi_translate_ksym2v(reference, symbol, &va) ||
+            VMI_FAILURE == vmi_translate_kv2p(reference, va, &bp.pa) ||
+            VMI_FAILURE == vmi_read_8_pa(reference, bp.pa, &bp.orig)) {
+        dbprint(VMI_DEBUG_EVENTS, "--%s: can't resolve %s\n", __FUNCTION__, symbol);
+        return VMI_FAILURE;
+    }
+
+    i = template_bisect(tmpl->breakpoints, sizeof(bp), bp.pa);
+    if (i < tmpl->breakpoints->len &&
+            g_array_index(tmpl->breakpoints, struct template_breakpoint, i).pa == bp.pa)
+        return VMI_SUCCESS;
+
+    bp.symbol = g_strdup(symbol);
+    g_array_insert_val(tmpl->breakpoints, i, bp);
+    return VMI_SUCCESS;
+}
+
+size_t
+vmi_event_template_watches(
+    vmi_event_template_t tmpl)
+{
+    return tmpl ? tmpl->watches->len : 0;
+}
+
+status_t
+vmi_event_template_lookup_breakpoint(
+    vmi_event_template_t tmpl,
+    addr_t pa,
+    const char **symbol,
+    uint8_t *orig)
+{
+    struct template_breakpoint *bp;
+    guint i;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!tmpl)
+        return VMI_FAILURE;
+#endif
+
+    i = template_bisect(tmpl->breakpoints, sizeof(struct template_breakpoint), pa);
+    if (i == tmpl->breakpoints->len)
+        return VMI_FAILURE;
+
+    bp = &g_array_index(tmpl->breakpoints, struct template_breakpoint, i);
+    if (bp->pa != pa)
+        return VMI_FAILURE;
+
+    if (symbol)
+        *symbol = bp->symbol;
+    if (orig)
+        *orig = bp->orig;
+
+    return VMI_SUCCESS;
+}
+
+static void
+template_restore(
+    vmi_event_template_t tmpl,
+    vmi_instance_t vmi,
+    guint count)
+{
+    guint i;
+
+    for (i = 0; i < count; i++) {
+        struct template_breakpoint *bp = &g_array_index(tmpl->breakpoints, struct template_breakpoint, i);
+
+        if (VMI_FAILURE == vmi_write_8_pa(vmi, bp->pa, &bp->orig))
+            errprint("%s: failed to restore the breakpoint at %s\n", __FUNCTION__, bp->symbol);
+    }
+}
+
+status_t
+vmi_event_template_apply(
+    vmi_event_template_t tmpl,
+    vmi_instance_t vmi,
+    const vmi_event_t *mem_event,
+    vmi_event_t **events)
+{
+    vmi_event_t *armed = NULL;
+    uint8_t int3 = 0xcc;
+    bool held = false;
+    guint i;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!tmpl || !vmi || !events)
+        return VMI_FAILURE;
+
+    if (!(vmi->init_flags & VMI_INIT_EVENTS))
+        return VMI_FAILURE;
+
+    if (tmpl->watches->len && (!mem_event || VMI_EVENT_MEMORY != mem_event->type ||
+                               VMI_EVENTS_VERSION != mem_event->version || !mem_event->callback))
+        return VMI_FAILURE;
+#endif
+
+    /* events can't be registered in bulk while a callback may clear some */
+    if (vmi->event_callback)
+        return VMI_FAILURE;
+
+    /* the plan only holds for clones running the reference's kernel */
+    for (i = 0; i < tmpl->breakpoints->len; i++) {
+        struct template_breakpoint *bp = &g_array_index(tmpl->breakpoints, struct template_breakpoint, i);
+        uint8_t byte;
+
+        if (VMI_FAILURE == vmi_read_8_pa(vmi, bp->pa, &byte) || byte != bp->orig) {
+            dbprint(VMI_DEBUG_EVENTS, "--%s: %s differs from the reference\n", __FUNCTION__, bp->symbol);
+            return VMI_FAILURE;
+        }
+    }
+
+    if (tmpl->watches->len) {
+        armed = g_try_new0(vmi_event_t, tmpl->watches->len);
+        if (!armed)
+            return VMI_FAILURE;
+
+        for (i = 0; i < tmpl->watches->len; i++) {
+            struct template_watch *watch = &g_array_index(tmpl->watches, struct template_watch, i);
+
+            armed[i] = *mem_event;
+            armed[i].mem_event.generic = 0;
+            armed[i].mem_event.gfn = watch->gfn;
+            armed[i].mem_event.in_access = watch->access;
+        }
+
+        if (VMI_FAILURE == register_mem_events_sorted(vmi, armed, tmpl->watches->len, &held)) {
+            /* pages that could not be cleared still point at their events */
+            if (!held)
+                g_free(armed);
+            return VMI_FAILURE;
+        }
+    }
+
+    for (i = 0; i < tmpl->breakpoints->len; i++) {
+        struct template_breakpoint *bp = &g_array_index(tmpl->breakpoints, struct template_breakpoint, i);
+
+        if (VMI_FAILURE == vmi_write_8_pa(vmi, bp->pa, &int3)) {
+            errprint("%s: failed to set the breakpoint at %s\n", __FUNCTION__, bp->symbol);
+            template_restore(tmpl, vmi, i);
+            if (!armed || VMI_SUCCESS == clear_mem_events_sorted(vmi, armed, tmpl->watches->len))
+                g_free(armed);
+            return VMI_FAILURE;
+        }
+    }
+
+    *events = armed;
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_event_template_remove(
+    vmi_event_template_t tmpl,
+    vmi_instance_t vmi,
+    vmi_event_t *events)
+{
+    status_t ret = VMI_SUCCESS;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!tmpl || !vmi || (tmpl->watches->len && !events))
+        return VMI_FAILURE;
+#endif
+
+    if (vmi->event_callback)
+        return VMI_FAILURE;
+
+    template_restore(tmpl, vmi, tmpl->breakpoints->len);
+
+    if (events)
+        ret = clear_mem_events_sorted(vmi, events, tmpl->watches->len);
+
+    /* pages that could not be cleared still point at their events */
+    if (VMI_SUCCESS == ret)
+        g_free(events);
+
+    return ret;
+}
+
+void
+vmi_event_template_destroy(
+    vmi_event_template_t tmpl)
+{
+    guint i;
+
+    if (!tmpl)
+        return;
+
+    for (i = 0; i < tmpl->breakpoints->len; i++)
+        g_free(g_array_index(tmpl->breakpoints, struct template_breakpoint, i).symbol);
+
+    g_array_free(tmpl->breakpoints, TRUE);
+    g_array_free(tmpl->watches, TRUE);
+    g_free(tmpl);
+}
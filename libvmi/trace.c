@@ -0,0 +1,239 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Event recording. The callbacks are issued through event_dispatch, which
+ * writes the event before and the response after the callback. Pages read
+ * in between are written the first time they are read by the callback if
+ * their content differs from what the trace already holds.
+ */
+
+#include <string.h>
+
+#include "private.h"
+
+struct recorded_page {
+    uint64_t pfn;       /* key */
+    uint64_t hash;      /* of the content last written */
+    uint64_t checked;   /* event the page was last checked in */
+};
+
+struct event_trace {
+    FILE *file;
+    GHashTable *pages;
+    uint64_t events;
+    bool in_callback;
+    bool failed;
+};
+
+static void
+trace_write(
+    struct event_trace *trace,
+    vmi_trace_record_type_t type,
+    const void *a,
+    size_t a_size,
+    const void *b,
+    size_t b_size)
+{
+    vmi_trace_record_t record = {
+        .type = type,
+        .size = a_size + b_size
+    };
+
+    if (trace->failed)
+        return;
+
+    if (fwrite(&record, sizeof(record), 1, trace->file) != 1 ||
+            fwrite(a, a_size, 1, trace->file) != 1 ||
+            (b_size && fwrite(b, b_size, 1, trace->file) != 1)) {
+        errprint("Failed to write the event trace, recording stopped.\n");
+        trace->failed = true;
+    }
+}
+
+event_response_t
+event_trace_dispatch(
+    vmi_instance_t vmi,
+    vmi_event_t *event)
+{
+    struct event_trace *trace = vmi->event_trace;
+    vmi_trace_event_t record = {
+        .type = event->type,
+        .vcpu_id = event->vcpu_id,
+        .page_mode = event->page_mode,
+        .slat_id = event->slat_id,
+    };
+    event_response_t response;
+
+    memcpy(record.data, &event->reg_event, VMI_TRACE_EVENT_DATA_SIZE);
+    if (event->x86_regs) {
+#if defined(ARM32) || defined(ARM64)
+        record.regs.arm = *event->arm_regs;
+#else
+        record.regs.x86 = *event->x86_regs;
+#endif
+        record.has_regs = 1;
+    }
+
+    trace_write(trace, VMI_TRACE_RECORD_EVENT, &record, sizeof(record), NULL, 0);
+
+    /* pages the lookaside holds would not be seen being read */
+    read_lookaside_flush(vmi);
+
+    trace->events++;
+    trace->in_callback = true;
+    response = event->callback(vmi, event);
+    trace->in_callback = false;
+
+    trace_write(trace, VMI_TRACE_RECORD_RESPONSE, &response, sizeof(response), NULL, 0);
+
+    return response;
+}
+
+void
+event_trace_page(
+    vmi_instance_t vmi,
+    addr_t pfn,
+    const void *page)
+{
+    struct event_trace *trace = vmi->event_trace;
+    struct recorded_page *recorded;
+    uint64_t hash;
+
+    if (!trace->in_callback)
+        return;
+
+    recorded = g_hash_table_lookup(trace->pages, &pfn);
+    if (recorded && recorded->checked == trace->events)
+        return;
+
+    hash = xxh64(page, vmi->page_size, 0);
+
+    if (!recorded) {
+        recorded = g_malloc0(sizeof(struct recorded_page));
+        recorded->pfn = pfn;
+        g_hash_table_insert(trace->pages, recorded, recorded);
+    } else if (recorded->hash == hash) {
+        recorded->checked = trace->events;
+        return;
+    }
+
+    recorded->hash = hash;
+    recorded->checked = trace->events;
+
+    trace_write(trace, VMI_TRACE_RECORD_PAGE, &recorded->pfn, sizeof(uint64_t), page, vmi->page_size);
+}
+
+status_t
+vmi_events_record(
+    vmi_instance_t vmi,
+    const char *path,
+    const char *image)
+{
+    struct event_trace *trace;
+    vmi_trace_header_t *header;
+    bool written;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !path)
+        return VMI_FAILURE;
+#endif
+
+    if (vmi->event_trace) {
+        dbprint(VMI_DEBUG_EVENTS, "--%s: already recording\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    if (image && strlen(image) >= sizeof(header->image)) {
+        errprint("%s: image path is too long\n", __FUNCTION__);
+        return VMI_FAILURE;
+    }
+
+    header = g_try_malloc0(sizeof(vmi_trace_header_t));
+    if (!header)
+        return VMI_FAILURE;
+
+    memcpy(header->magic, VMI_TRACE_MAGIC, sizeof(header->magic));
+    header->version = VMI_TRACE_VERSION;
+    header->events_version = VMI_EVENTS_VERSION;
+    header->page_shift = vmi->page_shift;
+    header->num_vcpus = vmi->num_vcpus;
+    header->memory_size = vmi->max_physical_address;
+    if (image)
+        strcpy(header->image, image);
+
+    trace = g_try_malloc0(sizeof(struct event_trace));
+    if (!trace) {
+        g_free(header);
+        return VMI_FAILURE;
+    }
+
+    trace->file = fopen(path, "wb");
+    if (!trace->file) {
+        errprint("Failed to open '%s' for writing.\n", path);
+        g_free(header);
+        g_free(trace);
+        return VMI_FAILURE;
+    }
+
+    written = fwrite(header, sizeof(*header), 1, trace->file) == 1;
+    g_free(header);
+
+    if (!written) {
+        errprint("Failed to write the header of '%s'.\n", path);
+        fclose(trace->file);
+        g_free(trace);
+        return VMI_FAILURE;
+    }
+
+    trace->pages = g_hash_table_new_full(g_int64_hash, g_int64_equal, g_free, NULL);
+    vmi->event_trace = trace;
+
+    dbprint(VMI_DEBUG_EVENTS, "--Recording events to %s\n", path);
+    return VMI_SUCCESS;
+}
+
+status_t
+vmi_events_record_stop(
+    vmi_instance_t vmi)
+{
+    struct event_trace *trace;
+    status_t ret = VMI_SUCCESS;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi)
+        return VMI_FAILURE;
+#endif
+
+    trace = vmi->event_trace;
+    if (!trace)
+        return VMI_FAILURE;
+
+    if (fclose(trace->file) || trace->failed)
+        ret = VMI_FAILURE;
+
+    dbprint(VMI_DEBUG_EVENTS, "--Recorded %"PRIu64" events\n", trace->events);
+
+    g_hash_table_destroy(trace->pages);
+    g_free(trace);
+    vmi->event_trace = NULL;
+
+    return ret;
+}
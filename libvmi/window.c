@@ -0,0 +1,310 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Windows onto a guest address space. A window is an anonymous host
+ * mapping registered with userfaultfd: the first touch of each page is
+ * caught by a handler thread that translates the guest address, reads the
+ * frame and copies it in. Invalidating the window drops the copies, so
+ * the next touch translates again.
+ */
+
+#include <string.h>
+#include <errno.h>
+
+#include "private.h"
+
+#ifdef HAVE_LINUX_USERFAULTFD_H
+#include <linux/userfaultfd.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+struct vmi_window {
+    vmi_instance_t vmi;
+    access_handle_t handle;     /* compiled context of the first page */
+    page_mode_t pm;
+    uint8_t *base;
+    size_t size;
+    int uffd;
+    int stop[2];                /* wakes the handler up to exit */
+    pthread_t thread;
+    uint8_t *bounce;
+};
+
+static void
+window_fill(
+    struct vmi_window *window,
+    addr_t host)
+{
+    vmi_instance_t vmi = window->vmi;
+    addr_t va = window->handle.ctx.addr + (host - (addr_t)window->base);
+    addr_t paddr;
+    struct uffdio_copy copy = {
+        .dst = host,
+        .src = (addr_t)window->bounce,
+        .len = vmi->page_size
+    };
+
+    if (VMI_FAILURE == translate_read_addr(vmi, &window->handle.ctx, window->handle.ctx.pt, window->pm, va, &paddr) ||
+            VMI_FAILURE == vmi_read_pa(vmi, paddr, vmi->page_size, window->bounce, NULL)) {
+        struct uffdio_zeropage zero = {
+            .range = { .start = host, .len = vmi->page_size }
+        };
+
+        /* there is no way to fail the access, it reads zeroes */
+        dbprint(VMI_DEBUG_READ, "--%s: 0x%"PRIx64" is not mapped\n", __FUNCTION__, va);
+        if (ioctl(window->uffd, UFFDIO_ZEROPAGE, &zero) < 0 && errno != EEXIST)
+            errprint("%s: failed to resolve the fault at 0x%"PRIx64"\n", __FUNCTION__, va);
+        return;
+    }
+
+    if (ioctl(window->uffd, UFFDIO_COPY, &copy) < 0 && errno != EEXIST)
+        errprint("%s: failed to resolve the fault at 0x%"PRIx64"\n", __FUNCTION__, va);
+}
+
+/*
+ * The thread touching the window is blocked until its fault is resolved,
+ * which is what lets the handler use the instance from another thread.
+ */
+static void *
+window_handler(
+    void *data)
+{
+    struct vmi_window *window = data;
+    struct pollfd fds[2] = {
+        { .fd = window->uffd, .events = POLLIN },
+        { .fd = window->stop[0], .events = POLLIN }
+    };
+
+    while (1) {
+        struct uffd_msg msg;
+
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents)
+            break;
+
+        if (read(window->uffd, &msg, sizeof(msg)) != sizeof(msg))
+            continue;
+
+        if (msg.event != UFFD_EVENT_PAGEFAULT)
+            continue;
+
+        window_fill(window, msg.arg.pagefault.address & ~((addr_t)window->vmi->page_size - 1));
+    }
+
+    return NULL;
+}
+
+static int
+open_userfaultfd(void)
+{
+    int fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+
+#ifdef UFFD_USER_MODE_ONLY
+    /* unprivileged users may only be allowed to handle user faults */
+    if (fd < 0 && errno == EPERM)
+        fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+#endif
+
+    return fd;
+}
+
+static void
+window_free(
+    struct vmi_window *window)
+{
+    if (window->stop[0] >= 0)
+        close(window->stop[0]);
+    if (window->stop[1] >= 0)
+        close(window->stop[1]);
+    if (window->uffd >= 0)
+        close(window->uffd);
+    if (window->base)
+        munmap(window->base, window->size);
+    g_free(window->bounce);
+    g_free(window);
+}
+
+status_t
+vmi_window_create(
+    vmi_instance_t vmi,
+    const access_context_t *ctx,
+    size_t num_pages,
+    vmi_window_t *_window,
+    void **base)
+{
+    struct vmi_window *window;
+    struct uffdio_api api = { .api = UFFD_API };
+    struct uffdio_register reg = { .mode = UFFDIO_REGISTER_MODE_MISSING };
+    addr_t offset;
+    void *map;
+
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !ctx || !num_pages || !_window || !base)
+        return VMI_FAILURE;
+#endif
+
+    window = g_try_malloc0(sizeof(struct vmi_window));
+    if (!window)
+        return VMI_FAILURE;
+
+    window->vmi = vmi;
+    window->uffd = window->stop[0] = window->stop[1] = -1;
+
+    if (VMI_FAILURE == vmi_compile_access_context(vmi, ctx, &window->handle))
+        goto error;
+
+    window->pm = VMI_TM_NONE == window->handle.ctx.tm ? VMI_PM_NONE : window->handle.ctx.pm;
+    offset = window->handle.ctx.addr & (vmi->page_size - 1);
+    window->handle.ctx.addr -= offset;
+    window->size = num_pages << vmi->page_shift;
+
+    window->bounce = g_try_malloc(vmi->page_size);
+    if (!window->bounce)
+        goto error;
+
+    window->uffd = open_userfaultfd();
+    if (window->uffd < 0) {
+        errprint("%s: userfaultfd is not available: %s\n", __FUNCTION__, strerror(errno));
+        goto error;
+    }
+
+    if (ioctl(window->uffd, UFFDIO_API, &api) < 0)
+        goto error;
+
+    map = mmap(NULL, window->size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (MAP_FAILED == map)
+        goto error;
+    window->base = map;
+
+    reg.range.start = (addr_t)window->base;
+    reg.range.len = window->size;
+    if (ioctl(window->uffd, UFFDIO_REGISTER, &reg) < 0) {
+        errprint("%s: failed to register the window: %s\n", __FUNCTION__, strerror(errno));
+        goto error;
+    }
+
+    if (pipe(window->stop) < 0)
+        goto error;
+
+    if (pthread_create(&window->thread, NULL, window_handler, window)) {
+        errprint("%s: failed to start the fault handler\n", __FUNCTION__);
+        goto error;
+    }
+
+    vmi->windows = g_slist_prepend(vmi->windows, window);
+
+    *_window = window;
+    *base = window->base + offset;
+    return VMI_SUCCESS;
+
+error:
+    window_free(window);
+    return VMI_FAILURE;
+}
+
+status_t
+vmi_window_invalidate(
+    vmi_window_t window)
+{
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!window)
+        return VMI_FAILURE;
+#endif
+
+    /* the page tables may have changed as well */
+    if (window->handle.ctx.pt)
+        vmi_v2pcache_flush(window->vmi, window->handle.ctx.pt);
+
+    if (madvise(window->base, window->size, MADV_DONTNEED) < 0)
+        return VMI_FAILURE;
+
+    return VMI_SUCCESS;
+}
+
+void
+vmi_window_destroy(
+    vmi_window_t window)
+{
+    char stop = 0;
+
+    if (!window)
+        return;
+
+    /*
+     * The handler must be gone before the window is unmapped. Closing the
+     * write end also wakes it up, with a hangup on the pipe.
+     */
+    if (write(window->stop[1], &stop, sizeof(stop)) != sizeof(stop)) {
+        close(window->stop[1]);
+        window->stop[1] = -1;
+    }
+    pthread_join(window->thread, NULL);
+
+    window->vmi->windows = g_slist_remove(window->vmi->windows, window);
+    window_free(window);
+}
+
+#else
+
+status_t
+vmi_window_create(
+    vmi_instance_t UNUSED(vmi),
+    const access_context_t *UNUSED(ctx),
+    size_t UNUSED(num_pages),
+    vmi_window_t *UNUSED(window),
+    void **UNUSED(base))
+{
+    dbprint(VMI_DEBUG_MISC, "--%s: built without userfaultfd support\n", __FUNCTION__);
+    return VMI_FAILURE;
+}
+
+status_t
+vmi_window_invalidate(
+    vmi_window_t UNUSED(window))
+{
+    return VMI_FAILURE;
+}
+
+void
+vmi_window_destroy(
+    vmi_window_t UNUSED(window))
+{
+}
+
+#endif /* HAVE_LINUX_USERFAULTFD_H */
+
+void
+window_destroy_all(
+    vmi_instance_t vmi)
+{
+    while (vmi->windows)
+        vmi_window_destroy(vmi->windows->data);
+}
@@ -173,6 +173,29 @@ done:
     return ret;
 }
 
+status_t
+vmi_write_handle(
+    vmi_instance_t vmi,
+    access_handle_t *handle,
+    size_t count,
+    void *buf,
+    size_t *bytes_written)
+{
+#ifdef ENABLE_SAFETY_CHECKS
+    if (!vmi || !handle)
+        return VMI_FAILURE;
+#endif
+
+    if (handle->generation != vmi->access_generation &&
+            VMI_FAILURE == vmi_compile_access_context(vmi, &handle->source, handle)) {
+        if ( bytes_written )
+            *bytes_written = 0;
+        return VMI_FAILURE;
+    }
+
+    return vmi_write(vmi, &handle->ctx, count, buf, bytes_written);
+}
+
 status_t
 vmi_write_pa(
     vmi_instance_t vmi,
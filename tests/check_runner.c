@@ -24,6 +24,10 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stddef.h>
 #include "check_tests.h"
 #include "../libvmi/libvmi.h"
 
@@ -37,6 +41,16 @@ TCase *util_tcase();
 TCase *peparse_tcase();
 TCase *cache_tcase();
 TCase *get_va_pages_tcase();
+TCase *modules_tcase();
+TCase *regions_tcase();
+TCase *delta_tcase();
+TCase *page_store_tcase();
+TCase *hash_tcase();
+TCase *window_tcase();
+TCase *replay_tcase();
+TCase *syscalls_tcase();
+TCase *sched_tcase();
+TCase *template_tcase();
 
 const char *get_testvm (void)
 {
@@ -46,6 +60,119 @@ const char *get_testvm (void)
     return testvm;
 }
 
+void image_create (const char *dir, const char *name, unsigned int pages, char *path, size_t len)
+{
+    char page[IMAGE_PAGE_SIZE];
+    unsigned int i;
+    FILE *f;
+
+    snprintf(path, len, "%s/%s", dir, name);
+    f = fopen(path, "w");
+    fail_unless(NULL != f, "failed to create %s", path);
+    for (i = 0; i < pages; i++) {
+        memset(page, IMAGE_FILL + i, sizeof(page));
+        fail_unless(1 == fwrite(page, sizeof(page), 1, f), "failed to write %s", path);
+    }
+    fclose(f);
+}
+
+void image_fill (const char *path, size_t offset, size_t len, unsigned char value)
+{
+    FILE *f = fopen(path, "r+");
+
+    fail_unless(NULL != f, "failed to open %s", path);
+    fail_unless(0 == fseek(f, offset, SEEK_SET), "failed to seek in %s", path);
+    while (len--)
+        fail_unless(EOF != fputc(value, f), "failed to write %s", path);
+    fclose(f);
+}
+
+void image_dir_remove (const char *dir)
+{
+    DIR *d = opendir(dir);
+    struct dirent *entry;
+    char path[256];
+
+    if (!d)
+        return;
+
+    while ((entry = readdir(d))) {
+        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+FILE *trace_create (const char *dir, const char *image, unsigned int pages, char *path, size_t len)
+{
+    return trace_create_vcpus(dir, image, pages, 1, path, len);
+}
+
+FILE *trace_create_vcpus (const char *dir, const char *image, unsigned int pages, unsigned int vcpus,
+                          char *path, size_t len)
+{
+    vmi_trace_header_t *header = calloc(1, sizeof(*header));
+    FILE *trace;
+
+    memcpy(header->magic, VMI_TRACE_MAGIC, sizeof(header->magic));
+    header->version = VMI_TRACE_VERSION;
+    header->events_version = VMI_EVENTS_VERSION;
+    header->page_shift = 12;
+    header->num_vcpus = vcpus;
+    header->memory_size = (uint64_t)pages * IMAGE_PAGE_SIZE;
+    if (image)
+        snprintf(header->image, sizeof(header->image), "%s", image);
+
+    snprintf(path, len, "%s/trace", dir);
+    trace = fopen(path, "w");
+    fail_unless(NULL != trace, "failed to create %s", path);
+    fail_unless(1 == fwrite(header, sizeof(*header), 1, trace), "failed to write %s", path);
+    free(header);
+
+    return trace;
+}
+
+void trace_event (FILE *trace, const vmi_event_t *event, const x86_registers_t *regs)
+{
+    vmi_trace_record_t record = { .type = VMI_TRACE_RECORD_EVENT, .size = sizeof(vmi_trace_event_t) };
+    vmi_trace_event_t data = {
+        .type = event->type,
+        .vcpu_id = event->vcpu_id,
+        .slat_id = event->slat_id,
+    };
+
+    memcpy(data.data, &event->reg_event, sizeof(data.data));
+    if (regs) {
+        data.regs.x86 = *regs;
+        data.has_regs = 1;
+    }
+
+    fail_unless(1 == fwrite(&record, sizeof(record), 1, trace) &&
+                1 == fwrite(&data, sizeof(data), 1, trace), "failed to write the trace");
+}
+
+void trace_page (FILE *trace, uint64_t pfn, unsigned char value)
+{
+    vmi_trace_record_t record = { .type = VMI_TRACE_RECORD_PAGE, .size = sizeof(pfn) + IMAGE_PAGE_SIZE };
+    char page[IMAGE_PAGE_SIZE];
+
+    memset(page, value, sizeof(page));
+    fail_unless(1 == fwrite(&record, sizeof(record), 1, trace) &&
+                1 == fwrite(&pfn, sizeof(pfn), 1, trace) &&
+                1 == fwrite(page, sizeof(page), 1, trace), "failed to write the trace");
+}
+
+void trace_response (FILE *trace, event_response_t response)
+{
+    vmi_trace_record_t record = { .type = VMI_TRACE_RECORD_RESPONSE, .size = sizeof(response) };
+
+    fail_unless(1 == fwrite(&record, sizeof(record), 1, trace) &&
+                1 == fwrite(&response, sizeof(response), 1, trace), "failed to write the trace");
+}
+
 int
 main (void)
 {
@@ -69,6 +196,16 @@ main (void)
     suite_add_tcase(s, peparse_tcase());
     suite_add_tcase(s, cache_tcase());
     suite_add_tcase(s, get_va_pages_tcase());
+    suite_add_tcase(s, modules_tcase());
+    suite_add_tcase(s, regions_tcase());
+    suite_add_tcase(s, delta_tcase());
+    suite_add_tcase(s, page_store_tcase());
+    suite_add_tcase(s, hash_tcase());
+    suite_add_tcase(s, window_tcase());
+    suite_add_tcase(s, replay_tcase());
+    suite_add_tcase(s, syscalls_tcase());
+    suite_add_tcase(s, sched_tcase());
+    suite_add_tcase(s, template_tcase());
 
     /* run the tests */
     SRunner *sr = srunner_create(s);
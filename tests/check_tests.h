@@ -25,11 +25,39 @@
 #ifndef CHECK_TESTS_H
 #define CHECK_TESTS_H
 
+#include <stddef.h>
+#include <stdio.h>
 #include <check.h>
+#include <libvmi/libvmi.h>
+#include <libvmi/events.h>
 
 /* vm name access */
 const char *get_testvm();
 
+/*
+ * Raw memory images for the file driver, kept in a directory made with
+ * mkdtemp. Page i of a new image is filled with IMAGE_FILL + i.
+ */
+#define IMAGE_PAGE_SIZE 4096
+#define IMAGE_FILL 0x10
+
+void image_create (const char *dir, const char *name, unsigned int pages, char *path, size_t len);
+void image_fill (const char *path, size_t offset, size_t len, unsigned char value);
+void image_dir_remove (const char *dir);
+
+/*
+ * Event traces for the file driver to replay, in the format written by
+ * vmi_events_record. Each event is written with trace_event, followed by
+ * the pages its callback read and trace_response. Pages the trace does not
+ * hold are read from the image, relative to the trace.
+ */
+FILE *trace_create (const char *dir, const char *image, unsigned int pages, char *path, size_t len);
+FILE *trace_create_vcpus (const char *dir, const char *image, unsigned int pages, unsigned int vcpus,
+                          char *path, size_t len);
+void trace_event (FILE *trace, const vmi_event_t *event, const x86_registers_t *regs);
+void trace_page (FILE *trace, uint64_t pfn, unsigned char value);
+void trace_response (FILE *trace, event_response_t response);
+
 /* test cases */
 TCase *init_tcase (void);
 TCase *translate_tcase (void);
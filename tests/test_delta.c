@@ -0,0 +1,76 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <libvmi/libvmi.h>
+#include "check_tests.h"
+
+/* a delta image overrides the pages it holds, the rest comes from its parent */
+START_TEST (test_vmi_read_delta_image)
+{
+    vmi_instance_t vmi = NULL;
+    char dir[] = "/tmp/libvmi-delta-XXXXXX";
+    char base_path[64], delta_path[64];
+    char page[IMAGE_PAGE_SIZE];
+    vmi_delta_header_t header = { .version = VMI_DELTA_VERSION, .page_shift = 12,
+                                  .memory_size = 4 * sizeof(page), .page_count = 1
+                                };
+    uint64_t pfn = 2;
+    uint8_t value = 0;
+    FILE *f;
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "base", 4, base_path, sizeof(base_path));
+
+    memcpy(header.magic, VMI_DELTA_MAGIC, sizeof(header.magic));
+    strcpy(header.parent, "base");
+    memset(page, 0xaa, sizeof(page));
+    snprintf(delta_path, sizeof(delta_path), "%s/delta", dir);
+    f = fopen(delta_path, "w");
+    fail_unless(NULL != f, "failed to create the delta image");
+    fwrite(&header, sizeof(header), 1, f);
+    fwrite(&pfn, sizeof(pfn), 1, f);
+    fwrite(page, sizeof(page), 1, f);
+    fclose(f);
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, delta_path, VMI_INIT_DOMAINNAME, NULL, NULL),
+                "failed to open the delta image");
+    fail_unless(vmi_get_memsize(vmi) == header.memory_size, "wrong size for the delta image");
+    fail_unless(VMI_SUCCESS == vmi_read_8_pa(vmi, 1 * sizeof(page) + 5, &value), "vmi_read_8_pa failed");
+    fail_unless(value == IMAGE_FILL + 1, "page missing from the delta was not read from the parent");
+    fail_unless(VMI_SUCCESS == vmi_read_8_pa(vmi, 2 * sizeof(page) + 5, &value), "vmi_read_8_pa failed");
+    fail_unless(value == 0xaa, "page of the delta was not read from the delta");
+    vmi_destroy(vmi);
+
+    image_dir_remove(dir);
+}
+END_TEST
+
+/* delta image test cases */
+TCase *delta_tcase (void)
+{
+    TCase *tc_delta = tcase_create("LibVMI delta images");
+    tcase_add_test(tc_delta, test_vmi_read_delta_image);
+    return tc_delta;
+}
@@ -0,0 +1,95 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <libvmi/libvmi.h>
+#include "check_tests.h"
+
+START_TEST (test_vmi_hash_range)
+{
+    vmi_instance_t vmi = NULL;
+    char dir[] = "/tmp/libvmi-hash-XXXXXX";
+    char path[64];
+    uint64_t hashes[3] = { 0 };
+    uint64_t dirty = 1ull << 2;
+    ACCESS_CONTEXT(ctx, .addr = IMAGE_PAGE_SIZE + 100);
+
+    /* page 3 is a copy of page 1 */
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "image", 5, path, sizeof(path));
+    image_fill(path, 3 * IMAGE_PAGE_SIZE, IMAGE_PAGE_SIZE, IMAGE_FILL + 1);
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME, NULL, NULL),
+                "failed to open the image");
+
+    /* pages 1 to 3, the range starts and ends within a page */
+    fail_unless(VMI_SUCCESS == vmi_hash_range(vmi, &ctx, 2 * IMAGE_PAGE_SIZE, VMI_HASH_XXH64, hashes),
+                "vmi_hash_range failed");
+    fail_unless(hashes[0] != hashes[1], "different pages hash the same");
+    fail_unless(hashes[0] == hashes[2], "identical pages hash differently");
+
+    /* only frame 2 is rehashed */
+    hashes[0] = hashes[1] = 0;
+    fail_unless(VMI_SUCCESS == vmi_rehash_range(vmi, &ctx, 2 * IMAGE_PAGE_SIZE, VMI_HASH_XXH64, &dirty, 64, hashes),
+                "vmi_rehash_range failed");
+    fail_unless(hashes[0] == 0 && hashes[1] != 0, "wrong pages rehashed");
+
+    vmi_destroy(vmi);
+    image_dir_remove(dir);
+}
+END_TEST
+
+/* known answers of the reference xxHash implementation */
+START_TEST (test_vmi_hash_xxh64)
+{
+    vmi_instance_t vmi = NULL;
+    char dir[] = "/tmp/libvmi-hash-XXXXXX";
+    char path[64];
+    uint64_t hashes[2] = { 0 };
+    ACCESS_CONTEXT(ctx, .addr = 0);
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "image", 2, path, sizeof(path));
+    image_fill(path, IMAGE_PAGE_SIZE, IMAGE_PAGE_SIZE, 0);
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME, NULL, NULL),
+                "failed to open the image");
+    fail_unless(VMI_SUCCESS == vmi_hash_range(vmi, &ctx, 2 * IMAGE_PAGE_SIZE, VMI_HASH_XXH64, hashes),
+                "vmi_hash_range failed");
+    fail_unless(hashes[0] == 0x1aff8b16124584dbull, "wrong hash for a page of 0x10: 0x%" PRIx64, hashes[0]);
+    fail_unless(hashes[1] == 0xac869b6f32d8bbdbull, "wrong hash for a zero page: 0x%" PRIx64, hashes[1]);
+
+    vmi_destroy(vmi);
+    image_dir_remove(dir);
+}
+END_TEST
+
+/* hash test cases */
+TCase *hash_tcase (void)
+{
+    TCase *tc_hash = tcase_create("LibVMI hash");
+    tcase_add_test(tc_hash, test_vmi_hash_range);
+    tcase_add_test(tc_hash, test_vmi_hash_xxh64);
+    return tc_hash;
+}
@@ -0,0 +1,121 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <libvmi/libvmi.h>
+#include "check_tests.h"
+
+/* take two kernel module snapshots, the second one reusing the first */
+START_TEST (test_libvmi_get_modules)
+{
+    vmi_instance_t vmi = NULL;
+    module_list_t *first = NULL, *second = NULL;
+    module_list_t *loaded = NULL, *unloaded = NULL;
+    size_t i;
+
+    vmi_init_complete(&vmi, (void*)get_testvm(), VMI_INIT_DOMAINNAME, NULL,
+                      VMI_CONFIG_GLOBAL_FILE_ENTRY, NULL, NULL);
+    vmi_pause_vm(vmi);
+
+    fail_unless(VMI_SUCCESS == vmi_get_modules(vmi, 0, NULL, &first),
+                "vmi_get_modules failed");
+    fail_unless(first->count > 0, "kernel module list is empty");
+
+    fail_unless(VMI_SUCCESS == vmi_get_modules(vmi, 0, first, &second),
+                "vmi_get_modules with a previous snapshot failed");
+    fail_unless(first->count == second->count, "module count changed while paused");
+
+    for (i = 0; i < first->count; i++) {
+        fail_unless(first->modules[i].base == second->modules[i].base, "module base mismatch");
+        fail_unless(!strcmp(first->modules[i].name, second->modules[i].name), "module name mismatch");
+    }
+
+    fail_unless(VMI_SUCCESS == vmi_diff_module_lists(first, second, &loaded, &unloaded),
+                "vmi_diff_module_lists failed");
+    fail_unless(loaded->count == 0 && unloaded->count == 0, "identical snapshots differ");
+
+    vmi_free_module_list(loaded);
+    vmi_free_module_list(unloaded);
+    vmi_free_module_list(second);
+    vmi_free_module_list(first);
+
+    vmi_resume_vm(vmi);
+    vmi_destroy(vmi);
+}
+END_TEST
+
+/* every kernel module should resolve to itself through the index */
+START_TEST (test_libvmi_addr_to_module)
+{
+    vmi_instance_t vmi = NULL;
+    module_list_t *list = NULL;
+    size_t i;
+
+    vmi_init_complete(&vmi, (void*)get_testvm(), VMI_INIT_DOMAINNAME, NULL,
+                      VMI_CONFIG_GLOBAL_FILE_ENTRY, NULL, NULL);
+    vmi_pause_vm(vmi);
+
+    fail_unless(VMI_SUCCESS == vmi_get_modules(vmi, 0, NULL, &list),
+                "vmi_get_modules failed");
+
+    for (i = 0; i < list->count; i++) {
+        addr_t base = 0;
+        const char *name = NULL;
+
+        if (!list->modules[i].size)
+            continue;
+
+        fail_unless(VMI_SUCCESS == vmi_addr_to_module(vmi, 0, list->modules[i].base + list->modules[i].size - 1, &base, &name),
+                    "vmi_addr_to_module failed");
+        fail_unless(base == list->modules[i].base, "wrong module base");
+        fail_unless(!strcmp(name, list->modules[i].name), "wrong module name");
+    }
+
+    vmi_free_module_list(list);
+
+    /* the Linux kernel text has an entry of its own */
+    if (VMI_OS_LINUX == vmi_get_ostype(vmi)) {
+        addr_t stext = 0;
+        const char *name = NULL;
+
+        fail_unless(VMI_SUCCESS == vmi_translate_ksym2v(vmi, "_stext", &stext), "_stext not found");
+        fail_unless(VMI_SUCCESS == vmi_addr_to_module(vmi, 0, stext, NULL, &name),
+                    "kernel text not in the index");
+        fail_unless(!strcmp(name, "vmlinux"), "wrong kernel text name");
+    }
+
+    vmi_resume_vm(vmi);
+    vmi_destroy(vmi);
+}
+END_TEST
+
+/* module test cases */
+TCase *modules_tcase (void)
+{
+    TCase *tc_modules = tcase_create("LibVMI modules");
+    tcase_set_timeout(tc_modules, 30);
+    tcase_add_test(tc_modules, test_libvmi_get_modules);
+    tcase_add_test(tc_modules, test_libvmi_addr_to_module);
+    return tc_modules;
+}
@@ -0,0 +1,79 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <libvmi/libvmi.h>
+#include "check_tests.h"
+
+START_TEST (test_vmi_diff_pages)
+{
+    vmi_instance_t a = NULL, b = NULL;
+    char dir[] = "/tmp/libvmi-diff-XXXXXX";
+    char path_a[64], path_b[64];
+    vmi_init_data_t *init_data = malloc(sizeof(vmi_init_data_t) + sizeof(vmi_init_data_entry_t));
+    uint64_t bitmap = 0;
+    uint8_t value = 0;
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "a", 5, path_a, sizeof(path_a));
+    image_create(dir, "b", 5, path_b, sizeof(path_b));
+    image_fill(path_b, 3 * IMAGE_PAGE_SIZE + 100, 1, 0);
+
+    init_data->count = 1;
+    init_data->entry[0].type = VMI_INIT_DATA_FILE_PAGE_STORE;
+    init_data->entry[0].data = NULL;
+
+    fail_unless(VMI_SUCCESS == vmi_init(&a, VMI_FILE, path_a, VMI_INIT_DOMAINNAME, init_data, NULL),
+                "failed to open the first image");
+    fail_unless(VMI_SUCCESS == vmi_init(&b, VMI_FILE, path_b, VMI_INIT_DOMAINNAME, init_data, NULL),
+                "failed to open the second image");
+
+    /* the same pages are shared between the images */
+    fail_unless(VMI_SUCCESS == vmi_read_8_pa(a, 1 * IMAGE_PAGE_SIZE + 5, &value), "vmi_read_8_pa failed");
+    fail_unless(VMI_SUCCESS == vmi_read_8_pa(b, 1 * IMAGE_PAGE_SIZE + 5, &value), "vmi_read_8_pa failed");
+    fail_unless(value == IMAGE_FILL + 1, "wrong value read from a shared page");
+    fail_unless(VMI_SUCCESS == vmi_read_8_pa(b, 3 * IMAGE_PAGE_SIZE + 100, &value), "vmi_read_8_pa failed");
+    fail_unless(value == 0, "wrong value read from a changed page");
+
+    fail_unless(VMI_SUCCESS == vmi_diff_pages(a, b, &bitmap, 5), "vmi_diff_pages failed");
+    fail_unless(bitmap == 1ull << 3, "wrong pages reported as changed");
+
+    /* the first image is gone, its shared pages stay with the second */
+    vmi_destroy(a);
+    fail_unless(VMI_SUCCESS == vmi_read_8_pa(b, 1 * IMAGE_PAGE_SIZE + 5, &value), "vmi_read_8_pa failed");
+    fail_unless(value == IMAGE_FILL + 1, "wrong value read from a shared page");
+    vmi_destroy(b);
+
+    free(init_data);
+    image_dir_remove(dir);
+}
+END_TEST
+
+/* page store test cases */
+TCase *page_store_tcase (void)
+{
+    TCase *tc_page_store = tcase_create("LibVMI page store");
+    tcase_add_test(tc_page_store, test_vmi_diff_pages);
+    return tc_page_store;
+}
@@ -289,6 +289,162 @@ START_TEST (test_vmi_read_64_pa)
 }
 END_TEST
 
+/* fixed-width reads hitting the same page have to agree with vmi_read */
+START_TEST (test_vmi_read_64_same_page)
+{
+    vmi_instance_t vmi = NULL;
+    addr_t va = 0;
+    uint64_t buf[8];
+    uint64_t value = 0;
+    unsigned int i;
+    vmi_init_complete(&vmi, (void*)get_testvm(), VMI_INIT_DOMAINNAME, NULL,
+                      VMI_CONFIG_GLOBAL_FILE_ENTRY, NULL, NULL);
+    va = get_vaddr(vmi) & ~(addr_t)7;
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_PROCESS_PID,
+                   .pid = 0,
+                   .addr = va);
+    fail_unless(VMI_SUCCESS == vmi_read(vmi, &ctx, sizeof(buf), buf, NULL), "vmi_read failed");
+
+    for (i = 0; i < 8; i++) {
+        ctx.addr = va + i * sizeof(uint64_t);
+        fail_unless(VMI_SUCCESS == vmi_read_64(vmi, &ctx, &value), "vmi_read_64 failed");
+        fail_unless(value == buf[i], "vmi_read_64 returned a different value than vmi_read");
+
+        /* the next read must not use the dropped page */
+        if (i == 4) {
+            vmi_pagecache_flush(vmi);
+            vmi_v2pcache_flush(vmi, ~0ull);
+        }
+    }
+    vmi_destroy(vmi);
+}
+END_TEST
+
+START_TEST (test_vmi_read_handle)
+{
+    vmi_instance_t vmi = NULL;
+    access_handle_t handle;
+    uint64_t value = 0, expected = 0;
+    vmi_init_complete(&vmi, (void*)get_testvm(), VMI_INIT_DOMAINNAME, NULL,
+                      VMI_CONFIG_GLOBAL_FILE_ENTRY, NULL, NULL);
+    ACCESS_CONTEXT(ctx,
+                   .translate_mechanism = VMI_TM_KERNEL_SYMBOL,
+                   .ksym = get_sym(vmi));
+    fail_unless(VMI_SUCCESS == vmi_compile_access_context(vmi, &ctx, &handle),
+                "vmi_compile_access_context failed");
+    fail_unless(VMI_TM_PROCESS_DTB == handle.ctx.tm, "handle was not resolved");
+    fail_unless(VMI_SUCCESS == vmi_read_64_ksym(vmi, get_sym(vmi), &expected), "vmi_read_64_ksym failed");
+    fail_unless(VMI_SUCCESS == vmi_read_handle(vmi, &handle, sizeof(value), &value, NULL),
+                "vmi_read_handle failed");
+    fail_unless(value == expected, "vmi_read_handle returned a different value");
+
+    /* a flush invalidates the handle, the next read has to recompile it */
+    vmi_symcache_flush(vmi);
+    value = 0;
+    fail_unless(VMI_SUCCESS == vmi_read_handle(vmi, &handle, sizeof(value), &value, NULL),
+                "vmi_read_handle failed after a cache flush");
+    fail_unless(value == expected, "vmi_read_handle returned a different value after a cache flush");
+    vmi_destroy(vmi);
+}
+END_TEST
+
+START_TEST (test_vmi_read_struct)
+{
+    vmi_instance_t vmi = NULL;
+    struct_view_t view = { 0 };
+    const char *struct_name = NULL, *member = NULL;
+    addr_t addr = 0, offset = 0;
+    uint32_t value = 0, expected = 0;
+    vmi_init_complete(&vmi, (void*)get_testvm(), VMI_INIT_DOMAINNAME, NULL,
+                      VMI_CONFIG_GLOBAL_FILE_ENTRY, NULL, NULL);
+    switch (vmi_get_ostype(vmi)) {
+        case VMI_OS_LINUX:
+            struct_name = "task_struct";
+            member = "pid";
+            vmi_translate_ksym2v(vmi, "init_task", &addr);
+            break;
+        case VMI_OS_WINDOWS:
+            struct_name = "_EPROCESS";
+            member = "UniqueProcessId";
+            vmi_read_addr_ksym(vmi, "PsInitialSystemProcess", &addr);
+            break;
+        default:
+            break;
+    }
+
+    if (struct_name && addr &&
+            VMI_SUCCESS == vmi_get_kernel_struct_offset(vmi, struct_name, member, &offset)) {
+        struct_field_t field = { .member = member, .size = sizeof(value) };
+        ACCESS_CONTEXT(ctx,
+                       .translate_mechanism = VMI_TM_PROCESS_PID,
+                       .pid = 0,
+                       .addr = addr);
+
+        fail_unless(VMI_SUCCESS == vmi_read_32_va(vmi, addr + offset, 0, &expected), "vmi_read_32_va failed");
+
+        fail_unless(VMI_SUCCESS == vmi_read_struct(vmi, &ctx, struct_name, &view), "vmi_read_struct failed");
+        fail_unless(VMI_SUCCESS == vmi_struct_read_32(vmi, &view, member, &value), "vmi_struct_read_32 failed");
+        fail_unless(value == expected, "vmi_read_struct returned a different value");
+        fail_unless(NULL == vmi_struct_field(vmi, &view, "no_such_member", 1), "unknown member was found");
+
+        value = 0;
+        fail_unless(VMI_SUCCESS == vmi_read_struct_fields(vmi, &ctx, struct_name, &field, 1, &view),
+                    "vmi_read_struct_fields failed");
+        fail_unless(view.len == sizeof(value), "vmi_read_struct_fields read more than needed");
+        fail_unless(VMI_SUCCESS == vmi_struct_read_32(vmi, &view, member, &value), "vmi_struct_read_32 failed");
+        fail_unless(value == expected, "vmi_read_struct_fields returned a different value");
+
+        vmi_free_struct_view(&view);
+    }
+    vmi_destroy(vmi);
+}
+END_TEST
+
+START_TEST (test_vmi_walk_list)
+{
+    vmi_instance_t vmi = NULL;
+    list_walk_t *list = NULL;
+    addr_t head = 0, tasks_offset = 0;
+    bool head_is_node = false;
+    vmi_init_complete(&vmi, (void*)get_testvm(), VMI_INIT_DOMAINNAME, NULL,
+                      VMI_CONFIG_GLOBAL_FILE_ENTRY, NULL, NULL);
+    switch (vmi_get_ostype(vmi)) {
+        case VMI_OS_LINUX:
+            vmi_get_offset(vmi, "linux_tasks", &tasks_offset);
+            vmi_translate_ksym2v(vmi, "init_task", &head);
+            head += tasks_offset;
+            head_is_node = true;
+            break;
+        case VMI_OS_WINDOWS:
+            vmi_get_offset(vmi, "win_tasks", &tasks_offset);
+            vmi_translate_ksym2v(vmi, "PsActiveProcessHead", &head);
+            break;
+        default:
+            break;
+    }
+
+    if (head && tasks_offset) {
+        ACCESS_CONTEXT(ctx,
+                       .translate_mechanism = VMI_TM_PROCESS_PID,
+                       .pid = 0,
+                       .addr = head);
+
+        fail_unless(VMI_SUCCESS == vmi_walk_list(vmi, &ctx, tasks_offset, head_is_node, NULL, 0, 0, &list),
+                    "vmi_walk_list failed");
+        fail_unless(VMI_LIST_WALK_COMPLETE == list->end, "process list walk did not complete");
+        fail_unless(list->count > 0, "process list walk found no processes");
+        vmi_free_list_walk(list);
+
+        fail_unless(VMI_SUCCESS == vmi_walk_list(vmi, &ctx, tasks_offset, head_is_node, NULL, 0, 1, &list),
+                    "vmi_walk_list failed");
+        fail_unless(list->count == 1, "vmi_walk_list ignored the node limit");
+        vmi_free_list_walk(list);
+    }
+    vmi_destroy(vmi);
+}
+END_TEST
+
 /* read test cases */
 TCase *read_tcase (void)
 {
@@ -321,5 +477,10 @@ TCase *read_tcase (void)
     // vmi_read_addr_pa
     // vmi_read_str_pa
 
+    tcase_add_test(tc_read, test_vmi_read_64_same_page);
+    tcase_add_test(tc_read, test_vmi_read_handle);
+    tcase_add_test(tc_read, test_vmi_read_struct);
+    tcase_add_test(tc_read, test_vmi_walk_list);
+
     return tc_read;
 }
@@ -0,0 +1,82 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <libvmi/libvmi.h>
+#include "check_tests.h"
+
+static void
+check_regions(
+    vmi_instance_t vmi,
+    vmi_pid_t pid)
+{
+    vm_region_list_t *list = NULL;
+    size_t i;
+
+    fail_unless(VMI_SUCCESS == vmi_get_regions(vmi, pid, &list),
+                "vmi_get_regions failed");
+    fail_unless(list->count > 0, "region list is empty");
+
+    for (i = 0; i < list->count; i++) {
+        const vm_region_t *region = &list->regions[i];
+
+        fail_unless(region->start < region->end, "empty region");
+        fail_unless(!i || list->regions[i - 1].end <= region->start, "regions overlap");
+        fail_unless(vmi_find_region(list, region->start) == region, "start not found");
+        fail_unless(vmi_find_region(list, region->end - 1) == region, "end not found");
+    }
+
+    fail_unless(vmi_find_region(list, list->regions[0].start - 1) == NULL,
+                "address below the first region found");
+
+    vmi_free_region_list(list);
+}
+
+START_TEST (test_libvmi_get_regions)
+{
+    vmi_instance_t vmi = NULL;
+
+    vmi_init_complete(&vmi, (void*)get_testvm(), VMI_INIT_DOMAINNAME, NULL,
+                      VMI_CONFIG_GLOBAL_FILE_ENTRY, NULL, NULL);
+    vmi_pause_vm(vmi);
+
+    /* init and System are the processes we can count on */
+    if (VMI_OS_LINUX == vmi_get_ostype(vmi))
+        check_regions(vmi, 1);
+    else if (VMI_OS_WINDOWS == vmi_get_ostype(vmi))
+        check_regions(vmi, 4);
+
+    vmi_resume_vm(vmi);
+    vmi_destroy(vmi);
+}
+END_TEST
+
+/* region test cases */
+TCase *regions_tcase (void)
+{
+    TCase *tc_regions = tcase_create("LibVMI regions");
+    tcase_set_timeout(tc_regions, 30);
+    tcase_add_test(tc_regions, test_libvmi_get_regions);
+    return tc_regions;
+}
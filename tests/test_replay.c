@@ -0,0 +1,597 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <libvmi/libvmi.h>
+#include <libvmi/events.h>
+#include "../libvmi/private.h"
+#include "check_tests.h"
+
+/* what the callbacks saw, in order */
+static struct {
+    unsigned int count;
+    struct {
+        const vmi_event_t *event;
+        vmi_mem_access_t in_access;
+        vmi_mem_access_t out_access;
+        addr_t gfn;
+        uint64_t rip;
+        uint8_t value;      /* read at offset 5 of pfn 1 */
+    } seen[16];
+} replayed;
+
+static event_response_t
+replay_cb(vmi_instance_t vmi, vmi_event_t *event)
+{
+    unsigned int i = replayed.count++;
+
+    fail_unless(i < 16, "too many events replayed");
+    replayed.seen[i].event = event;
+    replayed.seen[i].in_access = event->mem_event.in_access;
+    replayed.seen[i].out_access = event->mem_event.out_access;
+    replayed.seen[i].gfn = event->mem_event.gfn;
+    replayed.seen[i].rip = event->x86_regs ? event->x86_regs->rip : 0;
+    fail_unless(VMI_SUCCESS == vmi_read_8_pa(vmi, IMAGE_PAGE_SIZE + 5, &replayed.seen[i].value),
+                "failed to read in the callback");
+
+    return VMI_EVENT_RESPONSE_NONE;
+}
+
+static void
+trace_mem(FILE *trace, vmi_mem_access_t in_access, vmi_mem_access_t out_access, addr_t gfn, uint64_t rip,
+          uint8_t generic)
+{
+    vmi_event_t event = { 0 };
+    x86_registers_t regs = { .rip = rip };
+
+    SETUP_MEM_EVENT(&event, gfn, in_access, NULL, generic);
+    event.mem_event.gfn = gfn;
+    event.mem_event.out_access = out_access;
+    trace_event(trace, &event, rip ? &regs : NULL);
+    trace_response(trace, VMI_EVENT_RESPONSE_NONE);
+}
+
+/* a memory access as the Xen driver hands it to the handler registered for in_access */
+static void
+trace_mem_access(FILE *trace, vmi_mem_access_t in_access, vmi_mem_access_t out_access, addr_t gfn, uint64_t rip)
+{
+    vmi_event_t event = { 0 };
+    x86_registers_t regs = { .rip = rip };
+
+    SETUP_MEM_EVENT(&event, gfn, in_access, NULL, 1);
+    event.mem_event.gfn = gfn;
+    event.mem_event.out_access = out_access;
+    trace_event(trace, &event, rip ? &regs : NULL);
+}
+
+static void
+replay_all(vmi_instance_t vmi)
+{
+    memset(&replayed, 0, sizeof(replayed));
+    while (vmi_are_events_pending(vmi) > 0)
+        fail_unless(VMI_SUCCESS == vmi_events_listen(vmi, 0), "vmi_events_listen failed");
+}
+
+/* an access matching two generic handlers is replayed to each in the order recorded */
+START_TEST (test_vmi_replay_generic)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_event_t read_event = { 0 }, write_event = { 0 };
+    char dir[] = "/tmp/libvmi-replay-XXXXXX";
+    char image[64], path[64];
+    FILE *trace;
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "image", 5, image, sizeof(image));
+
+    trace = trace_create(dir, "image", 5, path, sizeof(path));
+    trace_mem_access(trace, VMI_MEMACCESS_W, VMI_MEMACCESS_RW, 2, 0x1000);
+    trace_page(trace, 1, 0xaa);
+    trace_response(trace, VMI_EVENT_RESPONSE_NONE);
+    trace_mem_access(trace, VMI_MEMACCESS_R, VMI_MEMACCESS_RW, 2, 0x1000);
+    trace_response(trace, VMI_EVENT_RESPONSE_NONE);
+    trace_mem_access(trace, VMI_MEMACCESS_R, VMI_MEMACCESS_R, 3, 0x2000);
+    trace_page(trace, 1, 0xbb);
+    trace_response(trace, VMI_EVENT_RESPONSE_NONE);
+    fclose(trace);
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS, NULL, NULL),
+                "failed to open the trace");
+
+    SETUP_MEM_EVENT(&read_event, 0, VMI_MEMACCESS_R, replay_cb, 1);
+    SETUP_MEM_EVENT(&write_event, 0, VMI_MEMACCESS_W, replay_cb, 1);
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &read_event), "failed to register the read event");
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &write_event), "failed to register the write event");
+
+    replay_all(vmi);
+
+    fail_unless(replayed.count == 3, "%u events replayed instead of 3", replayed.count);
+    fail_unless(replayed.seen[0].in_access == VMI_MEMACCESS_W, "first event replayed to the wrong handler");
+    fail_unless(replayed.seen[1].in_access == VMI_MEMACCESS_R, "second event replayed to the wrong handler");
+    fail_unless(replayed.seen[2].in_access == VMI_MEMACCESS_R, "third event replayed to the wrong handler");
+    fail_unless(replayed.seen[0].out_access == VMI_MEMACCESS_RW && replayed.seen[0].gfn == 2 &&
+                replayed.seen[0].rip == 0x1000, "wrong contents for the first event");
+    fail_unless(replayed.seen[2].out_access == VMI_MEMACCESS_R && replayed.seen[2].gfn == 3 &&
+                replayed.seen[2].rip == 0x2000, "wrong contents for the third event");
+
+    /* the pages are the ones recorded with each event, or the last ones recorded */
+    fail_unless(replayed.seen[0].value == 0xaa, "wrong page read in the first event");
+    fail_unless(replayed.seen[1].value == 0xaa, "wrong page read in the second event");
+    fail_unless(replayed.seen[2].value == 0xbb, "wrong page read in the third event");
+
+    vmi_clear_event(vmi, &read_event, NULL);
+    vmi_clear_event(vmi, &write_event, NULL);
+    vmi_destroy(vmi);
+    image_dir_remove(dir);
+}
+END_TEST
+
+/* overlapping ranges are merged, every field tested must be in range */
+START_TEST (test_vmi_replay_filter)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_event_t event = { 0 };
+    char dir[] = "/tmp/libvmi-replay-XXXXXX";
+    char image[64], path[64];
+    vmi_filter_rule_t rules[] = {
+        { .field = VMI_FILTER_GFN, .lo = 10, .hi = 10 },
+        { .field = VMI_FILTER_GFN, .lo = 2, .hi = 5 },
+        { .field = VMI_FILTER_REGISTER, .reg = RIP, .lo = 0x1000, .hi = 0x1fff },
+        { .field = VMI_FILTER_GFN, .lo = 1, .hi = 3 },
+        { .field = VMI_FILTER_GFN, .lo = 6, .hi = 6 },
+    };
+    addr_t gfns[] = { 0, 1, 5, 6, 7, 9, 10, 11, 3, 3 };
+    uint64_t rips[] = { 0x1000, 0x1000, 0x1fff, 0x1000, 0x1000, 0x1000, 0, 0x1000, 0x2000, 0xfff };
+    addr_t passed[] = { 1, 5, 6, 10 };
+    FILE *trace;
+    unsigned int i;
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "image", 16, image, sizeof(image));
+
+    trace = trace_create(dir, "image", 16, path, sizeof(path));
+    for (i = 0; i < sizeof(gfns) / sizeof(gfns[0]); i++) {
+        trace_mem_access(trace, VMI_MEMACCESS_X, VMI_MEMACCESS_X, gfns[i], rips[i]);
+        trace_response(trace, VMI_EVENT_RESPONSE_NONE);
+    }
+    fclose(trace);
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS, NULL, NULL),
+                "failed to open the trace");
+
+    SETUP_MEM_EVENT(&event, 0, VMI_MEMACCESS_X, replay_cb, 1);
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &event), "failed to register the event");
+    fail_unless(VMI_FAILURE == vmi_event_set_filter(vmi, &event,
+                &(vmi_filter_rule_t) { .field = VMI_FILTER_REG_VALUE, .lo = 0, .hi = 1 }, 1),
+                "a register event rule was accepted for a memory event");
+    fail_unless(VMI_SUCCESS == vmi_event_set_filter(vmi, &event, rules, sizeof(rules) / sizeof(rules[0])),
+                "vmi_event_set_filter failed");
+
+    /* gfn 10 has no registers, the RIP rule can't hold it back */
+    replay_all(vmi);
+
+    fail_unless(replayed.count == sizeof(passed) / sizeof(passed[0]), "%u events let through instead of %zu",
+                replayed.count, sizeof(passed) / sizeof(passed[0]));
+    for (i = 0; i < replayed.count; i++)
+        fail_unless(replayed.seen[i].gfn == passed[i], "gfn %"PRIu64" let through instead of %"PRIu64,
+                    replayed.seen[i].gfn, passed[i]);
+
+    /* without the filter everything goes through */
+    fail_unless(VMI_SUCCESS == vmi_event_set_filter(vmi, &event, NULL, 0), "failed to remove the filter");
+    vmi_destroy(vmi);
+
+    vmi = NULL;
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS, NULL, NULL),
+                "failed to open the trace");
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &event), "failed to register the event");
+    replay_all(vmi);
+    fail_unless(replayed.count == sizeof(gfns) / sizeof(gfns[0]), "events were filtered without a filter");
+
+    vmi_clear_event(vmi, &event, NULL);
+    vmi_destroy(vmi);
+    image_dir_remove(dir);
+}
+END_TEST
+
+/* dropped accesses are emulated without a callback, the others still arrive */
+START_TEST (test_vmi_replay_filter_dropped)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_event_t event = { 0 }, step = { 0 };
+    char dir[] = "/tmp/libvmi-replay-XXXXXX";
+    char image[64], path[64];
+    vmi_filter_rule_t rule = { .field = VMI_FILTER_GFN, .lo = 3, .hi = 3 };
+    addr_t gfns[] = { 2, 3, 2, 2, 3 };
+    FILE *trace;
+    unsigned int i;
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "image", 5, image, sizeof(image));
+
+    /* as a live run with the filter records it, the dropped accesses emulated */
+    trace = trace_create(dir, "image", 5, path, sizeof(path));
+    for (i = 0; i < sizeof(gfns) / sizeof(gfns[0]); i++) {
+        trace_mem_access(trace, VMI_MEMACCESS_W, VMI_MEMACCESS_W, gfns[i], 0x1000 + i);
+        trace_response(trace, gfns[i] == 3 ? VMI_EVENT_RESPONSE_NONE : VMI_EVENT_RESPONSE_EMULATE);
+    }
+    fclose(trace);
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS, NULL, NULL),
+                "failed to open the trace");
+
+    SETUP_MEM_EVENT(&event, 0, VMI_MEMACCESS_W, replay_cb, 1);
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &event), "failed to register the event");
+    fail_unless(VMI_SUCCESS == vmi_event_set_filter(vmi, &event, &rule, 1), "vmi_event_set_filter failed");
+
+    /* only memory, register and INT3 events can be answered without a callback */
+    SETUP_SINGLESTEP_EVENT(&step, 1, replay_cb, 0);
+    fail_unless(VMI_FAILURE == vmi_event_set_filter(vmi, &step, &rule, 1),
+                "a filter was accepted for a singlestep event");
+
+    replay_all(vmi);
+
+    fail_unless(replayed.count == 2, "%u events let through instead of 2", replayed.count);
+    fail_unless(replayed.seen[0].gfn == 3 && replayed.seen[0].rip == 0x1001, "wrong first event let through");
+    fail_unless(replayed.seen[1].gfn == 3 && replayed.seen[1].rip == 0x1004, "wrong second event let through");
+    fail_unless(vmi_are_events_pending(vmi) == 0, "the replay stopped at a dropped access");
+
+    vmi_clear_event(vmi, &event, NULL);
+    vmi_destroy(vmi);
+    image_dir_remove(dir);
+}
+END_TEST
+
+static event_response_t
+defer_cb(vmi_instance_t vmi, vmi_event_t *event)
+{
+    replay_cb(vmi, event);
+    return VMI_EVENT_RESPONSE_DEFER;
+}
+
+static void
+pop_deferred(vmi_instance_t vmi, addr_t first, unsigned int count)
+{
+    vmi_deferred_event_t deferred;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        fail_unless(VMI_SUCCESS == vmi_event_pop_deferred(vmi, 0, &deferred), "deferred event %u missing", i);
+        fail_unless(deferred.event.mem_event.gfn == first + i, "deferred events out of order");
+        fail_unless(deferred.event.x86_regs == &deferred.regs.x86, "deferred event registers not its own");
+        fail_unless(deferred.regs.x86.rip == 0x1000 + first + i, "wrong registers for a deferred event");
+        fail_unless(VMI_SUCCESS == vmi_event_respond(vmi, &deferred, VMI_EVENT_RESPONSE_NONE),
+                    "vmi_event_respond failed");
+    }
+
+    fail_unless(VMI_FAILURE == vmi_event_pop_deferred(vmi, 0, &deferred), "deferred event left over");
+}
+
+/* the queues of a vCPU hold four events, in order, across wraparounds */
+START_TEST (test_vmi_replay_defer)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_event_t event = { 0 };
+    vmi_deferred_event_t deferred;
+    char dir[] = "/tmp/libvmi-replay-XXXXXX";
+    char image[64], path[64];
+    FILE *trace;
+    unsigned int i;
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "image", 2, image, sizeof(image));
+
+    trace = trace_create(dir, "image", 2, path, sizeof(path));
+    for (i = 0; i < 12; i++) {
+        trace_mem_access(trace, VMI_MEMACCESS_W, VMI_MEMACCESS_W, i, 0x1000 + i);
+        trace_response(trace, VMI_EVENT_RESPONSE_DEFER);
+    }
+    fclose(trace);
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS, NULL, NULL),
+                "failed to open the trace");
+    fail_unless(VMI_FAILURE == vmi_event_pop_deferred(vmi, 0, &deferred), "deferred event before any callback");
+
+    SETUP_MEM_EVENT(&event, 0, VMI_MEMACCESS_W, defer_cb, 1);
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &event), "failed to register the event");
+    memset(&replayed, 0, sizeof(replayed));
+
+    /* a full queue drops the fifth event */
+    for (i = 0; i < 5; i++)
+        fail_unless(VMI_SUCCESS == vmi_events_listen(vmi, 0), "vmi_events_listen failed");
+    pop_deferred(vmi, 0, 4);
+
+    /* the responses fill their queue until the listen thread takes them */
+    deferred.event = event;
+    fail_unless(VMI_FAILURE == vmi_event_respond(vmi, &deferred, VMI_EVENT_RESPONSE_NONE),
+                "response queued to a full queue");
+
+    /* both queues wrap around */
+    for (i = 0; i < 3; i++)
+        fail_unless(VMI_SUCCESS == vmi_events_listen(vmi, 0), "vmi_events_listen failed");
+    pop_deferred(vmi, 5, 3);
+
+    for (i = 0; i < 4; i++)
+        fail_unless(VMI_SUCCESS == vmi_events_listen(vmi, 0), "vmi_events_listen failed");
+    pop_deferred(vmi, 8, 4);
+
+    fail_unless(VMI_SUCCESS == vmi_events_listen(vmi, 0), "vmi_events_listen failed");
+    fail_unless(replayed.count == 12, "%u callbacks instead of 12", replayed.count);
+
+    vmi_clear_event(vmi, &event, NULL);
+    vmi_destroy(vmi);
+    image_dir_remove(dir);
+}
+END_TEST
+
+static vmi_event_t late_event;
+
+/* registers a generic handler while the handlers of the access are walked */
+static event_response_t
+register_cb(vmi_instance_t vmi, vmi_event_t *event)
+{
+    replay_cb(vmi, event);
+    if (!late_event.callback) {
+        SETUP_MEM_EVENT(&late_event, 0, VMI_MEMACCESS_X, replay_cb, 1);
+        fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &late_event), "failed to register in a callback");
+    }
+    return VMI_EVENT_RESPONSE_NONE;
+}
+
+/* page handlers through the radix index, above it and after clear and swap */
+START_TEST (test_vmi_replay_mem_index)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_event_t low = { 0 }, other_leaf = { 0 }, deep = { 0 }, high = { 0 }, swapped = { 0 };
+    const addr_t high_gfn = (1ull << 40) + 7;
+    char dir[] = "/tmp/libvmi-replay-XXXXXX";
+    char image[64], path[64];
+    FILE *trace;
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "image", 2, image, sizeof(image));
+
+    trace = trace_create(dir, "image", 2, path, sizeof(path));
+    trace_mem(trace, VMI_MEMACCESS_RW, VMI_MEMACCESS_W, 1, 0, 0);
+    trace_mem(trace, VMI_MEMACCESS_RW, VMI_MEMACCESS_W, 2, 0, 0);          /* no handler */
+    trace_mem(trace, VMI_MEMACCESS_R, VMI_MEMACCESS_R, 0x200, 0, 0);
+    trace_mem(trace, VMI_MEMACCESS_X, VMI_MEMACCESS_X, 0x12345678, 0, 0);
+    trace_mem(trace, VMI_MEMACCESS_W, VMI_MEMACCESS_W, high_gfn, 0, 0);
+    trace_mem(trace, VMI_MEMACCESS_RW, VMI_MEMACCESS_X, 1, 0, 0);          /* access not watched */
+    /* after clearing gfn 1 and swapping gfn 0x200 */
+    trace_mem(trace, VMI_MEMACCESS_RW, VMI_MEMACCESS_W, 1, 0, 0);
+    trace_mem(trace, VMI_MEMACCESS_W, VMI_MEMACCESS_W, 0x200, 0, 0);
+    trace_mem(trace, VMI_MEMACCESS_W, VMI_MEMACCESS_W, high_gfn, 0, 0);
+    fclose(trace);
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS, NULL, NULL),
+                "failed to open the trace");
+
+    SETUP_MEM_EVENT(&low, 1, VMI_MEMACCESS_RW, replay_cb, 0);
+    SETUP_MEM_EVENT(&other_leaf, 0x200, VMI_MEMACCESS_R, replay_cb, 0);
+    SETUP_MEM_EVENT(&deep, 0x12345678, VMI_MEMACCESS_X, replay_cb, 0);
+    SETUP_MEM_EVENT(&high, high_gfn, VMI_MEMACCESS_W, replay_cb, 0);
+    SETUP_MEM_EVENT(&swapped, 0x200, VMI_MEMACCESS_W, replay_cb, 0);
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &low), "failed to register on gfn 1");
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &other_leaf), "failed to register on gfn 0x200");
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &deep), "failed to register on gfn 0x12345678");
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &high), "failed to register above the index");
+    fail_unless(VMI_FAILURE == vmi_register_event(vmi, &swapped), "registered twice on a page");
+    fail_unless(vmi_get_mem_event(vmi, high_gfn, VMI_MEMACCESS_W) == &high, "wrong event above the index");
+
+    memset(&replayed, 0, sizeof(replayed));
+    while (replayed.count < 4)
+        fail_unless(VMI_SUCCESS == vmi_events_listen(vmi, 0), "vmi_events_listen failed");
+    fail_unless(VMI_SUCCESS == vmi_events_listen(vmi, 0), "vmi_events_listen failed");
+
+    fail_unless(replayed.count == 4, "%u events replayed instead of 4", replayed.count);
+    fail_unless(replayed.seen[0].event == &low && replayed.seen[1].event == &other_leaf &&
+                replayed.seen[2].event == &deep && replayed.seen[3].event == &high,
+                "events replayed to the wrong handlers");
+
+    fail_unless(VMI_SUCCESS == vmi_clear_event(vmi, &low, NULL), "failed to clear gfn 1");
+    fail_unless(VMI_SUCCESS == vmi_swap_events(vmi, &other_leaf, &swapped, NULL), "failed to swap gfn 0x200");
+
+    replay_all(vmi);
+
+    fail_unless(replayed.count == 2, "%u events replayed instead of 2", replayed.count);
+    fail_unless(replayed.seen[0].event == &swapped, "swapped event not replayed to its replacement");
+    fail_unless(replayed.seen[1].event == &high, "event above the index lost");
+
+    vmi_clear_event(vmi, &swapped, NULL);
+    vmi_clear_event(vmi, &deep, NULL);
+    vmi_clear_event(vmi, &high, NULL);
+    vmi_destroy(vmi);
+    image_dir_remove(dir);
+}
+END_TEST
+
+/* generic handlers are found through the accesses they match */
+START_TEST (test_vmi_replay_mem_access)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_event_t r = { 0 }, w = { 0 }, rw = { 0 };
+    char dir[] = "/tmp/libvmi-replay-XXXXXX";
+    char image[64], path[64];
+    FILE *trace;
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "image", 2, image, sizeof(image));
+
+    trace = trace_create(dir, "image", 2, path, sizeof(path));
+    trace_mem(trace, VMI_MEMACCESS_W, VMI_MEMACCESS_W, 1, 0, 1);
+    trace_mem(trace, VMI_MEMACCESS_RW, VMI_MEMACCESS_W, 1, 0, 1);
+    trace_mem(trace, VMI_MEMACCESS_RW, VMI_MEMACCESS_X, 1, 0, 1);      /* RW does not match X */
+    trace_mem(trace, VMI_MEMACCESS_R, VMI_MEMACCESS_RW, 1, 0, 1);
+    trace_mem(trace, VMI_MEMACCESS_R, VMI_MEMACCESS_W, 1, 0, 1);       /* R does not match W */
+    trace_mem(trace, VMI_MEMACCESS_X, VMI_MEMACCESS_X, 1, 0, 1);       /* registered by the W callback */
+    fclose(trace);
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS, NULL, NULL),
+                "failed to open the trace");
+
+    memset(&late_event, 0, sizeof(late_event));
+    SETUP_MEM_EVENT(&r, 0, VMI_MEMACCESS_R, replay_cb, 1);
+    SETUP_MEM_EVENT(&w, 0, VMI_MEMACCESS_W, register_cb, 1);
+    SETUP_MEM_EVENT(&rw, 0, VMI_MEMACCESS_RW, replay_cb, 1);
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &r), "failed to register R");
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &w), "failed to register W");
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &rw), "failed to register RW");
+
+    replay_all(vmi);
+
+    fail_unless(replayed.count == 4, "%u events replayed instead of 4", replayed.count);
+    fail_unless(replayed.seen[0].event == &w && replayed.seen[1].event == &rw &&
+                replayed.seen[2].event == &r && replayed.seen[3].event == &late_event,
+                "events replayed to the wrong handlers");
+
+    vmi_clear_event(vmi, &late_event, NULL);
+    fail_unless(VMI_SUCCESS == vmi_clear_event(vmi, &rw, NULL), "failed to clear RW");
+    fail_unless(vmi_get_mem_event(vmi, ~0ull, VMI_MEMACCESS_RW) == NULL, "RW still registered");
+    fail_unless(vmi_get_mem_event(vmi, ~0ull, VMI_MEMACCESS_R) == &r, "R lost with RW");
+
+    vmi_clear_event(vmi, &r, NULL);
+    vmi_clear_event(vmi, &w, NULL);
+    vmi_destroy(vmi);
+    image_dir_remove(dir);
+}
+END_TEST
+
+/* the CR3 writes a switch callback saw */
+static struct {
+    unsigned int count;
+    uint32_t vcpu[16];
+    reg_t value[16];
+} switched;
+
+static event_response_t
+switch_cb(vmi_instance_t vmi, vmi_event_t *event)
+{
+    (void)vmi;
+
+    fail_unless(switched.count < 16, "too many switches replayed");
+    switched.vcpu[switched.count] = event->vcpu_id;
+    switched.value[switched.count] = event->reg_event.value;
+    switched.count++;
+
+    return VMI_EVENT_RESPONSE_NONE;
+}
+
+/* recorded without onswitch, so only the handler's setting can drop them */
+static void
+trace_cr3(FILE *trace, uint32_t vcpu, reg_t value)
+{
+    vmi_event_t event = { 0 };
+
+    SETUP_REG_EVENT(&event, CR3, VMI_REGACCESS_W, 0, NULL);
+    event.vcpu_id = vcpu;
+    event.reg_event.value = value;
+    trace_event(trace, &event, NULL);
+    trace_response(trace, VMI_EVENT_RESPONSE_NONE);
+}
+
+static void
+replay_switches(const char *path, bool kpti)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_event_t event = { 0 };
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS, NULL, NULL),
+                "failed to open the trace");
+
+    /* as the Linux init finds it for a kernel with KPTI */
+    vmi->kpti = kpti;
+
+    SETUP_REG_EVENT(&event, CR3, VMI_REGACCESS_W, 0, switch_cb);
+    event.reg_event.onswitch = 1;
+    fail_unless(VMI_SUCCESS == vmi_register_event(vmi, &event), "failed to register the CR3 event");
+
+    memset(&switched, 0, sizeof(switched));
+    while (vmi_are_events_pending(vmi) > 0)
+        fail_unless(VMI_SUCCESS == vmi_events_listen(vmi, 0), "vmi_events_listen failed");
+
+    fail_unless(event.reg_event.onswitch && event.reg_event.reg == CR3,
+                "the replay overwrote the handler's settings");
+
+    vmi_clear_event(vmi, &event, NULL);
+    vmi_destroy(vmi);
+}
+
+/* only writes moving a vCPU to another address space reach an onswitch handler */
+START_TEST (test_vmi_replay_onswitch)
+{
+    char dir[] = "/tmp/libvmi-replay-XXXXXX";
+    char image[64], path[64];
+    uint32_t vcpus[] = { 0, 1, 1, 0 };
+    reg_t values[] = { 0x1000, 0x1000, 0x2000, 0x2000 };
+    FILE *trace;
+    unsigned int i;
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "image", 2, image, sizeof(image));
+
+    trace = trace_create_vcpus(dir, "image", 2, 2, path, sizeof(path));
+    trace_cr3(trace, 0, 0x1000);
+    trace_cr3(trace, 0, 0x1000);                        /* the same value again */
+    trace_cr3(trace, 0, 0x1001);                        /* another PCID */
+    trace_cr3(trace, 0, 0x1002 | (1ull << 63));         /* a write without flush */
+    trace_cr3(trace, 1, 0x1000);                        /* new to vCPU 1 */
+    trace_cr3(trace, 1, 0x2000);
+    trace_cr3(trace, 0, 0x2000);
+    trace_cr3(trace, 0, 0x2001);
+    trace_cr3(trace, 0, 0x3000);                        /* the user tables of 0x2000 with KPTI */
+    fclose(trace);
+
+    replay_switches(path, false);
+
+    fail_unless(switched.count == 5, "%u switches without KPTI instead of 5", switched.count);
+    for (i = 0; i < 4; i++)
+        fail_unless(switched.vcpu[i] == vcpus[i] && switched.value[i] == values[i],
+                    "switch %u was vCPU %u to 0x%"PRIx64, i, switched.vcpu[i], switched.value[i]);
+    fail_unless(switched.vcpu[4] == 0 && switched.value[4] == 0x3000, "the last switch was lost");
+
+    /* a KPTI pair is one address space */
+    replay_switches(path, true);
+
+    fail_unless(switched.count == 4, "%u switches with KPTI instead of 4", switched.count);
+    for (i = 0; i < 4; i++)
+        fail_unless(switched.vcpu[i] == vcpus[i] && switched.value[i] == values[i],
+                    "switch %u was vCPU %u to 0x%"PRIx64, i, switched.vcpu[i], switched.value[i]);
+
+    image_dir_remove(dir);
+}
+END_TEST
+
+/* replay test cases */
+TCase *replay_tcase (void)
+{
+    TCase *tc_replay = tcase_create("LibVMI replay");
+    tcase_add_test(tc_replay, test_vmi_replay_generic);
+    tcase_add_test(tc_replay, test_vmi_replay_filter);
+    tcase_add_test(tc_replay, test_vmi_replay_filter_dropped);
+    tcase_add_test(tc_replay, test_vmi_replay_defer);
+    tcase_add_test(tc_replay, test_vmi_replay_mem_index);
+    tcase_add_test(tc_replay, test_vmi_replay_mem_access);
+    tcase_add_test(tc_replay, test_vmi_replay_onswitch);
+    return tc_replay;
+}
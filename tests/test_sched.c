@@ -0,0 +1,360 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <libvmi/libvmi.h>
+#include <libvmi/events.h>
+#include "check_tests.h"
+
+/*
+ * Instances replaying an empty trace never have events pending, so the
+ * scheduler only ever takes them for their tasks.
+ */
+struct sched_vm {
+    char dir[32];
+    vmi_instance_t vmi;
+};
+
+static void
+sched_vm_init(struct sched_vm *vm)
+{
+    char image[64], path[64];
+
+    strcpy(vm->dir, "/tmp/libvmi-sched-XXXXXX");
+    fail_unless(NULL != mkdtemp(vm->dir), "failed to create a temporary directory");
+    image_create(vm->dir, "image", 1, image, sizeof(image));
+    fclose(trace_create(vm->dir, "image", 1, path, sizeof(path)));
+
+    vm->vmi = NULL;
+    fail_unless(VMI_SUCCESS == vmi_init(&vm->vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS,
+                                        NULL, NULL), "failed to open the trace");
+}
+
+static void
+sched_vm_destroy(struct sched_vm *vm)
+{
+    vmi_destroy(vm->vmi);
+    image_dir_remove(vm->dir);
+}
+
+static uint64_t
+now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+static uint64_t
+cpu_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+}
+
+static volatile unsigned int burns;
+
+static void
+burn_task(vmi_instance_t vmi, void *data)
+{
+    uint64_t start = cpu_ms();
+
+    (void)vmi;
+    (void)data;
+
+    while (cpu_ms() - start < 20)
+        ;
+    burns++;
+}
+
+/* an instance over its quota pays for it from the next periods */
+START_TEST (test_libvmi_sched_quota)
+{
+    vmi_sched_params_t params = { .cpu_quota = 100 };
+    vmi_sched_stats_t stats = { 0 };
+    struct sched_vm vm;
+    vmi_scheduler_t sched;
+    uint64_t start, elapsed;
+
+    sched_vm_init(&vm);
+    burns = 0;
+
+    /* 5ms of CPU in each 50ms period, a single run of the task uses four */
+    sched = vmi_scheduler_create(1, 50);
+    fail_unless(NULL != sched, "failed to create the scheduler");
+    fail_unless(VMI_SUCCESS == vmi_scheduler_add(sched, vm.vmi, &params), "failed to add the instance");
+    start = now_ms();
+    fail_unless(VMI_SUCCESS == vmi_scheduler_add_task(sched, vm.vmi, 1, burn_task, NULL),
+                "failed to add the task");
+
+    usleep(500000);
+
+    fail_unless(VMI_SUCCESS == vmi_scheduler_get_stats(sched, vm.vmi, &stats), "failed to get the stats");
+    elapsed = now_ms() - start;
+    fail_unless(VMI_SUCCESS == vmi_scheduler_remove(sched, vm.vmi), "failed to remove the instance");
+    vmi_scheduler_destroy(sched);
+
+    fail_unless(stats.throttled > 0, "the instance was never throttled");
+    fail_unless(stats.cpu_ns >= 20000000, "the task's CPU time was not charged");
+
+    /*
+     * Over time it gets 10% of a CPU. Only the slice it is running may go
+     * past that, and the first slice, taken with the whole quota unused.
+     */
+    fail_unless(stats.cpu_ns <= elapsed * 100000 + 2 * 25000000,
+                "%"PRIu64"ms of CPU in %"PRIu64"ms with a 10%% quota", stats.cpu_ns / 1000000, elapsed);
+
+    sched_vm_destroy(&vm);
+}
+END_TEST
+
+#define SCHED_VMS 3
+
+static struct {
+    unsigned int count;
+    int order[SCHED_VMS];
+    volatile int blocked;
+} prio;
+
+/* holds the only worker until the others have been queued */
+static void
+block_task(vmi_instance_t vmi, void *data)
+{
+    (void)vmi;
+    (void)data;
+
+    if (!prio.blocked) {
+        prio.blocked = 1;
+        usleep(100000);
+    }
+}
+
+static void
+prio_task(vmi_instance_t vmi, void *data)
+{
+    int priority = (int)(intptr_t)data;
+    unsigned int i;
+
+    (void)vmi;
+
+    for (i = 0; i < prio.count; i++)
+        if (prio.order[i] == priority)
+            return;
+
+    if (prio.count < SCHED_VMS)
+        prio.order[prio.count++] = priority;
+}
+
+/* instances queued together are taken highest priority first */
+START_TEST (test_libvmi_sched_priority)
+{
+    struct sched_vm blocker, vms[SCHED_VMS];
+    vmi_sched_params_t params = { .priority = 10 };
+    vmi_scheduler_t sched;
+    int i;
+
+    memset(&prio, 0, sizeof(prio));
+    sched_vm_init(&blocker);
+    for (i = 0; i < SCHED_VMS; i++)
+        sched_vm_init(&vms[i]);
+
+    sched = vmi_scheduler_create(1, 1000);
+    fail_unless(NULL != sched, "failed to create the scheduler");
+    fail_unless(VMI_SUCCESS == vmi_scheduler_add(sched, blocker.vmi, &params), "failed to add the blocker");
+    fail_unless(VMI_SUCCESS == vmi_scheduler_add_task(sched, blocker.vmi, 5, block_task, NULL),
+                "failed to add the blocking task");
+
+    /* added lowest first, all due while the worker is blocked */
+    for (i = 0; i < SCHED_VMS; i++) {
+        params.priority = i + 1;
+        fail_unless(VMI_SUCCESS == vmi_scheduler_add(sched, vms[i].vmi, &params), "failed to add an instance");
+        fail_unless(VMI_SUCCESS == vmi_scheduler_add_task(sched, vms[i].vmi, 30, prio_task,
+                    (void *)(intptr_t)params.priority), "failed to add a task");
+    }
+
+    usleep(300000);
+
+    /* the workers are joined before the order is read */
+    vmi_scheduler_destroy(sched);
+
+    fail_unless(prio.blocked, "the blocking task never ran");
+    fail_unless(prio.count == SCHED_VMS, "only %u instances ran", prio.count);
+    for (i = 0; i < SCHED_VMS; i++)
+        fail_unless(prio.order[i] == SCHED_VMS - i, "priority %d ran in position %d",
+                    prio.order[i], i);
+
+    sched_vm_destroy(&blocker);
+    for (i = 0; i < SCHED_VMS; i++)
+        sched_vm_destroy(&vms[i]);
+}
+END_TEST
+
+static volatile int slow_started, slow_finished, slow_runs;
+
+static void
+slow_task(vmi_instance_t vmi, void *data)
+{
+    (void)vmi;
+    (void)data;
+
+    slow_started = 1;
+    usleep(100000);
+    slow_runs++;
+    slow_finished = 1;
+}
+
+/* removing an instance waits for its slice, and it isn't run again */
+START_TEST (test_libvmi_sched_remove_running)
+{
+    struct sched_vm vm;
+    vmi_scheduler_t sched;
+    vmi_sched_stats_t stats;
+    int runs, i;
+
+    sched_vm_init(&vm);
+    slow_started = slow_finished = slow_runs = 0;
+
+    sched = vmi_scheduler_create(2, 1000);
+    fail_unless(NULL != sched, "failed to create the scheduler");
+    fail_unless(VMI_SUCCESS == vmi_scheduler_add(sched, vm.vmi, NULL), "failed to add the instance");
+    fail_unless(VMI_SUCCESS == vmi_scheduler_add_task(sched, vm.vmi, 1, slow_task, NULL),
+                "failed to add the task");
+
+    for (i = 0; i < 1000 && !slow_started; i++)
+        usleep(1000);
+    fail_unless(slow_started, "the task never started");
+
+    fail_unless(VMI_SUCCESS == vmi_scheduler_remove(sched, vm.vmi), "failed to remove the instance");
+    fail_unless(slow_finished, "the instance was removed while its task was running");
+
+    runs = slow_runs;
+    usleep(50000);
+    fail_unless(slow_runs == runs, "the task ran after the instance was removed");
+    fail_unless(VMI_FAILURE == vmi_scheduler_remove(sched, vm.vmi), "the instance was removed twice");
+    fail_unless(VMI_FAILURE == vmi_scheduler_get_stats(sched, vm.vmi, &stats),
+                "a removed instance still has stats");
+
+    vmi_scheduler_destroy(sched);
+    sched_vm_destroy(&vm);
+}
+END_TEST
+
+#define SCHED_EVENTS 8
+
+static volatile unsigned int sched_events;
+
+static event_response_t
+sched_event_cb(vmi_instance_t vmi, vmi_event_t *event)
+{
+    (void)vmi;
+    (void)event;
+
+    sched_events++;
+    return VMI_EVENT_RESPONSE_NONE;
+}
+
+/* a worker replays the events of an instance queued behind a busy one */
+START_TEST (test_libvmi_sched_events)
+{
+    struct sched_vm blocker, vm;
+    vmi_event_t event = { 0 };
+    vmi_sched_stats_t stats = { 0 };
+    vmi_scheduler_t sched;
+    char image[64], path[64];
+    FILE *trace;
+    int i;
+
+    memset(&prio, 0, sizeof(prio));
+    sched_events = 0;
+    sched_vm_init(&blocker);
+
+    strcpy(vm.dir, "/tmp/libvmi-sched-XXXXXX");
+    fail_unless(NULL != mkdtemp(vm.dir), "failed to create a temporary directory");
+    image_create(vm.dir, "image", 2, image, sizeof(image));
+
+    trace = trace_create(vm.dir, "image", 2, path, sizeof(path));
+    for (i = 0; i < SCHED_EVENTS; i++) {
+        vmi_event_t recorded = { 0 };
+
+        SETUP_MEM_EVENT(&recorded, 1, VMI_MEMACCESS_W, NULL, 1);
+        recorded.mem_event.gfn = 1;
+        recorded.mem_event.out_access = VMI_MEMACCESS_W;
+        trace_event(trace, &recorded, NULL);
+        trace_response(trace, VMI_EVENT_RESPONSE_NONE);
+    }
+    fclose(trace);
+
+    vm.vmi = NULL;
+    fail_unless(VMI_SUCCESS == vmi_init(&vm.vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS,
+                                        NULL, NULL), "failed to open the trace");
+    SETUP_MEM_EVENT(&event, 0, VMI_MEMACCESS_W, sched_event_cb, 1);
+    fail_unless(VMI_SUCCESS == vmi_register_event(vm.vmi, &event), "failed to register the event");
+
+    sched = vmi_scheduler_create(1, 1000);
+    fail_unless(NULL != sched, "failed to create the scheduler");
+    fail_unless(VMI_SUCCESS == vmi_scheduler_add(sched, blocker.vmi, NULL), "failed to add the blocker");
+    fail_unless(VMI_SUCCESS == vmi_scheduler_add_task(sched, blocker.vmi, 5, block_task, NULL),
+                "failed to add the blocking task");
+
+    for (i = 0; i < 1000 && !prio.blocked; i++)
+        usleep(1000);
+    fail_unless(prio.blocked, "the blocking task never ran");
+
+    fail_unless(VMI_SUCCESS == vmi_scheduler_add(sched, vm.vmi, NULL), "failed to add the instance");
+
+    for (i = 0; i < 1000 && sched_events < SCHED_EVENTS; i++)
+        usleep(1000);
+
+    fail_unless(VMI_SUCCESS == vmi_scheduler_get_stats(sched, vm.vmi, &stats), "failed to get the stats");
+    fail_unless(VMI_SUCCESS == vmi_scheduler_remove(sched, vm.vmi), "failed to remove the instance");
+    vmi_scheduler_destroy(sched);
+
+    fail_unless(sched_events == SCHED_EVENTS, "%u of %u events replayed", sched_events, SCHED_EVENTS);
+    fail_unless(stats.slices > 0, "no slice was counted");
+    fail_unless(stats.delay_ns > 0 && stats.max_delay_ns > 0 && stats.max_delay_ns <= stats.delay_ns,
+                "the wait behind the blocker was not counted");
+    fail_unless(stats.cpu_ns > 0, "the slices were not charged");
+
+    vmi_clear_event(vm.vmi, &event, NULL);
+    sched_vm_destroy(&vm);
+    sched_vm_destroy(&blocker);
+}
+END_TEST
+
+/* scheduler test cases */
+TCase *sched_tcase (void)
+{
+    TCase *tc_sched = tcase_create("LibVMI scheduler");
+    tcase_set_timeout(tc_sched, 30);
+    tcase_add_test(tc_sched, test_libvmi_sched_quota);
+    tcase_add_test(tc_sched, test_libvmi_sched_priority);
+    tcase_add_test(tc_sched, test_libvmi_sched_remove_running);
+    tcase_add_test(tc_sched, test_libvmi_sched_events);
+    return tc_sched;
+}
@@ -0,0 +1,126 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <libvmi/libvmi.h>
+#include <libvmi/events.h>
+#include "check_tests.h"
+
+#define SYSCALLS_SEEN 64
+
+static struct {
+    unsigned int count;
+    vmi_syscall_t seen[SYSCALLS_SEEN];
+    char names[SYSCALLS_SEEN][64];
+} traced;
+
+static void
+syscall_cb(vmi_instance_t vmi, const vmi_syscall_t *syscall, void *data)
+{
+    (void)vmi;
+    (void)data;
+
+    if (traced.count == SYSCALLS_SEEN)
+        return;
+
+    traced.seen[traced.count] = *syscall;
+    snprintf(traced.names[traced.count], sizeof(traced.names[0]), "%s",
+             syscall->name ? syscall->name : "");
+    traced.seen[traced.count].name = syscall->name ? traced.names[traced.count] : NULL;
+    traced.count++;
+}
+
+/*
+ * The tracer needs a guest frame the guest does not use, given in
+ * LIBVMI_CHECK_SHADOW_GFN, the test is skipped without one.
+ */
+START_TEST (test_libvmi_syscall_trace)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_syscall_tracer_t tracer = NULL;
+    const char *shadow = getenv("LIBVMI_CHECK_SHADOW_GFN");
+    unsigned int i, j, named = 0, with_pid = 0, tries;
+
+    if (!shadow)
+        return;
+
+    vmi_init_complete(&vmi, (void*)get_testvm(), VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS, NULL,
+                      VMI_CONFIG_GLOBAL_FILE_ENTRY, NULL, NULL);
+    fail_unless(NULL != vmi, "failed to init the test VM with events");
+
+    memset(&traced, 0, sizeof(traced));
+    vmi_pause_vm(vmi);
+    fail_unless(VMI_SUCCESS == vmi_syscall_trace_start(vmi, strtoull(shadow, NULL, 0), syscall_cb, NULL, &tracer),
+                "vmi_syscall_trace_start failed");
+    vmi_resume_vm(vmi);
+
+    for (tries = 0; tries < 100 && traced.count < SYSCALLS_SEEN; tries++)
+        fail_unless(VMI_SUCCESS == vmi_events_listen(vmi, 100), "vmi_events_listen failed");
+
+    vmi_syscall_trace_stop(tracer);
+    fail_unless(traced.count > 0, "no syscall traced");
+
+    for (i = 0; i < traced.count; i++) {
+        const vmi_syscall_t *a = &traced.seen[i];
+
+        if (VMI_OS_LINUX == vmi_get_ostype(vmi))
+            fail_unless(a->nargs == VMI_SYSCALL_LINUX_ARGS, "wrong argument count for a Linux syscall");
+        else
+            fail_unless(a->nargs >= 4 && a->nargs <= VMI_SYSCALL_MAX_ARGS, "wrong argument count for a Windows syscall");
+
+        named += !!a->name;
+        with_pid += a->pid != -1;
+
+        /* the table and the DTB to pid cache give the same answers every time */
+        for (j = 0; j < i; j++) {
+            const vmi_syscall_t *b = &traced.seen[j];
+
+            if (a->number == b->number)
+                fail_unless((!a->name && !b->name) || (a->name && b->name && !strcmp(a->name, b->name)),
+                            "syscall %u resolved to two names", a->number);
+            if (a->dtb == b->dtb)
+                fail_unless(a->pid == b->pid, "DTB 0x%"PRIx64" resolved to two pids", a->dtb);
+        }
+    }
+
+    /* Windows names come from the symbols of a JSON profile */
+    if (VMI_OS_LINUX == vmi_get_ostype(vmi) || vmi_get_os_profile_path(vmi))
+        fail_unless(named > 0, "no syscall resolved from the syscall table");
+
+    /* with KVA shadowing Windows syscalls come in on a CR3 no process holds */
+    if (VMI_OS_LINUX == vmi_get_ostype(vmi))
+        fail_unless(with_pid > 0, "no syscall resolved to a process");
+
+    vmi_destroy(vmi);
+}
+END_TEST
+
+/* syscall tracer test cases */
+TCase *syscalls_tcase (void)
+{
+    TCase *tc_syscalls = tcase_create("LibVMI syscall tracer");
+    tcase_set_timeout(tc_syscalls, 60);
+    tcase_add_test(tc_syscalls, test_libvmi_syscall_trace);
+    return tc_syscalls;
+}
@@ -0,0 +1,188 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <libvmi/libvmi.h>
+#include <libvmi/events.h>
+#include "check_tests.h"
+
+static struct {
+    unsigned int count;
+    struct {
+        addr_t gfn;
+        vmi_mem_access_t in_access;
+    } seen[8];
+} armed;
+
+static event_response_t
+template_cb(vmi_instance_t vmi, vmi_event_t *event)
+{
+    unsigned int i = armed.count++;
+
+    (void)vmi;
+
+    fail_unless(i < 8, "too many events replayed");
+    armed.seen[i].gfn = event->mem_event.gfn;
+    armed.seen[i].in_access = event->mem_event.in_access;
+
+    return VMI_EVENT_RESPONSE_NONE;
+}
+
+static void
+trace_access(FILE *trace, addr_t gfn, vmi_mem_access_t in_access, vmi_mem_access_t out_access)
+{
+    vmi_event_t event = { 0 };
+
+    SETUP_MEM_EVENT(&event, gfn, in_access, NULL, 0);
+    event.mem_event.out_access = out_access;
+    trace_event(trace, &event, NULL);
+    trace_response(trace, VMI_EVENT_RESPONSE_NONE);
+}
+
+/* watches are kept sorted by gfn, a frame watched twice traps on either access */
+START_TEST (test_vmi_template_watch)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_event_template_t tmpl;
+    vmi_event_t mem_event = { 0 }, twice = { 0 }, *events = NULL;
+    char dir[] = "/tmp/libvmi-template-XXXXXX";
+    char image[64], path[64];
+    FILE *trace;
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "image", 5, image, sizeof(image));
+
+    trace = trace_create(dir, "image", 5, path, sizeof(path));
+    trace_access(trace, 4, VMI_MEMACCESS_RW, VMI_MEMACCESS_W);
+    trace_access(trace, 3, VMI_MEMACCESS_X, VMI_MEMACCESS_X);
+    trace_access(trace, 1, VMI_MEMACCESS_W, VMI_MEMACCESS_W);
+    fclose(trace);
+
+    tmpl = vmi_event_template_create();
+    fail_unless(NULL != tmpl, "failed to create the template");
+    fail_unless(VMI_SUCCESS == vmi_event_template_watch(tmpl, 4, VMI_MEMACCESS_R), "failed to watch gfn 4");
+    fail_unless(VMI_SUCCESS == vmi_event_template_watch(tmpl, 1, VMI_MEMACCESS_W), "failed to watch gfn 1");
+    fail_unless(VMI_SUCCESS == vmi_event_template_watch(tmpl, 3, VMI_MEMACCESS_X), "failed to watch gfn 3");
+    fail_unless(VMI_SUCCESS == vmi_event_template_watch(tmpl, 4, VMI_MEMACCESS_W), "failed to watch gfn 4 again");
+    fail_unless(VMI_SUCCESS == vmi_event_template_watch(tmpl, 1, VMI_MEMACCESS_W), "failed to watch gfn 1 again");
+    fail_unless(VMI_FAILURE == vmi_event_template_watch(tmpl, 4, VMI_MEMACCESS_W2X),
+                "W2X was combined with an earlier watch");
+    fail_unless(VMI_FAILURE == vmi_event_template_watch(tmpl, 5, VMI_MEMACCESS_N | VMI_MEMACCESS_R),
+                "N was combined with R");
+    fail_unless(vmi_event_template_watches(tmpl) == 3, "%zu watches instead of 3",
+                vmi_event_template_watches(tmpl));
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME | VMI_INIT_EVENTS, NULL, NULL),
+                "failed to open the trace");
+
+    SETUP_MEM_EVENT(&mem_event, 0, VMI_MEMACCESS_N, template_cb, 0);
+    fail_unless(VMI_SUCCESS == vmi_event_template_apply(tmpl, vmi, &mem_event, &events),
+                "failed to apply the template");
+    fail_unless(NULL != events, "no events returned");
+
+    fail_unless(events[0].mem_event.gfn == 1 && events[0].mem_event.in_access == VMI_MEMACCESS_W,
+                "wrong first watch");
+    fail_unless(events[1].mem_event.gfn == 3 && events[1].mem_event.in_access == VMI_MEMACCESS_X,
+                "wrong second watch");
+    fail_unless(events[2].mem_event.gfn == 4 && events[2].mem_event.in_access == VMI_MEMACCESS_RW,
+                "the accesses on gfn 4 were not merged");
+
+    /* the armed frames are registered like any other */
+    SETUP_MEM_EVENT(&twice, 1, VMI_MEMACCESS_R, template_cb, 0);
+    fail_unless(VMI_FAILURE == vmi_register_event(vmi, &twice), "gfn 1 was registered twice");
+
+    memset(&armed, 0, sizeof(armed));
+    while (vmi_are_events_pending(vmi) > 0)
+        fail_unless(VMI_SUCCESS == vmi_events_listen(vmi, 0), "vmi_events_listen failed");
+
+    fail_unless(armed.count == 3, "%u events replayed instead of 3", armed.count);
+    fail_unless(armed.seen[0].gfn == 4 && armed.seen[0].in_access == VMI_MEMACCESS_RW,
+                "the write on gfn 4 reached the wrong event");
+    fail_unless(armed.seen[1].gfn == 3 && armed.seen[1].in_access == VMI_MEMACCESS_X,
+                "the execute on gfn 3 reached the wrong event");
+    fail_unless(armed.seen[2].gfn == 1 && armed.seen[2].in_access == VMI_MEMACCESS_W,
+                "the write on gfn 1 reached the wrong event");
+
+    fail_unless(VMI_SUCCESS == vmi_event_template_remove(tmpl, vmi, events), "failed to remove the template");
+
+    /* applying doesn't change the template, it can be armed again */
+    fail_unless(vmi_event_template_watches(tmpl) == 3, "removing changed the template");
+    fail_unless(VMI_SUCCESS == vmi_event_template_apply(tmpl, vmi, &mem_event, &events),
+                "failed to apply the template again");
+    fail_unless(VMI_SUCCESS == vmi_event_template_remove(tmpl, vmi, events), "failed to remove the template again");
+
+    vmi_event_template_destroy(tmpl);
+    vmi_destroy(vmi);
+    image_dir_remove(dir);
+}
+END_TEST
+
+/*
+ * Breakpoints are only added by resolving a kernel symbol, which a raw
+ * image without an OS can't do, so only lookups that miss are tested.
+ */
+START_TEST (test_vmi_template_lookup_breakpoint)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_event_template_t tmpl;
+    const char *symbol = "unchanged";
+    uint8_t orig = 0x5a;
+    char dir[] = "/tmp/libvmi-template-XXXXXX";
+    char image[64];
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "image", 2, image, sizeof(image));
+
+    tmpl = vmi_event_template_create();
+    fail_unless(NULL != tmpl, "failed to create the template");
+
+    fail_unless(VMI_FAILURE == vmi_event_template_lookup_breakpoint(tmpl, 0, &symbol, &orig),
+                "found a breakpoint in an empty template");
+    fail_unless(VMI_FAILURE == vmi_event_template_lookup_breakpoint(tmpl, 0x1000, NULL, NULL),
+                "found a breakpoint in an empty template");
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, image, VMI_INIT_DOMAINNAME, NULL, NULL),
+                "failed to open the image");
+    fail_unless(VMI_FAILURE == vmi_event_template_breakpoint(tmpl, vmi, "do_sys_open"),
+                "resolved a symbol without an OS");
+
+    fail_unless(VMI_FAILURE == vmi_event_template_lookup_breakpoint(tmpl, 0x1000, &symbol, &orig),
+                "found a breakpoint that failed to resolve");
+    fail_unless(!strcmp(symbol, "unchanged") && orig == 0x5a, "a missed lookup wrote its outputs");
+    fail_unless(vmi_event_template_watches(tmpl) == 0, "a breakpoint added a watch");
+
+    vmi_event_template_destroy(tmpl);
+    vmi_destroy(vmi);
+    image_dir_remove(dir);
+}
+END_TEST
+
+/* event template test cases */
+TCase *template_tcase (void)
+{
+    TCase *tc_template = tcase_create("LibVMI event templates");
+    tcase_add_test(tc_template, test_vmi_template_watch);
+    tcase_add_test(tc_template, test_vmi_template_lookup_breakpoint);
+    return tc_template;
+}
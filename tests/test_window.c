@@ -0,0 +1,64 @@
+/* The LibVMI Library is an introspection library that simplifies access to
+ * memory in a target virtual machine or in a file containing a dump of
+ * a system's physical memory.  LibVMI is based on the XenAccess Library.
+ *
+ * This file is part of LibVMI.
+ *
+ * LibVMI is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the
+ * Free Software Foundation, either version 3 of the License, or (at your
+ * option) any later version.
+ *
+ * LibVMI is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with LibVMI.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+
+#include <libvmi/libvmi.h>
+#include "check_tests.h"
+
+START_TEST (test_vmi_window)
+{
+    vmi_instance_t vmi = NULL;
+    vmi_window_t window = NULL;
+    char dir[] = "/tmp/libvmi-window-XXXXXX";
+    char path[64];
+    uint8_t *base = NULL;
+    ACCESS_CONTEXT(ctx, .addr = IMAGE_PAGE_SIZE + 8);
+
+    fail_unless(NULL != mkdtemp(dir), "failed to create a temporary directory");
+    image_create(dir, "image", 5, path, sizeof(path));
+
+    fail_unless(VMI_SUCCESS == vmi_init(&vmi, VMI_FILE, path, VMI_INIT_DOMAINNAME, NULL, NULL),
+                "failed to open the image");
+
+    /* userfaultfd may not be available to the user running the tests */
+    if (VMI_SUCCESS == vmi_window_create(vmi, &ctx, 2, &window, (void **)&base)) {
+        fail_unless(base[0] == IMAGE_FILL + 1, "wrong value read through the window");
+        fail_unless(base[IMAGE_PAGE_SIZE] == IMAGE_FILL + 2, "wrong value read through the window");
+        fail_unless(VMI_SUCCESS == vmi_window_invalidate(window), "vmi_window_invalidate failed");
+        fail_unless(base[-8] == IMAGE_FILL + 1, "wrong value read through the window");
+        vmi_window_destroy(window);
+    }
+
+    vmi_destroy(vmi);
+    image_dir_remove(dir);
+}
+END_TEST
+
+/* window test cases */
+TCase *window_tcase (void)
+{
+    TCase *tc_window = tcase_create("LibVMI windows");
+    tcase_add_test(tc_window, test_vmi_window);
+    return tc_window;
+}